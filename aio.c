@@ -0,0 +1,251 @@
+// ============================================================================
+// aio.c - Asynchronous fs calls.  fsReadAsync, fsWriteAsync and fsSyncAsync
+// do not block: each queues a request, from a slab of AIOSLOTS, and returns.
+// A pool of AIOWORKERS threads, shared by every volume, runs the requests
+// as the plain fs calls, on the volume of the thread that asked.  Requests
+// on the same file descriptor run one at a time, in the order they were
+// made, so each sees the cursor its predecessors left, just as the
+// synchronous calls would.  A request with a callback completes onto a list
+// kept by the thread that made it, which that thread's event loop drains
+// with fsPoll, running the callbacks on its own thread; a thread must poll
+// until its callbacks have all run before it exits.  A request without one
+// is a future: test it with fsReady, or wait for its result with fsAwait
+// ============================================================================
+
+#include "aio.h"
+#include "slab.h"
+#include "vol.h"
+
+Aio g_aio = {
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+  .work = PTHREAD_COND_INITIALIZER,
+  .done = PTHREAD_COND_INITIALIZER,
+};
+
+pthread_once_t g_aioOnce = PTHREAD_ONCE_INIT;   // starts the workers
+
+__thread AioDone g_aiodone;                     // this thread's completions
+
+SLABDEFINE(g_aioreqs, sizeof(AioReq), AIOSLOTS);
+
+
+
+// ============================================================================
+// Wait for request 'req', a future, to complete; give it back and return
+// its result.  Call once per future
+// ============================================================================
+i32 aioAwait(AioReq* req) {
+  if (req == NULL)       FATAL(ENULLPTR);
+  if (req->done != NULL) FATAL(EBADOBJ);      // completes through fsPoll
+
+  pthread_mutex_lock(&g_aio.lock);
+  while (req->state != AIODONE) pthread_cond_wait(&g_aio.done, &g_aio.lock);
+  i32 ret = req->ret;
+  pthread_mutex_unlock(&g_aio.lock);
+
+  slabFree(&g_aioreqs, req);
+  return ret;
+}
+
+
+
+// ============================================================================
+// Return 1 if request 'req' must wait: a worker is running, or an older
+// request still queues, on the same volume and file descriptor.  Call with
+// g_aio.lock held
+// ============================================================================
+i32 aioBusy(AioReq* req) {
+  for (i32 w = 0; w < AIOWORKERS; ++w) {
+    AioReq* r = g_aio.running[w];
+    if (r != NULL && r->vol == req->vol && r->fd == req->fd) return 1;
+  }
+  for (AioReq* r = g_aio.head; r != req; r = r->next) {
+    if (r->vol == req->vol && r->fd == req->fd) return 1;
+  }
+  return 0;
+}
+
+
+
+// ============================================================================
+// Wait until no request of volume 'vol' is queued or running, so it may be
+// unmounted.  Return 0
+// ============================================================================
+i32 aioDrain(BfsVolume* vol) {
+  pthread_mutex_lock(&g_aio.lock);
+  for (;;) {
+    i32 busy = 0;
+    for (AioReq* r = g_aio.head; r != NULL && !busy; r = r->next) {
+      busy = (r->vol == vol);
+    }
+    for (i32 w = 0; w < AIOWORKERS && !busy; ++w) {
+      busy = (g_aio.running[w] != NULL && g_aio.running[w]->vol == vol);
+    }
+    if (!busy) break;
+    pthread_cond_wait(&g_aio.done, &g_aio.lock);
+  }
+  pthread_mutex_unlock(&g_aio.lock);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Start the workers, on the first request
+// ============================================================================
+void aioInit() {
+  for (i32 w = 0; w < AIOWORKERS; ++w) {
+    pthread_create(&g_aio.threads[w], NULL, aioMain, (void*)(intptr_t)w);
+  }
+  g_aio.started = 1;
+}
+
+
+
+// ============================================================================
+// Body of worker 'arg': take the oldest request that is not busy (see
+// aioBusy), run it, and complete it.  Workers live as long as the process
+// ============================================================================
+void* aioMain(void* arg) {
+  i32 w = (i32)(intptr_t)arg;
+
+  pthread_mutex_lock(&g_aio.lock);
+  for (;;) {
+    AioReq* prev = NULL;
+    AioReq* req  = g_aio.head;
+    while (req != NULL && aioBusy(req)) { prev = req; req = req->next; }
+    if (req == NULL) {
+      pthread_cond_wait(&g_aio.work, &g_aio.lock);
+      continue;
+    }
+
+    if (prev == NULL) g_aio.head = req->next;   // unlink it
+    else              prev->next = req->next;
+    if (g_aio.tail == req) g_aio.tail = prev;
+    req->next  = NULL;
+    req->state = AIORUNNING;
+    g_aio.running[w] = req;
+    pthread_mutex_unlock(&g_aio.lock);
+
+    g_vol = req->vol;
+    i32 ret = aioRun(req);
+
+    pthread_mutex_lock(&g_aio.lock);
+    g_aio.running[w] = NULL;
+    req->ret   = ret;
+    req->state = AIODONE;
+    if (req->done != NULL) {                    // for its thread's fsPoll
+      AioDone* d = req->owner;
+      if (d->tail == NULL) d->head = req;
+      else                 d->tail->next = req;
+      d->tail = req;
+    }
+    pthread_cond_broadcast(&g_aio.done);
+    pthread_cond_broadcast(&g_aio.work);        // its fd may be free now
+  }
+  return NULL;                                  // pacify compiler
+}
+
+
+
+// ============================================================================
+// Run the callbacks of the calling thread's completed requests, on that
+// thread, and give the requests back.  With 'wait' set, first wait for one
+// to complete, if any of its requests are in flight.  Return the # of
+// callbacks run
+// ============================================================================
+i32 aioPoll(i32 wait) {
+  AioDone* d = &g_aiodone;
+  pthread_mutex_lock(&g_aio.lock);
+  while (wait && d->head == NULL && d->pending > 0) {
+    pthread_cond_wait(&g_aio.done, &g_aio.lock);
+  }
+  AioReq* list = d->head;
+  d->head = NULL;
+  d->tail = NULL;
+  pthread_mutex_unlock(&g_aio.lock);
+
+  i32 n = 0;
+  while (list != NULL) {
+    AioReq* req = list;
+    list = req->next;
+    req->done(req->ret, req->arg);
+    slabFree(&g_aioreqs, req);
+    ++n;
+  }
+
+  pthread_mutex_lock(&g_aio.lock);
+  d->pending -= n;
+  pthread_mutex_unlock(&g_aio.lock);
+  return n;
+}
+
+
+
+// ============================================================================
+// Return 1 if request 'req', a future, has completed; else 0
+// ============================================================================
+i32 aioReady(AioReq* req) {
+  if (req == NULL) FATAL(ENULLPTR);
+  pthread_mutex_lock(&g_aio.lock);
+  i32 ready = (req->state == AIODONE);
+  pthread_mutex_unlock(&g_aio.lock);
+  return ready;
+}
+
+
+
+// ============================================================================
+// Run request 'req', as the synchronous fs call, on the calling thread's
+// volume.  Return what the call returned
+// ============================================================================
+i32 aioRun(AioReq* req) {
+  switch (req->op) {
+    case AIOREAD:  return fsRead(req->fd, req->numb, req->buf);
+    case AIOWRITE: return fsWrite(req->fd, req->numb, req->buf);
+    case AIOSYNC:  return fsSync(req->fd);
+  }
+  FATAL(EBADOBJ);
+  return 0;                                     // pacify compiler
+}
+
+
+
+// ============================================================================
+// Queue a request for 'op' on file descriptor 'fd' of the calling thread's
+// volume.  On completion, 'done' is called, by this thread's fsPoll, with
+// its result and 'arg'; if 'done' is NULL, the request is a future, for
+// fsAwait.  Return the request, or NULL if AIOSLOTS are in flight
+// ============================================================================
+AioReq* aioSubmit(i32 op, i32 fd, i32 numb, void* buf, FsDone done,
+                  void* arg) {
+  if (numb < 0)                     FATAL(ENEGNUMB);
+  if (buf == NULL && op != AIOSYNC) FATAL(ENULLPTR);
+
+  pthread_once(&g_aioOnce, aioInit);
+
+  AioReq* req = slabAlloc(&g_aioreqs);
+  if (req == NULL) return NULL;
+
+  req->op    = op;
+  req->fd    = fd;
+  req->numb  = numb;
+  req->buf   = buf;
+  req->done  = done;
+  req->arg   = arg;
+  req->vol   = g_vol;
+  req->owner = &g_aiodone;
+  req->state = AIOQUEUED;
+  req->ret   = 0;
+  req->next  = NULL;
+
+  pthread_mutex_lock(&g_aio.lock);
+  if (g_aio.tail == NULL) g_aio.head = req;
+  else                    g_aio.tail->next = req;
+  g_aio.tail = req;
+  if (done != NULL) ++g_aiodone.pending;
+  pthread_cond_signal(&g_aio.work);
+  pthread_mutex_unlock(&g_aio.lock);
+
+  return req;
+}
@@ -0,0 +1,68 @@
+#ifndef AIO_H
+#define AIO_H
+
+// ===================================================================
+// aio.h - Asynchronous fs calls: requests queued, run by a pool of
+// workers, and completed through callbacks or futures
+// ===================================================================
+
+#include "alias.h"
+#include "bfs.h"
+#include "fs.h"
+
+#define AIOSLOTS      256     // most requests in flight, over all volumes
+#define AIOWORKERS    4       // threads running requests
+
+#define AIOREAD       1       // AioReq.op
+#define AIOWRITE      2
+#define AIOSYNC       3
+
+#define AIOQUEUED     0       // AioReq.state: waiting for a worker
+#define AIORUNNING    1       //   a worker has it
+#define AIODONE       2       //   finished: 'ret' holds the result
+
+typedef struct AioReq AioReq;   // an FsFuture, to fs.h callers
+
+struct AioReq {           // AioReq: one asynchronous fs call
+  i32        op;          // AIOREAD, AIOWRITE or AIOSYNC
+  i32        fd;
+  i32        numb;
+  void*      buf;
+  FsDone     done;        // callback, run by fsPoll.  NULL => a future,
+  void*      arg;         //   for fsAwait
+  BfsVolume* vol;         // volume of the thread that asked
+  struct AioDone* owner;  // completions of the thread that asked
+  i32        state;       // AIOQUEUED, AIORUNNING or AIODONE
+  i32        ret;         // what the fs call returned
+  struct AioReq* next;    // in the queue, or the list of completions
+};
+
+typedef struct AioDone {  // AioDone: one thread's completed callbacks
+  AioReq* head;           // completed, callbacks not yet run
+  AioReq* tail;
+  i32     pending;        // # callback requests not yet through fsPoll
+} AioDone;                //   guarded by Aio.lock
+
+typedef struct {          // Aio: the request queue and its workers
+  AioReq* head;           // queued, oldest first
+  AioReq* tail;
+  AioReq* running[AIOWORKERS];  // what each worker is running
+  i32     started;        // 1 => workers are running
+  pthread_mutex_t lock;   // guards all the above
+  pthread_cond_t  work;   // signalled when a request may be runnable
+  pthread_cond_t  done;   // broadcast when a request completes
+  pthread_t       threads[AIOWORKERS];
+} Aio;
+
+i32     aioAwait (AioReq* req);
+i32     aioBusy  (AioReq* req);
+i32     aioDrain (BfsVolume* vol);
+void    aioInit  ();
+void*   aioMain  (void* arg);
+i32     aioPoll  (i32 wait);
+i32     aioReady (AioReq* req);
+i32     aioRun   (AioReq* req);
+AioReq* aioSubmit(i32 op, i32 fd, i32 numb, void* buf, FsDone done,
+                  void* arg);
+
+#endif
@@ -1,23 +1,23 @@
-#ifndef ALIAS_H
-#define ALIAS_H
-
-// ==================================================================
-// alias.h - typdefs and constants used within BFS (Bothell
-// File System)
-// ==================================================================
-
-#include <stdint.h>
-
-typedef uint8_t  u8;
-typedef uint16_t u16;
-typedef uint32_t u32;
-typedef uint64_t u64;
-
-typedef int8_t   i8;
-typedef int16_t  i16;
-typedef int32_t  i32;
-typedef int64_t  i64;
-
-typedef char* str;                    // string type
-
+#ifndef ALIAS_H
+#define ALIAS_H
+
+// ==================================================================
+// alias.h - typdefs and constants used within BFS (Bothell
+// File System)
+// ==================================================================
+
+#include <stdint.h>
+
+typedef uint8_t  u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+
+typedef int8_t   i8;
+typedef int16_t  i16;
+typedef int32_t  i32;
+typedef int64_t  i64;
+
+typedef char* str;                    // string type
+
 #endif
\ No newline at end of file
@@ -0,0 +1,473 @@
+// ============================================================================
+// arc.c - Export.  fsExport copies a directory tree out of BFS in one pass
+// over the disk: it walks the tree, maps every file into its runs of
+// contiguous blocks, sorts the runs of all the files together by DBN, and
+// reads each run in a single I/O, straight into its file's buffer.  The
+// files then go either to a host directory, written by ARCTHREADS threads,
+// or as a tar (ustar) archive to a host file or stdout, for piping.  The
+// tree is held under the BFS lock while it is read, so the export is a
+// consistent copy.  fsImport goes the other way, building a fresh image from
+// a host tree: the whole tree is planned first, and if it does not fit,
+// nothing is written.  Then every directory and file is created, each file
+// given its blocks as one contiguous run, so the metadata is all in place
+// before any data moves; last, ARCTHREADS threads copy the files' contents,
+// each in one fsWrite
+// ============================================================================
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "arc.h"
+#include "bio.h"
+#include "dir.h"
+#include "fs.h"
+#include "vol.h"
+
+
+
+// ============================================================================
+// Return the # of blocks a file of 'size' bytes takes: its data, unless it
+// fits inline, plus the map table beyond the Inode's direct DBNs
+// ============================================================================
+i32 arcBlocks(i32 size) {
+  if (size <= INLINESIZE) return 0;
+  i32 blocks = (size + BYTESPERBLOCK - 1) / BYTESPERBLOCK;
+  if (blocks > NUMDIRECT) ++blocks;             // the indirect table
+  return blocks;
+}
+
+
+
+// ============================================================================
+// Order ArcExtents by DBN, for qsort
+// ============================================================================
+i32 arcCmp(const void* a, const void* b) {
+  return ((ArcExtent*)a)->dbn - ((ArcExtent*)b)->dbn;
+}
+
+
+
+// ============================================================================
+// Export the tree below directory 'path' ("" for the root), as fsExport
+// ============================================================================
+i32 arcExport(str path, str dest, i32 mode) {
+  if (path == NULL || dest == NULL) FATAL(ENULLPTR);
+
+  i32 isdir;
+  i32 dinum = dirResolve(path, &isdir);
+  if (dinum < 0) return EFNF;
+  if (!isdir)    return ENOTADIR;
+
+  ArcPlan* plan = calloc(1, sizeof(ArcPlan));
+  if (plan == NULL) return ENOBUFS;
+  pthread_mutex_init(&plan->lock, NULL);
+  plan->host = dest;
+
+  bfsLock();
+  i32 ret = arcWalk(plan, dinum, "");
+  if (ret == 0) ret = arcLoad(plan);
+  bfsUnlock();
+
+  if (ret == 0 && (mode & EXPORT_TAR)) {
+    FILE* out = (strcmp(dest, "-") == 0) ? stdout : fopen(dest, "wb");
+    ret = (out == NULL) ? EHOSTIO : arcTar(plan, out);
+    if (out != NULL && out != stdout) fclose(out);
+  } else if (ret == 0) {
+    mkdir(dest, 0755);                          // parents before children
+    for (i32 e = 0; e < plan->n; ++e) {
+      if (!plan->ents[e].isdir) continue;
+      char host[2 * ARCPATHSIZE];
+      snprintf(host, sizeof(host), "%s/%s", dest, plan->ents[e].path);
+      mkdir(host, 0755);
+    }
+
+    pthread_t threads[ARCTHREADS];
+    for (i32 t = 0; t < ARCTHREADS; ++t) {
+      pthread_create(&threads[t], NULL, arcWrite, plan);
+    }
+    for (i32 t = 0; t < ARCTHREADS; ++t) pthread_join(threads[t], NULL);
+    ret = plan->err;
+  }
+
+  for (i32 e = 0; e < plan->n; ++e) free(plan->ents[e].data);
+  pthread_mutex_destroy(&plan->lock);
+  free(plan);
+  return ret;
+}
+
+
+
+// ============================================================================
+// Record error 'err' for 'plan', unless a thread has already recorded one
+// ============================================================================
+void arcFail(ArcPlan* plan, i32 err) {
+  pthread_mutex_lock(&plan->lock);
+  if (plan->err == 0) plan->err = err;
+  pthread_mutex_unlock(&plan->lock);
+}
+
+
+
+// ============================================================================
+// Return 0 if the directories and files of import 'plan' fit in an empty
+// image, else EDISKFULL
+// ============================================================================
+i32 arcFits(ArcPlan* plan) {
+  i32 blocks = 0;
+  if (plan->children > DENTPERBLOCK) {          // the root has one already
+    blocks += (plan->children - 1) / DENTPERBLOCK;
+  }
+  for (i32 e = 0; e < plan->n; ++e) {
+    ArcEntry* ent = &plan->ents[e];
+    blocks += ent->isdir
+            ? (ent->children + DENTPERBLOCK - 1) / DENTPERBLOCK
+            : arcBlocks(ent->size);
+  }
+  return (blocks > BLOCKSPERDISK - NUMMETA) ? EDISKFULL : 0;
+}
+
+
+
+// ============================================================================
+// Build image 'image' from host directory 'host', as fsImport
+// ============================================================================
+i32 arcImport(str host, str image) {
+  if (host == NULL || image == NULL) FATAL(ENULLPTR);
+
+  ArcPlan* plan = calloc(1, sizeof(ArcPlan));
+  if (plan == NULL) return ENOBUFS;
+  pthread_mutex_init(&plan->lock, NULL);
+  plan->host = host;
+
+  i32 ret = arcScan(plan, "", &plan->children);
+  if (ret == 0) ret = arcFits(plan);
+  if (ret != 0) {                               // nothing written
+    pthread_mutex_destroy(&plan->lock);
+    free(plan);
+    return ret;
+  }
+
+  char tmp[VOLPATHSIZE];                        // built aside, then renamed
+  if (snprintf(tmp, sizeof(tmp), "%s.tmp", image) >= (i32)sizeof(tmp)) {
+    pthread_mutex_destroy(&plan->lock);
+    free(plan);
+    return EBIGFNAME;
+  }
+
+  BfsVolume* was = g_vol;
+  plan->vol = fsMount(tmp, MOUNT_FORMAT);
+  if (plan->vol == NULL) {
+    pthread_mutex_destroy(&plan->lock);
+    free(plan);
+    return ENOBUFS;
+  }
+
+  for (i32 e = 0; e < plan->n && ret == 0; ++e) {  // parents before children
+    ArcEntry* ent = &plan->ents[e];
+    if (ent->isdir) {
+      ret = fsMkdir(ent->path);
+      continue;
+    }
+    i32 fd = fsCreate(ent->path);
+    if (fd < 0) {
+      ret = fd;
+      break;
+    }
+    if (ent->size > INLINESIZE) ret = fsFallocate(fd, 0, ent->size, 0);
+    fsClose(fd);
+  }
+
+  if (ret == 0) {
+    pthread_t threads[ARCTHREADS];
+    for (i32 t = 0; t < ARCTHREADS; ++t) {
+      pthread_create(&threads[t], NULL, arcRead, plan);
+    }
+    for (i32 t = 0; t < ARCTHREADS; ++t) pthread_join(threads[t], NULL);
+    ret = plan->err;
+  }
+
+  fsUnmount();
+  volUse(was);
+  if (ret == 0 && rename(tmp, image) != 0) ret = EHOSTIO;
+  if (ret != 0) remove(tmp);
+  pthread_mutex_destroy(&plan->lock);
+  free(plan);
+  return ret;
+}
+
+
+
+// ============================================================================
+// Read the contents of every file of 'plan' into memory.  The runs of all
+// the files are read in DBN order, each in one I/O; inline and compressed
+// files, which have no runs, are read block by block.  Holes stay zero.
+// Return 0, or ENOBUFS if out of memory
+// ============================================================================
+i32 arcLoad(ArcPlan* plan) {
+  ArcExtent* exts = NULL;
+  i32        n    = 0;
+  i32        max  = 0;
+
+  for (i32 e = 0; e < plan->n; ++e) {
+    ArcEntry* ent = &plan->ents[e];
+    if (ent->isdir) continue;
+
+    i32 blocks = (ent->size + BYTESPERBLOCK - 1) / BYTESPERBLOCK;
+    ent->data  = calloc(blocks + 1, BYTESPERBLOCK);
+    if (ent->data == NULL) { free(exts); return ENOBUFS; }
+
+    Inode inode;
+    bfsReadInode(ent->inum, &inode);
+    if (inode.flags & (INODEINLINE | INODECOMP)) {
+      for (i32 fbn = 0; fbn < blocks; ++fbn) {
+        bfsRead(ent->inum, fbn, ent->data + fbn * BYTESPERBLOCK);
+      }
+      continue;
+    }
+
+    for (i32 fbn = 0; fbn < blocks; ) {
+      i32 dbn = 0;
+      i32 run = bfsMapRun(ent->inum, fbn, blocks - fbn, &dbn);
+      if (run == 0) { ++fbn; continue; }        // hole, or unwritten
+
+      if (n == max) {
+        max = (max == 0) ? BLOCKSPERDISK : 2 * max;
+        ArcExtent* more = realloc(exts, max * sizeof(ArcExtent));
+        if (more == NULL) { free(exts); return ENOBUFS; }
+        exts = more;
+      }
+      exts[n].dbn   = dbn;
+      exts[n].count = run;
+      exts[n].entry = e;
+      exts[n].fbn   = fbn;
+      ++n;
+      fbn += run;
+    }
+  }
+
+  qsort(exts, n, sizeof(ArcExtent), arcCmp);
+
+  for (i32 x = 0; x < n; ++x) {                 // one sweep over the disk
+    ArcEntry* ent = &plan->ents[exts[x].entry];
+    bioReadRun(exts[x].dbn, exts[x].count,
+               ent->data + exts[x].fbn * BYTESPERBLOCK);
+  }
+
+  free(exts);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Body of a reader thread: take the next file of import 'arg', read it from
+// below the plan's 'host' whole, and write it into the image in one
+// fsWrite.  Repeat until every file is taken
+// ============================================================================
+void* arcRead(void* arg) {
+  ArcPlan* plan = (ArcPlan*)arg;
+  fsUse(plan->vol);
+
+  for (;;) {
+    pthread_mutex_lock(&plan->lock);
+    i32 e = plan->next++;
+    pthread_mutex_unlock(&plan->lock);
+    if (e >= plan->n) break;
+
+    ArcEntry* ent = &plan->ents[e];
+    if (ent->isdir || ent->size == 0) continue;
+
+    char host[2 * ARCPATHSIZE];
+    snprintf(host, sizeof(host), "%s/%s", plan->host, ent->path);
+    i8*   buf = malloc(ent->size);
+    FILE* fp  = fopen(host, "rb");
+    i32   ok  = (fp != NULL && buf != NULL)
+             && fread(buf, 1, ent->size, fp) == (size_t)ent->size;
+    if (fp != NULL) fclose(fp);
+
+    if (ok) {
+      i32 fd  = fsOpen(ent->path);
+      i32 ret = (fd < 0) ? fd : fsWrite(fd, ent->size, buf);
+      if (fd >= 0) fsClose(fd);
+      if (ret != 0) arcFail(plan, ret);
+    } else {
+      arcFail(plan, EHOSTIO);
+    }
+    free(buf);
+  }
+  return NULL;
+}
+
+
+
+// ============================================================================
+// Add to import 'plan' everything below 'path' ("" for the root) of its
+// host directory, and count the entries of 'path' into '*pchildren'.
+// Files other than plain files and directories are skipped.  Return 0;
+// EHOSTIO if a host directory cannot be read; EBIGFNAME if a name is longer
+// than BFS allows, or a path than ARCPATHSIZE; ENOINODE if there are more
+// entries than Inodes; EDISKFULL if a file is bigger than a disk
+// ============================================================================
+i32 arcScan(ArcPlan* plan, str path, i32* pchildren) {
+  char host[2 * ARCPATHSIZE];
+  snprintf(host, sizeof(host), "%s%s%s", plan->host, path[0] ? "/" : "",
+           path);
+  DIR* dir = opendir(host);
+  if (dir == NULL) return EHOSTIO;
+
+  i32 ret = 0;
+  struct dirent* de;
+  while (ret == 0 && (de = readdir(dir)) != NULL) {
+    if (strcmp(de->d_name, ".") == 0)  continue;
+    if (strcmp(de->d_name, "..") == 0) continue;
+
+    if (strlen(de->d_name) >= FNAMESIZE) { ret = EBIGFNAME; break; }
+    if (plan->n == NUMINODES - 1)        { ret = ENOINODE;  break; }
+
+    ArcEntry* ent = &plan->ents[plan->n];
+    i32 len = snprintf(ent->path, ARCPATHSIZE, "%s%s%s", path,
+                       path[0] ? "/" : "", de->d_name);
+    if (len >= ARCPATHSIZE) { ret = EBIGFNAME; break; }
+
+    char file[3 * ARCPATHSIZE];
+    snprintf(file, sizeof(file), "%s/%s", host, de->d_name);
+    struct stat st;
+    if (stat(file, &st) != 0) continue;
+    if (!S_ISDIR(st.st_mode) && !S_ISREG(st.st_mode)) continue;  // skip
+    if (st.st_size > BLOCKSPERDISK * BYTESPERBLOCK) { ret = EDISKFULL; break; }
+
+    ent->isdir    = S_ISDIR(st.st_mode);
+    ent->size     = ent->isdir ? 0 : (i32)st.st_size;
+    ent->children = 0;
+    ++plan->n;
+    ++*pchildren;
+
+    if (ent->isdir) ret = arcScan(plan, ent->path, &ent->children);
+  }
+
+  closedir(dir);
+  return ret;
+}
+
+
+
+// ============================================================================
+// Write 'plan' to 'out' as a tar archive: a header per entry, in tree order,
+// each file's contents padded to a whole block, and two zero blocks at the
+// end.  Return 0, EBIGFNAME if a path is too long for a header, or EHOSTIO
+// ============================================================================
+i32 arcTar(ArcPlan* plan, FILE* out) {
+  i8 zero[2 * BYTESPERBLOCK] = {0};
+
+  for (i32 e = 0; e < plan->n; ++e) {
+    ArcEntry* ent = &plan->ents[e];
+    i32 ret = arcTarHdr(out, ent);
+    if (ret != 0) return ret;
+    if (ent->isdir || ent->size == 0) continue;
+
+    i32 len = ent->size;
+    i32 pad = (BYTESPERBLOCK - len % BYTESPERBLOCK) % BYTESPERBLOCK;
+    if (fwrite(ent->data, 1, len, out) != (size_t)len) return EHOSTIO;
+    if (fwrite(zero, 1, pad, out) != (size_t)pad)      return EHOSTIO;
+  }
+
+  if (fwrite(zero, 1, sizeof(zero), out) != sizeof(zero)) return EHOSTIO;
+  return (fflush(out) == 0) ? 0 : EHOSTIO;
+}
+
+
+
+// ============================================================================
+// Write the ustar header for 'ent' to 'out'.  Return 0, EBIGFNAME if its
+// path does not fit the header, or EHOSTIO
+// ============================================================================
+i32 arcTarHdr(FILE* out, ArcEntry* ent) {
+  char hdr[BYTESPERBLOCK] = {0};
+
+  i32 len = strlen(ent->path) + (ent->isdir ? 1 : 0);   // dirs end in '/'
+  if (len >= ARCNAMESIZE) return EBIGFNAME;
+
+  memcpy(hdr, ent->path, strlen(ent->path));                    // name
+  if (ent->isdir) hdr[len - 1] = '/';
+  snprintf(hdr + 100, 8,  "%07o", ent->isdir ? 0755 : 0644);    // mode
+  snprintf(hdr + 108, 8,  "%07o", 0);                           // uid
+  snprintf(hdr + 116, 8,  "%07o", 0);                           // gid
+  snprintf(hdr + 124, 12, "%011o", ent->isdir ? 0 : ent->size); // size
+  snprintf(hdr + 136, 12, "%011o", 0);                          // mtime
+  hdr[156] = ent->isdir ? '5' : '0';                            // type
+  memcpy(hdr + 257, "ustar", 6);                                // magic
+  memcpy(hdr + 263, "00", 2);                                   // version
+
+  memset(hdr + 148, ' ', 8);                    // checksum: of the header,
+  u32 sum = 0;                                  //   taking itself as blanks
+  for (i32 i = 0; i < BYTESPERBLOCK; ++i) sum += (u8)hdr[i];
+  snprintf(hdr + 148, 8, "%06o", sum);          // then NUL, then ' '
+
+  return (fwrite(hdr, 1, BYTESPERBLOCK, out) == BYTESPERBLOCK) ? 0 : EHOSTIO;
+}
+
+
+
+// ============================================================================
+// Add to 'plan' every entry of directory 'dinum', which is 'path' in the
+// tree exported, and of every directory below it.  Return 0, or EBIGFNAME
+// if a path is longer than ARCPATHSIZE
+// ============================================================================
+i32 arcWalk(ArcPlan* plan, i32 dinum, str path) {
+  i32  cursor = 0;
+  char name[FNAMESIZE];
+
+  for (;;) {
+    i32 inum = dirNext(dinum, &cursor, name);
+    if (inum == 0) break;
+    if (plan->n == NUMINODES) FATAL(EBADINUM);  // a loop in the tree
+
+    ArcEntry* ent = &plan->ents[plan->n++];
+    i32 len = snprintf(ent->path, ARCPATHSIZE, "%s%s%s", path,
+                       path[0] ? "/" : "", name);
+    if (len >= ARCPATHSIZE) return EBIGFNAME;
+
+    Inode inode;
+    bfsReadInode(inum, &inode);
+    ent->inum  = inum;
+    ent->isdir = (inode.flags & INODEDIR) != 0;
+    ent->size  = inode.size;
+    ent->data  = NULL;
+
+    if (ent->isdir) {
+      i32 ret = arcWalk(plan, inum, ent->path);
+      if (ret != 0) return ret;
+    }
+  }
+  return 0;
+}
+
+
+
+// ============================================================================
+// Body of a writer thread: take the next file of plan 'arg' and write it to
+// its host file, below the plan's 'host'.  Repeat until every file is taken
+// ============================================================================
+void* arcWrite(void* arg) {
+  ArcPlan* plan = (ArcPlan*)arg;
+
+  for (;;) {
+    pthread_mutex_lock(&plan->lock);
+    i32 e = plan->next++;
+    pthread_mutex_unlock(&plan->lock);
+    if (e >= plan->n) break;
+
+    ArcEntry* ent = &plan->ents[e];
+    if (ent->isdir) continue;
+
+    char host[2 * ARCPATHSIZE];
+    snprintf(host, sizeof(host), "%s/%s", plan->host, ent->path);
+    FILE* fp = fopen(host, "wb");
+    i32   ok = (fp != NULL)
+            && fwrite(ent->data, 1, ent->size, fp) == (size_t)ent->size;
+    if (fp != NULL && fclose(fp) != 0) ok = 0;
+
+    if (!ok) arcFail(plan, EHOSTIO);
+  }
+  return NULL;
+}
@@ -0,0 +1,58 @@
+#ifndef ARC_H
+#define ARC_H
+
+// ===================================================================
+// arc.h - Export: copy a tree out of BFS, to host files or as a tar
+// archive, reading its blocks in DBN order.  Import: build a fresh image
+// from a host tree
+// ===================================================================
+
+#include "alias.h"
+#include "bfs.h"
+
+#define ARCTHREADS    4       // threads writing host files, or reading them
+#define ARCPATHSIZE   256     // longest path exported, plus its NUL
+#define ARCNAMESIZE   100     // longest path a tar header holds
+
+typedef struct {          // ArcEntry: one file or directory exported
+  char path[ARCPATHSIZE]; // relative to the tree exported, eg "a/b"
+  i32  inum;
+  i32  isdir;
+  i32  size;              // # bytes, for a file
+  i32  children;          // # entries, for a directory imported
+  i8*  data;              // its contents, once read
+} ArcEntry;
+
+typedef struct {          // ArcExtent: a run of a file's blocks on disk
+  i32 dbn;
+  i32 count;
+  i32 entry;              // ArcPlan.ents index of the file
+  i32 fbn;                // FBN of its first block
+} ArcExtent;
+
+typedef struct {          // ArcPlan: one export, or import
+  ArcEntry   ents[NUMINODES];   // parents before children
+  i32        n;
+  i32        children;    // # entries of the root, for an import
+  str        host;        // host directory, for arcWrite or arcRead
+  BfsVolume* vol;         // volume imported into, for arcRead
+  i32        next;        // next entry for a thread to take
+  i32        err;         // first error of a thread, else 0
+  pthread_mutex_t lock;   // guards 'next' and 'err'
+} ArcPlan;
+
+i32   arcBlocks(i32 size);
+i32   arcCmp   (const void* a, const void* b);
+i32   arcExport(str path, str dest, i32 mode);
+void  arcFail  (ArcPlan* plan, i32 err);
+i32   arcFits  (ArcPlan* plan);
+i32   arcImport(str host, str image);
+i32   arcLoad  (ArcPlan* plan);
+void* arcRead  (void* arg);
+i32   arcScan  (ArcPlan* plan, str path, i32* pchildren);
+i32   arcTar   (ArcPlan* plan, FILE* out);
+i32   arcTarHdr(FILE* out, ArcEntry* ent);
+i32   arcWalk  (ArcPlan* plan, i32 dinum, str path);
+void* arcWrite (void* arg);
+
+#endif
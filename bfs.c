@@ -1,455 +1,1833 @@
-// ============================================================================
-// bfs.c
-// ============================================================================
-
-#include "bfs.h"
-
-// ============================================================================
-// Allocate a free disk block for the file whose Inode number is 'inum' and
-// assign it to FBN 'fbn' in the file's Inode.  On success, return the DBN
-// allocated.  On failure, abort
-// ============================================================================
-i32 bfsAllocBlock(i32 inum, i32 fbn) {
-
-  if (inum < 0)       FATAL(EBADINUM);
-  if (inum > MAXINUM) FATAL(EBADINUM);
-  if (fbn  < 0)       FATAL(EBADFBN);
-  if (fbn  > MAXFBN)  FATAL(EBADFBN);
-
-  // Grab the next free block in the BFS disk
-
-  i32 dbn = bfsFindFreeBlock();
-
-  // Update the corresponding Inode, or IndirectBlock
-
-  i8 buf8[BYTESPERBLOCK] = {0};           // 1-block buffer
-  bioRead(DBNINODES, buf8);
- 
-  Inode* pinodes = (Inode*)buf8;          // array of Inodes
-  Inode* pinode  = &pinodes[inum];        // target Inode
-
-  if (fbn < NUMDIRECT) {                  // in direct[] array?
-    pinode->direct[fbn] = dbn;
-    bioWrite(DBNINODES, buf8);
-    return dbn;
-  } else {                                // in indirect block?
-    i16 buf16[I16SPERBLOCK]= {0};
-    i32 dbnIndirect = pinode->indirect;   // DBN of indirect block
-
-    if (dbnIndirect == 0) {               // not yet allocated
-      dbnIndirect = bfsFindFreeBlock();
-      pinode->indirect = dbn;
-    }
-
-    bioRead(dbnIndirect, buf16);
-
-    buf16[fbn - NUMDIRECT] = dbn;
-    bioWrite(dbnIndirect, buf16);
-  }
-
-  return dbn;                             // allocated DBN
-
-}
-
-
-
-// ============================================================================
-// Create file 'fname'.  Find a free inum; ie, free slot in the Directory.
-// Leave the size of the file as zero, until the user performs a write, or a
-// seek into the file.  On success, return the file's inum.  On failure, abort
-// ============================================================================
-i32 bfsCreateFile(str fname) {
-
-  if (fname == NULL) FATAL(ENULLPTR);
-
-  if (strlen(fname) > FNAMESIZE - 1) FATAL(EBIGFNAME);  // fname too big
-
-  i8 buf[BYTESPERBLOCK] = {0};
-
-  bioRead(DBNDIR, buf);
-
-  Dir* dir = (Dir*)buf;
-
-  for (int inum = 0; inum < NUMINODES; ++inum) {        // search Directory
-    if (strlen(dir->fname[inum]) == 0) {                // free slot
-      strcpy(dir->fname[inum], fname);
-      bioWrite(DBNDIR, dir);
-      bfsRefOFT(inum);
-      return inum;
-    }
-  }
-
-  FATAL(EDIRFULL);                                      // Directory full
-  return 0;                                             // pacify compiler
-}
-
-
-
-// ============================================================================
-// Dereference file with Inode number 'inum' in the Open File Table.  If
-// refcount reaches 0, free up that entry in the OFT
-// ============================================================================
-i32 bfsDerefOFT(i32 inum) {
-  i32 ofte = bfsFindOFTE(inum);
-  --g_oft[ofte].refs;
-  if (g_oft[ofte].refs == 0) {
-    g_oft[ofte].inum = 0;
-    g_oft[ofte].curs = 0;
-  }
-  return 0;
-}
-
-
-
-// ============================================================================
-// Extend file 'inum' out to FBN 'fbn'
-// ============================================================================
-i32 bfsExtend(i32 inum, i32 fbn) {
-  i32 size = bfsGetSize(inum);
-  i32 fbnLast = (size + 1) / BYTESPERBLOCK;
-  for (i32 f = fbnLast; f <= fbn; ++f) {
-    bfsAllocBlock(inum, f);
-  }
-  return 0;
-}
-
-
-
-// ============================================================================
-// Use Inode to find the DBN used to store file block 'fbn'.  Return ENODBN
-// if not yet mapped
-// ============================================================================
-i32 bfsFbnToDbn(i32 inum, i32 fbn) {
-
-  if (inum < 0)       FATAL(EBADINUM);
-  if (inum > MAXINUM) FATAL(EBADINUM);
-  if (fbn  < 0)       FATAL(EBADFBN);
-  if (fbn  > MAXFBN)  FATAL(EBADFBN);
-
-  Inode inode;
-  
-  bfsReadInode(inum, &inode);
-
-  if (fbn < NUMDIRECT) {            // in direct[] array?
-    i32 dbn = inode.direct[fbn];
-    return (dbn == 0) ? ENODBN : dbn;
-  }
-
-  // fbn is not in direct, so check indirect block.  If it doesn't exist,
-  // then allocate an empty indirect block.  But return ENODBN for the
-  // caller to handle grabing a new data block.
-
-  if (inode.indirect == 0) {      // no indirect block yet allocated
-    i32 dbn = bfsFindFreeBlock();
-    inode.indirect = dbn;
-    bfsWriteInode(inum, &inode);
-    return ENODBN;
-  }
-
-  // Check the indirect block
-
-  i16 buf[NUMINDIRECT] = {0};
-  bioRead(inode.indirect, buf);
-
-  i32 dbn = buf[fbn - NUMDIRECT];
-  return (dbn == 0) ? ENODBN : dbn;
-}
-
-
-
-// ============================================================================
-// Convert FileDescriptor (user-visible) to Inum (internal)
-// ============================================================================
-i32 bfsFdToInum(i32 fd) { 
-  i32 inum = fd - INUMTOFD; 
-  if (inum < 0) FATAL(EBADINUM);
-  return inum;
-}
-
-
-
-
-// ============================================================================
-// Find 'inum' in the Open File Table (OFT).  If not found, create an entry.
-// Return the index within the OFT.  On failure, EOFTFULL
-// ============================================================================
-i32 bfsFindOFTE(i32 inum) {
-  for (int i = 0; i < NUMOFTENTRIES; ++i) {
-    if (g_oft[i].inum == inum) return i;
-  }
-  
-  // Not found, so look for an empty OFTE
-
-  for (int i = 0; i < NUMOFTENTRIES; ++i) {
-    if (g_oft[i].inum == 0) {
-      g_oft[i].inum = inum;
-      g_oft[i].curs = 0;
-      g_oft[i].refs = 1;
-      return i;
-    }
-  }
-  FATAL(EOFTFULL);      // no-return
-  return 0;             // pacify compiler
-}
-
-
-
-// ============================================================================
-// Allocate the next free block from the Freelist.  Adjust Freelist
-// accordingly.  On success, return DBN.  FATAL otherwise
-// ============================================================================
-i32 bfsFindFreeBlock() {
-  i8 buf8[BYTESPERBLOCK] = {0};
-  bioRead(DBNSUPER, buf8);
-  Super* super = (Super*)buf8;
-
-  i32 dbn = super->firstFree;
-  if (dbn == 0) FATAL(EDISKFULL);
-
-  i16 buf16[I16SPERBLOCK] = {0};      // for next free block
-  bioRead(dbn, buf16);
-
-  super->firstFree = buf16[0];        // new head of Freelist
-
-  bioWrite(DBNSUPER, buf8);           // update SuperBlock
-
-  return dbn;
-}
-
-
-// ============================================================================
-// Initialize the Freelist
-// ============================================================================
-i32 bfsInitFreeList() {
-  i16 buf[I16SPERBLOCK] = {0};
-  i32 ret = 0;
-
-  for (int dbn = NUMMETA; dbn < BLOCKSPERDISK - 1; ++dbn) {
-    buf[0] = dbn + 1;
-    bioWrite(dbn, (i8*)buf);
-  }
-
-  buf[0] = 0;
-  bioWrite(BLOCKSPERDISK - 1, (i8*)buf);      // end of Freelist
-
-  return ret;
-}
-
-
-
-// ============================================================================
-// Write the initial Dir block, of all zeroes, into DBN 2
-// ============================================================================
-i32 bfsInitDir(FILE* fp) {
-  if (fp == NULL) FATAL(ENULLPTR);
-  i8 buf[BYTESPERBLOCK] = {0};
-  return bioWrite(DBNDIR, buf);
-}
-
-
-
-// ============================================================================
-// Write the initial Inodes block, of all zeroes, into DBN 1
-// ============================================================================
-i32 bfsInitInodes(FILE* fp) {
-  if (fp == NULL) FATAL(ENULLPTR);
-  i8 buf[BYTESPERBLOCK] = {0};
-  return bioWrite(DBNINODES, buf);
-}
-
-
-
-// ============================================================================
-// Initialize the Open File Table to all zeroes
-// ============================================================================
-i32 bfsInitOFT() {
-  for (i32 i = 0; i < NUMOFTENTRIES; ++i) {
-    g_oft[i].inum = 0;
-    g_oft[i].curs = 0;
-    g_oft[i].refs = 0;
-  }
-  return 0;
-}
-
-
-// ============================================================================
-// Write the initial Super block into DBN 0
-// ============================================================================
-i32 bfsInitSuper(FILE* fp) {
-
-  if (fp == NULL) FATAL(ENULLPTR);
-
-  Super sb;
-  sb.numBlocks = BLOCKSPERDISK;           // eg: 100
-  sb.numInodes = NUMINODES;               // eg: 8
-  sb.firstFree = NUMMETA;                 // eg: 3
-
-  i8 buf[BYTESPERBLOCK] = {0};
-  memcpy(buf, &sb, sizeof(Super));
-
-  return bioWrite(DBNSUPER, buf);
-}
-
-
-
-// ============================================================================
-// Convert between inum (internal) and FileDescriptor (user-visible)
-// ============================================================================
-i32 bfsInumToFd(i32 inum) { return inum + INUMTOFD; }
-
-
-// ============================================================================
-// Lookup 'fname' in the Directory.  If found, return its inum.  If not,
-// return EFNF
-// ============================================================================
-i32 bfsLookupFile(str fname) {
-
-  if (fname == NULL) FATAL(ENULLPTR);
-
-  i8 buf[BYTESPERBLOCK] = {0};
-
-  bioRead(DBNDIR, buf);
-
-  Dir* dir = (Dir*)buf;
-
-  for (int inum = 0; inum < NUMINODES; ++inum) {
-    if (strcmp(fname, dir->fname[inum]) == 0) {
-      bfsRefOFT(inum);
-      return inum;
-    }
-  }
-
-  return EFNF;
-
-}
-
-
-
-// ============================================================================
-// Read FBN 'fbn' for the file whose inum is 'inum' into 'buf'
-// ============================================================================
-i32 bfsRead(i32 inum, i32 fbn, i8* buf) {
-
-  if (inum < 0)       FATAL(EBADINUM);
-  if (inum > MAXINUM) FATAL(EBADINUM);
-  if (fbn  < 0)       FATAL(EBADFBN);
-  if (fbn  > MAXFBN)  FATAL(EBADFBN);
-
-  i32 dbn = bfsFbnToDbn(inum, fbn);
-
-  bioRead(dbn, buf);
-  return 0;
-}
-
-
-// ============================================================================
-// Read the Inodes block.  Extract and return the Inode whose number is 'inum'.
-// On success, return 0.  On failure, abort
-// ============================================================================
-i32 bfsReadInode(i32 inum, Inode* inode) {
-
-  if (inum < 0)       FATAL(EBADINUM);
-  if (inum > MAXINUM) FATAL(EBADINUM);
-  if (inode == NULL)  FATAL(ENULLPTR);
-
-  i8 buf[BYTESPERBLOCK] = {0};
-
-  bioRead(DBNINODES, buf);
-
-  Inode* inodes = (Inode*)buf;
-
-  memcpy(inode, &inodes[inum], sizeof(Inode));
-  return 0;
-}
-
-
-
-// ============================================================================
-// Reference file with Inode number 'inum' in the Open File Table
-// ============================================================================
-i32 bfsRefOFT(i32 inum) {
-  i32 ofte = bfsFindOFTE(inum);
-  ++g_oft[ofte].refs;
-  return 0;
-}
-
-
-
-// ============================================================================
-// Set cursor position for the file open on File Descriptor 'fd' to 'newCurs'
-// ============================================================================
-i32 bfsSetCursor(i32 inum, i32 newCurs) {
-
-  if (inum < 0) FATAL(EBADINUM);
-  if (inum > MAXINUM) FATAL(EBADINUM);
-
-  i32 ofte = bfsFindOFTE(inum);
-  g_oft[ofte].curs = newCurs;
-  return 0;
-}
-
-
-
-// ============================================================================
-// Return the cursor position for the file open on File Descriptor 'fd'
-// ============================================================================
-i32 bfsTell(i32 fd) {
-  i32 inum = bfsFdToInum(fd);
-  i32 ofte = bfsFindOFTE(inum);
-  return g_oft[ofte].curs;
-}
-
-
-
-// ============================================================================
-// Return the size of the file whose Inode number is 'inum'
-// ============================================================================
-i32 bfsGetSize(i32 inum) {
-
-  if (inum < 0)       FATAL(EBADINUM);
-  if (inum > MAXINUM) FATAL(EBADINUM);
-
-  Inode inode;
-  bfsReadInode(inum, &inode);
-
-  return inode.size;
-}
-
-
-
-// ============================================================================
-// Set size of file 'inum' to 'size
-// ============================================================================
-i32 bfsSetSize(i32 inum, i32 size) {
-
-  if (inum < 0)       FATAL(EBADINUM);
-  if (inum > MAXINUM) FATAL(EBADINUM);
-
-  Inode inode;
-  bfsReadInode(inum, &inode);
-  
-  inode.size = size;
-  bfsWriteInode(inum, &inode);
-  return 0;
-}
-
-
-
-// ============================================================================
-// Update the Inodes block on disk with the info in 'inode'
-// ============================================================================
-i32 bfsWriteInode(i32 inum, Inode* inode) {
-
-  if (inum < 0)       FATAL(EBADINUM);
-  if (inum > MAXINUM) FATAL(EBADINUM);
-  if (inode == NULL)  FATAL(ENULLPTR);
-
-  i8 buf[BYTESPERBLOCK];
-  bioRead(DBNINODES, buf);
-  Inode* inodes = (Inode*)buf;
-  memcpy(&inodes[inum], inode, sizeof(Inode));
-  bioWrite(DBNINODES, buf);
-
-  return 0;
-}
-
+// ============================================================================
+// bfs.c
+// ============================================================================
+
+#include "bfs.h"
+#include "comp.h"
+#include "dedup.h"
+#include "dir.h"
+#include "log.h"
+#include "map.h"
+#include "ref.h"
+#include "snap.h"
+#include "vol.h"
+
+// ============================================================================
+// Allocate a free disk block for the file whose Inode number is 'inum' and
+// assign it to FBN 'fbn' in the file's block map.  If 'fbn' was preallocated
+// by bfsFallocate (an unwritten entry), just mark it written: no allocator
+// traffic.  Otherwise the block is taken near the FBN before it: see
+// bfsNear; on a log-structured volume, at the head of the log.  An inline
+// file is moved to blocks first.  On success, return the DBN allocated.  On
+// failure, abort
+// ============================================================================
+i32 bfsAllocBlock(i32 inum, i32 fbn) {
+
+  if (inum < 0)       FATAL(EBADINUM);
+  if (inum > MAXINUM) FATAL(EBADINUM);
+  if (fbn  < 0)       FATAL(EBADFBN);
+  if (fbn >= MAXFBN)  FATAL(EBADFBN);
+
+  bfsLock();
+  bfsUninline(inum);                      // data goes to blocks from now on
+
+  Inode inode;
+  bfsReadInode(inum, &inode);
+
+  i32 dbn = mapGet(inum, &inode, fbn);
+
+  if (dbn > 0) {                          // already written
+    bfsUnlock();
+    return dbn;
+  }
+
+  if (dbn < 0) {                          // preallocated, unwritten
+    dbn = -dbn;
+  } else if (logOn()) {                   // log-structured: at its head
+    dbn = logNext();
+  } else {
+    dbn = bfsFindFreeNear(bfsNear(inum, &inode, fbn));
+  }
+
+  // Update the Inode, or the map table that holds 'fbn'
+
+  if (mapSet(inum, &inode, fbn, dbn)) bfsWriteInode(inum, &inode);
+
+  bfsUnlock();
+  return dbn;                             // allocated DBN
+
+}
+
+
+
+// ============================================================================
+// Sanity-check the FreeRun header read from free block 'dbn'.  Its checksum
+// held, but a bad link would still send the allocator into metadata or off
+// the disk.  FATAL if it is not a plausible run
+// ============================================================================
+void bfsCheckRun(i32 dbn, FreeRun* run) {
+  i32 count = (run->count == 0) ? 1 : run->count;
+  if (run->next != 0 && (run->next < MINDBN || run->next >= BLOCKSPERDISK))
+    FATAL(EBADDBN);
+  if (count < 1 || dbn + count > BLOCKSPERDISK) FATAL(EBADDBN);
+}
+
+
+
+// ============================================================================
+// Take a run of up to 'want' contiguous blocks from the Freelists: the run
+// just after DBN 'near', if it is big enough; else the nearest one past
+// 'near' in its group that is, so a file grows forward; else (wrapping) the
+// first run that is, else the biggest there is.  The group of 'near' is
+// searched first (if 'near' is 0, the group with most free space), then the
+// groups after it.
+// Store its first DBN in '*pdbn' and return its length.  FATAL if the disk
+// is full, even once the log's garbage is freed
+// ============================================================================
+i32 bfsAllocRun(i32 want, i32 near, i32* pdbn) {
+
+  if (want < 1)      FATAL(EBIGNUMB);
+  if (pdbn == NULL)  FATAL(ENULLPTR);
+
+  bfsLock();
+
+  i8 buf8[BYTESPERBLOCK] = {0};
+  bioRead(DBNSUPER, buf8);
+  Super* super = (Super*)buf8;
+
+  i32 first = (near >= MINDBN) ? bfsGroupOf(near) : bfsGroupPick(super);
+
+  i8 buf[BYTESPERBLOCK] = {0};
+  FreeRun* run = (FreeRun*)buf;
+
+  i32 best = 0, bestPrev = 0, bestNext = 0, bestCount = 0, bestGroup = 0;
+  i32 bestFwd = 0;                        // 1 => 'best' lies past 'near'
+  i32 after   = 0;                        // 1 => found the run after 'near'
+
+  for (i32 k = 0; k < NUMGROUPS && !after; ++k) {
+    if (k > 0 && bestCount >= want) break;
+    i32    g  = (first + k) % NUMGROUPS;
+    Group* gr = &super->groups[g];
+
+    if (gr->freeRun != 0) {               // spill cached head, so every run
+      memset(buf, 0, BYTESPERBLOCK);      // has its header on disk
+      run->next  = gr->nextFree;
+      run->count = gr->freeRun;
+      bioWrite(gr->firstFree, buf);
+      gr->freeRun  = 0;
+      gr->nextFree = 0;
+    }
+
+    for (i32 prev = 0, dbn = gr->firstFree; dbn != 0; ) {
+      bioRead(dbn, buf);
+      bfsCheckRun(dbn, run);
+      i32 count = (run->count == 0) ? 1 : run->count;
+      i32 fwd   = (near >= MINDBN && g == first && dbn > near);
+      after = (dbn == near + 1 && count >= want);
+      i32 better = (bestCount < want)
+                 ? count > bestCount
+                 : count >= want && fwd && (!bestFwd || dbn < best);
+      if (after || better) {
+        best = dbn; bestPrev = prev; bestNext = run->next; bestCount = count;
+        bestGroup = g;
+        bestFwd   = fwd;
+      }
+      if (after) break;
+      if (bestCount >= want && near < MINDBN) break;      // first fit
+      prev = dbn;
+      dbn  = run->next;
+    }
+  }
+
+  if (bestCount == 0 && logFlush() > 0) {   // free the log's garbage
+    bfsUnlock();
+    return bfsAllocRun(want, near, pdbn);
+  }
+  if (bestCount == 0) FATAL(EDISKFULL);
+
+  i32 take = (want < bestCount) ? want : bestCount;
+  i32 link = bestNext;
+
+  if (take < bestCount) {                 // split: rest stays on the list
+    link = best + take;
+    memset(buf, 0, BYTESPERBLOCK);
+    run->next  = bestNext;
+    run->count = bestCount - take;
+    bioWrite(link, buf);
+  }
+
+  Group* gr = &super->groups[bestGroup];
+  if (bestPrev == 0) {
+    gr->firstFree = link;
+  } else {
+    bioRead(bestPrev, buf);
+    run->next = link;
+    bioWrite(bestPrev, buf);
+  }
+  gr->free -= take;
+
+  snapBorn(best, take, super->gen);
+  bioWrite(DBNSUPER, buf8);
+
+  bfsUnlock();
+  *pdbn = best;
+  return take;
+}
+
+
+
+// ============================================================================
+// Find a free Inode (flags == 0) and claim it, as an empty file with 'flags'.
+// New files are spread over the allocation groups: the Inode is taken from
+// the first group, round-robin from the one after the last file's, that has
+// a free Inode and at least the average # of free blocks.  On success,
+// return its inum.  If every Inode is in use, abort
+// ============================================================================
+i32 bfsAllocInode(i32 flags) {
+
+  i8 buf8[BYTESPERBLOCK] = {0};
+  i8 buf[BYTESPERBLOCK]  = {0};
+
+  bfsLock();
+
+  bioRead(DBNSUPER, buf8);
+  Super* super = (Super*)buf8;
+
+  i32 avg = 0;
+  for (i32 g = 0; g < NUMGROUPS; ++g) avg += super->groups[g].free;
+  avg /= NUMGROUPS;
+
+  // Two passes: groups with their share of free space, then any group
+
+  for (i32 pass = 0; pass < 2; ++pass) {
+    for (i32 k = 1; k <= NUMGROUPS; ++k) {
+      i32 g = (super->rotor + k) % NUMGROUPS;
+      if (pass == 0 && super->groups[g].free < avg) continue;
+
+      bioRead(DBNINODES + g, buf);
+      Inode* inodes = (Inode*)buf;
+
+      for (i32 i = 0; i < INODESPERBLOCK; ++i) {
+        i32 inum = g * INODESPERBLOCK + i;
+        if (inum == ROOTINUM || inodes[i].flags != 0) continue;
+
+        memset(&inodes[i], 0, sizeof(Inode));
+        inodes[i].flags = flags;
+        bioWrite(DBNINODES + g, buf);
+        mapInval(inum);
+        compInval(inum);
+
+        super->rotor = g;
+        bioWrite(DBNSUPER, buf8);
+
+        bfsUnlock();
+        return inum;
+      }
+    }
+  }
+
+  FATAL(ENOINODE);                                      // Inodes all used
+  return 0;                                             // pacify compiler
+}
+
+
+
+// ============================================================================
+// Return a DBN that may be overwritten in place of block 'dbn': 'dbn' itself
+// if it is private to its one owner, else a fresh block, with 'dbn' given
+// up (which, for a shared or frozen block, leaves it with the others).  The
+// caller writes the new contents, and maps the DBN returned
+// ============================================================================
+i32 bfsCow(i32 dbn) {
+  if (bfsWritable(dbn)) return dbn;
+
+  bfsLock();
+  i32 fresh = bfsFindFreeNear(dbn);         // same group as the old copy
+  if (dbn >= MINDBN) bfsFreeList(&dbn, 1);  // DBNDIR just stays behind
+  bfsUnlock();
+  return fresh;
+}
+
+
+
+// ============================================================================
+// Copy bytes ['offset', 'offset' + 'len') of file 'sinum' to the same range
+// of file 'dinum', clipped to the source's size.  Whole blocks are cloned:
+// the destination maps the source's DBNs, each taking a reference, so no
+// data moves and either file copies a block when it later changes it (see
+// bfsWriteBlock).  Partial blocks at either end, and compressed or inline
+// files, are copied block by block.  The destination grows to cover the
+// range.  Return the # of bytes copied, or EBIGNUMB, copying nothing, if a
+// compressed destination would grow past COMPMAXSIZE
+// ============================================================================
+i32 bfsCopy(i32 sinum, i32 dinum, i32 offset, i32 len) {
+
+  if (offset < 0) FATAL(EBADCURS);
+  if (len < 0)    FATAL(ENEGNUMB);
+
+  bfsLock();
+
+  i32 ssize = bfsGetSize(sinum);
+  if (offset >= ssize)          len = 0;
+  if (offset + len > ssize)     len = ssize - offset;
+  if (len <= 0 || sinum == dinum) {           // nothing to do
+    bfsUnlock();
+    return (len > 0) ? len : 0;
+  }
+
+  Inode sin, din;
+  bfsReadInode(sinum, &sin);
+  bfsReadInode(dinum, &din);
+
+  if ((din.flags & INODECOMP) && offset + len > COMPMAXSIZE) {
+    bfsUnlock();
+    return EBIGNUMB;
+  }
+
+  i32 clone = !(sin.flags & (INODECOMP | INODEINLINE))
+           && !(din.flags & INODECOMP);
+  if (clone) bfsUninline(dinum);
+
+  FreeBatch fb;
+  fb.n = 0;
+
+  i8  buf[BYTESPERBLOCK];
+  i8  cur[BYTESPERBLOCK];
+  i32 end = offset + len;
+
+  for (i32 pos = offset; pos < end; ) {
+    i32 fbn = pos / BYTESPERBLOCK;
+    i32 lo  = pos % BYTESPERBLOCK;
+    i32 hi  = (end - fbn * BYTESPERBLOCK < BYTESPERBLOCK)
+            ? end - fbn * BYTESPERBLOCK : BYTESPERBLOCK;
+
+    if (clone && lo == 0 && hi == BYTESPERBLOCK) {        // share the DBN
+      bfsReadInode(dinum, &din);
+      i32 s = mapGet(sinum, &sin, fbn);
+      i32 d = mapGet(dinum, &din, fbn);
+      if (s < 0) s = 0;                       // unwritten reads as a hole
+      if (s != d) {
+        if (s > 0) refInc(s);
+        if (mapSet(dinum, &din, fbn, s)) bfsWriteInode(dinum, &din);
+        if (d != 0) mapFree(&fb, abs(d));
+      }
+    } else {                                  // copy the bytes
+      bfsRead(sinum, fbn, buf);
+      bfsRead(dinum, fbn, cur);
+      memcpy(cur + lo, buf + lo, hi - lo);
+      if (!compWrite(dinum, fbn * BYTESPERBLOCK + lo, hi - lo, cur + lo)) {
+        bfsWriteBlock(dinum, fbn, cur, hi - lo == BYTESPERBLOCK);
+      }
+    }
+
+    pos = fbn * BYTESPERBLOCK + hi;
+  }
+
+  mapFlush(&fb);
+  if (bfsGetSize(dinum) < end) bfsSetSize(dinum, end);
+
+  bfsUnlock();
+  return len;
+}
+
+
+
+// ============================================================================
+// Create file 'path'.  Its parent directory must already exist.  Claim a free
+// Inode, and enter it in the parent under the last component of 'path'.
+// Leave the size of the file as zero, until the user performs a write, or a
+// seek into the file.  If 'path' is an existing file, truncate it to zero
+// instead.  On success, return the file's inum.  Return EISADIR if 'path' is
+// a directory; EFNF if the parent is missing, ENOTADIR if part of the parent
+// path is a file, and EBIGFNAME if a component is too long
+// ============================================================================
+i32 bfsCreateFile(str path) {
+
+  if (path == NULL) FATAL(ENULLPTR);
+
+  i32  dinum;
+  char leaf[FNAMESIZE];
+
+  bfsLock();
+
+  i32 ret = dirWalk(path, &dinum, leaf);                // find the parent
+  if (ret != 0) {
+    bfsUnlock();
+    return ret;
+  }
+
+  i32 isdir = 1;                                        // "" is the root
+  i32 inum  = (leaf[0] == 0) ? ROOTINUM : dirLookup(dinum, leaf, &isdir);
+
+  if (inum != EFNF) {                                   // already exists
+    bfsUnlock();
+    if (isdir) return EISADIR;
+    bfsTruncate(inum, 0);
+    bfsRefOFT(inum);
+    return inum;
+  }
+
+  inum = bfsAllocInode(INODEUSED | INODEINLINE);        // starts out inline
+  dirAdd(dinum, leaf, inum);
+
+  bfsUnlock();
+  bfsRefOFT(inum);
+  return inum;
+}
+
+
+
+// ============================================================================
+// Remove 'path' from its parent directory.  Its Inode is marked INODEDEAD, so
+// the inum is not reused until bfsReclaim has freed its blocks.  A directory
+// must be empty, and a file must not be open.  On success, return the inum.
+// If not found, return EFNF; for a directory that still holds entries,
+// EDIRNOTEMPTY; for a file that is open (or being defragmented), EFOPEN
+// ============================================================================
+i32 bfsDeleteFile(str path) {
+
+  if (path == NULL) FATAL(ENULLPTR);
+
+  i32  dinum;
+  char leaf[FNAMESIZE];
+
+  bfsLock();
+
+  i32 ret = dirWalk(path, &dinum, leaf);
+  if (ret != 0 || leaf[0] == 0) {                       // the root stays
+    bfsUnlock();
+    return EFNF;
+  }
+
+  i32 isdir;
+  i32 inum = dirLookup(dinum, leaf, &isdir);
+  if (inum == EFNF) {
+    bfsUnlock();
+    return EFNF;
+  }
+
+  if (isdir && !dirIsEmpty(inum)) {
+    bfsUnlock();
+    return EDIRNOTEMPTY;
+  }
+
+  for (i32 i = 0; i < NUMOFTENTRIES; ++i) {     // its fds stay valid
+    if (g_vol->oft[i].inum == inum) { bfsUnlock(); return EFOPEN; }
+  }
+
+  dirRemove(dinum, leaf);
+
+  Inode inode;
+  bfsReadInode(inum, &inode);
+  inode.flags |= INODEDEAD;
+  bfsWriteInode(inum, &inode);
+
+  bfsUnlock();
+  return inum;
+}
+
+
+
+// ============================================================================
+// Gather the mapped FBNs of a file, and their map entries, for bfsDefrag
+// ============================================================================
+typedef struct {
+  i32* fbns;
+  i32* ents;
+  i32  n;
+  i32  max;
+} DefragList;
+
+i32 bfsDefragVisit(i32 fbn, i32 entry, void* ctx) {
+  DefragList* dl = (DefragList*)ctx;
+  if (dl->n == dl->max) return 1;             // map grew under us
+  dl->fbns[dl->n] = fbn;
+  dl->ents[dl->n] = entry;
+  ++dl->n;
+  return 0;
+}
+
+
+
+// ============================================================================
+// Fill 'dl' with room for 'n' entries, then scan 'inode' into it.  Return 1
+// if the map holds exactly 'n' entries
+// ============================================================================
+i32 bfsDefragList(Inode* inode, i32 n, DefragList* dl) {
+  dl->fbns = malloc(n * sizeof(i32));
+  dl->ents = malloc(n * sizeof(i32));
+  dl->n    = 0;
+  dl->max  = n;
+  if (dl->fbns == NULL || dl->ents == NULL) FATAL(ENOMEM);
+
+  return !mapScan(inode, 0, bfsDefragVisit, dl) && dl->n == n;
+}
+
+
+
+// ============================================================================
+// Release the OFT entry 'ofte' that bfsDefrag holds for 'inum' while it
+// copies.  Return 1 if it is untouched: the file was not opened meanwhile.
+// Caller holds the BFS lock
+// ============================================================================
+i32 bfsDefragRelease(i32 inum, i32 ofte) {
+  OFTE* e = &g_vol->oft[ofte];
+  if (e->inum != inum || e->refs != 0) return 0;  // opened, maybe closed
+  e->inum = 0;
+  e->curs = 0;
+  return 1;
+}
+
+
+
+// ============================================================================
+// Defragment file 'inum': copy all its blocks, in FBN order, into one free
+// contiguous run, then swap the block map.  Copies go DEFRAGBATCH blocks per
+// write, reading each contiguous source extent with one I/O.  The new map
+// (with fresh map tables) is built on the side and committed by the single
+// write of the Inodes block, under the BFS lock, only if the map did not
+// change meanwhile.  Other files are usable throughout.  The file itself
+// must not be open: while it is copied, it holds an OFT entry with no
+// references, which any open, or close, of it disturbs, so an in-place
+// write is never lost.  On success (or nothing to do), return 0.  Return
+// EFOPEN if the file is open, ENORUN if no free run is big enough, and
+// ECHANGED if the file was opened, or its block map changed, during the copy
+// ============================================================================
+i32 bfsDefrag(i32 inum) {
+
+  if (inum < 0)       FATAL(EBADINUM);
+  if (inum > MAXINUM) FATAL(EBADINUM);
+
+  Inode inode;
+
+  bfsLock();
+  bfsReadInode(inum, &inode);
+  bfsUnlock();
+  if (inode.flags & INODEINLINE) return 0;    // no blocks
+  if (inode.flags & INODECOMP)   return 0;    // clusters are contiguous
+
+  i32 extents = 0;
+  i32 n       = 0;                            // # mapped FBNs
+  bfsFragScore(inum, &extents, &n);
+  if (n == 0 || extents <= 1) return 0;       // empty or already contiguous
+
+  bfsLock();
+  for (i32 i = 0; i < NUMOFTENTRIES; ++i) {
+    if (g_vol->oft[i].inum == inum) { bfsUnlock(); return EFOPEN; }
+  }
+  i32 ofte = bfsFindOFTE(inum);               // held, with no references
+  bfsUnlock();
+
+  DefragList dl;
+  if (!bfsDefragList(&inode, n, &dl)) {
+    bfsLock();
+    bfsDefragRelease(inum, ofte);
+    bfsUnlock();
+    free(dl.fbns); free(dl.ents);
+    return ECHANGED;
+  }
+
+  FreeBatch fb;
+  fb.n = 0;
+
+  i32 dbnNew = 0;
+  i32 got = bfsAllocRun(n, bfsNear(inum, &inode, 0), &dbnNew);
+  if (got < n) {                              // no run big enough
+    bfsLock();
+    bfsDefragRelease(inum, ofte);
+    bfsUnlock();
+    for (i32 i = 0; i < got; ++i) mapFree(&fb, dbnNew + i);
+    mapFlush(&fb);
+    free(dl.fbns); free(dl.ents);
+    return ENORUN;
+  }
+
+  // Copy the data, DEFRAGBATCH blocks at a time
+
+  i8 batch[DEFRAGBATCH * BYTESPERBLOCK];
+
+  for (i32 p = 0; p < n; p += DEFRAGBATCH) {
+    i32 w = (n - p < DEFRAGBATCH) ? n - p : DEFRAGBATCH;
+    memset(batch, 0, w * BYTESPERBLOCK);      // unwritten blocks stay zero
+
+    for (i32 i = p; i < p + w; ) {
+      i32 src = dl.ents[i];
+      if (src < 0) { ++i; continue; }
+
+      i32 len = 1;                            // extend over a source extent
+      while (i + len < p + w && dl.ents[i + len] == src + len) ++len;
+
+      bioReadRun(src, len, batch + (i - p) * BYTESPERBLOCK);
+      i += len;
+    }
+
+    bioWriteRun(dbnNew + p, w, batch);
+  }
+
+  // Build the new map on the side, in fresh map tables
+
+  Inode side = inode;
+  memset(side.direct, 0, sizeof(side.direct));
+  side.indirect = side.dindirect = side.tindirect = 0;
+
+  for (i32 i = 0; i < n; ++i) {
+    i32 dbn = dbnNew + i;
+    mapSet(-1, &side, dl.fbns[i], (dl.ents[i] < 0) ? -dbn : dbn);
+  }
+
+  // Swap: commit the new map, unless the file changed under us
+
+  bfsLock();
+
+  Inode      now;
+  DefragList dn = { NULL, NULL, 0, 0 };
+  bfsReadInode(inum, &now);
+
+  i32 same = bfsDefragRelease(inum, ofte)
+          && memcmp(&now, &inode, sizeof(Inode)) == 0
+          && bfsDefragList(&now, n, &dn)
+          && memcmp(dn.fbns, dl.fbns, n * sizeof(i32)) == 0
+          && memcmp(dn.ents, dl.ents, n * sizeof(i32)) == 0;
+
+  if (same) {
+    bfsWriteInode(inum, &side);
+    mapInval(inum);
+  }
+  bfsUnlock();
+
+  free(dn.fbns); free(dn.ents);
+  free(dl.fbns); free(dl.ents);
+
+  mapTrim(same ? &inode : &side, 0, &fb);     // free the old map, or the copy
+  mapFlush(&fb);
+  return same ? 0 : ECHANGED;
+}
+
+
+
+// ============================================================================
+// Dereference file with Inode number 'inum' in the Open File Table.  If
+// refcount reaches 0, free up that entry in the OFT.  Return the refcount
+// left
+// ============================================================================
+i32 bfsDerefOFT(i32 inum) {
+  i32 ofte = bfsFindOFTE(inum);
+  i32 refs = --g_vol->oft[ofte].refs;
+  if (refs == 0) {
+    g_vol->oft[ofte].inum = 0;
+    g_vol->oft[ofte].curs = 0;
+  }
+  return refs;
+}
+
+
+
+// ============================================================================
+// Extend file 'inum' out to FBN 'fbn'
+// ============================================================================
+i32 bfsExtend(i32 inum, i32 fbn) {
+  i32 size = bfsGetSize(inum);
+  i32 fbnLast = (size + 1) / BYTESPERBLOCK;
+  for (i32 f = fbnLast; f <= fbn; ++f) {
+    bfsAllocBlock(inum, f);
+  }
+  return 0;
+}
+
+
+
+// ============================================================================
+// Preallocate every unmapped FBN covering bytes ['offset', 'offset' + 'len')
+// of file 'inum', taking contiguous runs from bfsAllocRun.  With 'zero' set,
+// the blocks are zeroed on disk now; otherwise they are recorded as unwritten
+// (negated DBN) and read back as zeroes until bfsAllocBlock marks them
+// written.  Grows the file size to cover the range.  Return 0, or EDISKFULL,
+// with nothing reserved, if the free blocks, with the log's garbage freed,
+// are too few for the range and the map tables it may need
+// ============================================================================
+i32 bfsFallocate(i32 inum, i32 offset, i32 len, i32 zero) {
+
+  if (inum < 0)       FATAL(EBADINUM);
+  if (inum > MAXINUM) FATAL(EBADINUM);
+  if (offset < 0)     FATAL(EBADCURS);
+  if (len < 0)        FATAL(ENEGNUMB);
+  if (len == 0)       return 0;
+
+  i32 fbnFirst = offset / BYTESPERBLOCK;
+  i32 fbnLast  = (i32)(((i64)offset + len - 1) / BYTESPERBLOCK);
+  if (fbnLast >= MAXFBN) FATAL(EBIGNUMB);
+
+  bfsLock();
+  bfsUninline(inum);
+
+  Inode inode;
+  bfsReadInode(inum, &inode);
+
+  // A compressed cluster's size is known only once it is written, so for a
+  // compressed file there is nothing to reserve: just grow it
+
+  if (inode.flags & INODECOMP) {
+    if (inode.size < offset + len) inode.size = offset + len;
+    bfsWriteInode(inum, &inode);
+    bfsUnlock();
+    return 0;
+  }
+
+  i32 need = 0;                               // # unmapped FBNs in range
+  for (i32 fbn = fbnFirst; fbn <= fbnLast; ++fbn) {
+    if (mapGet(inum, &inode, fbn) == 0) ++need;
+  }
+
+  i32 tables = (need + I32SPERBLOCK - 1) / I32SPERBLOCK + 2;   // at most
+  if (need > 0 && bfsFreeBlocks() < need + tables) logFlush();  // garbage
+  if (need > 0 && bfsFreeBlocks() < need + tables) {
+    bfsUnlock();
+    return EDISKFULL;
+  }
+
+  i8  zeroes[BYTESPERBLOCK] = {0};
+  i32 fbn = fbnFirst;
+
+  while (need > 0) {
+    i32 dbn;
+    i32 got = bfsAllocRun(need, bfsNear(inum, &inode, fbn), &dbn);
+    need -= got;
+
+    for (i32 i = 0; i < got; ++fbn) {
+      if (mapGet(inum, &inode, fbn) != 0) continue;
+      if (zero) bioWrite(dbn + i, zeroes);
+      mapSet(inum, &inode, fbn, zero ? dbn + i : -(dbn + i));
+      ++i;
+    }
+  }
+
+  if (inode.size < offset + len) inode.size = offset + len;
+  bfsWriteInode(inum, &inode);
+
+  bfsUnlock();
+  return 0;
+}
+
+
+
+// ============================================================================
+// Use Inode to find the DBN used to store file block 'fbn'.  Return ENODBN
+// if not yet mapped, or preallocated but not yet written.  Return EINLINE if
+// the file's data is held in its Inode, and ECOMPRESSED if it is compressed
+// ============================================================================
+i32 bfsFbnToDbn(i32 inum, i32 fbn) {
+
+  if (inum < 0)       FATAL(EBADINUM);
+  if (inum > MAXINUM) FATAL(EBADINUM);
+  if (fbn  < 0)       FATAL(EBADFBN);
+  if (fbn >= MAXFBN)  FATAL(EBADFBN);
+
+  Inode inode;
+  
+  bfsReadInode(inum, &inode);
+
+  if (inode.flags & INODEINLINE) return EINLINE;    // no blocks at all
+  if (inode.flags & INODECOMP)   return ECOMPRESSED; // no per-FBN map
+
+  // Walk direct[], then the map tables.  A missing table means its whole
+  // range is a hole.  Allocation is left to bfsAllocBlock, so a lookup never
+  // changes the disk
+
+  i32 dbn = mapGet(inum, &inode, fbn);
+  return (dbn <= 0) ? ENODBN : dbn;
+}
+
+
+
+// ============================================================================
+// Convert FileDescriptor (user-visible) to Inum (internal)
+// ============================================================================
+i32 bfsFdToInum(i32 fd) { 
+  i32 inum = fd - INUMTOFD; 
+  if (inum < 0) FATAL(EBADINUM);
+  return inum;
+}
+
+
+
+
+// ============================================================================
+// Resolve 'path', without touching the Open File Table.  If found, return its
+// inum.  If not, return EFNF
+// ============================================================================
+i32 bfsFindInum(str path) {
+
+  if (path == NULL) FATAL(ENULLPTR);
+
+  i32 inum = dirResolve(path, NULL);
+  return (inum < 0) ? EFNF : inum;
+}
+
+
+
+// ============================================================================
+// Count the extents and blocks of a file, for bfsFragScore
+// ============================================================================
+typedef struct {
+  i32 extents;
+  i32 blocks;
+  i32 dbnPrev;
+} FragCount;
+
+i32 bfsFragVisit(i32 fbn, i32 entry, void* ctx) {
+  FragCount* fc  = (FragCount*)ctx;
+  i32        dbn = abs(entry);
+  (void)fbn;
+  if (dbn != fc->dbnPrev + 1) ++fc->extents;
+  ++fc->blocks;
+  fc->dbnPrev = dbn;
+  return 0;
+}
+
+
+
+// ============================================================================
+// Measure the fragmentation of file 'inum'.  An extent is a run of mapped
+// FBNs whose DBNs are contiguous on disk.  Store the # of extents in
+// '*pextents' and the # of mapped blocks in '*pblocks' (either may be NULL).
+// Return the score, in extents per MB of mapped data (0 for an empty file)
+// ============================================================================
+i32 bfsFragScore(i32 inum, i32* pextents, i32* pblocks) {
+
+  if (inum < 0)       FATAL(EBADINUM);
+  if (inum > MAXINUM) FATAL(EBADINUM);
+
+  Inode inode;
+  bfsReadInode(inum, &inode);
+
+  FragCount fc = { 0, 0, 0 };
+  if (!(inode.flags & (INODEINLINE | INODECOMP))) {
+    mapScan(&inode, 0, bfsFragVisit, &fc);
+  }
+
+  if (pextents != NULL) *pextents = fc.extents;
+  if (pblocks  != NULL) *pblocks  = fc.blocks;
+
+  if (fc.blocks == 0) return 0;
+  return (i32)(((i64)fc.extents << 20) / ((i64)fc.blocks * BYTESPERBLOCK));
+}
+
+
+
+// ============================================================================
+// Find 'inum' in the Open File Table (OFT).  If not found, create an entry.
+// Return the index within the OFT.  On failure, EOFTFULL
+// ============================================================================
+i32 bfsFindOFTE(i32 inum) {
+  for (int i = 0; i < NUMOFTENTRIES; ++i) {
+    if (g_vol->oft[i].inum == inum) return i;
+  }
+  
+  // Not found, so look for an empty OFTE
+
+  for (int i = 0; i < NUMOFTENTRIES; ++i) {
+    if (g_vol->oft[i].inum == 0) {
+      g_vol->oft[i].inum = inum;
+      g_vol->oft[i].curs = 0;
+      g_vol->oft[i].refs = 0;                // bfsRefOFT counts the opener
+      return i;
+    }
+  }
+  FATAL(EOFTFULL);      // no-return
+  return 0;             // pacify compiler
+}
+
+
+
+// ============================================================================
+// Allocate a free block, from the group with most free space.  On success,
+// return DBN.  FATAL otherwise
+// ============================================================================
+i32 bfsFindFreeBlock() { return bfsFindFreeNear(0); }
+
+
+
+// ============================================================================
+// Allocate a free block from the group of DBN 'near' (if 'near' is 0, the
+// group with most free space), or the first group after it with any: the
+// block just after 'near' if it is free, else the nearest free block past
+// it (see bfsAllocRun); for 'near' 0, its head run's first.  Each
+// group's Freelist is a chain of runs of contiguous free blocks; the
+// SuperBlock caches the head run, so taking a block from it costs just the
+// SuperBlock update.  On success, return DBN.  FATAL otherwise
+// ============================================================================
+i32 bfsFindFreeNear(i32 near) {
+  bfsLock();
+
+  i8 buf8[BYTESPERBLOCK] = {0};
+  bioRead(DBNSUPER, buf8);
+  Super* super = (Super*)buf8;
+
+  i32 g = (near >= MINDBN) ? bfsGroupOf(near) : bfsGroupPick(super);
+  Group* gr = &super->groups[g];
+
+  if (near >= MINDBN && gr->firstFree != 0 && gr->firstFree != near + 1) {
+    i32 dbn;                          // look for the block after 'near'
+    bfsAllocRun(1, near, &dbn);       //   further down the Freelist
+    bfsUnlock();
+    return dbn;
+  }
+
+  for (i32 k = 0; k < NUMGROUPS && gr->firstFree == 0; ++k) {
+    g  = (g + 1) % NUMGROUPS;
+    gr = &super->groups[g];
+  }
+
+  i32 dbn = gr->firstFree;
+  if (dbn == 0 && logFlush() > 0) {       // free the log's garbage
+    bfsUnlock();
+    return bfsFindFreeNear(near);
+  }
+  if (dbn == 0) FATAL(EDISKFULL);
+
+  if (gr->freeRun == 0) {             // head run not cached: read its header
+    i8 buf[BYTESPERBLOCK] = {0};
+    bioRead(dbn, buf);
+    FreeRun* run = (FreeRun*)buf;
+    bfsCheckRun(dbn, run);
+    gr->nextFree = run->next;
+    gr->freeRun  = (run->count == 0) ? 1 : run->count;
+  }
+
+  if (--gr->freeRun == 0) {           // head run used up
+    gr->firstFree = gr->nextFree;
+    gr->nextFree  = 0;
+  } else {
+    ++gr->firstFree;
+  }
+  --gr->free;
+
+  snapBorn(dbn, 1, super->gen);
+  bioWrite(DBNSUPER, buf8);           // update SuperBlock
+
+  bfsUnlock();
+  return dbn;
+}
+
+
+
+// ============================================================================
+// Return the # of free blocks, over every allocation group
+// ============================================================================
+i32 bfsFreeBlocks() {
+  i8 buf8[BYTESPERBLOCK] = {0};
+  bioRead(DBNSUPER, buf8);
+  Super* super = (Super*)buf8;
+
+  i32 free = 0;
+  for (i32 g = 0; g < NUMGROUPS; ++g) free += super->groups[g].free;
+  return free;
+}
+
+
+
+// ============================================================================
+// Return the 'n' blocks in 'dbns' to the Freelist.  A shared block just loses
+// a reference, and stays put; so does a block frozen by a snapshot, until the
+// snapshot is deleted.  'dbns' is reordered
+// ============================================================================
+i32 bfsFreeList(i32* dbns, i32 n) {
+
+  if (n <= 0) return 0;
+  if (dbns == NULL) FATAL(ENULLPTR);
+
+  for (i32 i = 0; i < n; ++i) {
+    if (dbns[i] < MINDBN || dbns[i] >= BLOCKSPERDISK) FATAL(EBADDBN);
+  }
+
+  bfsLock();
+
+  i32 keep = 0;                               // drop the shared ones
+  for (i32 i = 0; i < n; ++i) {
+    if (refDrop(dbns[i])) continue;
+    dedupForget(dbns[i]);
+    if (snapFrozen(dbns[i])) continue;        // a snapshot still holds it
+    dbns[keep++] = dbns[i];
+  }
+  bfsFreeRuns(dbns, keep);
+
+  bfsUnlock();
+  return 0;
+}
+
+
+
+// ============================================================================
+// Push the 'n' blocks in 'dbns' onto the Freelist, whoever else may think
+// they hold them.  'dbns' is sorted and cut into runs of contiguous DBNs;
+// each run is pushed as a single FreeRun, and the SuperBlock is written once
+// for the whole batch.  'dbns' is reordered
+// ============================================================================
+i32 bfsFreeRuns(i32* dbns, i32 n) {
+
+  if (n <= 0) return 0;
+  if (dbns == NULL) FATAL(ENULLPTR);
+
+  for (i32 i = 1; i < n; ++i) {               // insertion sort: n is small
+    i32 d = dbns[i];
+    i32 j = i - 1;
+    while (j >= 0 && dbns[j] > d) { dbns[j + 1] = dbns[j]; --j; }
+    dbns[j + 1] = d;
+  }
+
+  for (i32 i = 0; i < n; ++i) {
+    if (dbns[i] < MINDBN || dbns[i] >= BLOCKSPERDISK) FATAL(EBADDBN);
+  }
+
+  bfsLock();
+
+  i8 buf8[BYTESPERBLOCK] = {0};
+  bioRead(DBNSUPER, buf8);
+  Super* super = (Super*)buf8;
+
+  // Push runs from the highest DBN down, so the lowest run ends up at the
+  // head of its group's Freelist and is allocated first.  A run is cut
+  // where it crosses into the next group
+
+  i32 end = n;
+  while (end > 0) {
+    i32 start = end - 1;
+    i32 g     = bfsGroupOf(dbns[start]);
+    while (start > 0 && dbns[start - 1] == dbns[start] - 1
+                     && bfsGroupOf(dbns[start - 1]) == g) --start;
+
+    Group* gr = &super->groups[g];
+    if (gr->firstFree != 0 && gr->freeRun != 0) {     // spill cached head
+      i8 buf[BYTESPERBLOCK] = {0};
+      FreeRun* run = (FreeRun*)buf;
+      run->next  = gr->nextFree;
+      run->count = gr->freeRun;
+      bioWrite(gr->firstFree, buf);
+    }
+
+    gr->nextFree  = gr->firstFree;
+    gr->firstFree = dbns[start];
+    gr->freeRun   = end - start;
+    gr->free     += end - start;
+    end = start;
+  }
+
+  bioWrite(DBNSUPER, buf8);
+
+  bfsUnlock();
+  return 0;
+}
+
+
+// ============================================================================
+// Initialize the Freelists.  On a fresh disk each group is one run,
+// described entirely by the SuperBlock; so we only write the last block, to
+// give BFSDISK its full size
+// ============================================================================
+i32 bfsInitFreeList() {
+  i8 buf[BYTESPERBLOCK] = {0};
+  return bioWrite(BLOCKSPERDISK - 1, buf);
+}
+
+
+
+// ============================================================================
+// Write the first block of the root directory, with no entries, into DBNDIR
+// ============================================================================
+i32 bfsInitDir(FILE* fp) {
+  if (fp == NULL) FATAL(ENULLPTR);
+  i8 buf[BYTESPERBLOCK] = {0};
+  return bioWrite(DBNDIR, buf);
+}
+
+
+
+// ============================================================================
+// Write the initial Inodes blocks, from DBN 1.  All Inodes are free, but the
+// root directory's: one block, at DBNDIR
+// ============================================================================
+i32 bfsInitInodes(FILE* fp) {
+  if (fp == NULL) FATAL(ENULLPTR);
+
+  i8 buf[BYTESPERBLOCK] = {0};
+  for (i32 b = 1; b < INODEBLOCKS; ++b) bioWrite(DBNINODES + b, buf);
+
+  Inode* root = &((Inode*)buf)[ROOTINUM];
+  root->size      = BYTESPERBLOCK;
+  root->flags     = INODEUSED | INODEDIR;
+  root->direct[0] = DBNDIR;
+  return bioWrite(DBNINODES, buf);
+}
+
+
+
+// ============================================================================
+// Initialize the Open File Table to all zeroes
+// ============================================================================
+i32 bfsInitOFT() {
+  for (i32 i = 0; i < NUMOFTENTRIES; ++i) {
+    g_vol->oft[i].inum = 0;
+    g_vol->oft[i].curs = 0;
+    g_vol->oft[i].refs = 0;
+  }
+  return 0;
+}
+
+
+// ============================================================================
+// Write the initial Super block into DBN 0
+// ============================================================================
+i32 bfsInitSuper(FILE* fp) {
+
+  if (fp == NULL) FATAL(ENULLPTR);
+
+  Super sb;
+  memset(&sb, 0, sizeof(Super));
+  sb.numBlocks   = BLOCKSPERDISK;         // eg: 100
+  sb.numInodes   = NUMINODES;             // eg: 32
+  sb.numGroups   = NUMGROUPS;             // eg: 4
+  sb.groupBlocks = GROUPBLOCKS;           // eg: 23
+  sb.rotor       = NUMGROUPS - 1;         // first file goes to group 0
+  sb.version     = BFSVERSION;
+  sb.gen         = 0;
+
+  for (i32 g = 0; g < NUMGROUPS; ++g) {   // each group is one run
+    i32 first = MINDBN + g * GROUPBLOCKS;
+    i32 end   = first + GROUPBLOCKS;
+    if (end > BLOCKSPERDISK) end = BLOCKSPERDISK;
+    sb.groups[g].firstFree = first;       // eg: 9, 32, 55, 78
+    sb.groups[g].freeRun   = end - first; // eg: 23, 23, 23, 22
+    sb.groups[g].free      = end - first;
+  }
+
+  i8 buf[BYTESPERBLOCK] = {0};
+  memcpy(buf, &sb, sizeof(Super));
+
+  return bioWrite(DBNSUPER, buf);
+}
+
+
+
+// ============================================================================
+// Convert between inum (internal) and FileDescriptor (user-visible)
+// ============================================================================
+i32 bfsInumToFd(i32 inum) { return inum + INUMTOFD; }
+
+
+// ============================================================================
+// Take the BFS metadata lock.  It serializes read-modify-write of the Super,
+// Inodes and directory blocks between callers and the reclaim thread.  Recursive,
+// so bfs functions that hold it may call each other
+// ============================================================================
+void bfsLockInit() {
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&g_vol->bfslock, &attr);
+  pthread_mutexattr_destroy(&attr);
+}
+
+void bfsLock() {
+  pthread_once(&g_vol->bfslockOnce, bfsLockInit);
+  pthread_mutex_lock(&g_vol->bfslock);
+}
+
+
+
+// ============================================================================
+// Resolve 'path'.  If it is a file, reference it in the Open File Table and
+// return its inum.  If not found, return EFNF; if a directory, EISADIR
+// ============================================================================
+i32 bfsLookupFile(str path) {
+
+  if (path == NULL) FATAL(ENULLPTR);
+
+  i32 isdir;
+  i32 inum = dirResolve(path, &isdir);
+  if (inum < 0) return EFNF;
+  if (isdir)    return EISADIR;
+  bfsRefOFT(inum);
+  return inum;
+}
+
+
+
+// ============================================================================
+// Create directory 'path', empty.  Its parent must already exist.  On
+// success, return its inum.  Return EFEXISTS if 'path' is taken, EFNF if the
+// parent is missing, ENOTADIR if part of the parent path is a file, and
+// EBIGFNAME if a component is too long
+// ============================================================================
+i32 bfsMakeDir(str path) {
+
+  if (path == NULL) FATAL(ENULLPTR);
+
+  i32  dinum;
+  char leaf[FNAMESIZE];
+
+  bfsLock();
+
+  i32 ret = dirWalk(path, &dinum, leaf);
+  if (ret == 0 && leaf[0] == 0) ret = EFEXISTS;         // the root
+  if (ret == 0 && dirLookup(dinum, leaf, NULL) != EFNF) ret = EFEXISTS;
+  if (ret != 0) {
+    bfsUnlock();
+    return ret;
+  }
+
+  i32 inum = bfsAllocInode(INODEUSED | INODEDIR);
+  dirAdd(dinum, leaf, inum);
+
+  bfsUnlock();
+  return inum;
+}
+
+
+
+// ============================================================================
+// Return a DBN for FBN 'fbn' of file 'inum' to be allocated near: the block
+// of the FBN before it, if it has one, so a file written in order stays
+// contiguous; else the first block of the file's own group
+// ============================================================================
+i32 bfsNear(i32 inum, Inode* inode, i32 fbn) {
+  i32 prev = (fbn > 0) ? mapGet(inum, inode, fbn - 1) : 0;
+  if (prev < 0) prev = -prev;                 // preallocated
+  if (prev >= MINDBN) return prev;
+  return MINDBN + (inum / INODESPERBLOCK) * GROUPBLOCKS;
+}
+
+
+
+// ============================================================================
+// Find the run of written FBNs, starting at 'fbn' in file 'inum', whose DBNs
+// are contiguous on disk; at most 'max' of them.  Store the first DBN in
+// '*pdbn' and return the run length.  Return 0 if 'fbn' is a hole
+// ============================================================================
+i32 bfsMapRun(i32 inum, i32 fbn, i32 max, i32* pdbn) {
+
+  if (inum < 0)       FATAL(EBADINUM);
+  if (inum > MAXINUM) FATAL(EBADINUM);
+  if (fbn  < 0)       FATAL(EBADFBN);
+  if (pdbn == NULL)   FATAL(ENULLPTR);
+
+  if (fbn + max > MAXFBN) max = MAXFBN - fbn;
+  if (max <= 0) return 0;
+
+  Inode inode;
+  bfsReadInode(inum, &inode);
+  if (inode.flags & (INODEINLINE | INODECOMP)) return 0;
+
+  i32 run = 0;
+  for (; run < max; ++run) {
+    i32 dbn = mapGet(inum, &inode, fbn + run);  // leaf table is cached
+    if (dbn <= 0) break;
+    if (run > 0 && dbn != *pdbn + run) break;
+    if (run == 0) *pdbn = dbn;
+  }
+
+  return run;
+}
+
+
+
+// ============================================================================
+// Read FBN 'fbn' for the file whose inum is 'inum' into 'buf'.  An unmapped
+// FBN is a hole, and reads back as zeroes.  An inline file is read from its
+// Inode, with no data block I/O; a compressed one from its cluster
+// ============================================================================
+i32 bfsRead(i32 inum, i32 fbn, i8* buf) {
+
+  if (inum < 0)       FATAL(EBADINUM);
+  if (inum > MAXINUM) FATAL(EBADINUM);
+  if (fbn  < 0)       FATAL(EBADFBN);
+  if (fbn  > MAXFBN)  FATAL(EBADFBN);
+
+  i32 dbn = bfsFbnToDbn(inum, fbn);
+
+  if (dbn == ENODBN) {                // hole: zero-fill, no disk I/O
+    memset(buf, 0, BYTESPERBLOCK);
+    return 0;
+  }
+
+  if (dbn == EINLINE) {               // served from the Inodes block
+    Inode inode;
+    bfsReadInode(inum, &inode);
+    memset(buf, 0, BYTESPERBLOCK);
+    if (fbn == 0) memcpy(buf, inode.data, INLINESIZE);
+    return 0;
+  }
+
+  if (dbn == ECOMPRESSED) return compRead(inum, fbn, buf);
+
+  bioRead(dbn, buf);
+  return 0;
+}
+
+
+// ============================================================================
+// Read the Inodes block holding Inode 'inum'.  Extract and return the Inode.
+// On success, return 0.  On failure, abort
+// ============================================================================
+i32 bfsReadInode(i32 inum, Inode* inode) {
+
+  if (inum < 0)       FATAL(EBADINUM);
+  if (inum > MAXINUM) FATAL(EBADINUM);
+  if (inode == NULL)  FATAL(ENULLPTR);
+
+  i8 buf[BYTESPERBLOCK] = {0};
+
+  bfsLock();
+  bioRead(snapInodes(inum / INODESPERBLOCK), buf);
+  bfsUnlock();
+
+  Inode* inodes = (Inode*)buf;
+
+  memcpy(inode, &inodes[inum % INODESPERBLOCK], sizeof(Inode));
+  return 0;
+}
+
+
+
+// ============================================================================
+// Free every block of deleted file 'inum', then free its INODEDEAD Inode.
+// Blocks are freed from the end of the file, RECLAIMBATCH at a time,
+// dropping the BFS lock between batches so writers are not stalled
+// ============================================================================
+i32 bfsReclaim(i32 inum) {
+
+  i32 size = bfsGetSize(inum);
+  while (size > 0) {
+    i32 fbnEnd = (size + BYTESPERBLOCK - 1) / BYTESPERBLOCK;
+    i32 fbnNew = (fbnEnd > RECLAIMBATCH) ? fbnEnd - RECLAIMBATCH : 0;
+    size = fbnNew * BYTESPERBLOCK;
+    bfsTruncate(inum, size);
+  }
+  bfsTruncate(inum, 0);                       // catch anything past EOF
+
+  Inode inode;
+  memset(&inode, 0, sizeof(Inode));           // flags 0: Inode is free again
+
+  bfsLock();
+  bfsWriteInode(inum, &inode);
+  mapInval(inum);
+  bfsUnlock();
+
+  return 0;
+}
+
+
+
+// ============================================================================
+// Wait until the reclaim thread has emptied its queue
+// ============================================================================
+i32 bfsReclaimDrain() {
+  pthread_mutex_lock(&g_vol->reclaim.lock);
+  while (g_vol->reclaim.count > 0 || g_vol->reclaim.busy) {
+    pthread_cond_wait(&g_vol->reclaim.idle, &g_vol->reclaim.lock);
+  }
+  pthread_mutex_unlock(&g_vol->reclaim.lock);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Body of the reclaim thread of volume 'arg': pop deleted inums and bfsReclaim
+// them, until bfsReclaimStop
+// ============================================================================
+void* bfsReclaimMain(void* arg) {
+  g_vol = (BfsVolume*)arg;
+  pthread_mutex_lock(&g_vol->reclaim.lock);
+  for (;;) {
+    while (g_vol->reclaim.count == 0 && !g_vol->reclaim.stop) {
+      pthread_cond_wait(&g_vol->reclaim.wake, &g_vol->reclaim.lock);
+    }
+    if (g_vol->reclaim.count == 0) break;       // stopped, and nothing left
+    i32 inum = g_vol->reclaim.inums[g_vol->reclaim.head];
+    g_vol->reclaim.head = (g_vol->reclaim.head + 1) % NUMRECLAIM;
+    --g_vol->reclaim.count;
+    g_vol->reclaim.busy = 1;
+    pthread_mutex_unlock(&g_vol->reclaim.lock);
+
+    bfsReclaim(inum);
+
+    pthread_mutex_lock(&g_vol->reclaim.lock);
+    g_vol->reclaim.busy = 0;
+    if (g_vol->reclaim.count == 0) pthread_cond_broadcast(&g_vol->reclaim.idle);
+  }
+  pthread_mutex_unlock(&g_vol->reclaim.lock);
+  return NULL;
+}
+
+
+
+// ============================================================================
+// Finish the reclaims queued, then end the reclaim thread, if one is running.
+// Called when a volume is unmounted for good
+// ============================================================================
+i32 bfsReclaimStop() {
+  pthread_mutex_lock(&g_vol->reclaim.lock);
+  i32 started = g_vol->reclaim.started;
+  g_vol->reclaim.stop = 1;
+  pthread_cond_signal(&g_vol->reclaim.wake);
+  pthread_mutex_unlock(&g_vol->reclaim.lock);
+
+  if (started) pthread_join(g_vol->reclaim.thread, NULL);
+  g_vol->reclaim.started = 0;
+  g_vol->reclaim.stop    = 0;
+  return 0;
+}
+
+
+
+// ============================================================================
+// Hand deleted file 'inum' to the reclaim thread, starting it if need be.
+// Returns at once; the blocks are freed in the background
+// ============================================================================
+i32 bfsReclaimQueue(i32 inum) {
+
+  if (inum < 0)       FATAL(EBADINUM);
+  if (inum > MAXINUM) FATAL(EBADINUM);
+
+  pthread_mutex_lock(&g_vol->reclaim.lock);
+
+  if (!g_vol->reclaim.started) {
+    if (pthread_create(&g_vol->reclaim.thread, NULL, bfsReclaimMain, g_vol)) {
+      pthread_mutex_unlock(&g_vol->reclaim.lock);
+      return bfsReclaim(inum);                // no thread: do it inline
+    }
+    g_vol->reclaim.started = 1;
+  }
+
+  i32 tail = (g_vol->reclaim.head + g_vol->reclaim.count) % NUMRECLAIM;
+  g_vol->reclaim.inums[tail] = inum;
+  ++g_vol->reclaim.count;
+  pthread_cond_signal(&g_vol->reclaim.wake);
+
+  pthread_mutex_unlock(&g_vol->reclaim.lock);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Queue any INODEDEAD Inodes left by a delete that was interrupted before
+// its blocks were reclaimed.  Called at mount
+// ============================================================================
+i32 bfsReclaimRecover() {
+  for (i32 inum = 0; inum < NUMINODES; ++inum) {
+    Inode inode;
+    bfsReadInode(inum, &inode);
+    if (inode.flags & INODEDEAD) bfsReclaimQueue(inum);
+  }
+  return 0;
+}
+
+
+
+// ============================================================================
+// Reference file with Inode number 'inum' in the Open File Table
+// ============================================================================
+i32 bfsRefOFT(i32 inum) {
+  i32 ofte = bfsFindOFTE(inum);
+  ++g_vol->oft[ofte].refs;
+  return 0;
+}
+
+
+
+// ============================================================================
+// Stop at the first written FBN, storing it in '*ctx'; for bfsSeekData
+// ============================================================================
+i32 bfsSeekDataVisit(i32 fbn, i32 entry, void* ctx) {
+  if (entry < 0) return 0;                      // unwritten: reads as a hole
+  *(i32*)ctx = fbn;
+  return 1;
+}
+
+
+
+// ============================================================================
+// Return the first byte-offset at or after 'offset' in file 'inum' that lies
+// in an allocated block (SEEK_DATA).  Return EPASTEOF if there is no data at
+// or beyond 'offset'.  Unmapped tables are skipped without being read
+// ============================================================================
+i32 bfsSeekData(i32 inum, i32 offset) {
+
+  if (offset < 0) FATAL(EBADCURS);
+
+  Inode inode;
+  bfsReadInode(inum, &inode);
+
+  i32 size = inode.size;
+  if (offset >= size) return EPASTEOF;
+  if (inode.flags & INODEINLINE) return offset; // inline: all data
+  if (inode.flags & INODECOMP) return compSeek(inum, offset, 1);
+
+  i32 fbn = offset / BYTESPERBLOCK;
+  if (!mapScan(&inode, fbn, bfsSeekDataVisit, &fbn)) return EPASTEOF;
+
+  i32 start = fbn * BYTESPERBLOCK;
+  if (start < offset) start = offset;
+  return (start < size) ? start : EPASTEOF;
+}
+
+
+
+// ============================================================================
+// Stop at the first FBN, from '*ctx' on, that is not written; for
+// bfsSeekHole.  Mapped FBNs arrive in order, so a gap is a hole
+// ============================================================================
+i32 bfsSeekHoleVisit(i32 fbn, i32 entry, void* ctx) {
+  i32* pfbn = (i32*)ctx;
+  if (fbn != *pfbn || entry < 0) return 1;      // hole at *pfbn
+  ++*pfbn;
+  return 0;
+}
+
+
+
+// ============================================================================
+// Return the first byte-offset at or after 'offset' in file 'inum' that lies
+// in a hole (SEEK_HOLE).  EOF counts as a hole, so any 'offset' within the
+// file succeeds.  Return EPASTEOF if 'offset' is at or beyond EOF
+// ============================================================================
+i32 bfsSeekHole(i32 inum, i32 offset) {
+
+  if (offset < 0) FATAL(EBADCURS);
+
+  Inode inode;
+  bfsReadInode(inum, &inode);
+
+  i32 size = inode.size;
+  if (offset >= size) return EPASTEOF;
+  if (inode.flags & INODEINLINE) return size;   // inline: no holes
+  if (inode.flags & INODECOMP) return compSeek(inum, offset, 0);
+
+  i32 fbn = offset / BYTESPERBLOCK;
+  mapScan(&inode, fbn, bfsSeekHoleVisit, &fbn);
+
+  i32 start = fbn * BYTESPERBLOCK;
+  if (start < offset) start = offset;
+  return (start < size) ? start : size;
+}
+
+
+
+// ============================================================================
+// Set cursor position for the file open on File Descriptor 'fd' to 'newCurs'
+// ============================================================================
+i32 bfsSetCursor(i32 inum, i32 newCurs) {
+
+  if (inum < 0) FATAL(EBADINUM);
+  if (inum > MAXINUM) FATAL(EBADINUM);
+
+  i32 ofte = bfsFindOFTE(inum);
+  g_vol->oft[ofte].curs = newCurs;
+  return 0;
+}
+
+
+
+// ============================================================================
+// Return the cursor position for the file open on File Descriptor 'fd'
+// ============================================================================
+i32 bfsTell(i32 fd) {
+  i32 inum = bfsFdToInum(fd);
+  i32 ofte = bfsFindOFTE(inum);
+  return g_vol->oft[ofte].curs;
+}
+
+
+
+// ============================================================================
+// Return the size of the file whose Inode number is 'inum'
+// ============================================================================
+i32 bfsGetSize(i32 inum) {
+
+  if (inum < 0)       FATAL(EBADINUM);
+  if (inum > MAXINUM) FATAL(EBADINUM);
+
+  Inode inode;
+  bfsReadInode(inum, &inode);
+
+  return inode.size;
+}
+
+
+
+// ============================================================================
+// Return the allocation group holding data block 'dbn'.  FATAL for metadata
+// ============================================================================
+i32 bfsGroupOf(i32 dbn) {
+  if (dbn < MINDBN || dbn >= BLOCKSPERDISK) FATAL(EBADDBN);
+  return (dbn - MINDBN) / GROUPBLOCKS;
+}
+
+
+
+// ============================================================================
+// Return the group, of those in 'super', with most free blocks
+// ============================================================================
+i32 bfsGroupPick(Super* super) {
+  i32 best = 0;
+  for (i32 g = 1; g < NUMGROUPS; ++g) {
+    if (super->groups[g].free > super->groups[best].free) best = g;
+  }
+  return best;
+}
+
+
+
+// ============================================================================
+// Set size of file 'inum' to 'size
+// ============================================================================
+i32 bfsSetSize(i32 inum, i32 size) {
+
+  if (inum < 0)       FATAL(EBADINUM);
+  if (inum > MAXINUM) FATAL(EBADINUM);
+
+  Inode inode;
+  bfsReadInode(inum, &inode);
+  
+  inode.size = size;
+  bfsWriteInode(inum, &inode);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Set the size of file 'inum' to 'size'.  Growing just moves EOF, leaving a
+// hole.  Shrinking zeroes the tail of a partial last block, then unmaps every
+// FBN wholly beyond the new EOF, and every map table left empty, handing the
+// freed DBNs to bfsFreeList FREEBATCH at a time.  Return 0, or EBIGNUMB if
+// a compressed file would grow past COMPMAXSIZE
+// ============================================================================
+i32 bfsTruncate(i32 inum, i32 size) {
+
+  if (inum < 0)       FATAL(EBADINUM);
+  if (inum > MAXINUM) FATAL(EBADINUM);
+  if (size < 0)       FATAL(EBADCURS);
+  if (size / BYTESPERBLOCK >= MAXFBN) FATAL(EBIGNUMB);
+
+  bfsLock();
+
+  Inode inode;
+  bfsReadInode(inum, &inode);
+
+  if (inode.flags & INODECOMP) {              // clusters, not a block map
+    i32 ret = compTruncate(inum, size);
+    bfsUnlock();
+    return ret;
+  }
+
+  if ((inode.flags & INODEINLINE) && size <= INLINESIZE) {
+    if (size < inode.size) memset(inode.data + size, 0, INLINESIZE - size);
+    inode.size = size;
+    bfsWriteInode(inum, &inode);
+    bfsUnlock();
+    return 0;
+  }
+
+  if (inode.flags & INODEINLINE) {            // grows past inline: to blocks
+    bfsUninline(inum);
+    bfsReadInode(inum, &inode);
+  }
+
+  // Zero the tail of a partial last block, so a later extension reads zeroes
+
+  if (size < inode.size && size % BYTESPERBLOCK != 0) {
+    i32 dbn = mapGet(inum, &inode, size / BYTESPERBLOCK);
+    if (dbn > 0) {                            // unwritten reads as zeroes
+      i8 buf[BYTESPERBLOCK];
+      bioRead(dbn, buf);
+      memset(buf + size % BYTESPERBLOCK, 0,
+             BYTESPERBLOCK - size % BYTESPERBLOCK);
+      bfsWriteBlock(inum, size / BYTESPERBLOCK, buf, 0);
+      bfsReadInode(inum, &inode);             // may have copied the block
+    }
+  }
+
+  FreeBatch fb;
+  fb.n = 0;
+
+  mapTrim(&inode, (size + BYTESPERBLOCK - 1) / BYTESPERBLOCK, &fb);
+  mapInval(inum);
+
+  inode.size = size;
+  bfsWriteInode(inum, &inode);
+
+  mapFlush(&fb);
+
+  bfsUnlock();
+  return 0;
+}
+
+
+
+// ============================================================================
+// Move the data of inline file 'inum' out of its Inode into a fresh block,
+// mapped at FBN 0 (no block at all if the file is empty), and clear
+// INODEINLINE.  No-op if the file is not inline.  Return 0
+// ============================================================================
+i32 bfsUninline(i32 inum) {
+
+  bfsLock();
+
+  Inode inode;
+  bfsReadInode(inum, &inode);
+  if (!(inode.flags & INODEINLINE)) { bfsUnlock(); return 0; }
+
+  i8 buf[BYTESPERBLOCK] = {0};
+  memcpy(buf, inode.data, INLINESIZE);
+
+  memset(&inode.data, 0, INLINESIZE);
+  inode.flags &= ~INODEINLINE;
+
+  if (inode.size > 0) {
+    i32 dbn = bfsFindFreeNear(bfsNear(inum, &inode, 0));
+    bioWrite(dbn, buf);
+    inode.direct[0] = dbn;
+  }
+
+  bfsWriteInode(inum, &inode);
+
+  bfsUnlock();
+  return 0;
+}
+
+
+
+// ============================================================================
+// Release the BFS metadata lock taken by bfsLock
+// ============================================================================
+void bfsUnlock() {
+  pthread_mutex_unlock(&g_vol->bfslock);
+}
+
+
+
+// ============================================================================
+// Write block 'buf' to FBN 'fbn' of file 'inum', allocating it if need be.
+// If the file is INODEDEDUP and the write covers the 'whole' block, a copy of
+// 'buf' already on disk is shared instead (and zeroes become a hole): no data
+// is written.  A block shared with other FBNs is never written in place; the
+// FBN gets a copy of its own; so is one frozen by a snapshot.  On a
+// log-structured volume, nor is any block once written back: each write
+// goes to the log (log.c).
+// Return the DBN now mapped (0 for a hole)
+// ============================================================================
+i32 bfsWriteBlock(i32 inum, i32 fbn, i8* buf, i32 whole) {
+
+  bfsLock();
+  bfsUninline(inum);
+
+  Inode inode;
+  bfsReadInode(inum, &inode);
+
+  i32 old   = mapGet(inum, &inode, fbn);      // DBN, -DBN unwritten, or 0
+  i32 dedup = whole && (inode.flags & INODEDEDUP);
+  u32 hash  = 0;
+
+  i32 dbn = dedup ? dedupFind(buf, &hash) : ENODBN;
+
+  if (dbn != ENODBN) {                        // have a copy: share it
+    if (dbn != old) {
+      if (dbn > 0) refInc(dbn);
+      if (mapSet(inum, &inode, fbn, dbn)) bfsWriteInode(inum, &inode);
+      if (old != 0) {
+        i32 drop = abs(old);
+        bfsFreeList(&drop, 1);
+      }
+    }
+    bfsUnlock();
+    return dbn;
+  }
+
+  if (old >= MINDBN && logRedirect(old)) {    // log-structured: to the log
+    dbn = logAppend(old);
+    if (mapSet(inum, &inode, fbn, dbn)) bfsWriteInode(inum, &inode);
+  } else if (old > 0 && !bfsWritable(old)) {  // shared or frozen: copy on write
+    dbn = bfsCow(old);
+    if (mapSet(inum, &inode, fbn, dbn)) bfsWriteInode(inum, &inode);
+  } else {
+    dbn = bfsAllocBlock(inum, fbn);
+  }
+
+  bioWrite(dbn, buf);
+  if (dedup) dedupAdd(dbn, hash);
+
+  bfsUnlock();
+  return dbn;
+}
+
+
+
+// ============================================================================
+// Write 'numb' bytes from 'buf' at byte 'offset' of file 'inum', inside its
+// Inode, if the file is inline and stays within INLINESIZE bytes; the size
+// grows to match.  Return 1 if so.  Otherwise move an inline file to blocks
+// (bfsUninline) and return 0, leaving the write to the caller
+// ============================================================================
+i32 bfsWriteInline(i32 inum, i32 offset, i32 numb, void* buf) {
+
+  if (offset < 0) FATAL(EBADCURS);
+  if (numb < 0)   FATAL(ENEGNUMB);
+
+  bfsLock();
+
+  Inode inode;
+  bfsReadInode(inum, &inode);
+
+  if (!(inode.flags & INODEINLINE)) { bfsUnlock(); return 0; }
+
+  if (offset + numb > INLINESIZE) {
+    bfsUninline(inum);
+    bfsUnlock();
+    return 0;
+  }
+
+  memcpy(inode.data + offset, buf, numb);
+  if (inode.size < offset + numb) inode.size = offset + numb;
+  bfsWriteInode(inum, &inode);
+
+  bfsUnlock();
+  return 1;
+}
+
+
+
+// ============================================================================
+// Update the Inodes block on disk with the info in 'inode'
+// ============================================================================
+i32 bfsWriteInode(i32 inum, Inode* inode) {
+
+  if (inum < 0)       FATAL(EBADINUM);
+  if (inum > MAXINUM) FATAL(EBADINUM);
+  if (inode == NULL)  FATAL(ENULLPTR);
+  if (snapReadOnly()) FATAL(EROFS);
+
+  i32 dbn = DBNINODES + inum / INODESPERBLOCK;
+
+  i8 buf[BYTESPERBLOCK];
+  bfsLock();
+  bioRead(dbn, buf);
+  Inode* inodes = (Inode*)buf;
+  memcpy(&inodes[inum % INODESPERBLOCK], inode, sizeof(Inode));
+  bioWrite(dbn, buf);
+  bfsUnlock();
+
+  return 0;
+}
+
+
+
+// ============================================================================
+// Return 1 if block 'dbn' may be changed in place: it is neither shared with
+// another FBN nor frozen by a snapshot.  Else 0
+// ============================================================================
+i32 bfsWritable(i32 dbn) {
+  if (dbn < MINDBN) return !snapFrozen(dbn);  // DBNDIR: never shared
+  return refGet(dbn) == 0 && !snapFrozen(dbn);
+}
@@ -1,92 +1,245 @@
-#ifndef BFS_H
-#define BFS_H
-
-// ===================================================================
-// bfs.h - API to Bothell File System
-// ===================================================================
-
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-
-#include "alias.h"
-#include "bio.h"
-#include "errors.h"
-
-#define BYTESPERBLOCK 512
-#define I16SPERBLOCK  256
-#define BLOCKSPERDISK 100
-#define BYTESPERDISK  (BLOCKSPERDISK * BYTESPERBLOCK)
-#define NUMINODES     8
-#define MAXINUM       NUMINODES - 1
-#define NUMMETA       3
-#define MINDBN        3
-#define BFSDISK       "BFSDISK"
-#define NUMDIRECT     5
-#define NUMINDIRECT   BYTESPERBLOCK / sizeof(i16)
-#define MAXFBN        NUMDIRECT + NUMINDIRECT
-#define FNAMESIZE     16
-
-#define DBNSUPER      0
-#define DBNINODES     1
-#define DBNDIR        2
-
-#define INUMTOFD      5
-
-#define NUMOFTENTRIES 20
-
-
-typedef struct {          // SuperBlock
-  i16 numBlocks;          // total # of blocks in BFSDISK = 1,000
-  i16 numInodes;          // total # of inodes = 8
-  i16 firstFree;          // DBN of first free block
-} Super;
-
-
-
-typedef struct {          // Inode
-  i32 size;               // # of bytes in file
-  i16 direct[NUMDIRECT];  // DBNs for first 5 FBNs
-  i16 indirect;           // DBN of the indirect table
-} Inode;
-
-
-
-typedef struct {          // Dir
-  char fname[NUMINODES][FNAMESIZE];
-} Dir;
-
-
-typedef struct {          // Open File Table Entry
-  i32 inum;               // inum of file. O => slot not used
-  i32 refs;               // # processes fsOpen'd this file
-  i32 curs;               // cursor into file
-} OFTE;
-
-OFTE g_oft[NUMOFTENTRIES];
-
-i32 bfsAllocBlock(i32 inum, i32 fbn);
-i32 bfsCreateFile(str fname);
-i32 bfsDerefOFT(i32 inum);
-i32 bfsExtend(i32 inum, i32 fbn);
-i32 bfsFbnToDbn(i32 inum,   i32 fbn);
-i32 bfsFdToInum(i32 fd);
-i32 bfsFindFreeBlock();
-i32 bfsFindOFTE(i32 inum);
-i32 bfsGetSize(i32 inum);
-i32 bfsInitDir();
-i32 bfsInitFreeList();
-i32 bfsInitInodes();
-i32 bfsInitOFT();
-i32 bfsInitSuper(FILE* fp);
-i32 bfsInumToFd(i32 inum);
-i32 bfsLookupFile(str fname);
-i32 bfsRead(i32 inum, i32 fbn, i8* buf);
-i32 bfsReadInode(i32 inum, Inode* inode);
-i32 bfsRefOFT(i32 inum);
-i32 bfsSetCursor(i32 inum, i32 newCurs);
-i32 bfsSetSize(i32 inum, i32 size);
-i32 bfsTell(i32 fd);
-i32 bfsWriteInode(i32 inum, Inode* inode);
-
+#ifndef BFS_H
+#define BFS_H
+
+// ===================================================================
+// bfs.h - API to Bothell File System
+// ===================================================================
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alias.h"
+#include "bio.h"
+#include "errors.h"
+
+#define BYTESPERBLOCK 512
+#define I16SPERBLOCK  256
+#define I32SPERBLOCK  128
+#define BLOCKSPERDISK 100
+#define BYTESPERDISK  (BLOCKSPERDISK * BYTESPERBLOCK)
+#define NUMINODES     32
+#define MAXINUM       NUMINODES - 1
+#define NUMMETA       9
+#define MINDBN        9
+#define BFSDISK       "BFSDISK"
+#define NUMDIRECT     5
+#define NUMINDIRECT   I32SPERBLOCK                    // FBNs under indirect
+#define NUMDINDIRECT  (I32SPERBLOCK * I32SPERBLOCK)   //   dindirect
+#define NUMTINDIRECT  (I32SPERBLOCK * NUMDINDIRECT)   //   tindirect
+#define MAXFBN        (NUMDIRECT + NUMINDIRECT + NUMDINDIRECT + NUMTINDIRECT)
+#define FNAMESIZE     60      // longest name in a directory, plus its NUL
+#define INODESIZE     64
+#define INODESPERBLOCK (BYTESPERBLOCK / INODESIZE)
+#define INODEBLOCKS   (NUMINODES / INODESPERBLOCK)
+#define INLINESIZE    (INODESIZE - 8)
+#define INODEINLINE   1       // Inode.flags: data lives in Inode.data[]
+#define INODEDIR      2       //   a directory, holding Dentrys
+#define INODEUSED     4       //   allocated.  flags == 0 => Inode is free
+#define INODEDEAD     8       //   deleted, blocks awaiting bfsReclaim
+#define INODECOMP     16      //   data compressed in clusters: see comp.c
+#define INODEDEDUP    32      //   whole blocks written are deduplicated
+#define DENTRYSIZE    64
+#define DENTPERBLOCK  (BYTESPERBLOCK / DENTRYSIZE)
+#define ROOTINUM      0       // inum of the root directory
+#define BFSVERSION    10      // on-disk format; 9 = no Super.log
+#define NUMGROUPS     INODEBLOCKS   // allocation groups: see bfsGroupOf
+#define GROUPBLOCKS   ((BLOCKSPERDISK - MINDBN + NUMGROUPS - 1) / NUMGROUPS)
+
+#define DBNSUPER      0
+#define DBNINODES     1       // INODEBLOCKS blocks of Inodes
+#define DBNDIR        5       // first block of the root directory
+#define DBNCRC        6       // CRC32C of every block: see bio.c
+#define DBNREFS       7       // reference count of every block: see ref.c
+#define DBNSNAPS      8       // table of snapshots: see snap.c
+
+#define CRCSELF       (I32SPERBLOCK - 1)  // DBNCRC slot holding its own CRC
+
+#define INUMTOFD      5
+
+#define NUMOFTENTRIES 20
+
+#define RECLAIMASYNC  16      // deletes bigger than this (blocks) go async
+#define RECLAIMBATCH  256     // FBNs freed per reclaim step
+#define NUMRECLAIM    NUMINODES
+
+#define DEFRAGBATCH   32      // blocks per bfsDefrag copy I/O
+
+#define CLUSTERBLOCKS 4       // FBNs per compressed cluster
+#define CLUSTERSIZE   (CLUSTERBLOCKS * BYTESPERBLOCK)
+#define NUMCDIRECT    13      // cluster entries held in the Inode
+#define MAXCLUSTER    (NUMCDIRECT + I32SPERBLOCK)   // + one cluster table
+
+
+typedef struct {          // Group: free space of one allocation group
+  i32 firstFree;          // DBN of first free block
+  i32 freeRun;            // # free blocks in the run at firstFree. 0 => read
+                          //   it from the FreeRun header in block firstFree
+  i32 nextFree;           // DBN of the run after firstFree's (if freeRun > 0)
+  i32 free;               // # free blocks in the group
+} Group;
+
+
+
+typedef struct {          // SuperBlock
+  i32 numBlocks;          // total # of blocks in BFSDISK = 1,000
+  i32 numInodes;          // total # of inodes = 8
+  i32 numGroups;          // # allocation groups = NUMGROUPS
+  i32 groupBlocks;        // # data blocks per group = GROUPBLOCKS
+  i32 rotor;              // group the last new file went to
+  i32 version;            // on-disk format = BFSVERSION
+  i32 gen;                // generation: bumped by each snapshot
+  i32 log;                // 1 => log-structured: see log.c
+  Group groups[NUMGROUPS];  // a Freelist per group
+} Super;
+
+// The data blocks, MINDBN on, are split into NUMGROUPS allocation groups of
+// GROUPBLOCKS blocks (the last one clipped), each with its own Freelist.
+// Group g also owns the Inodes in block DBNINODES + g.  A new file goes to
+// the group with most free space; its blocks come from its own group, next
+// to the block before them, so a file stays together, and files written at
+// once do not interleave.  A run of free blocks never spans two groups.
+// Groups buy locality and spread, not parallel allocation: every allocation
+// still runs under the BFS lock, which its callers hold anyway, to update
+// the map or Inode
+
+
+
+typedef struct {          // FreeRun: header of a run of contiguous free blocks
+  i32 next;               // DBN of the next run in the Freelist. 0 => end
+  i32 count;              // # blocks in this run.  0 => 1
+} FreeRun;
+
+
+
+typedef struct {          // Inode
+  i32 size;               // # of bytes in file
+  i32 flags;              // INODEINLINE, INODEDIR, INODEUSED, INODEDEAD,
+                          //   INODECOMP, INODEDEDUP
+  union {
+    struct {
+      i32 direct[NUMDIRECT];  // DBNs for first 5 FBNs
+      i32 indirect;           // DBN of the indirect table
+      i32 dindirect;          // DBN of the double-indirect table
+      i32 tindirect;          // DBN of the triple-indirect table
+    };
+    struct {                  // for an INODECOMP file:
+      i32 clusters[NUMCDIRECT];   // entries for the first 13 clusters
+      i32 ctable;                 // DBN of the table of entries for the rest
+    };
+    i8 data[INLINESIZE];      // the file itself, for an INODEINLINE file.
+  };                          //   Bytes past 'size' are kept zero
+} Inode;
+
+_Static_assert(sizeof(Inode) == INODESIZE, "Inodes must tile a block");
+
+// A file starts out INODEINLINE, and moves to a block (FBN 0) the first time
+// it outgrows INLINESIZE bytes; see bfsUninline
+
+// A DBN entry in direct[] or a leaf map table is 0 for a hole, and -DBN for a
+// block preallocated by bfsFallocate but not yet written (reads as zeroes).
+// See map.c for how FBNs are found in the tables
+
+// An INODECOMP file has no per-FBN map.  Each run of CLUSTERBLOCKS FBNs is
+// stored, compressed, in 1 to CLUSTERBLOCKS contiguous blocks, found through
+// a cluster entry; see comp.c
+
+// A block may be shared, by dedup (see ref.c), or frozen, by a snapshot (see
+// snap.c).  Either way it must not be changed in place: bfsCow gives the
+// writer a block of its own first
+
+
+
+typedef struct {          // Dentry: one slot in a directory block
+  i32  inum;              // inum named.  0 => slot free (0 is the root)
+  char name[FNAMESIZE];
+} Dentry;
+
+_Static_assert(sizeof(Dentry) == DENTRYSIZE, "Dentrys must tile a block");
+
+_Static_assert(BLOCKSPERDISK <= CRCSELF, "DBNCRC must hold a CRC for every DBN");
+
+
+typedef struct {          // Open File Table Entry
+  i32 inum;               // inum of file. O => slot not used
+  i32 refs;               // # processes fsOpen'd this file
+  i32 curs;               // cursor into file
+} OFTE;
+
+typedef struct BfsVolume BfsVolume;   // see vol.h
+
+typedef struct {          // Reclaim queue: deleted files awaiting block frees
+  i32 inums[NUMRECLAIM];  // ring of inums
+  i32 head;               // next inum to reclaim
+  i32 count;              // # inums queued
+  i32 busy;               // 1 => reclaim thread is freeing a file
+  i32 started;            // 1 => reclaim thread is running
+  i32 stop;               // 1 => reclaim thread must exit, at unmount
+  pthread_mutex_t lock;
+  pthread_cond_t  wake;   // signalled when work is queued
+  pthread_cond_t  idle;   // signalled when the queue drains
+  pthread_t       thread;
+} Reclaim;
+
+
+i32 bfsAllocBlock(i32 inum, i32 fbn);
+i32 bfsAllocInode(i32 flags);
+i32 bfsAllocRun(i32 want, i32 near, i32* pdbn);
+void bfsCheckRun(i32 dbn, FreeRun* run);
+i32 bfsCopy(i32 sinum, i32 dinum, i32 offset, i32 len);
+i32 bfsCow(i32 dbn);
+i32 bfsCreateFile(str path);
+i32 bfsDefrag(i32 inum);
+i32 bfsDeleteFile(str path);
+i32 bfsDerefOFT(i32 inum);
+i32 bfsExtend(i32 inum, i32 fbn);
+i32 bfsFallocate(i32 inum, i32 offset, i32 len, i32 zero);
+i32 bfsFbnToDbn(i32 inum,   i32 fbn);
+i32 bfsFdToInum(i32 fd);
+i32 bfsFindFreeBlock();
+i32 bfsFindFreeNear(i32 near);
+i32 bfsFindInum(str path);
+i32 bfsFindOFTE(i32 inum);
+i32 bfsFragScore(i32 inum, i32* pextents, i32* pblocks);
+i32 bfsFreeBlocks();
+i32 bfsFreeList(i32* dbns, i32 n);
+i32 bfsFreeRuns(i32* dbns, i32 n);
+i32 bfsGetSize(i32 inum);
+i32 bfsGroupOf(i32 dbn);
+i32 bfsGroupPick(Super* super);
+i32 bfsInitDir(FILE* fp);
+i32 bfsInitFreeList();
+i32 bfsInitInodes(FILE* fp);
+i32 bfsInitOFT();
+i32 bfsInitSuper(FILE* fp);
+i32 bfsInumToFd(i32 inum);
+void bfsLock();
+void bfsLockInit();
+i32 bfsLookupFile(str path);
+i32 bfsMakeDir(str path);
+i32 bfsMapRun(i32 inum, i32 fbn, i32 max, i32* pdbn);
+i32 bfsNear(i32 inum, Inode* inode, i32 fbn);
+i32 bfsRead(i32 inum, i32 fbn, i8* buf);
+i32 bfsReadInode(i32 inum, Inode* inode);
+i32 bfsReclaim(i32 inum);
+i32 bfsReclaimDrain();
+void* bfsReclaimMain(void* arg);
+i32 bfsReclaimQueue(i32 inum);
+i32 bfsReclaimRecover();
+i32 bfsReclaimStop();
+i32 bfsRefOFT(i32 inum);
+i32 bfsSeekData(i32 inum, i32 offset);
+i32 bfsSeekHole(i32 inum, i32 offset);
+i32 bfsSetCursor(i32 inum, i32 newCurs);
+i32 bfsSetSize(i32 inum, i32 size);
+i32 bfsTell(i32 fd);
+i32 bfsTruncate(i32 inum, i32 size);
+i32 bfsUninline(i32 inum);
+void bfsUnlock();
+i32 bfsWriteBlock(i32 inum, i32 fbn, i8* buf, i32 whole);
+i32 bfsWriteInline(i32 inum, i32 offset, i32 numb, void* buf);
+i32 bfsWriteInode(i32 inum, Inode* inode);
+i32 bfsWritable(i32 dbn);
+
 #endif
\ No newline at end of file
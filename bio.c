@@ -1,49 +1,434 @@
-// ============================================================================
-// bio.c - low level Block IO functions
-// ============================================================================
-
-#include "bfs.h"
-#include "bio.h"
-
-// ============================================================================
-// Read 512 bytes from block number 'dbn' in the BFS disk into buffer 'buf'
-// ============================================================================
-i32 bioRead(i32 dbn, void* buf) {
-
-  if (dbn < 0)             FATAL(EBADDBN);
-  if (dbn > BLOCKSPERDISK) FATAL(EBADDBN);
-
-  FILE* fp = fopen(BFSDISK, "rb+");
-  if (fp == NULL) FATAL(ENODISK);
-
-  i32 boff = dbn * BYTESPERBLOCK;
-  i32 ret  = fseek(fp, boff, SEEK_SET);
-  if (ret != 0) { fclose(fp); FATAL(ret); }
-
-  i32 numb = fread(buf, 1, BYTESPERBLOCK, fp);
-  if (numb != BYTESPERBLOCK) { fclose(fp); FATAL(EBADREAD); }
-
-  fclose(fp);
-  return 0;
-}
-
-
-// ============================================================================
-// Write 512 bytes from 'buf' into block number 'dbn' of the BFS disk
-// ============================================================================
-i32 bioWrite(i32 dbn, void* buf) {
-
-  FILE* fp = fopen(BFSDISK, "rb+");
-  if (fp == NULL) FATAL(ENODISK);
-
-  i32 boff = dbn * BYTESPERBLOCK;
-  i32 ret  = fseek(fp, boff, SEEK_SET);
-  if (ret != 0) { fclose(fp); FATAL(ret); }
-
-  i32 numb = fwrite(buf, 1, BYTESPERBLOCK, fp);
-  if (numb != BYTESPERBLOCK) { fclose(fp); FATAL(EBADWRITE); }
-
-  fclose(fp);
-
-  return 0;
-}
+// ============================================================================
+// bio.c - low level Block IO functions.  A volume is one disk image, or is
+// striped (RAID-0) over several: DBNs go round the members 'stripe' blocks
+// at a time.  A run of blocks that spans members is split, and each member's
+// share is read or written by a thread of its own, all at once.  Writes are
+// held back, dirty, and written later (see wb.c)
+// ============================================================================
+
+#include "bfs.h"
+#include "bio.h"
+#include "cache.h"
+#include "crc.h"
+#include "vol.h"
+#include "wb.h"
+
+int fsync(int fd);                          // <unistd.h>, whose pause()
+                                            //   clashes with errors.h's
+
+__thread i32 g_crcWriting = 0;              // 1 => in bioCrcFlush's write
+
+
+
+// ============================================================================
+// Check 'count' blocks at 'buf', just read from DBN 'dbn', against their
+// recorded CRCs.  Return 0, or EBADCRC if one does not match: the block is
+// torn or corrupt
+// ============================================================================
+i32 bioCrcCheck(i32 dbn, i32 count, void* buf) {
+  u32 crcs[count];
+  for (i32 i = 0; i < count; ++i) {
+    crcs[i] = crc32c((i8*)buf + i * BYTESPERBLOCK, BYTESPERBLOCK);
+  }
+
+  i32 ret = 0;
+  pthread_mutex_lock(&g_vol->crclock);
+  bioCrcLoad();
+  for (i32 i = 0; i < count && ret == 0; ++i) {
+    if (dbn + i == DBNCRC) continue;            // sealed by CRCSELF instead
+    if (g_vol->crctab[dbn + i] != crcs[i]) ret = EBADCRC;
+  }
+  pthread_mutex_unlock(&g_vol->crclock);
+  return ret;
+}
+
+
+
+// ============================================================================
+// Write the checksum table to DBNCRC, sealed with its own CRC.  Caller holds
+// g_vol->crclock.  The write may be throttled into a writeback flush, which
+// must then not come back for the table: g_crcWriting tells bioCrcSync
+// ============================================================================
+i32 bioCrcFlush() {
+  g_vol->crctab[CRCSELF] = crc32c(g_vol->crctab, CRCSELF * sizeof(u32));
+  g_vol->crcDirty = 0;
+  g_crcWriting = 1;
+  i32 ret = bioWriteRaw(DBNCRC, 1, g_vol->crctab);
+  g_crcWriting = 0;
+  return ret;
+}
+
+
+
+// ============================================================================
+// Start a fresh checksum table for a newly formatted disk, on which every
+// block not yet written reads as zeroes
+// ============================================================================
+i32 bioCrcFormat() {
+  i8  zeroes[BYTESPERBLOCK] = {0};
+  u32 crc = crc32c(zeroes, BYTESPERBLOCK);
+
+  pthread_mutex_lock(&g_vol->crclock);
+  memset(g_vol->crctab, 0, sizeof(g_vol->crctab));
+  for (i32 dbn = 0; dbn < BLOCKSPERDISK; ++dbn) g_vol->crctab[dbn] = crc;
+  g_vol->crcLoaded = 1;
+  bioCrcFlush();
+  pthread_mutex_unlock(&g_vol->crclock);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Read the checksum table from DBNCRC, if not already in memory.  Abort if
+// the table itself is corrupt.  Caller holds g_vol->crclock
+// ============================================================================
+i32 bioCrcLoad() {
+  if (g_vol->crcLoaded) return 0;
+
+  bioReadRaw(DBNCRC, 1, g_vol->crctab);
+  if (crc32c(g_vol->crctab, CRCSELF * sizeof(u32)) != g_vol->crctab[CRCSELF]) {
+    pthread_mutex_unlock(&g_vol->crclock);
+    FATAL(EBADCRC);
+  }
+  g_vol->crcLoaded = 1;
+  return 0;
+}
+
+
+
+// ============================================================================
+// Forget the in-memory checksum table, so it is re-read from the disk, once
+// any changes to it are written.  Called at mount
+// ============================================================================
+i32 bioCrcReset() {
+  pthread_mutex_lock(&g_vol->crclock);
+  if (g_vol->crcLoaded && g_vol->crcDirty) bioCrcFlush();
+  g_vol->crcLoaded = 0;
+  pthread_mutex_unlock(&g_vol->crclock);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Write the checksum table to DBNCRC, if it has changed since it was last
+// written.  Called by wbFlush at the start of every writeback pass, so the
+// table goes out with the blocks it covers, and at unmount
+// ============================================================================
+i32 bioCrcSync() {
+  if (g_crcWriting) return 0;                   // the table is on its way
+  pthread_mutex_lock(&g_vol->crclock);
+  if (g_vol->crcLoaded && g_vol->crcDirty) bioCrcFlush();
+  pthread_mutex_unlock(&g_vol->crclock);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Record the CRCs of 'count' blocks at 'buf', about to be written from DBN
+// 'dbn'.  The table is only marked dirty: it reaches DBNCRC at the next
+// bioCrcSync, so a run of writes costs one write of the table, not one each
+// ============================================================================
+i32 bioCrcUpdate(i32 dbn, i32 count, void* buf) {
+  u32 crcs[count];
+  for (i32 i = 0; i < count; ++i) {
+    crcs[i] = crc32c((i8*)buf + i * BYTESPERBLOCK, BYTESPERBLOCK);
+  }
+
+  pthread_mutex_lock(&g_vol->crclock);
+  bioCrcLoad();
+  for (i32 i = 0; i < count; ++i) g_vol->crctab[dbn + i] = crcs[i];
+  g_vol->crcDirty = 1;
+  pthread_mutex_unlock(&g_vol->crclock);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Check 'count' blocks at 'buf', just read from DBN 'dbn', against their
+// recorded CRCs, as bioCrcCheck.  Abort on a mismatch
+// ============================================================================
+i32 bioCrcVerify(i32 dbn, i32 count, void* buf) {
+  if (bioCrcCheck(dbn, count, buf) != 0) FATAL(EBADCRC);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Create every disk image of the volume, each empty and at its full size.
+// Called at format
+// ============================================================================
+i32 bioCreate() {
+  wbReset();                                    // old contents are going
+  for (i32 m = 0; m < g_vol->nmembers; ++m) {
+    FILE* fp = fopen(g_vol->members[m], "w+b");
+    if (fp == NULL) FATAL(EDISKCREATE);
+    fclose(fp);
+  }
+
+  i32 last[VOLMEMBERS] = {0};                   // highest block, per member
+  for (i32 dbn = 0; dbn < BLOCKSPERDISK; ++dbn) {
+    i32 m;
+    i32 mbn = bioLocate(dbn, &m);
+    if (mbn > last[m]) last[m] = mbn;
+  }
+
+  i8 zeroes[BYTESPERBLOCK] = {0};
+  for (i32 m = 0; m < g_vol->nmembers; ++m) {
+    i32 ret = bioFileIO(g_vol->members[m], last[m], 1, zeroes, 1);
+    if (ret != 0) FATAL(ret);
+  }
+  return 0;
+}
+
+
+
+// ============================================================================
+// Read (or, if 'write', write) 'count' contiguous blocks at 'buf' from block
+// 'mbn' of the disk image 'path', in a single I/O.  Return 0, or the error
+// ============================================================================
+i32 bioFileIO(str path, i32 mbn, i32 count, void* buf, i32 write) {
+  FILE* fp = fopen(path, "rb+");
+  if (fp == NULL) return ENODISK;
+
+  i32 boff = mbn * BYTESPERBLOCK;
+  i32 ret  = fseek(fp, boff, SEEK_SET);
+  if (ret != 0) { fclose(fp); return ret; }
+
+  i32 numb = write ? fwrite(buf, 1, count * BYTESPERBLOCK, fp)
+                   : fread (buf, 1, count * BYTESPERBLOCK, fp);
+  fclose(fp);
+  if (numb != count * BYTESPERBLOCK) return write ? EBADWRITE : EBADREAD;
+  return 0;
+}
+
+
+
+// ============================================================================
+// Do the pieces of one member's share of a striped I/O: the body of a thread
+// from bioStripeIO.  'arg' is the BioJob
+// ============================================================================
+void* bioJob(void* arg) {
+  BioJob* job = (BioJob*)arg;
+  for (i32 p = 0; p < job->npieces && job->err == 0; ++p) {
+    BioPiece* pc = &job->pieces[p];
+    job->err = bioFileIO(job->path, pc->mbn, pc->count, pc->buf, job->write);
+  }
+  return NULL;
+}
+
+
+
+// ============================================================================
+// Return where DBN 'dbn' lives: its block number within its member, whose
+// index goes in '*pmember'
+// ============================================================================
+i32 bioLocate(i32 dbn, i32* pmember) {
+  i32 unit = dbn / g_vol->stripe;
+  *pmember = unit % g_vol->nmembers;
+  return (unit / g_vol->nmembers) * g_vol->stripe + dbn % g_vol->stripe;
+}
+
+
+
+// ============================================================================
+// Read 512 bytes from block number 'dbn' in the BFS disk into buffer 'buf',
+// and verify its checksum.  Served from the block cache if it can be; the
+// metadata blocks before MINDBN are cached as metadata
+// ============================================================================
+i32 bioRead(i32 dbn, void* buf) {
+  return bioReadPrio(dbn, buf, dbn < MINDBN ? CACHEMETA : CACHEDATA);
+}
+
+
+
+// ============================================================================
+// Read metadata block 'dbn' (a map, directory or cluster table) into 'buf',
+// as bioRead does, but cached as metadata: kept over file data
+// ============================================================================
+i32 bioReadMeta(i32 dbn, void* buf) {
+  return bioReadPrio(dbn, buf, CACHEMETA);
+}
+
+
+
+// ============================================================================
+// Read block 'dbn' into 'buf' through the block cache, at priority 'prio',
+// verifying its checksum on a miss
+// ============================================================================
+i32 bioReadPrio(i32 dbn, void* buf, i32 prio) {
+  u32 seq;
+  if (cacheLookup(dbn, buf, prio, &seq)) return 0;
+  bioReadRaw(dbn, 1, buf);
+  bioCrcVerify(dbn, 1, buf);
+  return cacheFill(dbn, buf, prio, seq);
+}
+
+
+
+// ============================================================================
+// Read 'count' contiguous blocks, starting at block number 'dbn', from the
+// BFS disk into 'buf', in a single I/O, and verify their checksums.  They
+// are cached at low priority (CACHESCAN), as a bulk read
+// ============================================================================
+i32 bioReadRun(i32 dbn, i32 count, void* buf) {
+  u32 seq = cacheSeq();
+  bioReadRaw(dbn, count, buf);
+  bioCrcVerify(dbn, count, buf);
+  for (i32 i = 0; i < count; ++i) {             // low priority: a bulk read
+    cacheFill(dbn + i, (i8*)buf + i * BYTESPERBLOCK, CACHESCAN, seq);
+  }
+  return 0;
+}
+
+
+
+// ============================================================================
+// Read 'count' contiguous blocks, starting at block number 'dbn', from the
+// BFS disk into 'buf', in a single I/O.  No checksum verify: for the table
+// itself, and for callers that check the data some other way
+// ============================================================================
+i32 bioReadRaw(i32 dbn, i32 count, void* buf) {
+
+  if (dbn < 0)                      FATAL(EBADDBN);
+  if (count < 1)                    FATAL(EBADDBN);
+  if (dbn + count > BLOCKSPERDISK)  FATAL(EBADDBN);
+
+  i32 ret = wbRead(dbn, count, buf);            // dirty blocks, or the disk
+  if (ret != 0) FATAL(ret);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Read (or, if 'write', write) 'count' contiguous blocks at 'buf', from DBN
+// 'dbn' on.  On a single disk image that is one I/O.  On a stripe set, each
+// member gets its share as a list of pieces, one per stripe unit touched,
+// and every member but the first is handed to a thread, so they all run at
+// once.  Return 0, or the first error
+// ============================================================================
+i32 bioStripeIO(i32 dbn, i32 count, void* buf, i32 write) {
+  if (g_vol->nmembers == 1) {
+    return bioFileIO(g_vol->path, dbn, count, buf, write);
+  }
+
+  i32      n = g_vol->nmembers;
+  BioJob   jobs[n];
+  BioPiece pieces[n][count / g_vol->stripe + 2];
+
+  for (i32 m = 0; m < n; ++m) {
+    jobs[m] = (BioJob){ .path = g_vol->members[m], .write = write,
+                        .pieces = pieces[m] };
+  }
+
+  for (i32 done = 0; done < count; ) {          // split at stripe units
+    i32 m;
+    i32 mbn  = bioLocate(dbn + done, &m);
+    i32 take = g_vol->stripe - (dbn + done) % g_vol->stripe;
+    if (take > count - done) take = count - done;
+    jobs[m].pieces[jobs[m].npieces++] =
+      (BioPiece){ mbn, take, (i8*)buf + done * BYTESPERBLOCK };
+    done += take;
+  }
+
+  i32 first = -1;                               // done here, not by a thread
+  for (i32 m = 0; m < n; ++m) {
+    if (jobs[m].npieces == 0) continue;
+    if (first < 0) { first = m; continue; }
+    jobs[m].started = !pthread_create(&jobs[m].thread, NULL, bioJob, &jobs[m]);
+    if (!jobs[m].started) bioJob(&jobs[m]);     // no thread: do it inline
+  }
+  bioJob(&jobs[first]);
+
+  i32 err = 0;
+  for (i32 m = 0; m < n; ++m) {
+    if (jobs[m].started) pthread_join(jobs[m].thread, NULL);
+    if (err == 0) err = jobs[m].err;
+  }
+  return err;
+}
+
+
+
+// ============================================================================
+// Make the calling thread's volume a stripe set over the 'n' disk images
+// 'paths', in order, 'unit' blocks per stripe unit.  The first is the
+// volume's own path.  Abort if 'n' is over VOLMEMBERS, 'unit' < 1, or a path
+// is too long
+// ============================================================================
+i32 bioStripeSet(i32 n, str* paths, i32 unit) {
+  if (n < 1 || n > VOLMEMBERS || unit < 1) FATAL(EBADSTRIPE);
+  for (i32 m = 0; m < n; ++m) {
+    if (strlen(paths[m]) >= VOLPATHSIZE) FATAL(EBADSTRIPE);
+    strcpy(g_vol->members[m], paths[m]);
+  }
+  g_vol->nmembers = n;
+  g_vol->stripe   = unit;
+  return 0;
+}
+
+
+
+// ============================================================================
+// Flush every write so far from the OS to the BFS disk itself (fsync), on
+// every disk image of a stripe set: a durability barrier.  Writes after it
+// cannot reach the disk before those ahead of it
+// ============================================================================
+i32 bioSync() {
+  wbFlush();                                    // checksum table, and blocks
+  for (i32 m = 0; m < g_vol->nmembers; ++m) {
+    FILE* fp = fopen(g_vol->members[m], "rb+");
+    if (fp == NULL) FATAL(ENODISK);
+    i32 ret = fsync(fileno(fp));
+    fclose(fp);
+    if (ret != 0) FATAL(EBADWRITE);
+  }
+  return 0;
+}
+
+
+
+// ============================================================================
+// Write 512 bytes from 'buf' into block number 'dbn' of the BFS disk, and
+// record its checksum, first, so the table holds it before the block can be
+// written back.  The block cache is kept in step
+// ============================================================================
+i32 bioWrite(i32 dbn, void* buf) {
+  bioCrcUpdate(dbn, 1, buf);
+  bioWriteRaw(dbn, 1, buf);
+  return cacheWrite(dbn, 1, buf);
+}
+
+
+
+// ============================================================================
+// Write 'count' contiguous blocks from 'buf' into the BFS disk, starting at
+// block number 'dbn', in a single I/O, and record their checksums, first, as
+// bioWrite.  The block cache is kept in step
+// ============================================================================
+i32 bioWriteRun(i32 dbn, i32 count, void* buf) {
+  bioCrcUpdate(dbn, count, buf);
+  bioWriteRaw(dbn, count, buf);
+  return cacheWrite(dbn, count, buf);
+}
+
+
+
+// ============================================================================
+// Write 'count' contiguous blocks from 'buf' into the BFS disk, starting at
+// block number 'dbn'.  They are held dirty, and reach the disk later, merged
+// with their neighbours.  No checksum update
+// ============================================================================
+i32 bioWriteRaw(i32 dbn, i32 count, void* buf) {
+
+  if (dbn < 0)                      FATAL(EBADDBN);
+  if (count < 1)                    FATAL(EBADDBN);
+  if (dbn + count > BLOCKSPERDISK)  FATAL(EBADDBN);
+
+  return wbWrite(dbn, count, buf);              // written back later
+}
@@ -1,16 +1,56 @@
-#ifndef BIO_H
-#define BIO_H
-
-// ===================================================================
-// bio.h - Block IO interface.  Simulates kernel-mode read and write
-// functions to the BFS disk
-// ===================================================================
-
-#include <stdio.h>
-
-#include "alias.h"
-
-i32 bioRead (i32 dbn, void* buf);
-i32 bioWrite(i32 dbn, void* buf);
-
-#endif
\ No newline at end of file
+#ifndef BIO_H
+#define BIO_H
+
+// ===================================================================
+// bio.h - Block IO interface.  Simulates kernel-mode read and write
+// functions to the BFS disk.  Every block's CRC32C is kept in block
+// DBNCRC: bioRead* verify it, bioWrite* update it in memory, and
+// every writeback flush writes the table ahead of the blocks
+// ===================================================================
+
+#include <pthread.h>
+#include <stdio.h>
+
+#include "alias.h"
+
+typedef struct {          // BioPiece: one stripe unit's worth of an I/O
+  i32 mbn;                // first block, within the member
+  i32 count;              // # blocks
+  i8* buf;
+} BioPiece;
+
+typedef struct {          // BioJob: one member's share of a striped I/O
+  str       path;         // member disk image
+  i32       write;        // 1 => write; 0 => read
+  i32       npieces;
+  BioPiece* pieces;
+  i32       err;          // first error, or 0
+  i32       started;      // 1 => 'thread' is doing it
+  pthread_t thread;
+} BioJob;
+
+i32 bioCrcCheck (i32 dbn, i32 count, void* buf);
+i32 bioCrcFlush ();
+i32 bioCrcFormat();
+i32 bioCrcLoad  ();
+i32 bioCrcReset ();
+i32 bioCrcSync  ();
+i32 bioCrcUpdate(i32 dbn, i32 count, void* buf);
+i32 bioCrcVerify(i32 dbn, i32 count, void* buf);
+i32 bioCreate  ();
+i32 bioFileIO  (str path, i32 mbn, i32 count, void* buf, i32 write);
+void* bioJob   (void* arg);
+i32 bioLocate  (i32 dbn, i32* pmember);
+i32 bioRead    (i32 dbn, void* buf);
+i32 bioReadMeta(i32 dbn, void* buf);
+i32 bioReadPrio(i32 dbn, void* buf, i32 prio);
+i32 bioReadRaw (i32 dbn, i32 count, void* buf);
+i32 bioReadRun (i32 dbn, i32 count, void* buf);
+i32 bioStripeIO(i32 dbn, i32 count, void* buf, i32 write);
+i32 bioStripeSet(i32 n, str* paths, i32 unit);
+i32 bioSync    ();
+i32 bioWrite   (i32 dbn, void* buf);
+i32 bioWriteRaw(i32 dbn, i32 count, void* buf);
+i32 bioWriteRun(i32 dbn, i32 count, void* buf);
+
+#endif
@@ -0,0 +1,348 @@
+// ============================================================================
+// cache.c - Block cache.  CACHESLOTS blocks, found by a scan on DBN (the
+// cache is small).  Every page handed out is pinned; a pinned page is never
+// evicted, and never changes: when a block that is pinned is rewritten, its
+// page is detached from the DBN (readers holding it keep the bytes they
+// were lent) and goes free on the last cachePut.  Unpinned pages are updated
+// by bioWrite, so the cache never serves stale data.  Pages are filled by
+// bioRead, so a page has had its checksum verified.
+//
+// Replacement is 2Q.  A block read for the first time goes on A1in, a FIFO
+// held to CACHEKIN pages; evicted from there, its DBN is remembered on A1out
+// (the ghosts).  A block read again while a ghost has proven itself, and
+// goes on Am, an LRU.  So a scan, whose blocks are each read once, churns
+// A1in and never pushes out Am.  Metadata goes on a third LRU, evicted only
+// when nothing else can be; blocks read in bulk (CACHESCAN) leave no ghost
+// ============================================================================
+
+#include "bio.h"
+#include "cache.h"
+#include "vol.h"
+
+
+
+// ============================================================================
+// Mark every slot free (zeroed slots would claim DBN 0), and forget every
+// ghost.  Run once, before the first use
+// ============================================================================
+void cacheInit() {
+  for (i32 s = 0; s < CACHESLOTS;  ++s) g_vol->cache[s].dbn = CACHENONE;
+  for (i32 g = 0; g < CACHEGHOSTS; ++g) g_vol->cacheghosts[g] = CACHENONE;
+}
+
+
+
+// ============================================================================
+// Claim a slot for new contents: a free one, else a victim that is not
+// pinned.  Under 2Q: the oldest on A1in, if it holds over CACHEKIN pages;
+// else the least recently used on Am; else on A1in; else metadata.  Under
+// LRU: the least recently used.  Return its index, pinned once and detached,
+// or ECACHEFULL if every slot is pinned.  Caller holds g_vol->cachelock
+// ============================================================================
+i32 cacheClaim() {
+  i32 oldest[3] = { ECACHEFULL, ECACHEFULL, ECACHEFULL };   // by queue
+  i32 lru       = ECACHEFULL;
+  i32 nin       = 0;
+  i32 victim    = ECACHEFULL;
+
+  for (i32 s = 0; s < CACHESLOTS; ++s) {
+    CacheSlot* cs = &g_vol->cache[s];
+    if (cs->dbn != CACHENONE && cs->queue == CACHEQIN) ++nin;
+    if (cs->pins > 0) continue;
+    if (cs->dbn == CACHENONE) { victim = s; break; }
+    i32* o = &oldest[cs->queue];
+    if (*o < 0 || cs->tick < g_vol->cache[*o].tick) *o = s;
+    if (lru < 0 || cs->tick < g_vol->cache[lru].tick) lru = s;
+  }
+
+  if (victim < 0 && g_vol->cachepolicy == CACHELRU) {
+    victim = lru;
+  } else if (victim < 0) {
+    if      (nin > CACHEKIN && oldest[CACHEQIN] >= 0) victim = oldest[CACHEQIN];
+    else if (oldest[CACHEQMAIN] >= 0)                 victim = oldest[CACHEQMAIN];
+    else if (oldest[CACHEQIN]   >= 0)                 victim = oldest[CACHEQIN];
+    else                                              victim = oldest[CACHEQMETA];
+  }
+  if (victim < 0) return ECACHEFULL;
+
+  CacheSlot* cs = &g_vol->cache[victim];
+  if (cs->dbn != CACHENONE && cs->queue == CACHEQIN && !cs->scan) {
+    g_vol->cacheghosts[g_vol->cacheghostnext] = cs->dbn;    // onto A1out
+    g_vol->cacheghostnext = (g_vol->cacheghostnext + 1) % CACHEGHOSTS;
+  }
+
+  cs->dbn  = CACHENONE;
+  cs->pins = 1;
+  cs->tick = ++g_vol->cachetick;
+  return victim;
+}
+
+
+
+// ============================================================================
+// Return the bytes of cache page 'slot', which the caller has pinned
+// ============================================================================
+i8* cacheData(i32 slot) {
+  if (slot < 0 || slot >= CACHESLOTS) FATAL(EBADDBN);
+  return g_vol->cache[slot].data;
+}
+
+
+
+// ============================================================================
+// Cache block 'dbn', just read (and verified) into 'buf', at priority 'prio'
+// (CACHESCAN, CACHEDATA or CACHEMETA), unless it is cached already, or some
+// block has been written since cacheLookup handed out 'seq' (the bytes may be
+// stale).  Return 0
+// ============================================================================
+i32 cacheFill(i32 dbn, void* buf, i32 prio, u32 seq) {
+  pthread_mutex_lock(&g_vol->cachelock);
+  if (seq == g_vol->cacheseq && cacheFind(dbn) < 0) {
+    i32 s = cacheClaim();
+    if (s >= 0) {
+      memcpy(g_vol->cache[s].data, buf, BYTESPERBLOCK);
+      cachePlace(s, dbn, prio);
+      g_vol->cache[s].pins = 0;
+    }
+  }
+  pthread_mutex_unlock(&g_vol->cachelock);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Return the slot holding block 'dbn', or -1.  Caller holds g_vol->cachelock
+// ============================================================================
+i32 cacheFind(i32 dbn) {
+  for (i32 s = 0; s < CACHESLOTS; ++s) {
+    if (g_vol->cache[s].dbn == dbn) return s;
+  }
+  return -1;
+}
+
+
+
+// ============================================================================
+// Pin block 'dbn' in the cache, reading it in if need be.  Return its slot,
+// for cacheData and cachePut; or ECACHEFULL if every slot is pinned
+// ============================================================================
+i32 cacheGet(i32 dbn) {
+
+  if (dbn < 0 || dbn >= BLOCKSPERDISK) FATAL(EBADDBN);
+
+  pthread_once(&g_vol->cacheOnce, cacheInit);
+
+  i8 buf[BYTESPERBLOCK];
+  for (i32 pass = 0; pass < 2; ++pass) {
+    pthread_mutex_lock(&g_vol->cachelock);
+    i32 s = cacheFind(dbn);
+    if (s >= 0) {                               // hit
+      ++g_vol->cache[s].pins;
+      cacheTouch(s);
+      pthread_mutex_unlock(&g_vol->cachelock);
+      return s;
+    }
+    if (pass == 1) {                            // not kept: take a page
+      s = cacheClaim();
+      if (s >= 0) {
+        memcpy(g_vol->cache[s].data, buf, BYTESPERBLOCK);
+        cachePlace(s, dbn, CACHEDATA);
+      }
+      pthread_mutex_unlock(&g_vol->cachelock);
+      return s;
+    }
+    pthread_mutex_unlock(&g_vol->cachelock);
+    bioRead(dbn, buf);                          // miss: usually fills it
+  }
+  return ECACHEFULL;
+}
+
+
+
+// ============================================================================
+// Look up block 'dbn', for a read at priority 'prio'.  On a hit, copy it to
+// 'buf' and return 1.  On a miss, return 0, storing in '*pseq' the token to
+// pass to cacheFill once the block is read
+// ============================================================================
+i32 cacheLookup(i32 dbn, void* buf, i32 prio, u32* pseq) {
+  pthread_once(&g_vol->cacheOnce, cacheInit);
+  pthread_mutex_lock(&g_vol->cachelock);
+
+  CacheStats* st = &g_vol->cachestats;
+  i32         s  = cacheFind(dbn);
+  if (s >= 0) {
+    memcpy(buf, g_vol->cache[s].data, BYTESPERBLOCK);
+    cacheTouch(s);
+    ++st->hits;
+    if (prio == CACHEMETA) ++st->metahits;
+  } else {
+    *pseq = g_vol->cacheseq;
+    ++st->misses;
+    if (prio == CACHEMETA) ++st->metamisses;
+  }
+
+  pthread_mutex_unlock(&g_vol->cachelock);
+  return s >= 0;
+}
+
+
+
+// ============================================================================
+// Pin a page that belongs to no DBN, for data that is not a disk block as
+// is (a hole, an inline file, a decompressed cluster).  The caller fills it
+// through cacheData.  Return its slot, or ECACHEFULL
+// ============================================================================
+i32 cacheNew() {
+  pthread_once(&g_vol->cacheOnce, cacheInit);
+  pthread_mutex_lock(&g_vol->cachelock);
+  i32 s = cacheClaim();
+  if (s >= 0) g_vol->cache[s].queue = CACHEQIN;
+  pthread_mutex_unlock(&g_vol->cachelock);
+  return s;
+}
+
+
+
+// ============================================================================
+// Give claimed slot 's' to block 'dbn', on the queue 'prio' calls for: a
+// ghost goes on Am, as it has been read before.  Caller holds
+// g_vol->cachelock
+// ============================================================================
+void cachePlace(i32 s, i32 dbn, i32 prio) {
+  CacheSlot* cs = &g_vol->cache[s];
+  cs->dbn   = dbn;
+  cs->scan  = (prio == CACHESCAN);
+  cs->queue = CACHEQIN;
+
+  if (prio == CACHEMETA) {
+    cs->queue = CACHEQMETA;
+  } else if (g_vol->cachepolicy == CACHELRU) {
+    cs->queue = CACHEQMAIN;
+  } else {
+    for (i32 g = 0; g < CACHEGHOSTS; ++g) {
+      if (g_vol->cacheghosts[g] != dbn) continue;
+      g_vol->cacheghosts[g] = CACHENONE;
+      cs->queue = CACHEQMAIN;
+    }
+  }
+}
+
+
+
+// ============================================================================
+// Switch the cache to replacement 'policy', CACHE2Q or CACHELRU, starting
+// empty, with the stats zeroed.  For benchmarks.  Return 0
+// ============================================================================
+i32 cachePolicy(i32 policy) {
+  cacheReset();
+  pthread_mutex_lock(&g_vol->cachelock);
+  g_vol->cachepolicy = policy;
+  memset(&g_vol->cachestats, 0, sizeof(CacheStats));
+  pthread_mutex_unlock(&g_vol->cachelock);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Unpin page 'slot'.  A detached page goes free on its last unpin.  Return 0
+// ============================================================================
+i32 cachePut(i32 slot) {
+
+  if (slot < 0 || slot >= CACHESLOTS) FATAL(EBADDBN);
+
+  pthread_mutex_lock(&g_vol->cachelock);
+  if (g_vol->cache[slot].pins <= 0) {
+    pthread_mutex_unlock(&g_vol->cachelock);
+    FATAL(EBADDBN);
+  }
+  --g_vol->cache[slot].pins;
+  pthread_mutex_unlock(&g_vol->cachelock);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Drop every cached block, and every ghost, as the disk may have been
+// replaced.  Pinned pages are detached, so their readers are not disturbed.
+// Called at mount
+// ============================================================================
+i32 cacheReset() {
+  pthread_once(&g_vol->cacheOnce, cacheInit);
+  pthread_mutex_lock(&g_vol->cachelock);
+  cacheInit();
+  ++g_vol->cacheseq;                            // reads under way are stale
+  pthread_mutex_unlock(&g_vol->cachelock);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Return the token cacheFill needs, for a block about to be read without a
+// cacheLookup first
+// ============================================================================
+u32 cacheSeq() {
+  pthread_once(&g_vol->cacheOnce, cacheInit);
+  pthread_mutex_lock(&g_vol->cachelock);
+  u32 seq = g_vol->cacheseq;
+  pthread_mutex_unlock(&g_vol->cachelock);
+  return seq;
+}
+
+
+
+// ============================================================================
+// Copy the cache's hit and miss counts, since cachePolicy, to '*stats'.
+// Return 0
+// ============================================================================
+i32 cacheStats(CacheStats* stats) {
+  pthread_mutex_lock(&g_vol->cachelock);
+  *stats = g_vol->cachestats;
+  pthread_mutex_unlock(&g_vol->cachelock);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Note a hit on slot 's': to the back of its LRU (A1in is FIFO: no change).
+// Caller holds g_vol->cachelock
+// ============================================================================
+void cacheTouch(i32 s) {
+  CacheSlot* cs = &g_vol->cache[s];
+  if (cs->queue != CACHEQIN || g_vol->cachepolicy == CACHELRU) {
+    cs->tick = ++g_vol->cachetick;
+  }
+}
+
+
+
+// ============================================================================
+// Keep the cache in step with 'count' blocks from 'buf', just written from
+// DBN 'dbn'.  An unpinned page is updated; a pinned one is detached.  Called
+// by bioWrite and bioWriteRun.  Return 0
+// ============================================================================
+i32 cacheWrite(i32 dbn, i32 count, void* buf) {
+  pthread_once(&g_vol->cacheOnce, cacheInit);
+  pthread_mutex_lock(&g_vol->cachelock);
+
+  ++g_vol->cacheseq;                            // reads under way are stale
+  for (i32 s = 0; s < CACHESLOTS; ++s) {
+    CacheSlot* cs = &g_vol->cache[s];
+    if (cs->dbn == CACHENONE || cs->dbn < dbn || cs->dbn >= dbn + count) {
+      continue;
+    }
+    if (cs->pins > 0) {
+      cs->dbn = CACHENONE;                      // lent out: leave it be
+    } else {
+      memcpy(cs->data, (i8*)buf + (cs->dbn - dbn) * BYTESPERBLOCK,
+             BYTESPERBLOCK);
+    }
+  }
+
+  pthread_mutex_unlock(&g_vol->cachelock);
+  return 0;
+}
@@ -0,0 +1,61 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+// ===================================================================
+// cache.h - Block cache: pages of disk blocks that can be lent,
+// pinned, to readers.  Replacement is 2Q, scan resistant
+// ===================================================================
+
+#include "alias.h"
+#include "bfs.h"
+
+#define CACHESLOTS    16      // # blocks the cache holds
+#define CACHENONE     -1      // CacheSlot.dbn: slot holds no disk block
+#define CACHEKIN      (CACHESLOTS / 4)  // A1in gets this many, before Am
+#define CACHEGHOSTS   (CACHESLOTS / 2)  // DBNs A1out remembers
+
+#define CACHESCAN     0       // cacheFill: read in bulk, once, eg readahead
+#define CACHEDATA     1       //   a block read on its own
+#define CACHEMETA     2       //   metadata: kept over everything else
+
+#define CACHEQIN      0       // CacheSlot.queue: A1in, FIFO, seen once
+#define CACHEQMAIN    1       //   Am, LRU, seen again
+#define CACHEQMETA    2       //   metadata, LRU, evicted last
+
+#define CACHE2Q       0       // cachePolicy: 2Q (the default)
+#define CACHELRU      1       //   plain LRU, for comparison
+
+typedef struct {          // CacheSlot: one cached block
+  i32 dbn;                // DBN held.  CACHENONE => free, or detached
+  i32 pins;               // # views holding it.  > 0 => must not be evicted
+  u32 tick;               // A1in: entry; else last use
+  i32 queue;              // CACHEQIN, CACHEQMAIN or CACHEQMETA
+  i32 scan;               // 1 => read by a scan: forget it when evicted
+  i8  data[BYTESPERBLOCK];
+} CacheSlot;
+
+typedef struct {          // CacheStats: lookups since cachePolicy
+  i64 hits;
+  i64 misses;
+  i64 metahits;           //   of which metadata
+  i64 metamisses;
+} CacheStats;
+
+i32  cacheClaim ();
+i8*  cacheData  (i32 slot);
+i32  cacheFill  (i32 dbn, void* buf, i32 prio, u32 seq);
+i32  cacheFind  (i32 dbn);
+i32  cacheGet   (i32 dbn);
+void cacheInit  ();
+i32  cacheLookup(i32 dbn, void* buf, i32 prio, u32* pseq);
+i32  cacheNew   ();
+void cachePlace (i32 s, i32 dbn, i32 prio);
+i32  cachePolicy(i32 policy);
+i32  cachePut   (i32 slot);
+i32  cacheReset ();
+u32  cacheSeq   ();
+i32  cacheStats (CacheStats* stats);
+void cacheTouch (i32 s);
+i32  cacheWrite (i32 dbn, i32 count, void* buf);
+
+#endif
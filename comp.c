@@ -0,0 +1,392 @@
+// ============================================================================
+// comp.c - Compressed files.  An INODECOMP file is cut into clusters of
+// CLUSTERBLOCKS FBNs.  Each cluster is LZ4-compressed (lz.c) as a whole and
+// stored in the fewest contiguous blocks that hold it: CLUSTERHDR bytes of
+// length, then the stream.  A cluster that does not shrink by a block is
+// stored raw, in CLUSTERBLOCKS blocks; one of all zeroes is a hole.  The
+// cluster entries, CENTRY(dbn, # blocks), live in the Inode's clusters[]
+// and then in one cluster table, at ctable.  The last cluster used in each
+// file is kept decompressed in g_vol->compcache, so small reads and writes within
+// a cluster do not decompress it again
+// ============================================================================
+
+#include "comp.h"
+#include "lz.h"
+#include "vol.h"
+
+
+
+// ============================================================================
+// Return the entry for cluster 'c' of 'inode'.  0 => a hole
+// ============================================================================
+i32 compGet(Inode* inode, i32 c) {
+
+  if (c < 0 || c >= MAXCLUSTER) FATAL(EBADFBN);
+
+  if (c < NUMCDIRECT) return inode->clusters[c];
+  if (inode->ctable == 0) return 0;
+
+  i32 tab[I32SPERBLOCK];
+  bioReadMeta(inode->ctable, tab);
+  return tab[c - NUMCDIRECT];
+}
+
+
+
+// ============================================================================
+// Set the entry for cluster 'c' of 'inode' to 'entry', creating the cluster
+// table if need be, or copying it if it is shared or frozen (bfsCow).  Return
+// 1 if 'inode' itself changed, so the caller must write it back; 0 if only
+// the table did
+// ============================================================================
+i32 compSet(Inode* inode, i32 c, i32 entry) {
+
+  if (c < 0 || c >= MAXCLUSTER) FATAL(EBADFBN);
+
+  if (c < NUMCDIRECT) {
+    inode->clusters[c] = entry;
+    return 1;
+  }
+
+  i32 tab[I32SPERBLOCK] = {0};
+  i32 fresh = (inode->ctable == 0);
+
+  if (fresh) {
+    if (entry == 0) return 0;                 // a hole, as it was
+    inode->ctable = bfsFindFreeBlock();
+  } else {
+    bioReadMeta(inode->ctable, tab);
+  }
+
+  i32 old = inode->ctable;
+  if (!fresh) inode->ctable = bfsCow(old);
+
+  tab[c - NUMCDIRECT] = entry;
+  bioWrite(inode->ctable, tab);
+  return fresh || inode->ctable != old;
+}
+
+
+
+// ============================================================================
+// Forget the cached cluster of file 'inum'
+// ============================================================================
+void compInval(i32 inum) {
+  if (inum < 0 || inum > MAXINUM) return;
+  g_vol->compcache[inum].valid = 0;
+}
+
+
+
+// ============================================================================
+// Return the cache buffer for cluster 'c' of file 'inum', decompressing the
+// cluster into it if it is not there already.  Caller holds the BFS lock
+// ============================================================================
+i8* compLoad(i32 inum, Inode* inode, i32 c) {
+
+  CompCache* cc = &g_vol->compcache[inum];
+  if (cc->valid && cc->cluster == c) return cc->data;
+
+  cc->valid   = 0;
+  cc->cluster = c;
+
+  i32 entry = compGet(inode, c);
+  i32 n     = CENTRYLEN(entry);
+
+  if (entry == 0) {                           // hole: zeroes, no I/O
+    memset(cc->data, 0, CLUSTERSIZE);
+  } else if (n == CLUSTERBLOCKS) {            // stored raw
+    bioReadRun(CENTRYDBN(entry), n, cc->data);
+  } else {
+    i8  buf[CLUSTERSIZE];
+    i32 clen;
+    bioReadRun(CENTRYDBN(entry), n, buf);
+    memcpy(&clen, buf, CLUSTERHDR);
+    if (clen <= 0 || clen > n * BYTESPERBLOCK - CLUSTERHDR) FATAL(EBADCOMP);
+    i32 got = lzDecompress(buf + CLUSTERHDR, clen, cc->data, CLUSTERSIZE);
+    if (got != CLUSTERSIZE) FATAL(EBADCOMP);
+  }
+
+  cc->valid = 1;
+  return cc->data;
+}
+
+
+
+// ============================================================================
+// Compress cluster 'c' of file 'inum', whose bytes are at 'data', and write
+// it out.  It is rewritten in place if it fits in the blocks it had, giving
+// back any left over; else it goes to a fresh run and the old blocks are
+// given back.  Freed blocks go into 'fb'.  Return 1 if 'inode' changed
+// ============================================================================
+i32 compStore(Inode* inode, i32 c, i8* data, FreeBatch* fb) {
+
+  i32 old  = compGet(inode, c);
+  i32 oldn = CENTRYLEN(old);
+
+  i8  out[CLUSTERSIZE];
+  i32 n = 0;                                  // # blocks to store
+
+  i32 zero = 1;
+  for (i32 i = 0; i < CLUSTERSIZE && zero; ++i) zero = (data[i] == 0);
+
+  if (!zero) {
+    i32 cap  = (CLUSTERBLOCKS - 1) * BYTESPERBLOCK - CLUSTERHDR;
+    i32 clen = lzCompress(data, CLUSTERSIZE, out + CLUSTERHDR, cap);
+    if (clen > 0) {
+      n = (CLUSTERHDR + clen + BYTESPERBLOCK - 1) / BYTESPERBLOCK;
+      memcpy(out, &clen, CLUSTERHDR);
+      memset(out + CLUSTERHDR + clen, 0,
+             n * BYTESPERBLOCK - CLUSTERHDR - clen);
+    } else {                                  // incompressible
+      n = CLUSTERBLOCKS;
+      memcpy(out, data, CLUSTERSIZE);
+    }
+  }
+
+  i32 dbn = 0;
+
+  i32 inplace = (n > 0 && n <= oldn);
+  for (i32 i = 0; i < oldn && inplace; ++i) {
+    inplace = bfsWritable(CENTRYDBN(old) + i);
+  }
+
+  if (inplace) {                              // fits where it was
+    dbn = CENTRYDBN(old);
+    for (i32 i = n; i < oldn; ++i) mapFree(fb, dbn + i);
+  } else {
+    if (n > 0) {
+      i32 got = bfsAllocRun(n, CENTRYDBN(old), &dbn);   // near the old copy
+      if (got < n) {                          // no run big enough
+        for (i32 i = 0; i < got; ++i) mapFree(fb, dbn + i);
+        mapFlush(fb);
+        FATAL(EDISKFULL);
+      }
+    }
+    for (i32 i = 0; i < oldn; ++i) mapFree(fb, CENTRYDBN(old) + i);
+  }
+
+  if (n > 0) bioWriteRun(dbn, n, out);
+  return compSet(inode, c, (n > 0) ? CENTRY(dbn, n) : 0);
+}
+
+
+
+// ============================================================================
+// Switch file 'inum' to compressed clusters, rewriting whatever data it holds
+// (inline or in blocks).  No-op if it is compressed already.  Return 0, or
+// EBIGNUMB, changing nothing, if the file is bigger than COMPMAXSIZE
+// ============================================================================
+i32 compEnable(i32 inum) {
+
+  bfsLock();
+
+  Inode inode;
+  bfsReadInode(inum, &inode);
+  if (inode.flags & INODECOMP) { bfsUnlock(); return 0; }
+  if (inode.size > COMPMAXSIZE) { bfsUnlock(); return EBIGNUMB; }
+
+  i32 size   = inode.size;
+  i32 blocks = (size + BYTESPERBLOCK - 1) / BYTESPERBLOCK;
+  i8* data   = malloc(blocks * BYTESPERBLOCK + 1);
+  if (data == NULL) FATAL(ENOMEM);
+
+  for (i32 fbn = 0; fbn < blocks; ++fbn) {
+    bfsRead(inum, fbn, data + fbn * BYTESPERBLOCK);
+  }
+
+  bfsTruncate(inum, 0);                       // give back the old blocks
+
+  bfsReadInode(inum, &inode);
+  memset(inode.data, 0, INLINESIZE);
+  inode.flags = (inode.flags & ~INODEINLINE) | INODECOMP;
+  bfsWriteInode(inum, &inode);
+  compInval(inum);
+
+  compWrite(inum, 0, size, data);
+
+  free(data);
+  bfsUnlock();
+  return 0;
+}
+
+
+
+// ============================================================================
+// Return 1 if file 'inum' may grow to 'size' bytes: it is not compressed, or
+// its cluster map reaches that far (COMPMAXSIZE).  Else 0
+// ============================================================================
+i32 compFits(i32 inum, i32 size) {
+  Inode inode;
+  bfsReadInode(inum, &inode);
+  return !(inode.flags & INODECOMP) || size <= COMPMAXSIZE;
+}
+
+
+
+// ============================================================================
+// Read FBN 'fbn' of compressed file 'inum' into 'buf', from its cluster
+// ============================================================================
+i32 compRead(i32 inum, i32 fbn, i8* buf) {
+
+  bfsLock();
+
+  Inode inode;
+  bfsReadInode(inum, &inode);
+
+  i8* data = compLoad(inum, &inode, fbn / CLUSTERBLOCKS);
+  memcpy(buf, data + (fbn % CLUSTERBLOCKS) * BYTESPERBLOCK, BYTESPERBLOCK);
+
+  bfsUnlock();
+  return 0;
+}
+
+
+
+// ============================================================================
+// Return the first byte-offset at or after 'offset' in compressed file 'inum'
+// that lies in a stored cluster ('data' = 1: SEEK_DATA) or in a hole cluster
+// ('data' = 0: SEEK_HOLE; EOF counts as a hole).  Return EPASTEOF if there is
+// none, or 'offset' is at or beyond EOF
+// ============================================================================
+i32 compSeek(i32 inum, i32 offset, i32 data) {
+
+  Inode inode;
+  bfsReadInode(inum, &inode);
+
+  i32 size = inode.size;
+  if (offset >= size) return EPASTEOF;
+
+  i32 clusters = (size + CLUSTERSIZE - 1) / CLUSTERSIZE;
+  i32 c        = offset / CLUSTERSIZE;
+  while (c < clusters && (compGet(&inode, c) != 0) != data) ++c;
+
+  i32 start = c * CLUSTERSIZE;
+  if (start < offset) start = offset;
+  if (start < size) return start;
+  return data ? EPASTEOF : size;
+}
+
+
+
+// ============================================================================
+// Set the size of compressed file 'inum' to 'size'.  Growing just moves EOF.
+// Shrinking zeroes the tail of the cluster holding the new EOF, then frees
+// every cluster wholly beyond it, and the cluster table once it is unused.
+// Return 0, or EBIGNUMB, changing nothing, if 'size' is past COMPMAXSIZE
+// ============================================================================
+i32 compTruncate(i32 inum, i32 size) {
+
+  if (size < 0)           FATAL(EBADCURS);
+  if (size > COMPMAXSIZE) return EBIGNUMB;
+
+  bfsLock();
+
+  Inode inode;
+  bfsReadInode(inum, &inode);
+
+  FreeBatch fb;
+  fb.n = 0;
+
+  i32 keep = (size + CLUSTERSIZE - 1) / CLUSTERSIZE;   // clusters kept
+
+  if (size < inode.size && size % CLUSTERSIZE != 0
+      && compGet(&inode, size / CLUSTERSIZE) != 0) {
+    i8* data = compLoad(inum, &inode, size / CLUSTERSIZE);
+    memset(data + size % CLUSTERSIZE, 0, CLUSTERSIZE - size % CLUSTERSIZE);
+    compStore(&inode, size / CLUSTERSIZE, data, &fb);
+  }
+
+  for (i32 c = keep; c < NUMCDIRECT; ++c) {
+    i32 e = inode.clusters[c];
+    for (i32 i = 0; i < CENTRYLEN(e); ++i) mapFree(&fb, CENTRYDBN(e) + i);
+    inode.clusters[c] = 0;
+  }
+
+  if (inode.ctable != 0) {
+    i32 tab[I32SPERBLOCK];
+    bioReadMeta(inode.ctable, tab);
+    i32 first = (keep > NUMCDIRECT) ? keep - NUMCDIRECT : 0;
+    for (i32 t = first; t < I32SPERBLOCK; ++t) {
+      for (i32 i = 0; i < CENTRYLEN(tab[t]); ++i) {
+        mapFree(&fb, CENTRYDBN(tab[t]) + i);
+      }
+      tab[t] = 0;
+    }
+    if (first == 0) {                         // table no longer needed
+      mapFree(&fb, inode.ctable);
+      inode.ctable = 0;
+    } else {
+      inode.ctable = bfsCow(inode.ctable);
+      bioWrite(inode.ctable, tab);
+    }
+  }
+
+  CompCache* cc = &g_vol->compcache[inum];
+  if (cc->valid && cc->cluster >= keep) cc->valid = 0;
+
+  inode.size = size;
+  bfsWriteInode(inum, &inode);
+
+  mapFlush(&fb);
+
+  bfsUnlock();
+  return 0;
+}
+
+
+
+// ============================================================================
+// Write 'numb' bytes from 'buf' at byte 'offset' of file 'inum', if it is
+// compressed; the size grows to match.  Each cluster touched is brought into
+// g_vol->compcache (unless wholly overwritten), patched, then compressed and
+// written once.  Return 1 if so.  If the file is not compressed, return 0,
+// leaving the write to the caller.  Return EBIGNUMB, writing nothing, if the
+// file would grow past COMPMAXSIZE
+// ============================================================================
+i32 compWrite(i32 inum, i32 offset, i32 numb, void* buf) {
+
+  if (offset < 0) FATAL(EBADCURS);
+  if (numb < 0)   FATAL(ENEGNUMB);
+
+  bfsLock();
+
+  Inode inode;
+  bfsReadInode(inum, &inode);
+
+  if (!(inode.flags & INODECOMP)) { bfsUnlock(); return 0; }
+
+  i32 end = offset + numb;
+  if (numb > 0 && end > COMPMAXSIZE) { bfsUnlock(); return EBIGNUMB; }
+
+  FreeBatch fb;
+  fb.n = 0;
+
+  for (i32 pos = offset; pos < end; ) {
+    i32 c   = pos / CLUSTERSIZE;
+    i32 off = pos % CLUSTERSIZE;
+    i32 len = (end - pos < CLUSTERSIZE - off) ? end - pos : CLUSTERSIZE - off;
+
+    CompCache* cc = &g_vol->compcache[inum];
+    i8* data;
+    if (len == CLUSTERSIZE) {                 // all new: nothing to load
+      cc->valid   = 1;
+      cc->cluster = c;
+      data = cc->data;
+    } else {
+      data = compLoad(inum, &inode, c);
+    }
+
+    memcpy(data + off, (i8*)buf + (pos - offset), len);
+    compStore(&inode, c, data, &fb);
+    pos += len;
+  }
+
+  if (inode.size < end) inode.size = end;
+  bfsWriteInode(inum, &inode);
+
+  mapFlush(&fb);
+
+  bfsUnlock();
+  return 1;
+}
@@ -0,0 +1,36 @@
+#ifndef COMP_H
+#define COMP_H
+
+// ===================================================================
+// comp.h - Compressed files: clusters of CLUSTERBLOCKS FBNs, each
+// LZ4-compressed into as few contiguous blocks as it fits
+// ===================================================================
+
+#include "alias.h"
+#include "bfs.h"
+#include "map.h"
+
+#define CLUSTERHDR    4       // i32 compressed length, ahead of the data
+#define COMPMAXSIZE   (MAXCLUSTER * CLUSTERSIZE)  // biggest compressed file
+
+#define CENTRY(dbn, n)  (((dbn) << 3) | (n))  // 'n' blocks, from 'dbn'
+#define CENTRYDBN(e)    ((e) >> 3)
+#define CENTRYLEN(e)    ((e) & 7)             // CLUSTERBLOCKS => stored raw
+
+typedef struct {          // CompCache: the last cluster used in a file
+  i32 cluster;            // cluster index
+  i32 valid;              // 1 => 'data' holds that cluster
+  i8  data[CLUSTERSIZE];  // the cluster, decompressed
+} CompCache;
+
+i32  compEnable  (i32 inum);
+i32  compFits    (i32 inum, i32 size);
+i32  compGet     (Inode* inode, i32 c);
+void compInval   (i32 inum);
+i32  compRead    (i32 inum, i32 fbn, i8* buf);
+i32  compSeek    (i32 inum, i32 offset, i32 data);
+i32  compSet     (Inode* inode, i32 c, i32 entry);
+i32  compTruncate(i32 inum, i32 size);
+i32  compWrite   (i32 inum, i32 offset, i32 numb, void* buf);
+
+#endif
@@ -0,0 +1,200 @@
+// ============================================================================
+// crc.c - CRC32C.  On x86-64 CPUs with SSE4.2 and PCLMULQDQ, a block is
+// split into three lanes whose crc32 instructions run in parallel, and the
+// three partial CRCs are merged with one carry-less multiply each.  Anywhere
+// else, a portable slice-by-8 table walk gives the same answer
+// ============================================================================
+
+#include <pthread.h>
+#include <string.h>
+
+#include "bfs.h"
+#include "crc.h"
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#include <wmmintrin.h>
+#endif
+
+u32 g_crctable[8][256];                 // slice-by-8 tables
+u32 g_crcshift[2];                      // lane merge constants, per block
+i32 g_crchard = 0;                      // 1 => use SSE4.2 + PCLMULQDQ
+
+pthread_once_t g_crcOnce = PTHREAD_ONCE_INIT;
+
+
+
+// ============================================================================
+// Multiply 'a' by 'b', modulo the CRC32C polynomial (bit-reflected)
+// ============================================================================
+u32 crcMulMod(u32 a, u32 b) {
+  u32 m = 1u << 31;
+  u32 p = 0;
+  for (;;) {
+    if (a & m) {
+      p ^= b;
+      if ((a & (m - 1)) == 0) break;
+    }
+    m >>= 1;
+    b = (b & 1) ? (b >> 1) ^ CRCPOLY : b >> 1;
+  }
+  return p;
+}
+
+
+
+// ============================================================================
+// Return x^'n' modulo the CRC32C polynomial (bit-reflected)
+// ============================================================================
+u32 crcPow(u64 n) {
+  u32 r = 1u << 31;                     // x^0
+  u32 x = 1u << 30;                     // x^1
+  for (; n != 0; n >>= 1) {
+    if (n & 1) r = crcMulMod(x, r);
+    x = crcMulMod(x, x);
+  }
+  return r;
+}
+
+
+
+// ============================================================================
+// Build the slice-by-8 tables, pick the hardware path if the CPU has it, and
+// work out the constants that shift a lane's CRC past the lanes after it
+// ============================================================================
+void crcInit() {
+  for (u32 i = 0; i < 256; ++i) {
+    u32 c = i;
+    for (i32 k = 0; k < 8; ++k) c = (c >> 1) ^ (CRCPOLY & -(c & 1));
+    g_crctable[0][i] = c;
+  }
+  for (u32 i = 0; i < 256; ++i) {
+    for (i32 t = 1; t < 8; ++t) {
+      u32 c = g_crctable[t - 1][i];
+      g_crctable[t][i] = (c >> 8) ^ g_crctable[0][c & 0xff];
+    }
+  }
+
+#if defined(__x86_64__)
+  __builtin_cpu_init();
+  g_crchard = __builtin_cpu_supports("sse4.2")
+           && __builtin_cpu_supports("pclmul");
+#endif
+
+  i32 lane = (BYTESPERBLOCK / 3) & ~7;  // lanes A and B; C takes the rest
+  g_crcshift[0] = crcPow(8ull * (BYTESPERBLOCK - lane)     - 33);
+  g_crcshift[1] = crcPow(8ull * (BYTESPERBLOCK - 2 * lane) - 33);
+}
+
+
+
+// ============================================================================
+// Return the CRC32C of 'len' bytes at 'buf', with the portable table walk
+// ============================================================================
+u32 crcSoft(const void* buf, i32 len) {
+  pthread_once(&g_crcOnce, crcInit);
+
+  const u8* p = (const u8*)buf;
+  u32       c = ~0u;
+
+  for (; len >= 8; len -= 8, p += 8) {
+    u32 lo, hi;
+    memcpy(&lo, p, 4);
+    memcpy(&hi, p + 4, 4);
+    lo ^= c;
+    c = g_crctable[7][lo & 0xff]         ^ g_crctable[6][(lo >> 8) & 0xff]
+      ^ g_crctable[5][(lo >> 16) & 0xff] ^ g_crctable[4][lo >> 24]
+      ^ g_crctable[3][hi & 0xff]         ^ g_crctable[2][(hi >> 8) & 0xff]
+      ^ g_crctable[1][(hi >> 16) & 0xff] ^ g_crctable[0][hi >> 24];
+  }
+  while (len-- > 0) c = (c >> 8) ^ g_crctable[0][(c ^ *p++) & 0xff];
+
+  return ~c;
+}
+
+
+
+#if defined(__x86_64__)
+
+// ============================================================================
+// Run the crc32 instruction over 'len' bytes at 'p', from CRC state 'c'
+// ============================================================================
+__attribute__((target("sse4.2")))
+u32 crcHardRun(u32 c, const u8* p, i32 len) {
+  u64 c64 = c;
+  for (; len >= 8; len -= 8, p += 8) {
+    u64 v;
+    memcpy(&v, p, 8);
+    c64 = _mm_crc32_u64(c64, v);
+  }
+  c = (u32)c64;
+  while (len-- > 0) c = _mm_crc32_u8(c, *p++);
+  return c;
+}
+
+
+
+// ============================================================================
+// Shift CRC state 'c' past the bytes that 'k' (from crcPow) stands for
+// ============================================================================
+__attribute__((target("sse4.2,pclmul")))
+u32 crcHardShift(u32 c, u32 k) {
+  __m128i prod = _mm_clmulepi64_si128(_mm_cvtsi32_si128(c),
+                                      _mm_cvtsi32_si128(k), 0);
+  return (u32)_mm_crc32_u64(0, (u64)_mm_cvtsi128_si64(prod));
+}
+
+
+
+// ============================================================================
+// Return the CRC32C of one block at 'buf', running three lanes at once
+// ============================================================================
+__attribute__((target("sse4.2,pclmul")))
+u32 crcHardBlock(const u8* buf) {
+  i32 lane = (BYTESPERBLOCK / 3) & ~7;
+  u64 a = ~0u, b = 0, c = 0;
+
+  for (i32 i = 0; i < lane; i += 8) {   // three independent dependency chains
+    u64 va, vb, vc;
+    memcpy(&va, buf + i, 8);
+    memcpy(&vb, buf + lane + i, 8);
+    memcpy(&vc, buf + 2 * lane + i, 8);
+    a = _mm_crc32_u64(a, va);
+    b = _mm_crc32_u64(b, vb);
+    c = _mm_crc32_u64(c, vc);
+  }
+
+  u32 crc = crcHardRun((u32)c, buf + 3 * lane, BYTESPERBLOCK - 3 * lane);
+  crc ^= crcHardShift((u32)a, g_crcshift[0]);
+  crc ^= crcHardShift((u32)b, g_crcshift[1]);
+  return ~crc;
+}
+
+#endif
+
+
+
+// ============================================================================
+// Return the CRC32C of 'len' bytes at 'buf'
+// ============================================================================
+u32 crc32c(const void* buf, i32 len) {
+  pthread_once(&g_crcOnce, crcInit);
+
+#if defined(__x86_64__)
+  if (g_crchard) {
+    if (len == BYTESPERBLOCK) return crcHardBlock((const u8*)buf);
+    return ~crcHardRun(~0u, (const u8*)buf, len);
+  }
+#endif
+  return crcSoft(buf, len);
+}
+
+
+
+// ============================================================================
+// Return 1 if crc32c uses the SSE4.2 + PCLMULQDQ path
+// ============================================================================
+i32 crcHard() {
+  pthread_once(&g_crcOnce, crcInit);
+  return g_crchard;
+}
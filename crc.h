@@ -0,0 +1,17 @@
+#ifndef CRC_H
+#define CRC_H
+
+// ===================================================================
+// crc.h - CRC32C (Castagnoli) checksums, used by bio to detect torn
+// or corrupted blocks
+// ===================================================================
+
+#include "alias.h"
+
+#define CRCPOLY       0x82f63b78u     // CRC32C polynomial, bit-reflected
+
+u32 crc32c  (const void* buf, i32 len);
+i32 crcHard ();
+u32 crcSoft (const void* buf, i32 len);
+
+#endif
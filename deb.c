@@ -1,122 +1,167 @@
-// ============================================================================
-// deb.c - functions to help debug the BFS FileSystem
-// ============================================================================
-
-#include "bfs.h"
-#include "deb.h"
-
-// ============================================================================
-// Dump block DBN
-// ============================================================================
-i32 debDumpDbn(i32 dbn, i32 size) {
-  i8 buf[BYTESPERBLOCK] = {0};
-
-  i8*  buf8  = (i8*) buf;
-  i16* buf16 = (i16*)buf;
-  i32* buf32 = (i32*)buf;
-
-  bioRead(dbn, buf);
-
-  printf("\n");
-  if (size == 1) {
-    for (int i = 0; i < BYTESPERBLOCK; ++i) {
-      printf("%02x ", buf8[i]);
-      if ((i + 1) % 16 == 0) {
-        for (int i = 0; i < 16; ++i) {
-          char c = buf8[i];
-          if (!isprint(c)) c = '.';
-          printf("%c", c);
-        }
-        printf("\n");
-      }
-    }
-  } else if (size == 2) {
-    for (int i = 0; i < BYTESPERBLOCK / sizeof(i16); ++i) {
-      printf("%04x ", buf16[i]);
-      if ((i + 1) % 8 == 0) printf("\n");
-    }
-  } else if (size == 4) {
-    for (int i = 0; i < BYTESPERBLOCK / sizeof(i32); ++i) {
-      printf("%08x ", buf32[i]);
-      if ((i + 1) % 4 == 0) printf("\n");
-    }
-  } else {
-    printf("debDumpDbn: size must be 1, 2 or 4 \n");
-  }
-
-  return 0;
-}
-
-
-
-// ============================================================================
-// Dump the Dir
-// ============================================================================
-i32 debDumpDir() {
-  i8 buf[BYTESPERBLOCK] = {0};
-  bioRead(DBNDIR, buf);
-  Dir* dir = (Dir*)buf;
-
-  printf("\n");
-  for (int inum = 0; inum < NUMINODES; ++inum) {
-    printf("[%02d]  %s \n", inum, dir->fname[inum]);
-  }
-  printf("\n"); fflush(stdout);
-
-  return 0;
-}
-
-
-
-// ============================================================================
-// Dump the Inodes
-// ============================================================================
-i32 debDumpInodes() {
-  i8 buf[BYTESPERBLOCK] = {0};
-  bioRead(DBNINODES, buf);
-
-  Inode* inodes = (Inode*) buf;
-
-  printf("\n");
-  for (int inum = 0; inum < NUMINODES; ++inum) {
-    Inode inode = inodes[inum];
-    printf("[%d] size = %d \n", inum, inode.size);
-    for (i32 d = 0; d < NUMDIRECT; ++d) {
-      printf("    [%d] direct[%d] = %d \n", inum, d, inode.direct[d]);
-    }
-    printf("        indirect  = %d \n", inode.indirect);
-  }
-  printf("\n"); fflush(stdout);
-
-  return 0;
-}
-
-
-// ============================================================================
-// Dump the Superblock
-// ============================================================================
-i32 debDumpSuper() {
-  i8 buf[BYTESPERBLOCK] = {0};
-
-  bioRead(DBNSUPER, buf);
-
-  Super* super = (Super*)buf;
-
-  printf("\n");
-  printf("Super.numBlocks = %d \n", super->numBlocks);
-  printf("Super.numInodes = %d \n", super->numInodes);
-  printf("Super.firstFree = %d \n", super->firstFree);
-  printf("\n"); fflush(stdout);
-
-  // Check that remainder of Superblock is all zeroes
-
-  for (i32 b = sizeof(Super); b < BYTESPERBLOCK; ++b) {
-    if (buf[b] != 0) {
-      printf("Super[%d] == %02x, should be 0x00 \n", b, buf[b]);
-    }
-  }
-  fflush(stdout);
-
-  return 0;
-}
-
+// ============================================================================
+// deb.c - functions to help debug the BFS FileSystem
+// ============================================================================
+
+#include "bfs.h"
+#include "comp.h"
+#include "deb.h"
+#include "dir.h"
+
+// ============================================================================
+// Dump block DBN
+// ============================================================================
+i32 debDumpDbn(i32 dbn, i32 size) {
+  i8 buf[BYTESPERBLOCK] = {0};
+
+  i8*  buf8  = (i8*) buf;
+  i16* buf16 = (i16*)buf;
+  i32* buf32 = (i32*)buf;
+
+  bioRead(dbn, buf);
+
+  printf("\n");
+  if (size == 1) {
+    for (int i = 0; i < BYTESPERBLOCK; ++i) {
+      printf("%02x ", buf8[i]);
+      if ((i + 1) % 16 == 0) {
+        for (int i = 0; i < 16; ++i) {
+          char c = buf8[i];
+          if (!isprint(c)) c = '.';
+          printf("%c", c);
+        }
+        printf("\n");
+      }
+    }
+  } else if (size == 2) {
+    for (int i = 0; i < BYTESPERBLOCK / sizeof(i16); ++i) {
+      printf("%04x ", buf16[i]);
+      if ((i + 1) % 8 == 0) printf("\n");
+    }
+  } else if (size == 4) {
+    for (int i = 0; i < BYTESPERBLOCK / sizeof(i32); ++i) {
+      printf("%08x ", buf32[i]);
+      if ((i + 1) % 4 == 0) printf("\n");
+    }
+  } else {
+    printf("debDumpDbn: size must be 1, 2 or 4 \n");
+  }
+
+  return 0;
+}
+
+
+
+// ============================================================================
+// Dump directory 'dinum', and every directory below it, indented by 'depth'
+// ============================================================================
+i32 debDumpTree(i32 dinum, i32 depth) {
+  i32  cursor = 0;
+  char name[FNAMESIZE];
+
+  for (;;) {
+    i32 inum = dirNext(dinum, &cursor, name);
+    if (inum == 0) break;
+
+    Inode inode;
+    bfsReadInode(inum, &inode);
+    i32 isdir = (inode.flags & INODEDIR) != 0;
+
+    printf("%*s[%02d]  %s%s \n", 2 * depth, "", inum, name, isdir ? "/" : "");
+    if (isdir) debDumpTree(inum, depth + 1);
+  }
+  return 0;
+}
+
+
+
+// ============================================================================
+// Dump the directory tree, from the root
+// ============================================================================
+i32 debDumpDir() {
+  printf("\n");
+  printf("[%02d]  / \n", ROOTINUM);
+  debDumpTree(ROOTINUM, 1);
+  printf("\n"); fflush(stdout);
+
+  return 0;
+}
+
+
+
+// ============================================================================
+// Dump the Inodes in use
+// ============================================================================
+i32 debDumpInodes() {
+  printf("\n");
+  for (int inum = 0; inum < NUMINODES; ++inum) {
+    Inode inode;
+    bfsReadInode(inum, &inode);
+    if (inode.flags == 0) continue;             // free
+    printf("[%d] size = %d%s%s \n", inum, inode.size,
+           (inode.flags & INODEDIR)  ? "  dir"  : "",
+           (inode.flags & INODEDEAD) ? "  dead" : "");
+    if (inode.flags & INODEINLINE) {
+      printf("        inline \n");
+      continue;
+    }
+    if (inode.flags & INODECOMP) {
+      for (i32 c = 0; c < NUMCDIRECT; ++c) {
+        i32 e = inode.clusters[c];
+        if (e != 0) printf("    [%d] cluster[%d] = %d blocks at %d \n",
+                           inum, c, CENTRYLEN(e), CENTRYDBN(e));
+      }
+      printf("        ctable    = %d \n", inode.ctable);
+      continue;
+    }
+    for (i32 d = 0; d < NUMDIRECT; ++d) {
+      printf("    [%d] direct[%d] = %d \n", inum, d, inode.direct[d]);
+    }
+    printf("        indirect  = %d \n", inode.indirect);
+    printf("        dindirect = %d \n", inode.dindirect);
+    printf("        tindirect = %d \n", inode.tindirect);
+  }
+  printf("\n"); fflush(stdout);
+
+  return 0;
+}
+
+
+// ============================================================================
+// Dump the Superblock
+// ============================================================================
+i32 debDumpSuper() {
+  i8 buf[BYTESPERBLOCK] = {0};
+
+  bioRead(DBNSUPER, buf);
+
+  Super* super = (Super*)buf;
+
+  printf("\n");
+  printf("Super.numBlocks = %d \n", super->numBlocks);
+  printf("Super.numInodes = %d \n", super->numInodes);
+  printf("Super.numGroups = %d \n", super->numGroups);
+  printf("Super.groupBlocks = %d \n", super->groupBlocks);
+  printf("Super.rotor     = %d \n", super->rotor);
+  printf("Super.version   = %d \n", super->version);
+  printf("Super.gen       = %d \n", super->gen);
+  printf("Super.log       = %d \n", super->log);
+  for (i32 g = 0; g < NUMGROUPS; ++g) {
+    Group* gr = &super->groups[g];
+    printf("Super.groups[%d] firstFree = %d  freeRun = %d  nextFree = %d"
+           "  free = %d \n", g, gr->firstFree, gr->freeRun, gr->nextFree,
+           gr->free);
+  }
+  printf("\n"); fflush(stdout);
+
+  // Check that remainder of Superblock is all zeroes
+
+  for (i32 b = sizeof(Super); b < BYTESPERBLOCK; ++b) {
+    if (buf[b] != 0) {
+      printf("Super[%d] == %02x, should be 0x00 \n", b, buf[b]);
+    }
+  }
+  fflush(stdout);
+
+  return 0;
+}
+
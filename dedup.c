@@ -0,0 +1,104 @@
+// ============================================================================
+// dedup.c - Block deduplication.  Each whole block that fsWrite writes into
+// an INODEDEDUP file is fingerprinted with its CRC32C (crc.c, SSE4.2 where
+// there is one), and entered in g_vol->dedupidx, a direct-mapped index from
+// fingerprint to DBN.  A later write of the same bytes finds that DBN, checks
+// the block really is identical, and maps the FBN to it with one more
+// reference (ref.c), instead of writing.  A block of zeroes becomes a hole.
+// The index lives only in memory: it starts empty at mount, and a DBN is
+// dropped from it when the block is freed
+// ============================================================================
+
+#include "crc.h"
+#include "dedup.h"
+#include "vol.h"
+
+
+
+// ============================================================================
+// Enter block 'dbn', just written, with fingerprint 'hash', in the index.
+// It replaces whatever block held the slot.  Return 0
+// ============================================================================
+i32 dedupAdd(i32 dbn, u32 hash) {
+  bfsLock();
+  g_vol->dedupidx[hash & (DEDUPSLOTS - 1)] = dbn;
+  g_vol->deduphash[dbn] = hash;
+  g_vol->dedupin[dbn]   = 1;
+  bfsUnlock();
+  return 0;
+}
+
+
+
+// ============================================================================
+// Turn on deduplication for file 'inum': from now on, whole blocks written to
+// it are shared with identical ones.  Data already written is left as it is.
+// Return 0
+// ============================================================================
+i32 dedupEnable(i32 inum) {
+  bfsLock();
+  Inode inode;
+  bfsReadInode(inum, &inode);
+  inode.flags |= INODEDEDUP;
+  bfsWriteInode(inum, &inode);
+  bfsUnlock();
+  return 0;
+}
+
+
+
+// ============================================================================
+// Look for a block holding the same BYTESPERBLOCK bytes as 'buf'.  Store the
+// fingerprint of 'buf' in '*phash'.  Return 0 if 'buf' is all zeroes (it can
+// be a hole), the DBN of an identical block, or ENODBN if there is none
+// ============================================================================
+i32 dedupFind(i8* buf, u32* phash) {
+
+  static i8  zeroes[BYTESPERBLOCK];
+  static u32 zerohash = 0;
+
+  if (zerohash == 0) zerohash = crc32c(zeroes, BYTESPERBLOCK);
+
+  u32 hash = crc32c(buf, BYTESPERBLOCK);
+  *phash = hash;
+
+  if (hash == zerohash && memcmp(buf, zeroes, BYTESPERBLOCK) == 0) return 0;
+
+  bfsLock();
+
+  i32 dbn = g_vol->dedupidx[hash & (DEDUPSLOTS - 1)];
+  if (dbn == 0 || !g_vol->dedupin[dbn] || g_vol->deduphash[dbn] != hash) {
+    bfsUnlock();
+    return ENODBN;
+  }
+
+  i8 blk[BYTESPERBLOCK];                // same CRC: compare the bytes
+  bioRead(dbn, blk);
+  i32 same = memcmp(blk, buf, BYTESPERBLOCK) == 0;
+
+  bfsUnlock();
+  return same ? dbn : ENODBN;
+}
+
+
+
+// ============================================================================
+// Drop block 'dbn' from the index; it is being freed
+// ============================================================================
+void dedupForget(i32 dbn) {
+  bfsLock();
+  g_vol->dedupin[dbn] = 0;
+  bfsUnlock();
+}
+
+
+
+// ============================================================================
+// Empty the index.  Called when the disk is formatted or mounted
+// ============================================================================
+void dedupReset() {
+  bfsLock();
+  memset(g_vol->dedupidx, 0, sizeof(g_vol->dedupidx));
+  memset(g_vol->dedupin,  0, sizeof(g_vol->dedupin));
+  bfsUnlock();
+}
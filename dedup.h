@@ -0,0 +1,20 @@
+#ifndef DEDUP_H
+#define DEDUP_H
+
+// ===================================================================
+// dedup.h - Block deduplication: a fingerprint index of blocks
+// written by INODEDEDUP files, so duplicates can be shared
+// ===================================================================
+
+#include "alias.h"
+#include "bfs.h"
+
+#define DEDUPSLOTS    256     // # index slots; a power of 2
+
+i32  dedupAdd   (i32 dbn, u32 hash);
+i32  dedupEnable(i32 inum);
+i32  dedupFind  (i8* buf, u32* phash);
+void dedupForget(i32 dbn);
+void dedupReset ();
+
+#endif
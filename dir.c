@@ -0,0 +1,307 @@
+// ============================================================================
+// dir.c - Directories.  A directory is a file, flagged INODEDIR, whose blocks
+// are arrays of DENTPERBLOCK Dentrys; a Dentry with inum 0 is a free slot.
+// The root directory is inum ROOTINUM, with its first block at DBNDIR.  Each
+// (directory, name) lookup is remembered in the volume's dircache, hits and misses
+// alike, so walking a path that was walked before costs no I/O
+// ============================================================================
+
+#include "dir.h"
+#include "vol.h"
+
+
+
+// ============================================================================
+// Return the g_vol->dircache slot for 'name' in directory 'dinum' (FNV-1a hash)
+// ============================================================================
+DirCache* dirCacheSlot(i32 dinum, str name) {
+  unsigned h = 2166136261u ^ (unsigned)dinum;
+  for (str p = name; *p != 0; ++p) {
+    h ^= (unsigned char)*p;
+    h *= 16777619u;
+  }
+  return &g_vol->dircache[h & (DIRCACHESIZE - 1)];
+}
+
+
+
+// ============================================================================
+// Remember that 'name' in directory 'dinum' is 'inum' (EFNF if absent)
+// ============================================================================
+void dirCacheSet(i32 dinum, str name, i32 inum, i32 isdir) {
+  DirCache* dc = dirCacheSlot(dinum, name);
+  dc->dinum = dinum;
+  dc->inum  = inum;
+  dc->isdir = isdir;
+  strcpy(dc->name, name);
+}
+
+
+
+// ============================================================================
+// Forget every cached lookup.  Called when the disk is formatted or mounted
+// ============================================================================
+void dirCacheClear() {
+  bfsLock();
+  memset(g_vol->dircache, 0, sizeof(g_vol->dircache));
+  bfsUnlock();
+}
+
+
+
+// ============================================================================
+// Read block 'fbn' of directory 'dinum' into 'ents'
+// ============================================================================
+i32 dirReadBlock(i32 dinum, i32 fbn, Dentry* ents) {
+  i32 dbn = bfsFbnToDbn(dinum, fbn);
+  if (dbn < 0) {
+    memset(ents, 0, BYTESPERBLOCK);
+    return 0;
+  }
+  return bioReadMeta(dbn, ents);
+}
+
+
+
+// ============================================================================
+// Write 'ents' to block 'fbn' of directory 'dinum', allocating it if need be
+// (or copying it, if a snapshot holds it)
+// ============================================================================
+i32 dirWriteBlock(i32 dinum, i32 fbn, Dentry* ents) {
+  bfsWriteBlock(dinum, fbn, (i8*)ents, 0);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Search the blocks of directory 'dinum' for 'name'.  If found, store where
+// in '*pfbn' and '*pslot' and return its inum.  If not, return EFNF
+// ============================================================================
+i32 dirFind(i32 dinum, str name, i32* pfbn, i32* pslot) {
+  Dentry ents[DENTPERBLOCK];
+  i32    numBlocks = bfsGetSize(dinum) / BYTESPERBLOCK;
+
+  for (i32 fbn = 0; fbn < numBlocks; ++fbn) {
+    dirReadBlock(dinum, fbn, ents);
+    for (i32 s = 0; s < DENTPERBLOCK; ++s) {
+      if (ents[s].inum == 0 || strcmp(ents[s].name, name) != 0) continue;
+      if (pfbn  != NULL) *pfbn  = fbn;
+      if (pslot != NULL) *pslot = s;
+      return ents[s].inum;
+    }
+  }
+  return EFNF;
+}
+
+
+
+// ============================================================================
+// Add entry 'name' -> 'inum' to directory 'dinum', in its first free slot,
+// or in a new block appended to the directory.  The caller has checked that
+// 'name' is not already there.  Return 0
+// ============================================================================
+i32 dirAdd(i32 dinum, str name, i32 inum) {
+
+  if (strlen(name) > FNAMESIZE - 1) FATAL(EBIGFNAME);
+
+  bfsLock();
+
+  Dentry ents[DENTPERBLOCK];
+  i32    numBlocks = bfsGetSize(dinum) / BYTESPERBLOCK;
+  i32    fbn       = 0;
+  i32    slot      = -1;
+
+  for (; fbn < numBlocks && slot < 0; ++fbn) {
+    dirReadBlock(dinum, fbn, ents);
+    for (i32 s = 0; s < DENTPERBLOCK; ++s) {
+      if (ents[s].inum == 0) { slot = s; break; }
+    }
+  }
+
+  if (slot < 0) {                             // full: append a block
+    memset(ents, 0, BYTESPERBLOCK);
+    slot = 0;
+    ++fbn;
+  }
+
+  ents[slot].inum = inum;
+  memset(ents[slot].name, 0, FNAMESIZE);
+  strcpy(ents[slot].name, name);
+  dirWriteBlock(dinum, fbn - 1, ents);
+
+  if (fbn > numBlocks) bfsSetSize(dinum, fbn * BYTESPERBLOCK);
+
+  Inode inode;
+  bfsReadInode(inum, &inode);
+  dirCacheSet(dinum, name, inum, (inode.flags & INODEDIR) != 0);
+
+  bfsUnlock();
+  return 0;
+}
+
+
+
+// ============================================================================
+// Return 1 if directory 'dinum' holds no entries, else 0
+// ============================================================================
+i32 dirIsEmpty(i32 dinum) {
+  i32  cursor = 0;
+  char name[FNAMESIZE];
+  return dirNext(dinum, &cursor, name) == 0;
+}
+
+
+
+// ============================================================================
+// Look up 'name' in directory 'dinum'.  Return its inum, storing 1 in
+// '*pisdir' (if not NULL) when it is a directory.  If absent, return EFNF.
+// Answered from g_vol->dircache when possible; else the directory is scanned and
+// the answer, found or not, is cached
+// ============================================================================
+i32 dirLookup(i32 dinum, str name, i32* pisdir) {
+
+  if (strlen(name) > FNAMESIZE - 1) return EFNF;
+
+  bfsLock();
+
+  DirCache* dc = dirCacheSlot(dinum, name);
+  if (dc->name[0] == 0 || dc->dinum != dinum || strcmp(dc->name, name) != 0) {
+    i32 inum  = dirFind(dinum, name, NULL, NULL);
+    i32 isdir = 0;
+    if (inum != EFNF) {
+      Inode inode;
+      bfsReadInode(inum, &inode);
+      isdir = (inode.flags & INODEDIR) != 0;
+    }
+    dirCacheSet(dinum, name, inum, isdir);
+  }
+
+  i32 inum = dc->inum;
+  if (pisdir != NULL) *pisdir = dc->isdir;
+
+  bfsUnlock();
+  return inum;
+}
+
+
+
+// ============================================================================
+// Readdir: find the first entry of directory 'dinum' at or after slot
+// '*pcursor' (start at 0).  Copy its name into 'name' (FNAMESIZE bytes),
+// advance '*pcursor' past it, and return its inum.  At the end, return 0
+// ============================================================================
+i32 dirNext(i32 dinum, i32* pcursor, str name) {
+
+  if (pcursor == NULL || name == NULL) FATAL(ENULLPTR);
+
+  bfsLock();
+
+  Dentry ents[DENTPERBLOCK];
+  i32    numBlocks = bfsGetSize(dinum) / BYTESPERBLOCK;
+
+  for (i32 c = *pcursor; c < numBlocks * DENTPERBLOCK; ++c) {
+    if (c == *pcursor || c % DENTPERBLOCK == 0) {
+      dirReadBlock(dinum, c / DENTPERBLOCK, ents);
+    }
+    Dentry* d = &ents[c % DENTPERBLOCK];
+    if (d->inum == 0) continue;
+    strcpy(name, d->name);
+    *pcursor = c + 1;
+    bfsUnlock();
+    return d->inum;
+  }
+
+  *pcursor = numBlocks * DENTPERBLOCK;
+  bfsUnlock();
+  return 0;
+}
+
+
+
+// ============================================================================
+// Remove entry 'name' from directory 'dinum'.  Return the inum it named, or
+// EFNF
+// ============================================================================
+i32 dirRemove(i32 dinum, str name) {
+
+  bfsLock();
+
+  i32 fbn, slot;
+  i32 inum = dirFind(dinum, name, &fbn, &slot);
+  if (inum != EFNF) {
+    Dentry ents[DENTPERBLOCK];
+    dirReadBlock(dinum, fbn, ents);
+    memset(&ents[slot], 0, sizeof(Dentry));
+    dirWriteBlock(dinum, fbn, ents);
+  }
+  dirCacheSet(dinum, name, EFNF, 0);
+
+  bfsUnlock();
+  return inum;
+}
+
+
+
+// ============================================================================
+// Resolve 'path' to an inum, storing 1 in '*pisdir' (if not NULL) when it is
+// a directory.  "" and "/" name the root.  Return EFNF if any component is
+// missing, ENOTADIR if a component before the last is a file
+// ============================================================================
+i32 dirResolve(str path, i32* pisdir) {
+  i32  dinum;
+  char leaf[FNAMESIZE];
+
+  i32 ret = dirWalk(path, &dinum, leaf);
+  if (ret == EBIGFNAME) return EFNF;
+  if (ret != 0) return ret;
+
+  if (leaf[0] == 0) {                         // the root itself
+    if (pisdir != NULL) *pisdir = 1;
+    return dinum;
+  }
+  return dirLookup(dinum, leaf, pisdir);
+}
+
+
+
+// ============================================================================
+// Walk every component of 'path' but the last, starting at the root.  Store
+// the inum of the directory reached in '*pdinum', and the last component in
+// 'leaf' (FNAMESIZE bytes; "" if 'path' names the root).  Slashes separate
+// components; leading, trailing and repeated ones are ignored.  Return 0, or
+// EFNF if a directory on the way is missing, ENOTADIR if it is a file, and
+// EBIGFNAME if a component is FNAMESIZE chars or more
+// ============================================================================
+i32 dirWalk(str path, i32* pdinum, str leaf) {
+
+  if (path == NULL || pdinum == NULL || leaf == NULL) FATAL(ENULLPTR);
+
+  i32 dinum = ROOTINUM;
+  leaf[0] = 0;
+
+  str p = path;
+  for (;;) {
+    while (*p == '/') ++p;
+    if (*p == 0) break;
+
+    str q = p;
+    while (*q != 0 && *q != '/') ++q;
+    if (q - p > FNAMESIZE - 1) return EBIGFNAME;
+
+    if (leaf[0] != 0) {                       // previous one was a directory
+      i32 isdir;
+      i32 inum = dirLookup(dinum, leaf, &isdir);
+      if (inum == EFNF) return EFNF;
+      if (!isdir) return ENOTADIR;
+      dinum = inum;
+    }
+
+    memcpy(leaf, p, q - p);
+    leaf[q - p] = 0;
+    p = q;
+  }
+
+  *pdinum = dinum;
+  return 0;
+}
@@ -0,0 +1,29 @@
+#ifndef DIR_H
+#define DIR_H
+
+// ===================================================================
+// dir.h - Directories: Dentry blocks, path walks and the dentry cache
+// ===================================================================
+
+#include "alias.h"
+#include "bfs.h"
+
+#define DIRCACHESIZE  256     // # DirCache slots; a power of 2
+
+typedef struct {          // DirCache: one remembered (directory, name) lookup
+  i32  dinum;             // inum of the directory searched
+  i32  inum;              // inum found, or EFNF for a negative entry
+  i32  isdir;             // 1 => 'inum' is a directory
+  char name[FNAMESIZE];   // "" => slot empty
+} DirCache;
+
+i32  dirAdd      (i32 dinum, str name, i32 inum);
+void dirCacheClear();
+i32  dirIsEmpty  (i32 dinum);
+i32  dirLookup   (i32 dinum, str name, i32* pisdir);
+i32  dirNext     (i32 dinum, i32* pcursor, str name);
+i32  dirRemove   (i32 dinum, str name);
+i32  dirResolve  (str path, i32* pisdir);
+i32  dirWalk     (str path, i32* pdinum, str leaf);
+
+#endif
@@ -1,72 +1,118 @@
-// ============================================================================
-// errors.c
-// ============================================================================
-
-#include <stdio.h>
-#include <stdlib.h>
-#include "errors.h"
-
-void pause() {
-  printf("\nHit any key to finish ");
-  getchar();
-  exit(0);
-}
-
-
-
-void RepTest(int err, str file, int line) {
-  RepError(err);
-  printf(" in file %s at line %d \n", file, line);
-  pause();
-}
-
-
-void RepError(i32 e) {
-  switch(e) {
-    case EBADDBN:
-      printf("\nERROR: Bad DBN: negative or too large \n");    pause(); break;
-    case EBADFBN:
-      printf("\nERROR: Bad FBN: negative or too large \n");    pause(); break;
-    case EBADINUM:
-      printf("\nERROR: Bad Inum: negative or too large \n");   pause(); break;
-    case EBADCURS:
-      printf("\nERROR: Bad cursor within file \n");           pause(); break;
-    case EBADREAD:
-      printf("\nERROR: Error writing to BFS disk \n");         pause(); break;
-    case EBADWRITE:
-      printf("\nERROR: Error writing to BFS disk \n");         pause(); break;
-    case EBIGFNAME:
-      printf("\nERROR: Filename too big \n");                  pause(); break;
-    case EBIGNUMB:
-      printf("\nERROR: Read or write is too big \n");          pause(); break;
-    case EDIRFULL:
-      printf("\nERROR: Directory is already full \n");         pause(); break;
-    case EDISKCREATE:
-      printf("\nERROR: Failure creating BFS disk \n");         pause(); break;
-    case EDISKFULL:
-      printf("\nERROR: Disk is full \n");                      pause(); break;
-    case EEXISTS:
-      printf("\nERROR: Format would destroy current disk \n"); pause(); break;
-    case EFNF:
-      printf("\nERROR: File Not Found \n");                    pause(); break;
-    case ENEGNUMB:
-      printf("\nERROR: Negative # bytes in read or write \n"); pause(); break;
-    case ENODBN:
-      printf("\nERROR: No DBN yet allocated - non-fatal \n");  pause(); break;
-    case ENODISK:
-      printf("\nERROR: Cannot open the BFS disk \n");          pause(); break;
-    case ENOMEM:
-      printf("\nERROR: Failure to malloc memory \n");          pause(); break;
-    case ENULLPTR:
-      printf("\nERROR: About to deref a null pointer \n");     pause(); break;
-    case ENYI:
-      printf("\nERROR: Function Note Yet Implemented \n");     pause(); break;
-    case EOFTFULL:
-      printf("\nERROR: OpenFileTable is full \n");             pause(); break;
-    case EBADWHENCE:
-      printf("\nERROR: Invalid 'whence' in fsSeek \n");        pause(); break;
-    default:
-      printf("\nERROR: Miscellaneous error \n");               pause(); break;
-  }
-}
-
+// ============================================================================
+// errors.c
+// ============================================================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "errors.h"
+
+void pause() {
+  printf("\nHit any key to finish ");
+  getchar();
+  exit(0);
+}
+
+
+
+void RepTest(int err, str file, int line) {
+  RepError(err);
+  printf(" in file %s at line %d \n", file, line);
+  pause();
+}
+
+
+void RepError(i32 e) {
+  switch(e) {
+    case EBADDBN:
+      printf("\nERROR: Bad DBN: negative or too large \n");    pause(); break;
+    case EBADFBN:
+      printf("\nERROR: Bad FBN: negative or too large \n");    pause(); break;
+    case EBADINUM:
+      printf("\nERROR: Bad Inum: negative or too large \n");   pause(); break;
+    case EBADCURS:
+      printf("\nERROR: Bad cursor within file \n");           pause(); break;
+    case EBADREAD:
+      printf("\nERROR: Error writing to BFS disk \n");         pause(); break;
+    case EBADWRITE:
+      printf("\nERROR: Error writing to BFS disk \n");         pause(); break;
+    case EBIGFNAME:
+      printf("\nERROR: Filename too big \n");                  pause(); break;
+    case EBIGNUMB:
+      printf("\nERROR: Read or write is too big \n");          pause(); break;
+    case EDIRFULL:
+      printf("\nERROR: Directory is already full \n");         pause(); break;
+    case EDISKCREATE:
+      printf("\nERROR: Failure creating BFS disk \n");         pause(); break;
+    case EDISKFULL:
+      printf("\nERROR: Disk is full \n");                      pause(); break;
+    case EEXISTS:
+      printf("\nERROR: Format would destroy current disk \n"); pause(); break;
+    case EFNF:
+      printf("\nERROR: File Not Found \n");                    pause(); break;
+    case ENEGNUMB:
+      printf("\nERROR: Negative # bytes in read or write \n"); pause(); break;
+    case ENODBN:
+      printf("\nERROR: No DBN yet allocated - non-fatal \n");  pause(); break;
+    case ENODISK:
+      printf("\nERROR: Cannot open the BFS disk \n");          pause(); break;
+    case ENOMEM:
+      printf("\nERROR: Failure to malloc memory \n");          pause(); break;
+    case ENULLPTR:
+      printf("\nERROR: About to deref a null pointer \n");     pause(); break;
+    case ENYI:
+      printf("\nERROR: Function Note Yet Implemented \n");     pause(); break;
+    case EOFTFULL:
+      printf("\nERROR: OpenFileTable is full \n");             pause(); break;
+    case EPASTEOF:
+      printf("\nERROR: No data or hole past offset \n");       pause(); break;
+    case ENORUN:
+      printf("\nERROR: No free run big enough \n");            pause(); break;
+    case ECHANGED:
+      printf("\nERROR: File changed during operation \n");     pause(); break;
+    case EINLINE:
+      printf("\nERROR: File data is inline in its Inode \n");   pause(); break;
+    case EBADVERSION:
+      printf("\nERROR: Unknown BFS disk format - reformat \n");  pause(); break;
+    case EFEXISTS:
+      printf("\nERROR: File or directory already exists \n");  pause(); break;
+    case ENOTADIR:
+      printf("\nERROR: Path component is not a directory \n"); pause(); break;
+    case EISADIR:
+      printf("\nERROR: Is a directory \n");                   pause(); break;
+    case EDIRNOTEMPTY:
+      printf("\nERROR: Directory is not empty \n");           pause(); break;
+    case ENOINODE:
+      printf("\nERROR: No free Inode \n");                    pause(); break;
+    case EBADCRC:
+      printf("\nERROR: Block checksum mismatch \n");          pause(); break;
+    case ECOMPRESSED:
+      printf("\nERROR: File data is compressed \n");          pause(); break;
+    case EBADCOMP:
+      printf("\nERROR: Compressed cluster is corrupt \n");    pause(); break;
+    case ESNAPFULL:
+      printf("\nERROR: No free snapshot slot \n");            pause(); break;
+    case EROFS:
+      printf("\nERROR: Snapshot mounted read-only \n");       pause(); break;
+    case ECACHEFULL:
+      printf("\nERROR: Every cache page is pinned \n");       pause(); break;
+    case ENOBUFS:
+      printf("\nERROR: In-core object pool used up \n");      pause(); break;
+    case EBADOBJ:
+      printf("\nERROR: Object freed to the wrong slab \n");   pause(); break;
+    case EBADSTRIPE:
+      printf("\nERROR: Bad stripe set \n");                   pause(); break;
+    case ETRACEON:
+      printf("\nERROR: A trace is already on \n");           pause(); break;
+    case EBADTRACE:
+      printf("\nERROR: Not a BFS trace file \n");           pause(); break;
+    case EFOPEN:
+      printf("\nERROR: The file is open \n");               pause(); break;
+    case EHOSTIO:
+      printf("\nERROR: Cannot write to, or read, the host \n"); pause(); break;
+    case EBADWHENCE:
+      printf("\nERROR: Invalid 'whence' in fsSeek \n");        pause(); break;
+    default:
+      printf("\nERROR: Miscellaneous error \n");               pause(); break;
+  }
+}
+
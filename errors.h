@@ -1,36 +1,59 @@
-#ifndef ERRORS_H
-#define ERRORS_H
-
-#include "alias.h"
-
-#define FATAL(err) { printf("\nERROR: File %s, Line %d \n", __FILE__, __LINE__); \
-                     RepTest(err, __FILE__, __LINE__); }
-
-void RepTest(int err, str file, int line);
-
-#define EBADCURS    -1    // invalid cursor (byte offset into file)
-#define EBADDBN     -2    // invalid DBN
-#define EBADFBN     -3    // invalid FBN
-#define EBADINUM    -4    // invalid inum
-#define EBADREAD    -5    // error reading from BFS disk
-#define EBADWHENCE  -6    // Invalide 'whence' in fsSeek
-#define EBADWRITE   -7    // error writing to BFS disk
-#define EBIGFNAME   -8    // filename too big
-#define EBIGNUMB    -9    // number of bytes to transfer too big
-#define EDIRFULL    -10   // Directory full
-#define EDISKCREATE -11   // Failed to create new BFS disk
-#define EDISKFULL   -12   // BFS disk has no free blocks
-#define EEXISTS     -13   // BFS disk already exists, so don't format it!
-#define EFNF        -14   // File Not Found
-#define ENEGNUMB    -15   // negative number of bytes to transfer
-#define ENODBN      -16   // no DBN yet allocated - non fatal
-#define ENODISK     -17   // cannot open BFSDISK
-#define ENOMEM      -18   // no memory (malloc failed)
-#define ENULLPTR    -19   // about to deref a NULL pointer
-#define ENYI        -20   // not yet implemented
-#define EOFTFULL    -21   // OpenFileTable is full
-
-void pause();
-void RepError(i32 ret);
-
+#ifndef ERRORS_H
+#define ERRORS_H
+
+#include "alias.h"
+
+#define FATAL(err) { printf("\nERROR: File %s, Line %d \n", __FILE__, __LINE__); \
+                     RepTest(err, __FILE__, __LINE__); }
+
+void RepTest(int err, str file, int line);
+
+#define EBADCURS    -1    // invalid cursor (byte offset into file)
+#define EBADDBN     -2    // invalid DBN
+#define EBADFBN     -3    // invalid FBN
+#define EBADINUM    -4    // invalid inum
+#define EBADREAD    -5    // error reading from BFS disk
+#define EBADWHENCE  -6    // Invalide 'whence' in fsSeek
+#define EBADWRITE   -7    // error writing to BFS disk
+#define EBIGFNAME   -8    // filename too big
+#define EBIGNUMB    -9    // number of bytes to transfer too big
+#define EDIRFULL    -10   // Directory full
+#define EDISKCREATE -11   // Failed to create new BFS disk
+#define EDISKFULL   -12   // BFS disk has no free blocks
+#define EEXISTS     -13   // BFS disk already exists, so don't format it!
+#define EFNF        -14   // File Not Found
+#define ENEGNUMB    -15   // negative number of bytes to transfer
+#define ENODBN      -16   // no DBN yet allocated - non fatal
+#define ENODISK     -17   // cannot open BFSDISK
+#define ENOMEM      -18   // no memory (malloc failed)
+#define ENULLPTR    -19   // about to deref a NULL pointer
+#define ENYI        -20   // not yet implemented
+#define EOFTFULL    -21   // OpenFileTable is full
+#define EPASTEOF    -22   // no data or hole at/after offset - non fatal
+#define ENORUN      -23   // no free contiguous run big enough - non fatal
+#define ECHANGED    -24   // file changed during the operation - non fatal
+#define EINLINE     -25   // file data is inline in its Inode - non fatal
+#define EBADVERSION -26   // BFS disk has an unknown on-disk format
+#define EFEXISTS    -27   // a file or directory of that name exists
+#define ENOTADIR    -28   // path component is a file, not a directory
+#define EISADIR     -29   // expected a file, found a directory
+#define EDIRNOTEMPTY -30  // directory still holds entries
+#define ENOINODE    -31   // no free Inode
+#define EBADCRC     -32   // block contents do not match their checksum
+#define ECOMPRESSED -33   // file data is in compressed clusters - non fatal
+#define EBADCOMP    -34   // compressed cluster does not decompress
+#define ESNAPFULL   -35   // no free snapshot slot
+#define EROFS       -36   // a snapshot is mounted: read-only
+#define ECACHEFULL  -37   // every block cache page is pinned - non fatal
+#define ENOBUFS     -38   // an in-core object pool is used up - non fatal
+#define EBADOBJ     -39   // object freed to a slab it is not from
+#define EBADSTRIPE  -40   // stripe set too big, or stripe unit < 1
+#define EHOSTIO     -41   // cannot write to, or read, the host - non fatal
+#define ETRACEON    -42   // a trace is already being recorded - non fatal
+#define EBADTRACE   -43   // not a BFS trace file - non fatal
+#define EFOPEN      -44   // the file is open - non fatal
+
+void pause();
+void RepError(i32 ret);
+
 #endif
\ No newline at end of file
@@ -1,402 +1,1014 @@
-// ============================================================================
-// fs.c - user FileSytem API
-// ============================================================================
-
-#include "bfs.h"
-#include "fs.h"
-
-// ============================================================================
-// Close the file currently open on file descriptor 'fd'.
-// ============================================================================
-i32 fsClose(i32 fd) { 
-  i32 inum = bfsFdToInum(fd);
-  bfsDerefOFT(inum);
-  return 0; 
-}
-
-
-
-// ============================================================================
-// Create the file called 'fname'.  Overwrite, if it already exsists.
-// On success, return its file descriptor.  On failure, EFNF
-// ============================================================================
-i32 fsCreate(str fname) {
-  i32 inum = bfsCreateFile(fname);
-  if (inum == EFNF) return EFNF;
-  return bfsInumToFd(inum);
-}
-
-
-
-// ============================================================================
-// Format the BFS disk by initializing the SuperBlock, Inodes, Directory and 
-// Freelist.  On succes, return 0.  On failure, abort
-// ============================================================================
-i32 fsFormat() {
-  FILE* fp = fopen(BFSDISK, "w+b");
-  if (fp == NULL) FATAL(EDISKCREATE);
-
-  i32 ret = bfsInitSuper(fp);               // initialize Super block
-  if (ret != 0) { fclose(fp); FATAL(ret); }
-
-  ret = bfsInitInodes(fp);                  // initialize Inodes block
-  if (ret != 0) { fclose(fp); FATAL(ret); }
-
-  ret = bfsInitDir(fp);                     // initialize Dir block
-  if (ret != 0) { fclose(fp); FATAL(ret); }
-
-  ret = bfsInitFreeList();                  // initialize Freelist
-  if (ret != 0) { fclose(fp); FATAL(ret); }
-
-  fclose(fp);
-  return 0;
-}
-
-
-// ============================================================================
-// Mount the BFS disk.  It must already exist
-// ============================================================================
-i32 fsMount() {
-  FILE* fp = fopen(BFSDISK, "rb");
-  if (fp == NULL) FATAL(ENODISK);           // BFSDISK not found
-  fclose(fp);
-  return 0;
-}
-
-
-
-// ============================================================================
-// Open the existing file called 'fname'.  On success, return its file 
-// descriptor.  On failure, return EFNF
-// ============================================================================
-i32 fsOpen(str fname) {
-  i32 inum = bfsLookupFile(fname);        // lookup 'fname' in Directory
-  if (inum == EFNF) return EFNF;
-  return bfsInumToFd(inum);
-}
-
-
-
-// ============================================================================
-// Read 'numb' bytes of data from the cursor in the file currently fsOpen'd on
-// File Descriptor 'fd' into 'buf'.  On success, return actual number of bytes
-// read (may be less than 'numb' if we hit EOF).  On failure, abort
-// ============================================================================
-i32 fsRead(i32 fd, i32 numb, void* buf) {
-
-  //make a temporary bio buffer
-  i8 bio_buffer[BYTESPERBLOCK]; 
-
-  //variable to keep track of how many bytes of data we have left to read. 
-  i32 remaining_bytes = numb;
-
-  //get inum of the file to be read
-  i32 Inum = bfsFdToInum(fd);
-
-  //get cursor position of file
-  i32 cursor_position = fsTell(fd);
-
-  //get current block. This will hold the the index of the current block
-  i32 current_block = cursor_position / BYTESPERBLOCK;
-
-  //offset within the current block to account for the cursor
-  i32 remainder = cursor_position % BYTESPERBLOCK;
-  
-  //offset to traverse the buffer
-  i32 byte_offset = 0; 
-  
-  //used for end of file case
-  i32 start = cursor_position;
-
-  while(remaining_bytes > 0) //while there are still bytes of data continue reading blocks
-  {
-     bfsRead(Inum, current_block, bio_buffer); //read contents of block into buffer
-  
-     //if there is a remainder
-     if(remainder > 0) 
-     {
-        //get the bytes that we have left 
-        i32 bytes_left = BYTESPERBLOCK - remainder; 
-
-        //determine how much we have to read
-        if(remaining_bytes > bytes_left) //case for if there are more bytes to read than bytes left in the current block
-        {
-            remaining_bytes -= bytes_left;
-        }
-        else //case for if the current bytes left in this block can satisfy remaining bytes. 
-        {
-            bytes_left = remaining_bytes;
-            remaining_bytes = 0;
-        }
-        //copy data from bio_buffer to actual buffer (buf)
-        memcpy(buf + byte_offset, bio_buffer + remainder, bytes_left);
-        
-        //update the byte offset, set remainder to 0, and move the file cursor. 
-        byte_offset += bytes_left;
-        remainder = 0;
-        fsSeek(fd, bytes_left, SEEK_CUR);
-
-      }
-      else //case for if there is no remainder (process entire block)
-      {  
-         if(remaining_bytes >= BYTESPERBLOCK) 
-         {
-           memcpy(buf + byte_offset, bio_buffer, BYTESPERBLOCK);
-           remaining_bytes -= BYTESPERBLOCK;
-           byte_offset += BYTESPERBLOCK;
-           fsSeek(fd, BYTESPERBLOCK, SEEK_CUR);
-         }
-         else //final case for if remaining bytes left in block are less than the usual size (512)
-         {
-          memcpy(buf + byte_offset, bio_buffer, remaining_bytes);
-          fsSeek(fd, remaining_bytes, SEEK_CUR);
-          remaining_bytes = 0;
-
-         }
-
-      }
-      //if there are bytes left to process then adjust index to the next block
-      if(remaining_bytes != 0)
-      {
-        current_block++;
-      }
-  }
-      //test case for end of file
-      if(start + numb > fsSize(fd))
-      {
-        fsSeek(fd, fsSize(fd), SEEK_SET); //move cursor back if we have passed End of file
-
-        i32 total_read = fsSize(fd) - start;
-
-        return total_read; //return how much we were able to read
-      }
-      
-      return numb; //return numb for the cases where we don't deal with end of file
-}
-
-
-// ============================================================================
-// Move the cursor for the file currently open on File Descriptor 'fd' to the
-// byte-offset 'offset'.  'whence' can be any of:
-//
-//  SEEK_SET : set cursor to 'offset'
-//  SEEK_CUR : add 'offset' to the current cursor
-//  SEEK_END : add 'offset' to the size of the file
-//
-// On success, return 0.  On failure, abort
-// ============================================================================
-i32 fsSeek(i32 fd, i32 offset, i32 whence) {
-
-  if (offset < 0) FATAL(EBADCURS);
- 
-  i32 inum = bfsFdToInum(fd);
-  i32 ofte = bfsFindOFTE(inum);
-  
-  switch(whence) {
-    case SEEK_SET:
-      g_oft[ofte].curs = offset;
-      break;
-    case SEEK_CUR:
-      g_oft[ofte].curs += offset;
-      break;
-    case SEEK_END: {
-        i32 end = fsSize(fd);
-        g_oft[ofte].curs = end + offset;
-        break;
-      }
-    default:
-        FATAL(EBADWHENCE);
-  }
-  return 0;
-}
-
-
-
-// ============================================================================
-// Return the cursor position for the file open on File Descriptor 'fd'
-// ============================================================================
-i32 fsTell(i32 fd) {
-  return bfsTell(fd);
-}
-
-
-
-// ============================================================================
-// Retrieve the current file size in bytes.  This depends on the highest offset
-// written to the file, or the highest offset set with the fsSeek function.  On
-// success, return the file size.  On failure, abort
-// ============================================================================
-i32 fsSize(i32 fd) {
-  i32 inum = bfsFdToInum(fd);
-  return bfsGetSize(inum);
-}
-
-
-
-// ============================================================================
-// Write 'numb' bytes of data from 'buf' into the file currently fsOpen'd on
-// filedescriptor 'fd'.  The write starts at the current file offset for the
-// destination file.  On success, return 0.  On failure, abort
-// ============================================================================
-i32 fsWrite(i32 fd, i32 numb, void* buf) {
-
-    //make a temporary bio buffer
-    i8 bio_buffer[BYTESPERBLOCK];
-
-    //variable to keep track of how many bytes of data we have left to read. 
-    i32 remaining_bytes = numb;
-
-    //get inum of the file to be read
-    i32 Inum = bfsFdToInum(fd);
-    
-    //get cursor position of file
-    i32 cursor_position = fsTell(fd);
-
-    //get current block starting from the first FBN going all the way until the last. This will hold the the index of the current block
-    i32 current_block = cursor_position / BYTESPERBLOCK;
-
-    // Find where the cursor is
-    i32 remainder = cursor_position % BYTESPERBLOCK;
-
-    //offset to traverse the buffer
-    i32 byte_offset = 0;
-
-    //get total file size (size after writing the numb bytes)
-    i32 total_size = cursor_position + numb;
-    
-    //case for determining whether we need to allocate more blocks (allocation has exceeded file size)
-    if (fsSize(fd) < total_size) 
-    {
-
-      //determine current number of blocks that file has 
-      i32 num_of_current_blocks = 0;
-
-      //file has enough space fills up perfectly into whole blocks
-      if (fsSize(fd) % BYTESPERBLOCK == 0) 
-      {
-         num_of_current_blocks = fsSize(fd) / BYTESPERBLOCK;
-      }
-      //doesn't fit evenly we have some space in the last block (so we add a + 1 to account for this)
-      else if(fsSize(fd) % BYTESPERBLOCK != 0) 
-      {
-         num_of_current_blocks = fsSize(fd) / BYTESPERBLOCK + 1;
-      }
-
-    //variable for current space
-    i32 current_space = num_of_current_blocks * BYTESPERBLOCK;
-
-      
-      if (current_space < total_size) 
-      {
-
-        //determine how many blocks we need to allocated based on memory needed
-        i32 needed_memory = total_size - current_space;
-        i32 needed_blocks = 0;
-
-        //needed memory can fit into whole blocks evenly
-        if (needed_memory % BYTESPERBLOCK == 0) 
-        {
-          needed_blocks = needed_memory / BYTESPERBLOCK;
-        }
-        //needed memory doesn't fit into whole blocks evenly and has some partial space (we add a + 1 to account for that)
-        else if (needed_blocks % BYTESPERBLOCK != 0) 
-        {
-          needed_blocks = needed_memory / BYTESPERBLOCK + 1;
-        }
-    
-        //new size with added blocks
-        i32 new_size = num_of_current_blocks + needed_blocks;
-
-        //extend with new size
-        bfsExtend(Inum, new_size);
-      }
-
-      //update the size of the file
-      bfsSetSize(Inum, total_size);
-    
-    }
-    
-    remaining_bytes = numb;
-
-    while (remaining_bytes > 0) //as long as we have bytes to write
-    {
-        if (remainder > 0) //if there is a remainder (we don't start at the beginning of a block)
-        { 
-            //get the bytes that we have left
-            i32 bytes_left = BYTESPERBLOCK - remainder; 
-
-            //determine how many bytes we have to read
-            if (remaining_bytes > bytes_left) //case for if there are more bytes to write than bytes left in the current block
-            {
-                remaining_bytes -= bytes_left;
-            } 
-            else //case for if the current bytes left in this block can satisfy remaining bytes. 
-            { 
-                bytes_left = remaining_bytes;
-                remaining_bytes = 0;
-            }
-
-            //perform a bioRead into the bio_buffer
-            i32 dbn = bfsFbnToDbn(Inum, current_block);
-            bioRead(dbn, bio_buffer);
-
-            //write to the bio buffer starting at remainder
-            memcpy(bio_buffer + remainder, buf + byte_offset, bytes_left);
-            byte_offset += bytes_left;
-            remainder = 0;
-
-            //write the updated buffer back to the block using bioWrite
-            bioWrite(dbn, bio_buffer);
-
-            //move the cursor
-            fsSeek(fd, bytes_left, SEEK_CUR);
-        } 
-        else 
-        {   
-
-            // bioRead into bio buffer
-            i32 dbn = bfsFbnToDbn(Inum, current_block);
-            bioRead(dbn, bio_buffer);
-
-            
-            if (remaining_bytes >= BYTESPERBLOCK) //as long as remaining bytes are >= 512, write the entire block
-            { 
-
-                //copy a full block of bytes to bio buffer
-                memcpy(bio_buffer, buf + byte_offset, BYTESPERBLOCK);
-
-                // Update remaining bytes and byte offset
-                remaining_bytes -= BYTESPERBLOCK;
-                byte_offset += BYTESPERBLOCK;
-
-                //Write the updated bio buffer back to the block using bioWrite
-                bioWrite(dbn, bio_buffer);
-
-                //move the cursor
-                fsSeek(fd, BYTESPERBLOCK, SEEK_CUR);
-            } 
-            else //final case for if remaining bytes left in block are less than the usual size (512) 
-            { 
-                // copy the remaining bytes from buf to bio buffer
-                memcpy(bio_buffer, buf + byte_offset, remaining_bytes);
-
-                //write the updated bio buffer back to that block using bioWrite
-                bioWrite(dbn, bio_buffer);
-
-                //move the cursor
-                fsSeek(fd, remaining_bytes, SEEK_CUR);
-
-                //set remaining bytes to 0 since we have nothing left
-                remaining_bytes = 0;
-            }
-        }
-
-        //if there are bytes left to process then adjust index to the next block
-        if (remaining_bytes != 0) 
-        {
-            current_block++;
-        }
-    }
-
-    return 0;
-}
+// ============================================================================
+// fs.c - user FileSytem API
+// ============================================================================
+
+#include "aio.h"
+#include "arc.h"
+#include "bfs.h"
+#include "cache.h"
+#include "comp.h"
+#include "dedup.h"
+#include "dir.h"
+#include "fs.h"
+#include "log.h"
+#include "ref.h"
+#include "snap.h"
+#include "tail.h"
+#include "trace.h"
+#include "vol.h"
+#include "wb.h"
+
+// ============================================================================
+// Wait for future 'f', from fsReadAsync, fsWriteAsync or fsSyncAsync with no
+// callback, to complete.  Return what the synchronous call would have
+// returned.  'f' is given back: do not use it again
+// ============================================================================
+i32 fsAwait(FsFuture* f) {
+  return aioAwait(f);
+}
+
+
+
+// ============================================================================
+// Close the file currently open on file descriptor 'fd'.  The last close of
+// a file in append mode writes out its tail buffer (but does not sync)
+// ============================================================================
+i32 fsClose(i32 fd) { 
+  if (TRACING()) return traceClose(fd);
+  i32 inum = bfsFdToInum(fd);
+  if (bfsDerefOFT(inum) == 0) tailStop(inum, 0);
+  return 0; 
+}
+
+
+
+// ============================================================================
+// Clean the log of a log-structured volume now, rather than waiting for its
+// cleaner thread: empty the group with fewest live blocks into the log, and
+// merge the free runs left.  Return the # of blocks moved: 0 if there is no
+// group worth cleaning, or the volume is not log-structured.  EROFS while a
+// snapshot is mounted
+// ============================================================================
+i32 fsClean() {
+  if (snapReadOnly()) return EROFS;
+  return logClean();
+}
+
+
+
+// ============================================================================
+// Store the file 'path' compressed from now on: its data is rewritten at once
+// as LZ4-compressed clusters of CLUSTERBLOCKS blocks, and later writes are
+// compressed as they are made.  Text and logs take a third to a fifth of the
+// blocks.  On success, return 0.  If not found, EFNF; if a directory,
+// EISADIR; if bigger than COMPMAXSIZE, EBIGNUMB, and the file is left as is
+// ============================================================================
+i32 fsCompress(str path) {
+  if (snapReadOnly()) return EROFS;
+  i32 inum = bfsLookupFile(path);
+  if (inum < 0) return inum;
+  bfsDerefOFT(inum);                      // bfsLookupFile opened it
+  tailFlush(inum);
+  return compEnable(inum);
+}
+
+
+
+// ============================================================================
+// Copy bytes ['offset', 'offset' + 'len') of file 'src' to the same range of
+// file 'dst', creating 'dst' if need be, without a trip through the caller's
+// buffers.  Whole blocks are cloned, not copied: 'dst' shares the DBNs of
+// 'src', and either file gets its own copy of a block the first time it
+// changes it.  On success, return the # of bytes copied (fewer than 'len' if
+// 'src' ends first).  If 'src' is not found, EFNF; if either is a directory,
+// EISADIR
+// ============================================================================
+i32 fsCopy(str src, str dst, i32 offset, i32 len) {
+  if (snapReadOnly()) return EROFS;
+
+  i32 sinum = bfsLookupFile(src);
+  if (sinum < 0) return sinum;
+  bfsDerefOFT(sinum);                     // bfsLookupFile opened it
+
+  i32 dinum = bfsLookupFile(dst);
+  if (dinum == EFNF) dinum = bfsCreateFile(dst);
+  if (dinum < 0) return dinum;
+  bfsDerefOFT(dinum);
+
+  tailFlush(sinum);
+  tailFlush(dinum);
+  return bfsCopy(sinum, dinum, offset, len);
+}
+
+
+
+// ============================================================================
+// Create the file 'path', in a directory that already exists.  Overwrite, if
+// it already exsists.  On success, return its file descriptor.  If 'path' is
+// a directory, EISADIR; if the parent is missing, EFNF; if part of the parent
+// path is a file, ENOTADIR; if a component is too long, EBIGFNAME
+// ============================================================================
+i32 fsCreate(str path) {
+  if (TRACING()) return traceCreate(path);
+  if (snapReadOnly()) return EROFS;
+  i32 inum = bfsCreateFile(path);
+  if (inum < 0) return inum;
+  return bfsInumToFd(inum);
+}
+
+
+
+// ============================================================================
+// Deduplicate the file 'path' from now on: each whole block later written to
+// it, that matches a block already written to a deduplicated file, shares
+// that block instead of taking a new one.  A block of zeroes becomes a hole.
+// A shared block is copied when either file changes it.  On success, return
+// 0.  If not found, EFNF; if a directory, EISADIR
+// ============================================================================
+i32 fsDedup(str path) {
+  if (snapReadOnly()) return EROFS;
+  i32 inum = bfsLookupFile(path);
+  if (inum < 0) return inum;
+  bfsDerefOFT(inum);                      // bfsLookupFile opened it
+  tailFlush(inum);
+  return dedupEnable(inum);
+}
+
+
+
+// ============================================================================
+// Defragment the file 'path': move all its blocks into one free
+// contiguous run and swap its block map in one step.  Other files may be in
+// use meanwhile, but the file itself must be closed.  On success, return 0.
+// If the file is open, EFOPEN; if no free run is big enough, ENORUN; if the
+// file was opened or changed during the copy, ECHANGED; if not found, EFNF
+// ============================================================================
+i32 fsDefrag(str path) {
+  if (snapReadOnly()) return EROFS;
+  i32 inum = bfsFindInum(path);
+  if (inum == EFNF) return EFNF;
+  tailFlush(inum);
+  return bfsDefrag(inum);
+}
+
+
+
+// ============================================================================
+// Delete the file, or empty directory, 'path'.  The name disappears at once.
+// A small file's blocks are freed before returning; a big file (more than
+// RECLAIMASYNC blocks) is handed to the reclaim thread, so the caller does
+// not wait on the frees.  An open file cannot be deleted: close it first.
+// On success, return 0.  If not found, EFNF; if a directory that still holds
+// entries, EDIRNOTEMPTY; if the file is open, EFOPEN
+// ============================================================================
+i32 fsDelete(str path) {
+  if (snapReadOnly()) return EROFS;
+  i32 inum = bfsDeleteFile(path);
+  if (inum < 0) return inum;
+  tailStop(inum, 1);                      // appends not yet written: gone
+
+  i32 blocks = (bfsGetSize(inum) + BYTESPERBLOCK - 1) / BYTESPERBLOCK;
+  if (blocks > RECLAIMASYNC) {
+    bfsReclaimQueue(inum);
+  } else {
+    bfsReclaim(inum);
+  }
+  return 0;
+}
+
+
+
+// ============================================================================
+// Copy the tree below directory 'path' ("" for the root) out of BFS: into
+// host directory 'dest', created if need be; or, with 'mode' EXPORT_TAR, as
+// a tar archive into host file 'dest', "-" for stdout.  Every block is read
+// once, in DBN order over all the files.  Return 0; EFNF or ENOTADIR for a
+// bad 'path'; EBIGFNAME if a path is too long for the archive; EHOSTIO if
+// the host side cannot be written
+// ============================================================================
+i32 fsExport(str path, str dest, i32 mode) {
+  return arcExport(path, dest, mode);
+}
+
+
+
+// ============================================================================
+// Reserve disk blocks for bytes ['offset', 'offset' + 'len') of the file open
+// on File Descriptor 'fd', as contiguous runs taken in one go.  Blocks that
+// are already mapped are left alone.  By default the new blocks are marked
+// unwritten (read as zeroes, no disk writes); 'mode' FALLOC_ZERO zeroes them
+// on disk instead.  Later fsWrites into the range need no allocation.  The
+// file grows to cover the range.  On success, return 0.  If the disk has
+// too few free blocks, EDISKFULL, and nothing is reserved
+// ============================================================================
+i32 fsFallocate(i32 fd, i32 offset, i32 len, i32 mode) {
+  if (snapReadOnly()) return EROFS;
+  i32 inum = bfsFdToInum(fd);
+  tailFlush(inum);
+  return bfsFallocate(inum, offset, len, mode & FALLOC_ZERO);
+}
+
+
+
+// ============================================================================
+// Format the BFS disk by initializing the block checksums, SuperBlock, Inodes,
+// root directory Freelist.  On succes, return 0.  On failure, abort
+// ============================================================================
+i32 fsFormat() {
+  bioCreate();                              // create every disk image
+  FILE* fp = fopen(g_vol->path, "rb+");
+  if (fp == NULL) FATAL(EDISKCREATE);
+
+  bioCrcFormat();                           // initialize checksum block
+  cacheReset();                             // nothing cached is valid now
+  tailReset();                              //   nor any append buffered
+
+  i32 ret = bfsInitSuper(fp);               // initialize Super block
+  if (ret != 0) { fclose(fp); FATAL(ret); }
+
+  ret = bfsInitInodes(fp);                  // initialize Inodes block
+  if (ret != 0) { fclose(fp); FATAL(ret); }
+
+  ret = bfsInitDir(fp);                     // initialize Dir block
+  if (ret != 0) { fclose(fp); FATAL(ret); }
+
+  ret = bfsInitFreeList();                  // initialize Freelist
+  if (ret != 0) { fclose(fp); FATAL(ret); }
+
+  refFormat();                              // no block shared yet
+  snapFormat();                             //   and no snapshots
+
+  fclose(fp);
+  dirCacheClear();
+  dedupReset();
+  logReset();
+  return 0;
+}
+
+
+// ============================================================================
+// Return the fragmentation score of the file 'path', in extents
+// (runs of disk-contiguous blocks) per MB.  A contiguous file scores
+// 1024 / its size in KB; lower is better.  On failure, EFNF
+// ============================================================================
+i32 fsFragScore(str path) {
+  i32 inum = bfsFindInum(path);
+  if (inum == EFNF) return EFNF;
+  return bfsFragScore(inum, NULL, NULL);
+}
+
+
+
+// ============================================================================
+// Build BFS disk image 'image', formatted afresh, from the tree below host
+// directory 'host': every file and directory in it, but for special files.
+// The tree is planned first, and if it does not fit, nothing is written.
+// The image is built as '<image>.tmp' and renamed over 'image' only once
+// complete, so on any failure 'image' is left as it was.  'image' must not be
+// mounted.  The calling thread stays on its volume.
+// Return 0; EHOSTIO if the host tree cannot be read; EBIGFNAME if a name or
+// path is too long; ENOINODE if there are too many entries; EDISKFULL if
+// their blocks do not fit
+// ============================================================================
+i32 fsImport(str host, str image) {
+  return arcImport(host, image);
+}
+
+
+
+// ============================================================================
+// Mount the BFS disk image 'path', and make it the calling thread's volume:
+// the one every fs call it makes works on (see fsUse).  If 'path' is NULL, or
+// is already the thread's volume, remount that.  Else the image gets a volume
+// of its own, sharing nothing in memory with any other.  'options'
+// MOUNT_FORMAT formats the image first; else it must already exist, in the
+// current on-disk format, with a sound checksum block and SuperBlock.
+// MOUNT_LOG makes the volume log-structured, for good (see log.c).
+// Restart the reclaim of any file whose delete was interrupted.  Return the
+// volume, or NULL if NUMVOLUMES are already mounted, or 'path' is too long
+// ============================================================================
+BfsVolume* fsMount(str path, i32 options) {
+  if (path != NULL && strcmp(path, g_vol->path) != 0) {
+    BfsVolume* vol = volAlloc(path);
+    if (vol == NULL) return NULL;
+    volUse(vol);
+  }
+
+  logRelease();                             // from an earlier mount
+  if (options & MOUNT_FORMAT) fsFormat();
+
+  FILE* fp = fopen(g_vol->path, "rb");
+  if (fp == NULL) FATAL(ENODISK);           // disk image not found
+  fclose(fp);
+
+  i8 buf[BYTESPERBLOCK] = {0};
+  bioReadRaw(DBNSUPER, 1, buf);             // older formats have no checksums
+  Super* super = (Super*)buf;
+  if (super->version != BFSVERSION) FATAL(EBADVERSION);
+
+  bioCrcReset();                            // re-read the checksums
+  cacheReset();                             //   and every cached block
+  bioRead(DBNSUPER, buf);
+  refReset();                               //   and the refcounts
+  snapReset();                              //   and go back to the live tree
+
+  dirCacheClear();
+  dedupReset();
+  if (options & MOUNT_LOG) logEnable();
+  logReset();
+  bfsReclaimRecover();
+  return g_vol;
+}
+
+
+
+// ============================================================================
+// Mount a volume striped (RAID-0) over the 'n' disk images 'paths', 'unit'
+// blocks per stripe unit, as fsMount mounts one.  Each image may be on a
+// different disk: runs of blocks that span images are split and go to every
+// image at once.  Every mount of the set must give the same images, in the
+// same order, with the same 'unit'.  Return as fsMount
+// ============================================================================
+BfsVolume* fsMountStriped(i32 n, str* paths, i32 unit, i32 options) {
+  if (n < 1) FATAL(EBADSTRIPE);
+  if (strcmp(paths[0], g_vol->path) != 0) {
+    BfsVolume* vol = volAlloc(paths[0]);
+    if (vol == NULL) return NULL;
+    volUse(vol);
+  }
+  bioStripeSet(n, paths, unit);
+  return fsMount(NULL, options);
+}
+
+
+
+// ============================================================================
+// Create the directory 'path'.  Its parent directory must already exist.  On
+// success, return 0.  Return EFEXISTS if 'path' is taken, EFNF if the parent
+// is missing, ENOTADIR if part of the parent path is a file, and EBIGFNAME if
+// a component is too long
+// ============================================================================
+i32 fsMkdir(str path) {
+  if (snapReadOnly()) return EROFS;
+  i32 inum = bfsMakeDir(path);
+  return (inum < 0) ? inum : 0;
+}
+
+
+
+// ============================================================================
+// Open the existing file 'path', eg "a/b/c".  On success, return its file
+// descriptor.  On failure, return EFNF; if 'path' is a directory, EISADIR
+// ============================================================================
+i32 fsOpen(str path) {
+  if (TRACING()) return traceOpen(path);
+  i32 inum = bfsLookupFile(path);         // walk 'path' from the root
+  if (inum < 0) return inum;
+  return bfsInumToFd(inum);
+}
+
+
+
+// ============================================================================
+// Open the existing file 'path', as fsOpen does, in 'mode'.  OPEN_APPEND puts
+// the file in append mode, until its last fsClose: every fsWrite goes to the
+// end of the file, whatever the cursor, and is held in a tail buffer in
+// memory rather than written at once.  fsSync makes appends durable.  On
+// success, return its file descriptor.  On failure, as fsOpen; or ENOBUFS
+// if too many files are open for append
+// ============================================================================
+i32 fsOpenMode(str path, i32 mode) {
+  if ((mode & OPEN_APPEND) && snapReadOnly()) return EROFS;
+  i32 inum = bfsLookupFile(path);
+  if (inum < 0) return inum;
+  if ((mode & OPEN_APPEND) && tailStart(inum) == ENOBUFS) {
+    bfsDerefOFT(inum);
+    return ENOBUFS;
+  }
+  return bfsInumToFd(inum);
+}
+
+
+
+// ============================================================================
+// Run the callbacks of the asynchronous calls the calling thread made that
+// have completed, on that thread: an event loop calls this whenever it is
+// idle.  Other threads' callbacks wait for their own fsPoll.  With 'wait'
+// set, block until one completes, unless none of the thread's is in flight.
+// Return the # of callbacks run
+// ============================================================================
+i32 fsPoll(i32 wait) {
+  return aioPoll(wait);
+}
+
+
+
+// ============================================================================
+// Read 'numb' bytes of data from the cursor in the file currently fsOpen'd on
+// File Descriptor 'fd' into 'buf'.  On success, return actual number of bytes
+// read (may be less than 'numb' if we hit EOF).  On failure, abort
+// ============================================================================
+i32 fsRead(i32 fd, i32 numb, void* buf) {
+  if (TRACING()) return traceRead(fd, numb, buf);
+
+  //make a temporary bio buffer
+  i8 bio_buffer[BYTESPERBLOCK]; 
+
+  //variable to keep track of how many bytes of data we have left to read. 
+  i32 remaining_bytes = numb;
+
+  //get inum of the file to be read
+  i32 Inum = bfsFdToInum(fd);
+
+  //write out anything still sitting in the file's append buffer, so we read it too
+  tailFlush(Inum);
+
+  //get cursor position of file
+  i32 cursor_position = fsTell(fd);
+
+  //get current block. This will hold the the index of the current block
+  i32 current_block = cursor_position / BYTESPERBLOCK;
+
+  //offset within the current block to account for the cursor
+  i32 remainder = cursor_position % BYTESPERBLOCK;
+  
+  //offset to traverse the buffer
+  i32 byte_offset = 0; 
+  
+  //used for end of file case
+  i32 start = cursor_position;
+
+  while(remaining_bytes > 0) //while there are still bytes of data continue reading blocks
+  {
+     //case for block aligned reads of whole blocks: read the longest run of blocks that are
+     //contiguous on disk straight into buf, with one I/O
+     if(remainder == 0 && remaining_bytes >= BYTESPERBLOCK)
+     {
+        i32 dbn = 0;
+        i32 run = bfsMapRun(Inum, current_block, remaining_bytes / BYTESPERBLOCK, &dbn);
+        if(run > 1)
+        {
+           bioReadRun(dbn, run, buf + byte_offset);
+           byte_offset += run * BYTESPERBLOCK;
+           remaining_bytes -= run * BYTESPERBLOCK;
+           fsSeek(fd, run * BYTESPERBLOCK, SEEK_CUR);
+           current_block += run;
+           continue;
+        }
+     }
+
+     bfsRead(Inum, current_block, bio_buffer); //read contents of block into buffer
+  
+     //if there is a remainder
+     if(remainder > 0) 
+     {
+        //get the bytes that we have left 
+        i32 bytes_left = BYTESPERBLOCK - remainder; 
+
+        //determine how much we have to read
+        if(remaining_bytes > bytes_left) //case for if there are more bytes to read than bytes left in the current block
+        {
+            remaining_bytes -= bytes_left;
+        }
+        else //case for if the current bytes left in this block can satisfy remaining bytes. 
+        {
+            bytes_left = remaining_bytes;
+            remaining_bytes = 0;
+        }
+        //copy data from bio_buffer to actual buffer (buf)
+        memcpy(buf + byte_offset, bio_buffer + remainder, bytes_left);
+        
+        //update the byte offset, set remainder to 0, and move the file cursor. 
+        byte_offset += bytes_left;
+        remainder = 0;
+        fsSeek(fd, bytes_left, SEEK_CUR);
+
+      }
+      else //case for if there is no remainder (process entire block)
+      {  
+         if(remaining_bytes >= BYTESPERBLOCK) 
+         {
+           memcpy(buf + byte_offset, bio_buffer, BYTESPERBLOCK);
+           remaining_bytes -= BYTESPERBLOCK;
+           byte_offset += BYTESPERBLOCK;
+           fsSeek(fd, BYTESPERBLOCK, SEEK_CUR);
+         }
+         else //final case for if remaining bytes left in block are less than the usual size (512)
+         {
+          memcpy(buf + byte_offset, bio_buffer, remaining_bytes);
+          fsSeek(fd, remaining_bytes, SEEK_CUR);
+          remaining_bytes = 0;
+
+         }
+
+      }
+      //if there are bytes left to process then adjust index to the next block
+      if(remaining_bytes != 0)
+      {
+        current_block++;
+      }
+  }
+      //test case for end of file
+      if(start + numb > fsSize(fd))
+      {
+        fsSeek(fd, fsSize(fd), SEEK_SET); //move cursor back if we have passed End of file
+
+        i32 total_read = fsSize(fd) - start;
+
+        return total_read; //return how much we were able to read
+      }
+      
+      return numb; //return numb for the cases where we don't deal with end of file
+}
+
+
+
+// ============================================================================
+// Read directory 'path' one entry at a time.  Start with '*pcursor' = 0; each
+// call copies the next entry's name into 'name', which must hold FNAMESIZE
+// (60) bytes, and advances '*pcursor'.  Return 1 for an entry, 0 at the end.
+// Return EFNF if 'path' does not exist, and ENOTADIR if it is a file
+// ============================================================================
+i32 fsReaddir(str path, i32* pcursor, str name) {
+  i32 isdir;
+  i32 dinum = dirResolve(path, &isdir);
+  if (dinum < 0) return dinum;
+  if (!isdir) return ENOTADIR;
+  return (dirNext(dinum, pcursor, name) > 0) ? 1 : 0;
+}
+
+
+
+// ============================================================================
+// Queue a read of 'numb' bytes, from the cursor in the file open on 'fd',
+// into 'buf', and return at once.  Calls on one fd run in the order they are
+// made, each as fsRead would.  On completion 'done'(bytes read, 'arg') is
+// run by fsPoll; with 'done' NULL, get the result from fsAwait instead.
+// 'buf' must stay put until then.  Return the future, or NULL if AIOSLOTS
+// (256) calls are in flight
+// ============================================================================
+FsFuture* fsReadAsync(i32 fd, i32 numb, void* buf, FsDone done, void* arg) {
+  return aioSubmit(AIOREAD, fd, numb, buf, done, arg);
+}
+
+
+
+// ============================================================================
+// Return 1 if future 'f' has completed, so fsAwait will not block; else 0
+// ============================================================================
+i32 fsReady(FsFuture* f) {
+  return aioReady(f);
+}
+
+
+
+// ============================================================================
+// Lend bytes ['offset', 'offset' + 'len') of the file open on File Descriptor
+// 'fd', in place, as read-only spans of pinned block cache pages: one span
+// per block, in file order, up to VIEWSPANS blocks.  Nothing is copied into
+// the caller's memory.  The pages stay put, and keep their bytes even if the
+// file is rewritten meanwhile, until fsReleaseView.  The cursor is not moved.
+// On success, return the # of bytes lent in '*view' (fewer than 'len' at EOF
+// or past VIEWSPANS blocks; 0 at EOF).  If every cache page is pinned
+// already, ECACHEFULL
+// ============================================================================
+i32 fsReadView(i32 fd, i32 offset, i32 len, View* view) {
+
+  if (view == NULL) FATAL(ENULLPTR);
+  if (offset < 0)   FATAL(EBADCURS);
+  if (len < 0)      FATAL(ENEGNUMB);
+
+  memset(view, 0, sizeof(View));
+  i32 inum = bfsFdToInum(fd);
+  tailFlush(inum);
+
+  bfsLock();                              // no writer between map and pin
+
+  i32 end = bfsGetSize(inum);
+  if (offset + len < end) end = offset + len;
+
+  for (i32 pos = offset; pos < end && view->nspans < VIEWSPANS; ) {
+    i32 fbn = pos / BYTESPERBLOCK;
+    i32 lo  = pos % BYTESPERBLOCK;
+    i32 hi  = (end - fbn * BYTESPERBLOCK < BYTESPERBLOCK)
+            ? end - fbn * BYTESPERBLOCK : BYTESPERBLOCK;
+
+    i32 slot;
+    i32 dbn = bfsFbnToDbn(inum, fbn);
+    if (dbn > 0) {                        // the disk block itself
+      slot = cacheGet(dbn);
+    } else {                              // hole, inline or compressed
+      slot = cacheNew();
+      if (slot >= 0) bfsRead(inum, fbn, cacheData(slot));
+    }
+    if (slot < 0) break;                  // cache all pinned
+
+    ViewSpan* vs = &view->spans[view->nspans];
+    vs->data = cacheData(slot) + lo;
+    vs->len  = hi - lo;
+    view->slots[view->nspans++] = slot;
+    view->len += hi - lo;
+
+    pos = fbn * BYTESPERBLOCK + hi;
+  }
+
+  bfsUnlock();
+
+  if (view->nspans == 0 && offset < end) return ECACHEFULL;
+  return view->len;
+}
+
+
+
+// ============================================================================
+// Give back the cache pages lent by fsReadView in '*view', and empty it.
+// Return 0
+// ============================================================================
+i32 fsReleaseView(View* view) {
+  if (view == NULL) FATAL(ENULLPTR);
+  for (i32 i = 0; i < view->nspans; ++i) cachePut(view->slots[i]);
+  memset(view, 0, sizeof(View));
+  return 0;
+}
+
+
+
+// ============================================================================
+// Move the cursor for the file currently open on File Descriptor 'fd' to the
+// byte-offset 'offset'.  'whence' can be any of:
+//
+//  SEEK_SET : set cursor to 'offset'
+//  SEEK_CUR : add 'offset' to the current cursor
+//  SEEK_END : add 'offset' to the size of the file
+//  SEEK_DATA: set cursor to the first byte at or after 'offset' that is data
+//  SEEK_HOLE: set cursor to the first byte at or after 'offset' in a hole
+//             (EOF counts as a hole)
+//
+// Seeking beyond EOF does not allocate anything; a later fsWrite allocates
+// only the blocks it touches, leaving holes in between.  On success, return
+// 0.  If SEEK_DATA/SEEK_HOLE find nothing at or after 'offset', return
+// EPASTEOF and leave the cursor alone.  On failure, abort
+// ============================================================================
+i32 fsSeek(i32 fd, i32 offset, i32 whence) {
+  if (TRACING()) return traceSeek(fd, offset, whence);
+
+  if (offset < 0) FATAL(EBADCURS);
+ 
+  i32 inum = bfsFdToInum(fd);
+  i32 ofte = bfsFindOFTE(inum);
+  if (whence != SEEK_SET && whence != SEEK_CUR) tailFlush(inum);
+  
+  switch(whence) {
+    case SEEK_SET:
+      g_vol->oft[ofte].curs = offset;
+      break;
+    case SEEK_CUR:
+      g_vol->oft[ofte].curs += offset;
+      break;
+    case SEEK_END: {
+        i32 end = fsSize(fd);
+        g_vol->oft[ofte].curs = end + offset;
+        break;
+      }
+    case SEEK_DATA: {
+        i32 curs = bfsSeekData(inum, offset);
+        if (curs == EPASTEOF) return EPASTEOF;
+        g_vol->oft[ofte].curs = curs;
+        break;
+      }
+    case SEEK_HOLE: {
+        i32 curs = bfsSeekHole(inum, offset);
+        if (curs == EPASTEOF) return EPASTEOF;
+        g_vol->oft[ofte].curs = curs;
+        break;
+      }
+    default:
+        FATAL(EBADWHENCE);
+  }
+  return 0;
+}
+
+
+
+// ============================================================================
+// Return the cursor position for the file open on File Descriptor 'fd'
+// ============================================================================
+i32 fsTell(i32 fd) {
+  return bfsTell(fd);
+}
+
+
+
+// ============================================================================
+// Retrieve the current file size in bytes.  This depends on the highest offset
+// written to the file, or the highest offset set with the fsSeek function.  On
+// success, return the file size.  On failure, abort
+// ============================================================================
+i32 fsSize(i32 fd) {
+  i32 inum = bfsFdToInum(fd);
+  tailFlush(inum);
+  return bfsGetSize(inum);
+}
+
+
+
+// ============================================================================
+// Take snapshot 'name' of the whole tree: every file and directory as it is
+// now.  Costs the same however big the tree; from then on, blocks the
+// snapshot shares are copied when the live tree changes them.  On success,
+// return 0.  If 'name' is taken, EFEXISTS; if NUMSNAPS snapshots exist,
+// ESNAPFULL
+// ============================================================================
+i32 fsSnapshot(str name) {
+  if (snapReadOnly()) return EROFS;
+  tailFlushAll();
+  return snapCreate(name);
+}
+
+
+
+// ============================================================================
+// Delete snapshot 'name', freeing the blocks only it still held.  On success,
+// return 0.  If not found, EFNF
+// ============================================================================
+i32 fsSnapshotDelete(str name) {
+  if (snapReadOnly()) return EROFS;
+  return snapDelete(name);
+}
+
+
+
+// ============================================================================
+// Mount snapshot 'name' read-only, in place of the live tree: fsOpen, fsRead
+// and fsReaddir see the tree as it was, and every call that would change it
+// returns EROFS.  fsMount goes back to the live tree.  On success, return 0.
+// If not found, EFNF
+// ============================================================================
+i32 fsSnapshotMount(str name) {
+  return snapMount(name);
+}
+
+
+
+// ============================================================================
+// Make everything written to the file open on File Descriptor 'fd' durable:
+// its data, then its size, flushed to the disk in that order.  Syncs of one
+// file by many threads at once are merged into a flush or two (group
+// commit).  Return 0
+// ============================================================================
+i32 fsSync(i32 fd) {
+  i32 inum = bfsFdToInum(fd);
+  return tailSync(inum);
+}
+
+
+
+// ============================================================================
+// Queue an fsSync of the file open on 'fd', behind the calls on 'fd' made
+// before it, and return at once.  Completes as fsReadAsync does
+// ============================================================================
+FsFuture* fsSyncAsync(i32 fd, FsDone done, void* arg) {
+  return aioSubmit(AIOSYNC, fd, 0, NULL, done, arg);
+}
+
+
+
+// ============================================================================
+// Start recording every fsOpen, fsCreate, fsRead, fsWrite, fsSeek and fsClose,
+// by any thread, with its timing, to trace file 'path' on the host, for
+// bfsreplay.  Return 0; ETRACEON if a trace is already on; EHOSTIO if
+// 'path' cannot be written
+// ============================================================================
+i32 fsTraceStart(str path) {
+  return traceStart(path);
+}
+
+
+
+// ============================================================================
+// Stop the trace, and close its file.  Return the # of calls recorded, or
+// EHOSTIO if the trace could not be written
+// ============================================================================
+i32 fsTraceStop() {
+  return traceStop();
+}
+
+
+
+// ============================================================================
+// Set the size of the file open on File Descriptor 'fd' to 'size'.  Blocks
+// wholly beyond the new EOF go back to the Freelist; growing leaves a hole.
+// The cursor is not moved.  On success, return 0.  If a compressed file
+// would grow past COMPMAXSIZE, EBIGNUMB.  On failure, abort
+// ============================================================================
+i32 fsTruncate(i32 fd, i32 size) {
+  if (snapReadOnly()) return EROFS;
+  i32 inum = bfsFdToInum(fd);
+  tailFlush(inum);
+  return bfsTruncate(inum, size);
+}
+
+
+
+// ============================================================================
+// Unmount the calling thread's volume.  Writes out every append buffer, and
+// waits for background reclaim to finish, so every deleted file's blocks are
+// back on the Freelist, and for the log's cleaner, and writes back the
+// checksum table and every dirty block.  A volume other than BFSDISK's is
+// then released, and the thread goes back to BFSDISK's
+// ============================================================================
+i32 fsUnmount() {
+  aioDrain(g_vol);                          // let its async calls finish
+  tailFlushAll();
+  bfsReclaimDrain();
+  logDrain();
+  logRelease();
+  bioCrcSync();
+  if (g_vol != &g_bootvol) {                // done with it for good
+    bfsReclaimStop();
+    logStop();
+    wbStop();
+    volFree(volUse(&g_bootvol));
+  } else {
+    wbFlush();
+  }
+  return 0;
+}
+
+
+
+// ============================================================================
+// Make 'vol', from fsMount, the calling thread's volume, so every fs call it
+// makes from now on works on that disk image.  A new thread starts on the
+// volume for BFSDISK.  Return the thread's volume before
+// ============================================================================
+BfsVolume* fsUse(BfsVolume* vol) {
+  if (vol == NULL) FATAL(ENULLPTR);
+  return volUse(vol);
+}
+
+
+
+// ============================================================================
+// Write 'numb' bytes of data from 'buf' into the file currently fsOpen'd on
+// filedescriptor 'fd'.  The write starts at the current file offset for the
+// destination file.  On success, return 0.  If a compressed file would grow
+// past COMPMAXSIZE, EBIGNUMB, and nothing is written.  On failure, abort
+// ============================================================================
+i32 fsWrite(i32 fd, i32 numb, void* buf) {
+  if (TRACING()) return traceWrite(fd, numb, buf);
+
+    //nothing may change while a snapshot is mounted
+    if (snapReadOnly()) return EROFS;
+
+    //make a temporary bio buffer
+    i8 bio_buffer[BYTESPERBLOCK];
+
+    //variable to keep track of how many bytes of data we have left to read. 
+    i32 remaining_bytes = numb;
+
+    //get inum of the file to be read
+    i32 Inum = bfsFdToInum(fd);
+
+    //case for a file opened OPEN_APPEND: the bytes go to its tail buffer, at EOF,
+    //and the cursor follows them
+    i32 end_of_file;
+    i32 appended = tailAppend(Inum, numb, buf, &end_of_file);
+    if (appended < 0) return appended;
+    if (appended)
+    {
+        bfsSetCursor(Inum, end_of_file);
+        return 0;
+    }
+    
+    //get cursor position of file
+    i32 cursor_position = fsTell(fd);
+
+    //get current block starting from the first FBN going all the way until the last. This will hold the the index of the current block
+    i32 current_block = cursor_position / BYTESPERBLOCK;
+
+    // Find where the cursor is
+    i32 remainder = cursor_position % BYTESPERBLOCK;
+
+    //offset to traverse the buffer
+    i32 byte_offset = 0;
+
+    //case for a small file that still fits inside its inode: the write is done right there
+    if (bfsWriteInline(Inum, cursor_position, numb, buf))
+    {
+        fsSeek(fd, numb, SEEK_CUR);
+        return 0;
+    }
+
+    //case for a compressed file: each cluster the write touches is patched and recompressed
+    i32 compressed = compWrite(Inum, cursor_position, numb, buf);
+    if (compressed < 0) return compressed;
+    if (compressed)
+    {
+        fsSeek(fd, numb, SEEK_CUR);
+        return 0;
+    }
+
+    //get total file size (size after writing the numb bytes)
+    i32 total_size = cursor_position + numb;
+    
+    //case for a write that extends the file. Only the blocks the write touches get allocated
+    //(inside the loop below), so any gap between the old EOF and the cursor stays a hole
+    if (fsSize(fd) < total_size) 
+    {
+      //update the size of the file
+      bfsSetSize(Inum, total_size);
+    }
+    
+    remaining_bytes = numb;
+
+    while (remaining_bytes > 0) //as long as we have bytes to write
+    {
+        if (remainder > 0) //if there is a remainder (we don't start at the beginning of a block)
+        { 
+            //get the bytes that we have left
+            i32 bytes_left = BYTESPERBLOCK - remainder; 
+
+            //determine how many bytes we have to read
+            if (remaining_bytes > bytes_left) //case for if there are more bytes to write than bytes left in the current block
+            {
+                remaining_bytes -= bytes_left;
+            } 
+            else //case for if the current bytes left in this block can satisfy remaining bytes. 
+            { 
+                bytes_left = remaining_bytes;
+                remaining_bytes = 0;
+            }
+
+            //read the block into the bio_buffer (a hole reads as zeroes)
+            bfsRead(Inum, current_block, bio_buffer);
+
+            //write to the bio buffer starting at remainder
+            memcpy(bio_buffer + remainder, buf + byte_offset, bytes_left);
+            byte_offset += bytes_left;
+            remainder = 0;
+
+            //write the updated buffer back to the block (allocating it, or copying it if shared)
+            bfsWriteBlock(Inum, current_block, bio_buffer, 0);
+
+            //move the cursor
+            fsSeek(fd, bytes_left, SEEK_CUR);
+        } 
+        else 
+        {   
+
+            if (remaining_bytes >= BYTESPERBLOCK) //as long as remaining bytes are >= 512, write the entire block (no need to read it first)
+            { 
+
+                //copy a full block of bytes to bio buffer
+                memcpy(bio_buffer, buf + byte_offset, BYTESPERBLOCK);
+
+                // Update remaining bytes and byte offset
+                remaining_bytes -= BYTESPERBLOCK;
+                byte_offset += BYTESPERBLOCK;
+
+                //Write the whole block (a dedup file may share an identical block instead)
+                bfsWriteBlock(Inum, current_block, bio_buffer, 1);
+
+                //move the cursor
+                fsSeek(fd, BYTESPERBLOCK, SEEK_CUR);
+            } 
+            else //final case for if remaining bytes left in block are less than the usual size (512) 
+            { 
+                //read the block into bio buffer to keep its tail (zeroes for a hole)
+                bfsRead(Inum, current_block, bio_buffer);
+
+                // copy the remaining bytes from buf to bio buffer
+                memcpy(bio_buffer, buf + byte_offset, remaining_bytes);
+
+                //write the updated bio buffer back to that block
+                bfsWriteBlock(Inum, current_block, bio_buffer, 0);
+
+                //move the cursor
+                fsSeek(fd, remaining_bytes, SEEK_CUR);
+
+                //set remaining bytes to 0 since we have nothing left
+                remaining_bytes = 0;
+            }
+        }
+
+        //if there are bytes left to process then adjust index to the next block
+        if (remaining_bytes != 0) 
+        {
+            current_block++;
+        }
+    }
+
+    return 0;
+}
+
+
+
+// ============================================================================
+// Queue a write of 'numb' bytes from 'buf', at the cursor in the file open on
+// 'fd', and return at once.  Completes as fsReadAsync does, with what fsWrite
+// returns
+// ============================================================================
+FsFuture* fsWriteAsync(i32 fd, i32 numb, void* buf, FsDone done, void* arg) {
+  return aioSubmit(AIOWRITE, fd, numb, buf, done, arg);
+}
@@ -1,23 +1,89 @@
-#ifndef FS_H
-#define FS_H
-
-// ===================================================================
-// fs.h - File System user interface
-// ===================================================================
-
-#include <stdio.h>
-#include "alias.h"
-#include "errors.h"
-
-i32 fsClose (i32 fd);
-i32 fsCreate(str name);
-i32 fsFormat();
-i32 fsMount();
-i32 fsOpen  (str fname);
-i32 fsRead  (i32 fd, i32 numb,   void* buf);
-i32 fsSeek  (i32 fd, i32 offset, i32   whence);
-i32 fsSize  (i32 fd);
-i32 fsTell  (i32 fd);
-i32 fsWrite (i32 fd, i32 numb,   void* buf);
-
+#ifndef FS_H
+#define FS_H
+
+// ===================================================================
+// fs.h - File System user interface
+// ===================================================================
+
+#include <stdio.h>
+#include "alias.h"
+#include "errors.h"
+
+#ifndef SEEK_DATA
+#define SEEK_DATA 3       // fsSeek: next data at or after offset
+#endif
+#ifndef SEEK_HOLE
+#define SEEK_HOLE 4       // fsSeek: next hole at or after offset
+#endif
+
+#define FALLOC_ZERO 1     // fsFallocate: zero the blocks now, not unwritten
+
+#define OPEN_APPEND 1     // fsOpenMode: every fsWrite appends, buffered
+
+#define MOUNT_FORMAT 1    // fsMount: format the disk image first
+#define MOUNT_LOG    2    //   make the volume log-structured: see log.c
+
+#define EXPORT_TAR  1     // fsExport: a tar archive, not a host directory
+
+typedef struct BfsVolume BfsVolume;   // a mounted disk image: see vol.h
+
+typedef struct AioReq FsFuture;       // an asynchronous call: see aio.h
+typedef void (*FsDone)(i32 ret, void* arg);   // its completion callback
+
+#define VIEWSPANS   8     // most blocks one fsReadView lends
+
+typedef struct {          // ViewSpan: bytes lent in place, read-only
+  const i8* data;
+  i32       len;
+} ViewSpan;
+
+typedef struct {          // View: what fsReadView lends, until fsReleaseView
+  i32      len;           // # bytes lent, over all spans
+  i32      nspans;
+  ViewSpan spans[VIEWSPANS];  // in file order
+  i32      slots[VIEWSPANS];  // cache pages pinned, one per span
+} View;
+
+i32 fsAwait (FsFuture* f);
+i32 fsClean ();
+i32 fsClose (i32 fd);
+i32 fsCompress(str path);
+i32 fsCopy  (str src, str dst, i32 offset, i32 len);
+i32 fsCreate(str path);
+i32 fsDedup (str path);
+i32 fsDefrag(str path);
+i32 fsDelete(str path);
+i32 fsExport(str path, str dest, i32 mode);
+i32 fsFallocate(i32 fd, i32 offset, i32 len, i32 mode);
+i32 fsFormat();
+i32 fsFragScore(str path);
+i32 fsImport(str host, str image);
+i32 fsMkdir (str path);
+BfsVolume* fsMount(str path, i32 options);
+BfsVolume* fsMountStriped(i32 n, str* paths, i32 unit, i32 options);
+i32 fsOpen  (str path);
+i32 fsOpenMode(str path, i32 mode);
+i32 fsPoll  (i32 wait);
+i32 fsRead  (i32 fd, i32 numb,   void* buf);
+FsFuture* fsReadAsync(i32 fd, i32 numb, void* buf, FsDone done, void* arg);
+i32 fsReady (FsFuture* f);
+i32 fsReaddir(str path, i32* pcursor, str name);
+i32 fsReadView(i32 fd, i32 offset, i32 len, View* view);
+i32 fsReleaseView(View* view);
+i32 fsSeek  (i32 fd, i32 offset, i32   whence);
+i32 fsSize  (i32 fd);
+i32 fsSnapshot(str name);
+i32 fsSnapshotDelete(str name);
+i32 fsSnapshotMount(str name);
+i32 fsSync  (i32 fd);
+FsFuture* fsSyncAsync(i32 fd, FsDone done, void* arg);
+i32 fsTell  (i32 fd);
+i32 fsTraceStart(str path);
+i32 fsTraceStop();
+i32 fsTruncate(i32 fd, i32 size);
+i32 fsUnmount();
+BfsVolume* fsUse(BfsVolume* vol);
+i32 fsWrite (i32 fd, i32 numb,   void* buf);
+FsFuture* fsWriteAsync(i32 fd, i32 numb, void* buf, FsDone done, void* arg);
+
 #endif
\ No newline at end of file
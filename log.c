@@ -0,0 +1,577 @@
+// ============================================================================
+// log.c - Log-structured mode.  On a volume made log-structured (fsMount
+// with MOUNT_LOG, recorded in Super.log), no data block on disk is written
+// in place: every block a file writes, new or rewritten, goes to the head
+// of the log.  A stream of small random writes becomes a run of sequential
+// ones, which writeback (wb.c) merges into few large I/Os.  A block still
+// dirty in writeback is the exception: like a block in an LFS segment
+// buffer, it is changed where it is, for free.  Inodes stay in their Inodes
+// blocks, which already serve as the map from inum to Inode, and map tables
+// stay put.
+//
+// The log takes a whole run of free blocks off the Freelists at a time, and
+// hands it out block by block, with no allocator traffic.  When the run is
+// used up, the log goes on with the run just after it, if there is one in
+// the same group; else it breaks, and takes the biggest run on the disk.
+//
+// The old copy of a block is not freed: it becomes garbage, marked in
+// memory, at no I/O cost.  The cleaner, a thread per volume woken when the
+// log breaks, picks the group, other than the log's, with fewest live blocks
+// (at most LOGCLEANUTIL % live), copies the file blocks it holds to the log,
+// then rebuilds its Freelist from its free runs and its garbage, so the
+// group is one long run for the log to come back to.  Garbage is freed
+// outright only when the disk would be full, and at unmount.  After a crash,
+// the mount sweeps (snapSweep) what was garbage, or held by the log
+// ============================================================================
+
+#include "dedup.h"
+#include "log.h"
+#include "map.h"
+#include "ref.h"
+#include "snap.h"
+#include "vol.h"
+#include "wb.h"
+
+typedef struct {          // LogOwner: a file block in the group cleaned
+  i32 inum;
+  i32 fbn;
+  i32 entry;              // its map entry: DBN, or -DBN if unwritten
+} LogOwner;
+
+typedef struct {          // LogScan: gathers the LogOwners of one group
+  LogOwner owners[BLOCKSPERDISK];
+  i32      n;
+  i32      inum;          // file being scanned
+  i32      group;         // group being cleaned
+} LogScan;
+
+
+
+// ============================================================================
+// Return a DBN to hold the new contents of a file block held at DBN 'old' (0
+// if none): the next block of the log.  'old' becomes garbage (a shared or
+// frozen block just loses this owner).  The caller writes the block, and
+// maps it
+// ============================================================================
+i32 logAppend(i32 old) {
+  bfsLock();
+  i32 dbn = logNext();
+  if (old >= MINDBN) logFree(old);            // DBNDIR just stays behind
+  bfsUnlock();
+  return dbn;
+}
+
+
+
+// ============================================================================
+// Remember, in 'ls', each block of file 'ls->inum' that lies in the group
+// being cleaned
+// ============================================================================
+i32 logCleanVisit(i32 fbn, i32 entry, void* ctx) {
+  LogScan* ls  = (LogScan*)ctx;
+  i32      dbn = abs(entry);
+  if (dbn < MINDBN || bfsGroupOf(dbn) != ls->group) return 0;
+  if (ls->n == BLOCKSPERDISK) return 1;
+  ls->owners[ls->n].inum  = ls->inum;
+  ls->owners[ls->n].fbn   = fbn;
+  ls->owners[ls->n].entry = entry;
+  ++ls->n;
+  return 0;
+}
+
+
+
+// ============================================================================
+// Clean one group: copy the file blocks it holds to the head of the log,
+// then free the group's garbage, merged with its free runs.  Blocks that are
+// shared, frozen by a snapshot, or not file data (map tables, compressed
+// clusters) stay.  Return the # of blocks moved; 0 if the volume is not
+// log-structured, or no group is worth cleaning
+// ============================================================================
+i32 logClean() {
+  bfsLock();
+  Log* log = &g_vol->log;
+  if (!log->on || snapReadOnly()) { bfsUnlock(); return 0; }
+
+  i32 runs[BLOCKSPERDISK];
+  i32 victim = logVictim(runs);
+  if (victim < 0) { bfsUnlock(); return 0; }
+
+  LogScan ls;
+  ls.n     = 0;
+  ls.group = victim;
+
+  for (i32 inum = 0; inum < NUMINODES; ++inum) {
+    Inode inode;
+    bfsReadInode(inum, &inode);
+    if (!(inode.flags & INODEUSED)) continue;
+    if (inode.flags & (INODEINLINE | INODECOMP | INODEDEAD)) continue;
+    ls.inum = inum;
+    mapScan(&inode, 0, logCleanVisit, &ls);
+  }
+
+  log->cleaning = 1;
+  i32 moved = 0;
+  i8  buf[BYTESPERBLOCK];
+
+  for (i32 i = 0; i < ls.n; ++i) {
+    LogOwner* o   = &ls.owners[i];
+    i32       old = abs(o->entry);
+    if (refGet(old) != 0 || snapFrozen(old)) continue;
+
+    if (log->next >= log->end) {
+      logReserve();
+      if (bfsGroupOf(log->next) == victim) break;   // nowhere else to go
+    }
+    i32 dbn = logNext();
+
+    if (o->entry > 0) {
+      bioRead(old, buf);
+      bioWrite(dbn, buf);
+    }
+
+    Inode inode;
+    bfsReadInode(o->inum, &inode);
+    if (mapSet(o->inum, &inode, o->fbn, (o->entry > 0) ? dbn : -dbn)) {
+      bfsWriteInode(o->inum, &inode);
+    }
+    dedupForget(old);                         // unshared: now garbage
+    log->dead[old] = 1;
+    ++log->ndead;
+    ++moved;
+  }
+  log->cleaning = 0;
+
+  logRebuild(victim);
+  ++log->stats.cleans;
+  log->stats.moved += moved;
+
+  bfsUnlock();
+  return moved;
+}
+
+
+
+// ============================================================================
+// Wait until the cleaner thread has nothing left to do
+// ============================================================================
+i32 logDrain() {
+  Log* log = &g_vol->log;
+  pthread_mutex_lock(&log->lock);
+  while (log->started && (log->kicked || log->busy)) {
+    pthread_cond_wait(&log->idle, &log->lock);
+  }
+  pthread_mutex_unlock(&log->lock);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Make the volume log-structured, from now on and at every later mount.
+// Blocks already written move to the log as they are rewritten.  Return 0
+// ============================================================================
+i32 logEnable() {
+  bfsLock();
+  i8 buf[BYTESPERBLOCK] = {0};
+  bioRead(DBNSUPER, buf);
+  Super* super = (Super*)buf;
+  if (!super->log) {
+    super->log = 1;
+    bioWrite(DBNSUPER, buf);
+  }
+  g_vol->log.on = 1;
+  bfsUnlock();
+  return 0;
+}
+
+
+
+// ============================================================================
+// Free all the garbage, wherever it lies: the disk is nearly full, or the
+// volume is going down.  Return the # of blocks freed
+// ============================================================================
+i32 logFlush() {
+  bfsLock();
+  Log* log = &g_vol->log;
+
+  i32 dbns[BLOCKSPERDISK];
+  i32 n = 0;
+  for (i32 dbn = MINDBN; dbn < BLOCKSPERDISK && n < log->ndead; ++dbn) {
+    if (!log->dead[dbn]) continue;
+    log->dead[dbn] = 0;
+    dbns[n++] = dbn;
+  }
+  log->ndead = 0;
+  bfsFreeRuns(dbns, n);
+
+  bfsUnlock();
+  return n;
+}
+
+
+
+// ============================================================================
+// Drop block 'dbn', an old copy the log replaced.  A block that is shared,
+// or frozen by a snapshot, just loses this owner, as in bfsFreeList.  Any
+// other is garbage: no I/O now, freed by the cleaner or logFlush.  Return 0
+// ============================================================================
+i32 logFree(i32 dbn) {
+  bfsLock();
+  Log* log = &g_vol->log;
+  if (!refDrop(dbn)) {
+    dedupForget(dbn);
+    if (!snapFrozen(dbn) && !log->dead[dbn]) {
+      log->dead[dbn] = 1;
+      ++log->ndead;
+    }
+  }
+  bfsUnlock();
+  return 0;
+}
+
+
+
+// ============================================================================
+// Walk the Freelists of 'super', setting 'runs[dbn]' to the length of the
+// free run that starts at 'dbn', or to 0 if none does.  Return the # of
+// free blocks
+// ============================================================================
+i32 logFreeMap(Super* super, i32* runs) {
+  memset(runs, 0, BLOCKSPERDISK * sizeof(i32));
+
+  i8 buf[BYTESPERBLOCK] = {0};
+  FreeRun* run = (FreeRun*)buf;
+
+  i32 n = 0;
+  for (i32 g = 0; g < NUMGROUPS; ++g) {
+    Group* gr    = &super->groups[g];
+    i32    dbn   = gr->firstFree;
+    i32    count = gr->freeRun;               // head run may be cached
+    i32    next  = gr->nextFree;
+
+    while (dbn != 0) {
+      if (count == 0) {
+        bioRead(dbn, buf);
+        bfsCheckRun(dbn, run);
+        count = (run->count == 0) ? 1 : run->count;
+        next  = run->next;
+      }
+      runs[dbn] = count;
+      n    += count;
+      dbn   = next;
+      count = 0;
+    }
+  }
+  return n;
+}
+
+
+
+// ============================================================================
+// Wake the cleaner thread, starting it if need be.  If it cannot be started,
+// cleaning waits for fsClean.  Return 0
+// ============================================================================
+i32 logKick() {
+  Log* log = &g_vol->log;
+  pthread_mutex_lock(&log->lock);
+  if (!log->started) {
+    if (pthread_create(&log->thread, NULL, logMain, g_vol)) {
+      pthread_mutex_unlock(&log->lock);
+      return 0;
+    }
+    log->started = 1;
+  }
+  log->kicked = 1;
+  pthread_cond_signal(&log->kick);
+  pthread_mutex_unlock(&log->lock);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Body of the cleaner thread of volume 'arg': clean a group each time the
+// log breaks, until logStop
+// ============================================================================
+void* logMain(void* arg) {
+  g_vol = (BfsVolume*)arg;
+  Log* log = &g_vol->log;
+
+  pthread_mutex_lock(&log->lock);
+  for (;;) {
+    while (!log->kicked && !log->stop) {
+      pthread_cond_wait(&log->kick, &log->lock);
+    }
+    if (!log->kicked) break;                    // stopped, and nothing left
+    log->kicked = 0;
+    log->busy   = 1;
+    pthread_mutex_unlock(&log->lock);
+
+    logClean();
+
+    pthread_mutex_lock(&log->lock);
+    log->busy = 0;
+    if (!log->kicked) pthread_cond_broadcast(&log->idle);
+  }
+  pthread_mutex_unlock(&log->lock);
+  return NULL;
+}
+
+
+
+// ============================================================================
+// Take the next block of the log, reserving a new run first if need be.
+// Return its DBN.  FATAL if the disk is full
+// ============================================================================
+i32 logNext() {
+  bfsLock();
+  Log* log = &g_vol->log;
+  if (log->next >= log->end) logReserve();
+
+  i32 dbn = log->next++;
+  log->head = dbn;
+  ++log->stats.appends;
+
+  i8 buf8[BYTESPERBLOCK] = {0};
+  bioRead(DBNSUPER, buf8);
+  snapBorn(dbn, 1, ((Super*)buf8)->gen);    // born now, not when reserved
+
+  bfsUnlock();
+  return dbn;
+}
+
+
+
+// ============================================================================
+// Return 1 if the volume is log-structured, else 0
+// ============================================================================
+i32 logOn() {
+  return g_vol->log.on;
+}
+
+
+
+// ============================================================================
+// Rebuild the Freelist of group 'group' from scratch, from its free runs and
+// its garbage, in DBN order, with runs that touch merged into one.  Return
+// the # of free blocks in the group
+// ============================================================================
+i32 logRebuild(i32 group) {
+  bfsLock();
+  Log* log = &g_vol->log;
+
+  i8 buf8[BYTESPERBLOCK] = {0};
+  bioRead(DBNSUPER, buf8);
+  Super* super = (Super*)buf8;
+
+  i32 runs[BLOCKSPERDISK];
+  logFreeMap(super, runs);
+
+  i32 first = MINDBN + group * GROUPBLOCKS;
+  i32 end   = first + GROUPBLOCKS;
+  if (end > BLOCKSPERDISK) end = BLOCKSPERDISK;
+
+  i32 dbns[BLOCKSPERDISK];
+  i32 n = 0;
+  for (i32 dbn = first; dbn < end; ++dbn) {
+    for (i32 i = 0; i < runs[dbn]; ++i) dbns[n++] = dbn + i;
+    if (log->dead[dbn]) {
+      log->dead[dbn] = 0;
+      --log->ndead;
+      dbns[n++] = dbn;
+    }
+  }
+
+  memset(&super->groups[group], 0, sizeof(Group));
+  bioWrite(DBNSUPER, buf8);
+  bfsFreeRuns(dbns, n);                       // one FreeRun per run
+
+  bfsUnlock();
+  return n;
+}
+
+
+
+// ============================================================================
+// Give back the rest of the log's run, and free the garbage.  Called at
+// unmount, and before anything that walks every block.  Return 0
+// ============================================================================
+i32 logRelease() {
+  bfsLock();
+  Log* log = &g_vol->log;
+  logFlush();
+
+  if (log->end > log->next) {
+    i32 dbns[BLOCKSPERDISK];
+    i32 n = 0;
+    for (i32 dbn = log->next; dbn < log->end; ++dbn) dbns[n++] = dbn;
+    bfsFreeRuns(dbns, n);                   // never handed out
+  }
+  log->next = log->end = 0;
+
+  bfsUnlock();
+  return 0;
+}
+
+
+
+// ============================================================================
+// Return 1 if a write to file block 'dbn' must go to the log, not in place:
+// the volume is log-structured, and the block has been written back.  One
+// still dirty in writeback costs nothing to change again, and its write
+// will land where the log put it
+// ============================================================================
+i32 logRedirect(i32 dbn) {
+  return g_vol->log.on && !wbDirty(dbn);
+}
+
+
+
+// ============================================================================
+// Take a new run of free blocks for the log: the run just after the log's
+// head, if it starts there, in the same group; else (the log breaks) the
+// biggest run on the disk, and the cleaner is woken.  If there is no free
+// run, the garbage is freed first.  FATAL if the disk is full.  Return the #
+// of blocks taken
+// ============================================================================
+i32 logReserve() {
+  bfsLock();
+  Log* log = &g_vol->log;
+
+  i8 buf8[BYTESPERBLOCK] = {0};
+  bioRead(DBNSUPER, buf8);
+  Super* super = (Super*)buf8;
+
+  i32 runs[BLOCKSPERDISK];
+  logFreeMap(super, runs);
+
+  i32 head = log->head;
+  i32 want = 0, near = 0;
+  if (head >= MINDBN && head + 1 < BLOCKSPERDISK && runs[head + 1] > 0
+      && bfsGroupOf(head + 1) == bfsGroupOf(head)) {
+    want = runs[head + 1];                  // bfsAllocRun takes just this
+    near = head;
+  } else {
+    for (i32 dbn = MINDBN; dbn < BLOCKSPERDISK; ++dbn) {
+      if (runs[dbn] > want) { want = runs[dbn]; near = dbn - 1; }
+    }
+    if (want == 0 && logFlush() > 0) {      // nothing free but garbage
+      bioRead(DBNSUPER, buf8);
+      logFreeMap(super, runs);
+      for (i32 dbn = MINDBN; dbn < BLOCKSPERDISK; ++dbn) {
+        if (runs[dbn] > want) { want = runs[dbn]; near = dbn - 1; }
+      }
+    }
+    if (want == 0) FATAL(EDISKFULL);
+    ++log->stats.breaks;
+    if (!log->cleaning) logKick();
+  }
+
+  i32 dbn = 0;
+  i32 got = bfsAllocRun(want, near, &dbn);  // a run of 'want', or longer
+  log->next = dbn;
+  log->end  = dbn + got;
+
+  bfsUnlock();
+  return got;
+}
+
+
+
+// ============================================================================
+// Load the log state at mount (or format), from the SuperBlock.  The log
+// starts afresh, with no head and no garbage.  On a log-structured volume,
+// what the last mount left as garbage, or held in the log, if it went down
+// without an unmount, is swept back to the Freelists.  Return 0
+// ============================================================================
+i32 logReset() {
+  bfsLock();
+  Log* log = &g_vol->log;
+
+  i8 buf8[BYTESPERBLOCK] = {0};
+  bioRead(DBNSUPER, buf8);
+  log->on    = ((Super*)buf8)->log;
+  log->head  = 0;
+  log->next  = 0;
+  log->end   = 0;
+  log->ndead = 0;
+  memset(log->dead, 0, sizeof(log->dead));
+
+  if (log->on) snapSweep();
+
+  bfsUnlock();
+  return 0;
+}
+
+
+
+// ============================================================================
+// Copy the log's statistics into 'stats'.  Return 0
+// ============================================================================
+i32 logStats(LogStats* stats) {
+  if (stats == NULL) FATAL(ENULLPTR);
+  bfsLock();
+  *stats = g_vol->log.stats;
+  bfsUnlock();
+  return 0;
+}
+
+
+
+// ============================================================================
+// Let the cleaner finish, then end its thread, if one is running.  Called
+// when a volume is unmounted for good
+// ============================================================================
+i32 logStop() {
+  Log* log = &g_vol->log;
+  pthread_mutex_lock(&log->lock);
+  i32 started = log->started;
+  log->stop = 1;
+  pthread_cond_signal(&log->kick);
+  pthread_mutex_unlock(&log->lock);
+
+  if (started) pthread_join(log->thread, NULL);
+  log->started = 0;
+  log->stop    = 0;
+  return 0;
+}
+
+
+
+// ============================================================================
+// Pick the group to clean: of those holding both live blocks and garbage,
+// not the log's own, and at most LOGCLEANUTIL % live, the one with fewest
+// live blocks, as long as the other groups have room for them.  Fill 'runs'
+// as logFreeMap.  Return the group, or -1 if none is worth cleaning
+// ============================================================================
+i32 logVictim(i32* runs) {
+  i8 buf8[BYTESPERBLOCK] = {0};
+  bioRead(DBNSUPER, buf8);
+  Super* super = (Super*)buf8;
+
+  i32 total = logFreeMap(super, runs);
+  Log* log  = &g_vol->log;
+  i32  at   = (log->next < log->end) ? log->next : log->head;
+  i32  mine = (at >= MINDBN) ? bfsGroupOf(at) : -1;
+
+  i32 best = -1, bestLive = 0;
+  for (i32 g = 0; g < NUMGROUPS; ++g) {
+    i32 first = MINDBN + g * GROUPBLOCKS;
+    i32 end   = first + GROUPBLOCKS;
+    if (end > BLOCKSPERDISK) end = BLOCKSPERDISK;
+
+    i32 free = 0, dead = 0;                     // runs never span groups
+    for (i32 dbn = first; dbn < end; ++dbn) {
+      free += runs[dbn];
+      dead += log->dead[dbn];
+    }
+    i32 live = (end - first) - free - dead;
+
+    if (g == mine || live == 0 || dead == 0) continue;
+    if (live * 100 > (end - first) * LOGCLEANUTIL) continue;
+    if (total - free < live) continue;          // nowhere to put them
+    if (best < 0 || live < bestLive) { best = g; bestLive = live; }
+  }
+  return best;
+}
@@ -0,0 +1,60 @@
+#ifndef LOG_H
+#define LOG_H
+
+// ===================================================================
+// log.h - Log-structured mode: data blocks written at the head of a
+// sequential log, never in place, and a cleaner that empties groups
+// ===================================================================
+
+#include "alias.h"
+#include "bfs.h"
+
+#define LOGCLEANUTIL  50      // % live, at most, of a group worth cleaning
+
+typedef struct {          // LogStats: what a volume's log has done
+  i64 appends;            // # blocks written at the head of the log
+  i64 breaks;             // # times the log had to start a new run
+  i64 cleans;             // # groups the cleaner emptied
+  i64 moved;              // # live blocks it copied to the log
+} LogStats;
+
+typedef struct {          // Log: the log of a volume, if log-structured
+  i32      on;            // 1 => Super.log: data blocks go to the log
+  i32      head;          // DBN the log wrote last.  0 => none yet
+  i32      next;          // run of free blocks the log holds: [next, end)
+  i32      end;
+  i8       dead[BLOCKSPERDISK];   // 1 => an old copy: garbage, not yet free
+  i32      ndead;
+  i32      cleaning;      // 1 => logClean is moving blocks
+  LogStats stats;         // 'on' ... 'stats' are guarded by the BFS lock
+  i32      kicked;        // 1 => the cleaner has work
+  i32      busy;          // 1 => the cleaner thread is cleaning
+  i32      started;       // 1 => the cleaner thread is running
+  i32      stop;          // 1 => the cleaner thread must exit, at unmount
+  pthread_mutex_t lock;   // guards 'kicked' ... 'stop'
+  pthread_cond_t  kick;   // signalled when cleaning may be due
+  pthread_cond_t  idle;   // signalled when the cleaner is done
+  pthread_t       thread;
+} Log;
+
+i32   logAppend  (i32 old);
+i32   logClean   ();
+i32   logDrain   ();
+i32   logEnable  ();
+i32   logFlush   ();
+i32   logFree    (i32 dbn);
+i32   logFreeMap (Super* super, i32* runs);
+i32   logKick    ();
+void* logMain    (void* arg);
+i32   logNext    ();
+i32   logOn      ();
+i32   logRebuild (i32 group);
+i32   logRelease ();
+i32   logRedirect(i32 dbn);
+i32   logReserve ();
+i32   logReset   ();
+i32   logStats   (LogStats* stats);
+i32   logStop    ();
+i32   logVictim  (i32* runs);
+
+#endif
@@ -0,0 +1,179 @@
+// ============================================================================
+// lz.c - LZ4 block format.  A stream is a list of sequences: a token byte
+// (literal count in the high nibble, match length - 4 in the low), extra
+// length bytes for either count when its nibble is 15, the literals, then a
+// 2-byte little-endian match offset.  The last sequence has literals only.
+// Compression is greedy, with one hash slot per 4-byte prefix
+// ============================================================================
+
+#include <string.h>
+
+#include "lz.h"
+
+// ============================================================================
+// Return the 4 bytes at 'p', as an unaligned load
+// ============================================================================
+u32 lzRead32(const u8* p) {
+  u32 v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+
+
+// ============================================================================
+// Return the hash slot for the 4-byte prefix 'seq'
+// ============================================================================
+u32 lzHash(u32 seq) {
+  return (seq * 2654435761u) >> (32 - LZHASHLOG);
+}
+
+
+
+// ============================================================================
+// Append length 'n' beyond a 15 nibble: 255 per byte, then the remainder
+// ============================================================================
+u8* lzPutLen(u8* op, i32 n) {
+  for (; n >= 255; n -= 255) *op++ = 255;
+  *op++ = (u8)n;
+  return op;
+}
+
+
+
+// ============================================================================
+// Append one sequence: the 'nlit' literals at 'lit', then (if 'mlen' > 0) a
+// match of 'mlen' bytes, 'off' bytes back.  Return the new end of output,
+// or NULL if it would pass 'oend'
+// ============================================================================
+u8* lzPutSeq(u8* op, u8* oend, const u8* lit, i32 nlit, i32 off, i32 mlen) {
+  i32 need = 1 + nlit / 255 + 1 + nlit + (mlen > 0 ? 2 + mlen / 255 + 1 : 0);
+  if (op + need > oend) return NULL;
+
+  i32 mcode = (mlen > 0) ? mlen - LZMINMATCH : 0;
+  u8* token = op++;
+  *token = (u8)(((nlit < 15 ? nlit : 15) << 4) | (mcode < 15 ? mcode : 15));
+
+  if (nlit >= 15) op = lzPutLen(op, nlit - 15);
+  memcpy(op, lit, nlit);
+  op += nlit;
+
+  if (mlen == 0) return op;
+
+  *op++ = (u8)(off & 0xff);
+  *op++ = (u8)(off >> 8);
+  if (mcode >= 15) op = lzPutLen(op, mcode - 15);
+  return op;
+}
+
+
+
+// ============================================================================
+// Compress 'srclen' bytes at 'src' into 'dst'.  Return the compressed size,
+// or 0 if it would not fit in 'dstcap' bytes
+// ============================================================================
+i32 lzCompress(const void* src, i32 srclen, void* dst, i32 dstcap) {
+
+  if (srclen < 0 || srclen > LZMAXINPUT) return 0;
+
+  const u8* in   = (const u8*)src;
+  u8*       op   = (u8*)dst;
+  u8*       oend = op + dstcap;
+
+  u16 table[1 << LZHASHLOG];                // position + 1; 0 => empty
+  memset(table, 0, sizeof(table));
+
+  i32 anchor = 0;                           // first literal not yet emitted
+  i32 ip     = 0;
+  i32 limit  = srclen - LZMFLIMIT;          // matches start before this
+  i32 mend   = srclen - LZLASTLIT;          // ... and end by this
+
+  while (ip < limit) {
+    u32 seq = lzRead32(in + ip);
+    u32 h   = lzHash(seq);
+    i32 ref = table[h] - 1;
+    table[h] = (u16)(ip + 1);
+
+    if (ref < 0 || lzRead32(in + ref) != seq) { ++ip; continue; }
+
+    while (ip > anchor && ref > 0 && in[ip - 1] == in[ref - 1]) {
+      --ip; --ref;                          // extend the match backwards
+    }
+
+    i32 mlen = LZMINMATCH;
+    while (ip + mlen < mend && in[ip + mlen] == in[ref + mlen]) ++mlen;
+
+    op = lzPutSeq(op, oend, in + anchor, ip - anchor, ip - ref, mlen);
+    if (op == NULL) return 0;
+
+    ip    += mlen;
+    anchor = ip;
+    if (ip - 2 < limit) table[lzHash(lzRead32(in + ip - 2))] = (u16)(ip - 1);
+  }
+
+  op = lzPutSeq(op, oend, in + anchor, srclen - anchor, 0, 0);
+  if (op == NULL) return 0;
+
+  return (i32)(op - (u8*)dst);
+}
+
+
+
+// ============================================================================
+// Decompress the 'srclen' byte stream at 'src' into 'dst', which holds
+// 'dstcap' bytes.  Return the # of bytes produced, or -1 if the stream is
+// malformed or would overrun 'dst'
+// ============================================================================
+i32 lzDecompress(const void* src, i32 srclen, void* dst, i32 dstcap) {
+
+  const u8* in  = (const u8*)src;
+  u8*       out = (u8*)dst;
+  i32       ip  = 0;
+  i32       op  = 0;
+
+  while (ip < srclen) {
+    u8  token = in[ip++];
+    i32 nlit  = token >> 4;
+    if (nlit == 15) {
+      u8 b;
+      do {
+        if (ip >= srclen) return -1;
+        b = in[ip++];
+        nlit += b;
+      } while (b == 255);
+    }
+
+    if (nlit > srclen - ip || nlit > dstcap - op) return -1;
+    memcpy(out + op, in + ip, nlit);
+    ip += nlit;
+    op += nlit;
+
+    if (ip == srclen) break;                // last sequence: literals only
+
+    if (srclen - ip < 2) return -1;
+    i32 off = in[ip] | (in[ip + 1] << 8);
+    ip += 2;
+    if (off == 0 || off > op) return -1;
+
+    i32 mlen = token & 15;
+    if (mlen == 15) {
+      u8 b;
+      do {
+        if (ip >= srclen) return -1;
+        b = in[ip++];
+        mlen += b;
+      } while (b == 255);
+    }
+    mlen += LZMINMATCH;
+    if (mlen > dstcap - op) return -1;
+
+    if (off >= mlen) {
+      memcpy(out + op, out + op - off, mlen);
+    } else {                                // overlapping: a repeating run
+      for (i32 i = 0; i < mlen; ++i) out[op + i] = out[op - off + i];
+    }
+    op += mlen;
+  }
+
+  return op;
+}
@@ -0,0 +1,20 @@
+#ifndef LZ_H
+#define LZ_H
+
+// ===================================================================
+// lz.h - LZ4 block-format compression, used by comp.c to pack
+// file clusters
+// ===================================================================
+
+#include "alias.h"
+
+#define LZMINMATCH    4       // shortest match encoded
+#define LZLASTLIT     5       // the last 5 bytes are always literals
+#define LZMFLIMIT     12      // no match may start in the last 12 bytes
+#define LZHASHLOG     10      // log2(# hash slots)
+#define LZMAXINPUT    65535   // positions are kept in u16s
+
+i32 lzCompress  (const void* src, i32 srclen, void* dst, i32 dstcap);
+i32 lzDecompress(const void* src, i32 srclen, void* dst, i32 dstcap);
+
+#endif
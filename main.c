@@ -1,11 +1,14 @@
-#include <stdio.h>
-
-#include "bfs.h"
-#include "errors.h"
-#include "p5test.h"
-
-int main() {
-  bfsInitOFT();
-  p5test();
-  return 0;
+#include <stdio.h>
+
+#include "bfs.h"
+#include "errors.h"
+#include "fs.h"
+#include "p5test.h"
+
+int main() {
+  bfsInitOFT();
+  fsMount(BFSDISK, 0);
+  p5test();
+  fsUnmount();
+  return 0;
 }
\ No newline at end of file
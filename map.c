@@ -0,0 +1,332 @@
+// ============================================================================
+// map.c - Block map.  An FBN is found in direct[], else in the (single)
+// indirect table, else two levels below dindirect, else three below
+// tindirect.  Each table is one block of I32SPERBLOCK DBNs.  The last leaf
+// table walked for each file is kept in the volume's mapcache, so a sequential scan
+// pays one table walk per I32SPERBLOCK FBNs, not one per FBN
+// ============================================================================
+
+#include "map.h"
+#include "vol.h"
+
+
+
+// ============================================================================
+// Return the # of FBNs mapped by one entry of a table at level 'depth'
+// (1 = leaf table, whose entries are data DBNs)
+// ============================================================================
+i32 mapSpan(i32 depth) {
+  i32 span = 1;
+  for (i32 d = 1; d < depth; ++d) span *= I32SPERBLOCK;
+  return span;
+}
+
+
+
+// ============================================================================
+// Add 'dbn' to the batch of blocks to free; flush the batch when it is full
+// ============================================================================
+i32 mapFree(FreeBatch* fb, i32 dbn) {
+  fb->dbns[fb->n++] = dbn;
+  if (fb->n == FREEBATCH) mapFlush(fb);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Return every block gathered in 'fb' to the Freelist
+// ============================================================================
+i32 mapFlush(FreeBatch* fb) {
+  bfsFreeList(fb->dbns, fb->n);
+  fb->n = 0;
+  return 0;
+}
+
+
+
+// ============================================================================
+// Return the map entry for FBN 'fbn' of the file whose Inode is 'inode': a
+// DBN, -DBN for an unwritten block, or 0 for a hole.  'inum' selects the
+// file's MapCache; pass -1 to bypass it
+// ============================================================================
+i32 mapGet(i32 inum, Inode* inode, i32 fbn) {
+
+  if (fbn < 0 || fbn >= MAXFBN) FATAL(EBADFBN);
+
+  if (fbn < NUMDIRECT) return inode->direct[fbn];
+
+  bfsLock();
+
+  MapCache* mc = (inum >= 0) ? &g_vol->mapcache[inum] : NULL;
+  if (mc != NULL && mc->dbn != 0 &&
+      fbn >= mc->fbn && fbn < mc->fbn + I32SPERBLOCK) {
+    i32 entry = mc->tab[fbn - mc->fbn];
+    bfsUnlock();
+    return entry;
+  }
+
+  i32 depth, base;
+  i32 dbn = *mapRoot(inode, fbn, &depth, &base);
+  i32 tab[I32SPERBLOCK];
+
+  while (dbn != 0) {
+    bioReadMeta(dbn, tab);
+    i32 span = mapSpan(depth);
+    i32 i    = (fbn - base) / span;
+
+    if (depth == 1) {                           // leaf: remember it
+      if (mc != NULL) {
+        mc->dbn = dbn;
+        mc->fbn = base;
+        memcpy(mc->tab, tab, BYTESPERBLOCK);
+      }
+      bfsUnlock();
+      return tab[i];
+    }
+
+    base += i * span;
+    dbn   = tab[i];
+    --depth;
+  }
+
+  bfsUnlock();
+  return 0;                                     // hole in an upper level
+}
+
+
+
+// ============================================================================
+// Forget the cached leaf table of file 'inum'.  Called whenever its map is
+// rebuilt or trimmed
+// ============================================================================
+void mapInval(i32 inum) {
+  if (inum < 0 || inum > MAXINUM) return;
+  bfsLock();
+  g_vol->mapcache[inum].dbn = 0;
+  bfsUnlock();
+}
+
+
+
+// ============================================================================
+// Return a pointer to the Inode slot holding the root table for 'fbn' (which
+// must be past direct[]).  Store its level in '*pdepth' and the first FBN it
+// maps in '*pbase'
+// ============================================================================
+i32* mapRoot(Inode* inode, i32 fbn, i32* pdepth, i32* pbase) {
+  i32 base = NUMDIRECT;
+  if (fbn < base + NUMINDIRECT) {
+    *pdepth = 1; *pbase = base; return &inode->indirect;
+  }
+  base += NUMINDIRECT;
+  if (fbn < base + NUMDINDIRECT) {
+    *pdepth = 2; *pbase = base; return &inode->dindirect;
+  }
+  base += NUMDINDIRECT;
+  *pdepth = 3; *pbase = base; return &inode->tindirect;
+}
+
+
+
+// ============================================================================
+// Visit the mapped entries of the table at 'dbn' (level 'depth', first FBN
+// 'base') whose FBN is at least 'fbnFirst', in FBN order.  Return 1 if
+// 'visit' asked to stop
+// ============================================================================
+i32 mapScanTable(i32 dbn, i32 depth, i32 base, i32 fbnFirst,
+                 MapVisit visit, void* ctx) {
+  i32 tab[I32SPERBLOCK];
+  bioReadMeta(dbn, tab);
+
+  i32 span = mapSpan(depth);
+  for (i32 i = 0; i < I32SPERBLOCK; ++i) {
+    i32 fbn0 = base + i * span;
+    if (tab[i] == 0 || fbn0 + span <= fbnFirst) continue;
+    if (depth == 1) {
+      if (visit(fbn0, tab[i], ctx)) return 1;
+    } else if (mapScanTable(tab[i], depth - 1, fbn0, fbnFirst, visit, ctx)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+
+
+// ============================================================================
+// Call 'visit'(fbn, entry, 'ctx') for each mapped FBN of 'inode' from
+// 'fbnFirst' on, in FBN order, skipping unmapped tables without reading
+// them.  Stop early if 'visit' returns nonzero.  Return 1 if stopped early
+// ============================================================================
+i32 mapScan(Inode* inode, i32 fbnFirst, MapVisit visit, void* ctx) {
+
+  for (i32 fbn = fbnFirst; fbn < NUMDIRECT; ++fbn) {
+    if (inode->direct[fbn] == 0) continue;
+    if (visit(fbn, inode->direct[fbn], ctx)) return 1;
+  }
+
+  i32 roots[] = { NUMDIRECT, NUMDIRECT + NUMINDIRECT,
+                  NUMDIRECT + NUMINDIRECT + NUMDINDIRECT };
+
+  for (i32 r = 0; r < 3; ++r) {
+    i32  depth, base;
+    i32* slot = mapRoot(inode, roots[r], &depth, &base);
+    if (*slot == 0 || base + mapSpan(depth) * I32SPERBLOCK <= fbnFirst) {
+      continue;
+    }
+    if (mapScanTable(*slot, depth, base, fbnFirst, visit, ctx)) return 1;
+  }
+  return 0;
+}
+
+
+
+// ============================================================================
+// Set the map entry for FBN 'fbn' of 'inode' to 'entry', creating any missing
+// tables on the way down.  The tables are written at once; the Inode is not.
+// A table that is shared or frozen by a snapshot is not changed in place: it
+// is copied (bfsCow), so its parent changes too, up to the first table that
+// could be written in place, or the Inode.  Return 1 if 'inode' changed (the
+// caller must then write it).  'inum' keeps the file's MapCache in step; pass
+// -1 to bypass it
+// ============================================================================
+i32 mapSet(i32 inum, Inode* inode, i32 fbn, i32 entry) {
+
+  if (fbn < 0 || fbn >= MAXFBN) FATAL(EBADFBN);
+
+  if (fbn < NUMDIRECT) {
+    inode->direct[fbn] = entry;
+    return 1;
+  }
+
+  bfsLock();
+
+  i32  depth, base;
+  i32* slot = mapRoot(inode, fbn, &depth, &base);
+
+  MapCache* mc = (inum >= 0) ? &g_vol->mapcache[inum] : NULL;
+  i32       dbns[3];                            // tables, root first
+  i32       idx[3];                             // entry taken in each
+  i32       tabs[3][I32SPERBLOCK];
+  i32       levels = depth;
+
+  // Walk down, reading each table on the path (0 => not there yet)
+
+  for (i32 l = 0; l < levels; ++l, --depth) {
+    i32 span = mapSpan(depth);
+    idx[l]   = (fbn - base) / span;
+    dbns[l]  = (l == 0) ? *slot : tabs[l - 1][idx[l - 1]];
+
+    if (dbns[l] == 0) {
+      if (entry == 0) { bfsUnlock(); return 0; }  // already a hole
+      memset(tabs[l], 0, BYTESPERBLOCK);
+    } else if (depth == 1 && mc != NULL && mc->dbn == dbns[l]) {
+      memcpy(tabs[l], mc->tab, BYTESPERBLOCK);  // leaf already in hand
+    } else {
+      bioReadMeta(dbns[l], tabs[l]);
+    }
+
+    if (depth > 1) base += idx[l] * span;       // leaf: 'base' is its first
+  }
+
+  // Write back up, for as long as a table had to move
+
+  tabs[levels - 1][idx[levels - 1]] = entry;
+
+  i32 changed = 0;
+  i32 leaf    = 0;
+  for (i32 l = levels - 1; l >= 0; --l) {
+    i32 w = (dbns[l] == 0) ? bfsFindFreeBlock() : bfsCow(dbns[l]);
+    bioWrite(w, tabs[l]);
+    if (l == levels - 1) leaf = w;
+    if (w == dbns[l]) break;                    // written in place
+    if (l == 0) {
+      *slot   = w;
+      changed = 1;
+    } else {
+      tabs[l - 1][idx[l - 1]] = w;
+    }
+  }
+
+  if (mc != NULL) {
+    mc->dbn = leaf;
+    mc->fbn = base;
+    memcpy(mc->tab, tabs[levels - 1], BYTESPERBLOCK);
+  }
+
+  bfsUnlock();
+  return changed;
+}
+
+
+
+// ============================================================================
+// Unmap the entries of the table at '*pdbn' (level 'depth', first FBN 'base')
+// whose FBN is at least 'fbnFirst', adding their blocks (and any emptied
+// tables below) to 'fb'.  Return 1 if the table is left empty, in which case
+// the caller frees it; else write it back if it changed, to a copy if it is
+// shared or frozen (bfsCow), updating '*pdbn'
+// ============================================================================
+i32 mapTrimTable(i32* pdbn, i32 depth, i32 base, i32 fbnFirst, FreeBatch* fb) {
+  i32 tab[I32SPERBLOCK];
+  bioReadMeta(*pdbn, tab);
+
+  i32 span  = mapSpan(depth);
+  i32 live  = 0;
+  i32 dirty = 0;
+
+  for (i32 i = 0; i < I32SPERBLOCK; ++i) {
+    if (tab[i] == 0) continue;
+    i32 fbn0 = base + i * span;
+    if (fbn0 + span <= fbnFirst) { ++live; continue; }
+
+    i32 was = tab[i];
+    if (depth == 1 || mapTrimTable(&tab[i], depth - 1, fbn0, fbnFirst, fb)) {
+      mapFree(fb, abs(tab[i]));                 // may be unwritten (negated)
+      tab[i] = 0;
+      dirty  = 1;
+    } else {
+      ++live;
+      if (tab[i] != was) dirty = 1;             // child table was copied
+    }
+  }
+
+  if (live == 0) return 1;
+  if (dirty) {
+    *pdbn = bfsCow(*pdbn);
+    bioWrite(*pdbn, tab);
+  }
+  return 0;
+}
+
+
+
+// ============================================================================
+// Unmap every FBN of 'inode' from 'fbnFirst' on, adding the data blocks, and
+// every table left empty, to 'fb'.  The Inode is updated but not written
+// ============================================================================
+i32 mapTrim(Inode* inode, i32 fbnFirst, FreeBatch* fb) {
+
+  for (i32 fbn = fbnFirst; fbn < NUMDIRECT; ++fbn) {
+    if (inode->direct[fbn] == 0) continue;
+    mapFree(fb, abs(inode->direct[fbn]));
+    inode->direct[fbn] = 0;
+  }
+
+  i32 roots[] = { NUMDIRECT, NUMDIRECT + NUMINDIRECT,
+                  NUMDIRECT + NUMINDIRECT + NUMDINDIRECT };
+
+  for (i32 r = 0; r < 3; ++r) {
+    i32  depth, base;
+    i32* slot = mapRoot(inode, roots[r], &depth, &base);
+    if (*slot == 0 || base + mapSpan(depth) * I32SPERBLOCK <= fbnFirst) {
+      continue;
+    }
+    if (mapTrimTable(slot, depth, base, fbnFirst, fb)) {
+      mapFree(fb, *slot);
+      *slot = 0;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,36 @@
+#ifndef MAP_H
+#define MAP_H
+
+// ===================================================================
+// map.h - Block map: translate FBNs to DBNs through an Inode's
+// direct[], indirect, double-indirect and triple-indirect tables
+// ===================================================================
+
+#include "alias.h"
+#include "bfs.h"
+
+#define FREEBATCH     256     // DBNs gathered before a bfsFreeList call
+
+typedef i32 (*MapVisit)(i32 fbn, i32 entry, void* ctx);
+
+typedef struct {          // FreeBatch: DBNs on their way to the Freelist
+  i32 dbns[FREEBATCH];
+  i32 n;
+} FreeBatch;
+
+typedef struct {          // MapCache: the last leaf table walked for a file
+  i32 dbn;                // DBN of the table.  0 => empty
+  i32 fbn;                // FBN mapped by tab[0]
+  i32 tab[I32SPERBLOCK];  // copy of the table
+} MapCache;
+
+i32  mapFree   (FreeBatch* fb, i32 dbn);
+i32  mapFlush  (FreeBatch* fb);
+i32  mapGet    (i32 inum, Inode* inode, i32 fbn);
+void mapInval  (i32 inum);
+i32* mapRoot   (Inode* inode, i32 fbn, i32* pdepth, i32* pbase);
+i32  mapScan   (Inode* inode, i32 fbnFirst, MapVisit visit, void* ctx);
+i32  mapSet    (i32 inum, Inode* inode, i32 fbn, i32 entry);
+i32  mapTrim   (Inode* inode, i32 fbnFirst, FreeBatch* fb);
+
+#endif
@@ -1,252 +1,1865 @@
-// ============================================================================
-// p5test.c : use regular C library calls to check what the answers should be
-// when run against the BFS filesystem
-// ============================================================================
-
-#include "p5test.h"
-
-// ============================================================================
-// Check that 'size' bytes, starting at buf[start] hold the value 'val'.
-// 'testnum' is the test number - used for reporting
-// ============================================================================
-void check(int testnum, i8* buf, int start, int size, int val) {
-  for (int i = start; i < start + size; ++i) {
-    if (buf[i] != val) {
-      printf("TEST %d : BAD  : buf[%d] = %d but should be %d \n", 
-        testnum, i, buf[i], val);
-      return;
-    }
-  }
-  printf("TEST %d : GOOD \n", testnum);
-}
-
-
-
-// ============================================================================
-// Check that 'actual' == 'expected' for test 'testnum'
-// ============================================================================
-void checkCursor(int testnum, int expected, int actual) {
-  if (actual == expected) {
-    printf("TEST %d : GOOD \n", testnum);
-  } else {
-    printf("TEST %d : BAD  : cursor = %d but should be %d \n", 
-        testnum, actual, expected);
-  }
-}
-
-
-
-// ============================================================================
-// Create file "P5", holding 50 blocks, inside of BFSDISK, and populate
-// ============================================================================
-void createP5() {
-
-  i32 fd = fsCreate("P5");
-
-  i8 buf[BYTESPERBLOCK];
-
-  // Write 100 blocks.  Every byte in block 'b' the value 'b'
-
-  for (int b = 0; b < 50; ++b) {
-    memset(buf, b, BYTESPERBLOCK);
-    fsWrite(fd, BYTESPERBLOCK, buf);
-  }
-
-  fsClose(fd);
-}
-
-
-
-// ============================================================================
-// TEST 1 : Small read (100 bytes) from cursor = 0
-// ============================================================================
-void test1(i32 fd) {
-  i8 buf[BUFSIZE];                  // buffer for reads and writes
-
-  fsSeek(fd, 0, SEEK_SET);     
-
-  i32 curs = fsTell(fd);
-  checkCursor(1, 0, curs);
-
-  memset(buf, 0, BUFSIZE);
-  i32 ret = fsRead(fd, 100, buf);   // read 100 bytes from cursor = 0
-  assert(ret == 100);
-
-  curs = fsTell(fd);
-  checkCursor(1, 100, curs);
-
-  check(1, buf, 0, 100, 0);
-}
-
-
-// ============================================================================
-// TEST 2 : Small read (200 bytes) from 30 bytes into block 1
-// ============================================================================
-void test2(i32 fd) {
-  i8 buf[BUFSIZE];                  // buffer for reads and writes
-
-  fsSeek(fd, 512 + 30, SEEK_SET);     
-
-  i32 curs = fsTell(fd);
-  checkCursor(2, 512 + 30, curs);
-
-  memset(buf, 0, BUFSIZE);
-  i32 ret = fsRead(fd, 200, buf);   // read 200 bytes from current cursor
-  assert(ret == 200);
-
-  curs = fsTell(fd);
-  checkCursor(2, 512 + 30 + 200, curs);
-
-  check(2, buf, 0, 200, 1);
-}
-
-
-
-// ============================================================================
-// TEST 3 : Large, spanning read (1,000 bytes) from start of block 20
-//          512*20, 488*21
-// ============================================================================
-void test3(i32 fd) {
-  i8 buf[BUFSIZE];                  // buffer for reads and writes
-
-  fsSeek(fd, 20 * BYTESPERBLOCK, SEEK_SET);     
-
-  i32 curs = fsTell(fd);
-  checkCursor(3, 20 * 512, curs);
-
-  memset(buf, 0, BUFSIZE);
-  i32 ret = fsRead(fd, 1000, buf);  // read 1,000 bytes from current cursor
-  assert(ret == 1000);
-
-  curs = fsTell(fd);
-  checkCursor(3, 20 * 512 + 1000, curs);
-
-  check(3, buf,   0, 512, 20);
-  check(3, buf, 512, 488, 21);
-}
-
-
-// ============================================================================
-// TEST 4 : Small write (77 bytes) starting at 10 bytes into block 7
-//          10*7, 77*77, 425*7
-// ============================================================================
-void test4(i32 fd) {
-  i8 buf[BUFSIZE];                  // buffer for reads and writes
-
-  fsSeek(fd, 7 * BYTESPERBLOCK + 10, SEEK_SET);     
-
-  i32 curs = fsTell(fd);
-  checkCursor(4, 7 * 512 + 10, curs);
-
-  memset(buf, 0, BUFSIZE);
-  memset(buf, 77, 77);
-  
-  fsWrite(fd, 77, buf);
-
-  curs = fsTell(fd);
-  checkCursor(4, 7 * 512 + 10 + 77, curs);
-
-  fsSeek(fd, 7 * BYTESPERBLOCK, SEEK_SET);     
-
-  i32 ret = fsRead(fd, BYTESPERBLOCK, buf);
-  assert(ret == BYTESPERBLOCK);
-
-  check(4, buf, 0,  10,  7);
-  check(4, buf, 10, 77,  77);
-  check(4, buf, 87, 425, 7);   
-}
-
-
-
-// ============================================================================
-// TEST 5 : Large, spanning write (900 bytes) starting at 50 bytes into 
-//          block 10
-//          50*10, 462*88, 438*88, 74*11
-// ============================================================================
-void test5(i32 fd) {
-  i8 buf[BUFSIZE];                  // buffer for reads and writes
-
-  fsSeek(fd, 10 * BYTESPERBLOCK + 50, SEEK_SET);     
-
-  i32 curs = fsTell(fd);
-  checkCursor(5, 10 * 512 + 50, curs);
-
-  memset(buf,  0, BUFSIZE);
-  memset(buf, 88, 900);
-  
-  fsWrite(fd, 900, buf);
-
-  curs = fsTell(fd);
-  checkCursor(5, 10 * 512 + 50 + 900, curs);
-
-  fsSeek(fd, 10 * BYTESPERBLOCK, SEEK_SET);     
-
-  curs = fsTell(fd);
-  checkCursor(5, 10 * 512, curs);
-
-  i32 ret = fsRead(fd, 2 * BYTESPERBLOCK, buf);
-  assert(ret == 2 * BYTESPERBLOCK);
-
-  curs = fsTell(fd);
-  checkCursor(5, 12 * 512, curs);
-
-  check(5, buf, 0,    50, 10);
-  check(5, buf, 50,  462, 88);
-  check(5, buf, 512, 438, 88);   
-  check(5, buf, 950,  74, 11);
-}
-
-
-
-// ============================================================================
-// TEST 6 : Large, extending write (700 bytes) starting at block 49
-//          512*99, 188*99, 324*0
-// ============================================================================
-void test6(i32 fd) {
-  i8 buf[BUFSIZE];                  // buffer for reads and writes
-
-  fsSeek(fd, 49 * BYTESPERBLOCK, SEEK_SET);     
-
-  i32 curs = fsTell(fd);
-  checkCursor(6, 49 * 512, curs);
-
-  memset(buf, 0, BUFSIZE);
-  memset(buf, 99, 700);
-  
-  fsWrite(fd, 700, buf);
-
-  curs = fsTell(fd);
-  checkCursor(6, 49 * 512 + 700, curs);
-
-  fsSeek(fd, 49 * BYTESPERBLOCK, SEEK_SET);     
-
-  curs = fsTell(fd);
-  checkCursor(6, 49 * 512, curs);
-
-  i32 ret = fsRead(fd, 2 * BYTESPERBLOCK, buf);
-  assert(ret == 700);
-
-  curs = fsTell(fd);
-  checkCursor(6, 49 * 512 + 700, curs);
-
-  check(6, buf,   0, 512, 99);
-  check(6, buf, 512, 188, 99);
-  check(6, buf, 700, 324,  0);    // technically beyond EOF
-}
-
-
-
-void p5test() {
-
-  i32 fd = fsOpen("P5");    // open "P5" for testing
-
-  test1(fd);
-  test2(fd);
-  test3(fd);
-  test4(fd);
-  test5(fd);
-  test6(fd);
-
-  fsClose(fd);
-
-}
+// ============================================================================
+// p5test.c : use regular C library calls to check what the answers should be
+// when run against the BFS filesystem
+// ============================================================================
+
+#include "p5test.h"
+
+// ============================================================================
+// Check that 'size' bytes, starting at buf[start] hold the value 'val'.
+// 'testnum' is the test number - used for reporting
+// ============================================================================
+void check(int testnum, i8* buf, int start, int size, int val) {
+  for (int i = start; i < start + size; ++i) {
+    if (buf[i] != val) {
+      printf("TEST %d : BAD  : buf[%d] = %d but should be %d \n", 
+        testnum, i, buf[i], val);
+      return;
+    }
+  }
+  printf("TEST %d : GOOD \n", testnum);
+}
+
+
+
+// ============================================================================
+// Check that 'actual' == 'expected' for test 'testnum'
+// ============================================================================
+void checkCursor(int testnum, int expected, int actual) {
+  if (actual == expected) {
+    printf("TEST %d : GOOD \n", testnum);
+  } else {
+    printf("TEST %d : BAD  : cursor = %d but should be %d \n", 
+        testnum, actual, expected);
+  }
+}
+
+
+
+// ============================================================================
+// Create file "P5", holding 50 blocks, inside of BFSDISK, and populate
+// ============================================================================
+void createP5() {
+
+  i32 fd = fsCreate("P5");
+
+  i8 buf[BYTESPERBLOCK];
+
+  // Write 100 blocks.  Every byte in block 'b' the value 'b'
+
+  for (int b = 0; b < 50; ++b) {
+    memset(buf, b, BYTESPERBLOCK);
+    fsWrite(fd, BYTESPERBLOCK, buf);
+  }
+
+  fsClose(fd);
+}
+
+
+
+// ============================================================================
+// TEST 1 : Small read (100 bytes) from cursor = 0
+// ============================================================================
+void test1(i32 fd) {
+  i8 buf[BUFSIZE];                  // buffer for reads and writes
+
+  fsSeek(fd, 0, SEEK_SET);     
+
+  i32 curs = fsTell(fd);
+  checkCursor(1, 0, curs);
+
+  memset(buf, 0, BUFSIZE);
+  i32 ret = fsRead(fd, 100, buf);   // read 100 bytes from cursor = 0
+  assert(ret == 100);
+
+  curs = fsTell(fd);
+  checkCursor(1, 100, curs);
+
+  check(1, buf, 0, 100, 0);
+}
+
+
+// ============================================================================
+// TEST 2 : Small read (200 bytes) from 30 bytes into block 1
+// ============================================================================
+void test2(i32 fd) {
+  i8 buf[BUFSIZE];                  // buffer for reads and writes
+
+  fsSeek(fd, 512 + 30, SEEK_SET);     
+
+  i32 curs = fsTell(fd);
+  checkCursor(2, 512 + 30, curs);
+
+  memset(buf, 0, BUFSIZE);
+  i32 ret = fsRead(fd, 200, buf);   // read 200 bytes from current cursor
+  assert(ret == 200);
+
+  curs = fsTell(fd);
+  checkCursor(2, 512 + 30 + 200, curs);
+
+  check(2, buf, 0, 200, 1);
+}
+
+
+
+// ============================================================================
+// TEST 3 : Large, spanning read (1,000 bytes) from start of block 20
+//          512*20, 488*21
+// ============================================================================
+void test3(i32 fd) {
+  i8 buf[BUFSIZE];                  // buffer for reads and writes
+
+  fsSeek(fd, 20 * BYTESPERBLOCK, SEEK_SET);     
+
+  i32 curs = fsTell(fd);
+  checkCursor(3, 20 * 512, curs);
+
+  memset(buf, 0, BUFSIZE);
+  i32 ret = fsRead(fd, 1000, buf);  // read 1,000 bytes from current cursor
+  assert(ret == 1000);
+
+  curs = fsTell(fd);
+  checkCursor(3, 20 * 512 + 1000, curs);
+
+  check(3, buf,   0, 512, 20);
+  check(3, buf, 512, 488, 21);
+}
+
+
+// ============================================================================
+// TEST 4 : Small write (77 bytes) starting at 10 bytes into block 7
+//          10*7, 77*77, 425*7
+// ============================================================================
+void test4(i32 fd) {
+  i8 buf[BUFSIZE];                  // buffer for reads and writes
+
+  fsSeek(fd, 7 * BYTESPERBLOCK + 10, SEEK_SET);     
+
+  i32 curs = fsTell(fd);
+  checkCursor(4, 7 * 512 + 10, curs);
+
+  memset(buf, 0, BUFSIZE);
+  memset(buf, 77, 77);
+  
+  fsWrite(fd, 77, buf);
+
+  curs = fsTell(fd);
+  checkCursor(4, 7 * 512 + 10 + 77, curs);
+
+  fsSeek(fd, 7 * BYTESPERBLOCK, SEEK_SET);     
+
+  i32 ret = fsRead(fd, BYTESPERBLOCK, buf);
+  assert(ret == BYTESPERBLOCK);
+
+  check(4, buf, 0,  10,  7);
+  check(4, buf, 10, 77,  77);
+  check(4, buf, 87, 425, 7);   
+}
+
+
+
+// ============================================================================
+// TEST 5 : Large, spanning write (900 bytes) starting at 50 bytes into 
+//          block 10
+//          50*10, 462*88, 438*88, 74*11
+// ============================================================================
+void test5(i32 fd) {
+  i8 buf[BUFSIZE];                  // buffer for reads and writes
+
+  fsSeek(fd, 10 * BYTESPERBLOCK + 50, SEEK_SET);     
+
+  i32 curs = fsTell(fd);
+  checkCursor(5, 10 * 512 + 50, curs);
+
+  memset(buf,  0, BUFSIZE);
+  memset(buf, 88, 900);
+  
+  fsWrite(fd, 900, buf);
+
+  curs = fsTell(fd);
+  checkCursor(5, 10 * 512 + 50 + 900, curs);
+
+  fsSeek(fd, 10 * BYTESPERBLOCK, SEEK_SET);     
+
+  curs = fsTell(fd);
+  checkCursor(5, 10 * 512, curs);
+
+  i32 ret = fsRead(fd, 2 * BYTESPERBLOCK, buf);
+  assert(ret == 2 * BYTESPERBLOCK);
+
+  curs = fsTell(fd);
+  checkCursor(5, 12 * 512, curs);
+
+  check(5, buf, 0,    50, 10);
+  check(5, buf, 50,  462, 88);
+  check(5, buf, 512, 438, 88);   
+  check(5, buf, 950,  74, 11);
+}
+
+
+
+// ============================================================================
+// TEST 6 : Large, extending write (700 bytes) starting at block 49
+//          512*99, 188*99, 324*0
+// ============================================================================
+void test6(i32 fd) {
+  i8 buf[BUFSIZE];                  // buffer for reads and writes
+
+  fsSeek(fd, 49 * BYTESPERBLOCK, SEEK_SET);     
+
+  i32 curs = fsTell(fd);
+  checkCursor(6, 49 * 512, curs);
+
+  memset(buf, 0, BUFSIZE);
+  memset(buf, 99, 700);
+  
+  fsWrite(fd, 700, buf);
+
+  curs = fsTell(fd);
+  checkCursor(6, 49 * 512 + 700, curs);
+
+  fsSeek(fd, 49 * BYTESPERBLOCK, SEEK_SET);     
+
+  curs = fsTell(fd);
+  checkCursor(6, 49 * 512, curs);
+
+  i32 ret = fsRead(fd, 2 * BYTESPERBLOCK, buf);
+  assert(ret == 700);
+
+  curs = fsTell(fd);
+  checkCursor(6, 49 * 512 + 700, curs);
+
+  check(6, buf,   0, 512, 99);
+  check(6, buf, 512, 188, 99);
+  check(6, buf, 700, 324,  0);    // technically beyond EOF
+}
+
+
+
+// ============================================================================
+// TEST 7 : Sparse write (100 bytes) at 10 bytes into block 20 of file SPARSE.
+//          FBNs 0-19 are a hole: they read back as zeroes, SEEK_DATA skips
+//          over them and SEEK_HOLE finds them
+// ============================================================================
+void test7() {
+  i8 buf[BUFSIZE];                  // buffer for reads and writes
+
+  i32 fd = fsOpen("SPARSE");
+  if (fd == EFNF) fd = fsCreate("SPARSE");
+
+  fsSeek(fd, 20 * BYTESPERBLOCK + 10, SEEK_SET);
+
+  memset(buf,  0, BUFSIZE);
+  memset(buf, 55, 100);
+
+  fsWrite(fd, 100, buf);
+
+  checkCursor(7, 20 * 512 + 110, fsSize(fd));
+
+  fsSeek(fd, 0, SEEK_SET);
+
+  memset(buf, 1, BUFSIZE);
+  i32 ret = fsRead(fd, BUFSIZE, buf);
+  assert(ret == BUFSIZE);
+
+  check(7, buf, 0, BUFSIZE, 0);
+
+  fsSeek(fd, 0, SEEK_DATA);
+  checkCursor(7, 20 * 512, fsTell(fd));
+
+  fsSeek(fd, 0, SEEK_HOLE);
+  checkCursor(7, 0, fsTell(fd));
+
+  fsSeek(fd, 20 * 512, SEEK_HOLE);
+  checkCursor(7, 20 * 512 + 110, fsTell(fd));
+
+  ret = fsSeek(fd, 20 * 512 + 110, SEEK_DATA);
+  assert(ret == EPASTEOF);
+
+  fsSeek(fd, 20 * 512 + 10, SEEK_SET);
+  ret = fsRead(fd, 100, buf);
+  assert(ret == 100);
+  check(7, buf, 0, 100, 55);
+
+  fsClose(fd);
+}
+
+
+
+// ============================================================================
+// TEST 8 : Truncate file TRUNC from 20 blocks down to 3 blocks + 100 bytes,
+//          grow it back to 20 blocks, then delete it.  Bytes past the
+//          truncation point read back as zeroes.  While open, TRUNC cannot
+//          be deleted: EFOPEN.  Closed, the name is gone as soon as fsDelete
+//          returns (its blocks are reclaimed in background)
+// ============================================================================
+void test8() {
+  i8 buf[BUFSIZE];                  // buffer for reads and writes
+
+  fsDelete("TRUNC");                // left over from an earlier run?
+
+  i32 fd = fsCreate("TRUNC");
+
+  for (int b = 0; b < 20; ++b) {
+    memset(buf, b + 1, BYTESPERBLOCK);
+    fsWrite(fd, BYTESPERBLOCK, buf);
+  }
+
+  checkCursor(8, 20 * 512, fsSize(fd));
+
+  fsTruncate(fd, 3 * BYTESPERBLOCK + 100);
+  checkCursor(8, 3 * 512 + 100, fsSize(fd));
+
+  fsTruncate(fd, 20 * BYTESPERBLOCK);
+  checkCursor(8, 20 * 512, fsSize(fd));
+
+  fsSeek(fd, 3 * BYTESPERBLOCK, SEEK_SET);
+
+  memset(buf, 0, BUFSIZE);
+  i32 ret = fsRead(fd, 2 * BYTESPERBLOCK, buf);
+  assert(ret == 2 * BYTESPERBLOCK);
+
+  check(8, buf,   0, 100, 4);
+  check(8, buf, 100, 924, 0);
+
+  checkCursor(8, EFOPEN, fsDelete("TRUNC"));    // still open
+  checkCursor(8, 20 * 512, fsSize(fd));
+
+  fsClose(fd);
+
+  ret = fsDelete("TRUNC");
+  assert(ret == 0);
+
+  checkCursor(8, EFNF, fsOpen("TRUNC"));
+}
+
+
+
+// ============================================================================
+// TEST 9 : Preallocate 6 blocks of file PREALLOC, then write 600 bytes
+//          starting at 100 bytes into block 2.  The rest of the preallocated
+//          range is unwritten, so it reads back as zeroes.  Preallocating
+//          more than the disk holds is EDISKFULL, and reserves nothing
+//          1124*0, 600*66, 1348*0
+// ============================================================================
+void test9() {
+  i8 buf[3 * BUFSIZE];              // buffer for reads and writes
+
+  fsDelete("PREALLOC");             // left over from an earlier run?
+
+  i32 fd = fsCreate("PREALLOC");
+
+  fsFallocate(fd, 0, 6 * BYTESPERBLOCK, 0);
+  checkCursor(9, 6 * 512, fsSize(fd));
+
+  fsSeek(fd, 2 * BYTESPERBLOCK + 100, SEEK_SET);
+
+  memset(buf, 66, 600);
+  fsWrite(fd, 600, buf);
+
+  checkCursor(9, 6 * 512, fsSize(fd));
+
+  fsSeek(fd, 0, SEEK_SET);
+
+  memset(buf, 1, sizeof(buf));
+  i32 ret = fsRead(fd, 6 * BYTESPERBLOCK, buf);
+  assert(ret == 6 * BYTESPERBLOCK);
+
+  check(9, buf,    0,  1124,  0);
+  check(9, buf, 1124,   600, 66);
+  check(9, buf, 1724,  1348,  0);
+
+  ret = fsFallocate(fd, 0, BLOCKSPERDISK * BYTESPERBLOCK, 0);
+  checkCursor(9, EDISKFULL, ret);
+  checkCursor(9, 6 * 512, fsSize(fd));
+
+  fsClose(fd);
+  fsDelete("PREALLOC");
+}
+
+
+
+// ============================================================================
+// TEST 10 : Write files FRAGA and FRAGB, in one allocation group, a block at
+//           a time, alternately, so their blocks interleave on disk.  While
+//           FRAGA is open, it may not be defragmented: EFOPEN.  Closed, it
+//           becomes one extent (score 1 MB / 4 blocks = 512 per MB) and still
+//           holds the same data
+// ============================================================================
+void test10() {
+  i8 buf[3 * BUFSIZE];              // buffer for reads and writes
+
+  fsDelete("FRAGA");                // left over from an earlier run?
+  fsDelete("FRAGB");
+
+  i32 fda   = fsCreate("FRAGA");
+  i32 fdb   = fsCreate("FRAGB");
+  i32 group = bfsFdToInum(fda) / INODESPERBLOCK;
+  for (i32 k = 0; k < 2 * NUMGROUPS; ++k) {   // new files go round the
+    if (bfsFdToInum(fdb) / INODESPERBLOCK == group) break;  //   groups
+    fsClose(fdb);
+    fsDelete("FRAGB");
+    fdb = fsCreate("FRAGB");
+  }
+  checkCursor(10, group, bfsFdToInum(fdb) / INODESPERBLOCK);
+
+  for (int b = 0; b < 4; ++b) {
+    memset(buf, 30 + b, BYTESPERBLOCK);
+    fsWrite(fda, BYTESPERBLOCK, buf);
+    fsWrite(fdb, BYTESPERBLOCK, buf);
+  }
+
+  checkCursor(10, 1, fsFragScore("FRAGA") > 512);
+
+  checkCursor(10, EFOPEN, fsDefrag("FRAGA"));
+  fsClose(fda);
+  i32 ret = fsDefrag("FRAGA");
+  checkCursor(10, 0, ret);
+
+  checkCursor(10, 512, fsFragScore("FRAGA"));
+
+  fda = fsOpen("FRAGA");
+  ret = fsRead(fda, 4 * BYTESPERBLOCK, buf);
+  checkCursor(10, 4 * BYTESPERBLOCK, ret);
+
+  for (int b = 0; b < 4; ++b) {
+    check(10, buf, b * 512, 512, 30 + b);
+  }
+
+  fsClose(fda);
+  fsClose(fdb);
+  fsDelete("FRAGA");
+  fsDelete("FRAGB");
+}
+
+
+
+// ============================================================================
+// TEST 11 : Write a 10-byte file TINY.  It stays inline in its Inode (no
+//           blocks), reads back, and moves to a block once a 600-byte write
+//           outgrows the Inode
+//           10*44, 600*45
+// ============================================================================
+void test11() {
+  i8 buf[BUFSIZE];                  // buffer for reads and writes
+
+  fsDelete("TINY");                 // left over from an earlier run?
+
+  i32 fd = fsCreate("TINY");
+
+  memset(buf, 44, 10);
+  fsWrite(fd, 10, buf);
+
+  checkCursor(11, 10, fsSize(fd));
+  checkCursor(11, 0, fsFragScore("TINY"));        // no blocks
+
+  fsSeek(fd, 0, SEEK_SET);
+  memset(buf, 0, BUFSIZE);
+  i32 ret = fsRead(fd, 10, buf);
+  assert(ret == 10);
+  check(11, buf, 0, 10, 44);
+
+  memset(buf, 45, 600);
+  fsWrite(fd, 600, buf);
+
+  checkCursor(11, 610, fsSize(fd));
+  ret = fsFragScore("TINY");                      // now has blocks
+  checkCursor(11, 1, ret > 0);
+
+  fsSeek(fd, 0, SEEK_SET);
+  memset(buf, 0, BUFSIZE);
+  ret = fsRead(fd, 610, buf);
+  assert(ret == 610);
+  check(11, buf,  0,  10, 44);
+  check(11, buf, 10, 600, 45);
+
+  fsClose(fd);
+  fsDelete("TINY");
+}
+
+
+
+// ============================================================================
+// TEST 12 : Write 100 bytes into the double-indirect range of file HUGE, and
+//           100 more into the triple-indirect range.  Only the map tables on
+//           the way down are allocated; SEEK_DATA skips the empty tables,
+//           and both writes read back
+//           100*66 at FBN 5+128+300, 100*67 at FBN 5+128+16384+7
+// ============================================================================
+void test12() {
+  i8 buf[BUFSIZE];                  // buffer for reads and writes
+
+  fsDelete("HUGE");                 // left over from an earlier run?
+
+  i32 fd = fsCreate("HUGE");
+
+  i32 offD = (5 + 128 + 300) * 512 + 10;
+  i32 offT = (5 + 128 + 16384 + 7) * 512;
+
+  fsSeek(fd, offD, SEEK_SET);
+  memset(buf, 66, 100);
+  fsWrite(fd, 100, buf);
+
+  fsSeek(fd, offT, SEEK_SET);
+  memset(buf, 67, 100);
+  fsWrite(fd, 100, buf);
+
+  checkCursor(12, offT + 100, fsSize(fd));
+
+  fsSeek(fd, 0, SEEK_DATA);
+  checkCursor(12, offD - 10, fsTell(fd));
+
+  fsSeek(fd, offD, SEEK_HOLE);
+  checkCursor(12, offD - 10 + 512, fsTell(fd));
+
+  fsSeek(fd, offD - 10 + 512, SEEK_DATA);
+  checkCursor(12, offT, fsTell(fd));
+
+  fsSeek(fd, offD - 10, SEEK_SET);
+  memset(buf, 1, BUFSIZE);
+  i32 ret = fsRead(fd, BYTESPERBLOCK, buf);
+  assert(ret == BYTESPERBLOCK);
+  check(12, buf,   0,  10,  0);
+  check(12, buf,  10, 100, 66);
+  check(12, buf, 110, BYTESPERBLOCK - 110, 0);
+
+  fsSeek(fd, offT, SEEK_SET);
+  ret = fsRead(fd, 100, buf);
+  assert(ret == 100);
+  check(12, buf, 0, 100, 67);
+
+  fsTruncate(fd, offD + 100);       // drops the triple-indirect tables
+  checkCursor(12, offD + 100, fsSize(fd));
+  ret = fsSeek(fd, offD + 100, SEEK_DATA);
+  assert(ret == EPASTEOF);
+
+  fsClose(fd);
+  fsDelete("HUGE");
+}
+
+
+
+// ============================================================================
+// TEST 13 : Build DIRA/DIRB, holding a file with a long name, and walk to it
+//           by path.  fsReaddir lists each directory; a non-empty directory
+//           cannot be deleted; names are per-directory.  A bad path to
+//           create is an error, not an abort.  Then tear it down
+//           100*77 in DIRA/DIRB/a-file-name-well-past-sixteen-chars
+// ============================================================================
+void test13() {
+  i8   buf[BUFSIZE];                // buffer for reads and writes
+  char name[64];                    // >= FNAMESIZE
+  str  path = "DIRA/DIRB/a-file-name-well-past-sixteen-chars";
+
+  fsDelete(path);                   // left over from an earlier run?
+  fsDelete("DIRA/DIRB/P5");
+  fsDelete("DIRA/DIRB");
+  fsDelete("DIRA");
+
+  i32 ret = fsMkdir("DIRA");
+  checkCursor(13, 0, ret);
+  ret = fsMkdir("DIRA/DIRB");
+  checkCursor(13, 0, ret);
+  ret = fsMkdir("DIRA");
+  checkCursor(13, EFEXISTS, ret);
+  ret = fsMkdir("NODIR/DIRB");
+  checkCursor(13, EFNF, ret);
+
+  i32 fd = fsCreate(path);
+  memset(buf, 77, 100);
+  fsWrite(fd, 100, buf);
+  fsClose(fd);
+
+  i32 fd2 = fsCreate("DIRA/DIRB/P5");   // not the P5 in the root
+  fsClose(fd2);
+
+  fd = fsOpen("/DIRA//DIRB/a-file-name-well-past-sixteen-chars");
+  assert(fd >= 0);
+  checkCursor(13, 100, fsSize(fd));
+  memset(buf, 0, BUFSIZE);
+  ret = fsRead(fd, 100, buf);
+  assert(ret == 100);
+  check(13, buf, 0, 100, 77);
+  fsClose(fd);
+
+  fd = fsOpen("P5");
+  ret = fsSize(fd);                     // the root P5 is untouched
+  checkCursor(13, 1, ret >= 50 * 512);
+  fsClose(fd);
+
+  ret = fsOpen("DIRA/DIRB");
+  checkCursor(13, EISADIR, ret);
+  ret = fsOpen("DIRA/nope");
+  checkCursor(13, EFNF, ret);
+  ret = fsOpen("DIRA/DIRB/P5/x");
+  checkCursor(13, EFNF, ret);
+
+  memset(name, 'N', FNAMESIZE);     // a name FNAMESIZE chars long
+  name[FNAMESIZE] = 0;
+  checkCursor(13, EBIGFNAME, fsCreate(name));
+  checkCursor(13, EBIGFNAME, fsMkdir(name));
+  checkCursor(13, EFNF, fsCreate("NODIR/X"));
+  checkCursor(13, ENOTADIR, fsCreate("DIRA/DIRB/P5/x"));
+
+  i32 cursor = 0;
+  i32 count  = 0;
+  while (fsReaddir("DIRA/DIRB", &cursor, name) == 1) ++count;
+  checkCursor(13, 2, count);
+
+  cursor = 0;
+  ret = fsReaddir("DIRA", &cursor, name);
+  assert(ret == 1 && strcmp(name, "DIRB") == 0);
+  ret = fsReaddir("DIRA", &cursor, name);
+  assert(ret == 0);
+
+  ret = fsDelete("DIRA");
+  checkCursor(13, EDIRNOTEMPTY, ret);
+  ret = fsDelete(path);
+  checkCursor(13, 0, ret);
+  ret = fsDelete("DIRA/DIRB/P5");
+  checkCursor(13, 0, ret);
+  ret = fsDelete("DIRA/DIRB");
+  checkCursor(13, 0, ret);
+  ret = fsDelete("DIRA");
+  checkCursor(13, 0, ret);
+  ret = fsOpen(path);
+  checkCursor(13, EFNF, ret);
+}
+
+
+
+// ============================================================================
+// TEST 14 : CRC32C, which guards every block.  Check the standard vector, and
+//           that the fast (SSE4.2) path agrees with the portable one on a
+//           whole block and on odd lengths.  Then write and re-read P5's first
+//           block, each read verified against its checksum.  A byte of that
+//           block changed on the disk, behind BFS's back, is EBADCRC.  A
+//           writer that dies after writeback, but before any sync or unmount,
+//           leaves an image (BFSDISK-CRASH) whose checksums match its data
+// ============================================================================
+void test14() {
+  i8 buf[BUFSIZE];                  // buffer for reads and writes
+  static i8 img[BLOCKSPERDISK * BYTESPERBLOCK];
+
+  checkCursor(14, 0xe3069283, crc32c("123456789", 9));
+
+  for (i32 i = 0; i < BYTESPERBLOCK; ++i) buf[i] = (i8)(i * 7 + 3);
+  checkCursor(14, crcSoft(buf, BYTESPERBLOCK), crc32c(buf, BYTESPERBLOCK));
+  checkCursor(14, crcSoft(buf + 1, 77),  crc32c(buf + 1, 77));
+  checkCursor(14, crcSoft(buf, 0),       crc32c(buf, 0));
+
+  i32 fd = fsOpen("P5");
+  i8  old[BYTESPERBLOCK];
+  i32 ret = fsRead(fd, BYTESPERBLOCK, old);
+  checkCursor(14, BYTESPERBLOCK, ret);
+  fsSeek(fd, 0, SEEK_SET);
+  fsWrite(fd, BYTESPERBLOCK, buf);
+  fsSeek(fd, 0, SEEK_SET);
+  i8 back[BYTESPERBLOCK];
+  ret = fsRead(fd, BYTESPERBLOCK, back);
+  checkCursor(14, BYTESPERBLOCK, ret);
+  checkCursor(14, 0, memcmp(back, buf, BYTESPERBLOCK));
+  fsSeek(fd, 0, SEEK_SET);
+  fsWrite(fd, BYTESPERBLOCK, old);  // put P5 back
+  fsSync(fd);                       // on the disk, checksum too
+
+  i32 dbn = bfsFbnToDbn(bfsFdToInum(fd), 0);
+  FILE* fp = fopen(BFSDISK, "rb+"); // flip a byte of it
+  assert(fp != NULL);
+  fseek(fp, dbn * BYTESPERBLOCK + 17, SEEK_SET);
+  fputc(old[17] ^ 0x55, fp);
+  fflush(fp);
+  bioReadRaw(dbn, 1, back);
+  checkCursor(14, EBADCRC, bioCrcCheck(dbn, 1, back));
+  fseek(fp, dbn * BYTESPERBLOCK + 17, SEEK_SET);
+  fputc(old[17], fp);               // and back
+  fclose(fp);
+  bioReadRaw(dbn, 1, back);
+  checkCursor(14, 0, bioCrcCheck(dbn, 1, back));
+  fsClose(fd);
+
+  BfsVolume* vol = fsMount("BFSDISK-CRASH", MOUNT_FORMAT);
+  checkCursor(14, 1, vol != NULL);
+  fd = fsCreate("CRASH");
+  for (i32 b = 0; b < 3; ++b) {
+    memset(buf, 40 + b, BYTESPERBLOCK);
+    fsWrite(fd, BYTESPERBLOCK, buf);
+  }
+  fsClose(fd);
+  wbFlush();                        // written back, never synced
+
+  fp = fopen("BFSDISK-CRASH", "rb");    // the image as the crash left it
+  assert(fp != NULL);
+  size_t got = fread(img, 1, sizeof(img), fp);
+  fclose(fp);
+  checkCursor(14, sizeof(img), got);
+  fp = fopen("BFSDISK-CRASH2", "wb");
+  assert(fp != NULL);
+  fwrite(img, 1, sizeof(img), fp);
+  fclose(fp);
+
+  BfsVolume* after = fsMount("BFSDISK-CRASH2", 0);
+  checkCursor(14, 1, after != NULL);
+  fd = fsOpen("CRASH");
+  for (i32 b = 0; b < 3; ++b) {
+    ret = fsRead(fd, BYTESPERBLOCK, buf);
+    checkCursor(14, BYTESPERBLOCK, ret);
+    check(14, buf, 0, BYTESPERBLOCK, 40 + b);
+  }
+  i32 bad = 0;
+  for (i32 d = MINDBN; d < BLOCKSPERDISK; ++d) {
+    bioReadRaw(d, 1, back);
+    if (bioCrcCheck(d, 1, back) != 0) ++bad;
+  }
+  checkCursor(14, 0, bad);
+  fsClose(fd);
+  fsUnmount();                      // back to BFSDISK
+
+  fsUse(vol);
+  fsUnmount();
+  remove("BFSDISK-CRASH");
+  remove("BFSDISK-CRASH2");
+}
+
+
+
+// ============================================================================
+// TEST 15 : Compressed file COMP.  Write log-like text across three clusters,
+//           starting mid-block; patch bytes that straddle a cluster edge;
+//           write past a 2-cluster hole, which SEEK_HOLE/SEEK_DATA find.  Read
+//           it all back.  Shrink mid-cluster, regrow, and the tail reads zero.
+//           Then fsCompress a plain file that already holds data.  A
+//           compressed file may not grow past COMPMAXSIZE, nor a bigger file
+//           be compressed: EBIGNUMB, and the data is kept
+// ============================================================================
+void test15() {
+  i8  buf[BUFSIZE];                 // buffer for reads and writes
+  i8  text[6000];                   // expected content of COMP from byte 100
+  str line = "2026-10-18 BFS log line\n";
+
+  for (i32 i = 0; i < 6000; ++i) text[i] = line[i % 24];
+
+  fsDelete("COMP");                 // left over from an earlier run?
+  fsDelete("COMP2");
+
+  i32 fd = fsCreate("COMP");
+  i32 ret = fsCompress("COMP");
+  checkCursor(15, 0, ret);
+  fsSeek(fd, 100, SEEK_SET);
+  fsWrite(fd, 6000, text);
+  checkCursor(15, 6100, fsSize(fd));
+
+  memset(buf, 9, 50);               // across the edge of clusters 0 and 1
+  fsSeek(fd, 2030, SEEK_SET);
+  fsWrite(fd, 50, buf);
+  memset(text + 1930, 9, 50);
+
+  fsSeek(fd, 12000, SEEK_SET);      // clusters 3 and 4 stay holes
+  fsWrite(fd, 10, buf);
+
+  ret = fsSeek(fd, 0, SEEK_HOLE);
+  checkCursor(15, 0, ret);
+  checkCursor(15, 3 * 2048, fsTell(fd));
+  ret = fsSeek(fd, 3 * 2048, SEEK_DATA);
+  checkCursor(15, 0, ret);
+  checkCursor(15, 5 * 2048, fsTell(fd));
+
+  fsSeek(fd, 0, SEEK_SET);
+  ret = fsRead(fd, 100, buf);
+  checkCursor(15, 100, ret);
+  check(15, buf, 0, 100, 0);
+  for (i32 p = 0; p < 6000; p += BUFSIZE) {
+    ret = fsRead(fd, BUFSIZE, buf);
+    checkCursor(15, BUFSIZE, ret);
+    checkCursor(15, 0, memcmp(buf, text + p, BUFSIZE));
+  }
+  fsSeek(fd, 12000, SEEK_SET);
+  ret = fsRead(fd, 100, buf);
+  checkCursor(15, 10, ret);
+  check(15, buf, 0, 10, 9);
+
+  fsTruncate(fd, 3000);
+  fsTruncate(fd, 4000);
+  fsSeek(fd, 2900, SEEK_SET);
+  ret = fsRead(fd, 1100, buf);
+  checkCursor(15, 1100, ret);
+  checkCursor(15, 0, memcmp(buf, text + 2800, 100));
+  check(15, buf, 100, 1000, 0);
+  fsClose(fd);
+  ret = fsDelete("COMP");
+  checkCursor(15, 0, ret);
+
+  fd = fsCreate("COMP2");           // plain, in blocks
+  fsWrite(fd, 3000, text);
+  ret = fsCompress("COMP2");
+  checkCursor(15, 0, ret);
+  fsSeek(fd, 0, SEEK_SET);
+  ret = fsRead(fd, 3000, text + 3000);
+  checkCursor(15, 3000, ret);
+  checkCursor(15, 0, memcmp(text, text + 3000, 3000));
+
+  checkCursor(15, EBIGNUMB, fsTruncate(fd, COMPMAXSIZE + 1));
+  fsSeek(fd, COMPMAXSIZE - 10, SEEK_SET);
+  checkCursor(15, EBIGNUMB, fsWrite(fd, 20, buf));
+  checkCursor(15, 3000, fsSize(fd));
+  fsClose(fd);
+  ret = fsDelete("COMP2");
+  checkCursor(15, 0, ret);
+
+  fd = fsCreate("COMP2");           // plain, sparse, too big to compress
+  fsWrite(fd, 3000, text);
+  fsTruncate(fd, COMPMAXSIZE + 1);
+  checkCursor(15, EBIGNUMB, fsCompress("COMP2"));
+  fsSeek(fd, 0, SEEK_SET);
+  ret = fsRead(fd, 3000, text + 3000);
+  checkCursor(15, 3000, ret);
+  checkCursor(15, 0, memcmp(text, text + 3000, 3000));
+  checkCursor(15, COMPMAXSIZE + 1, fsSize(fd));
+  fsClose(fd);
+  ret = fsDelete("COMP2");
+  checkCursor(15, 0, ret);
+}
+
+
+
+// ============================================================================
+// TEST 16 : Deduplicated files DUPA and DUPB get the same 4 blocks, then
+//           DUPB a block of zeroes, which becomes a hole.  Patch DUPB where
+//           the two share a block: DUPA must not change.  Delete DUPA: DUPB
+//           keeps its data
+// ============================================================================
+void test16() {
+  i8 buf[5 * 512];                  // buffer for reads and writes
+  i8 data[4 * 512];                 // the 4 blocks both files are given
+
+  for (i32 i = 0; i < 4 * 512; ++i) data[i] = (i8)(i / 512 + 1);
+
+  fsDelete("DUPA");                 // left over from an earlier run?
+  fsDelete("DUPB");
+
+  i32 fda = fsCreate("DUPA");
+  i32 fdb = fsCreate("DUPB");
+  i32 ret = fsDedup("DUPA");
+  checkCursor(16, 0, ret);
+  ret = fsDedup("DUPB");
+  checkCursor(16, 0, ret);
+
+  fsWrite(fda, 4 * 512, data);
+  fsWrite(fdb, 4 * 512, data);
+
+  memset(buf, 0, 512);
+  fsWrite(fdb, 512, buf);           // FBN 4: zeroes
+  checkCursor(16, 5 * 512, fsSize(fdb));
+  ret = fsSeek(fdb, 0, SEEK_HOLE);
+  checkCursor(16, 0, ret);
+  checkCursor(16, 4 * 512, fsTell(fdb));
+
+  memset(buf, 77, 10);              // patch the block shared at FBN 2
+  fsSeek(fdb, 2 * 512 + 100, SEEK_SET);
+  fsWrite(fdb, 10, buf);
+
+  fsSeek(fda, 0, SEEK_SET);
+  ret = fsRead(fda, 4 * 512, buf);
+  checkCursor(16, 4 * 512, ret);
+  checkCursor(16, 0, memcmp(buf, data, 4 * 512));
+  fsClose(fda);
+  ret = fsDelete("DUPA");
+  checkCursor(16, 0, ret);
+
+  fsSeek(fdb, 0, SEEK_SET);
+  ret = fsRead(fdb, 5 * 512, buf);
+  checkCursor(16, 5 * 512, ret);
+  check(16, buf, 2 * 512 + 100, 10, 77);
+  memset(data + 2 * 512 + 100, 77, 10);
+  checkCursor(16, 0, memcmp(buf, data, 4 * 512));
+  check(16, buf, 4 * 512, 512, 0);
+  fsClose(fdb);
+  ret = fsDelete("DUPB");
+  checkCursor(16, 0, ret);
+}
+
+
+
+// ============================================================================
+// TEST 17 : Snapshot S17 of SNAPF (8 blocks: reaches the indirect table) and
+//           SNAPG.  Patch SNAPF and delete SNAPG: mounted, the snapshot still
+//           reads both as they were, and refuses writes, creates and deletes
+//           (EROFS).  Back on the live tree, the patches are there and SNAPG
+//           is gone
+// ============================================================================
+void test17() {
+  i8 buf[BUFSIZE];                  // buffer for reads and writes
+  i8 data[8 * 512];                 // what SNAPF holds when snapshotted
+
+  for (i32 i = 0; i < 8 * 512; ++i) data[i] = (i8)(i / 512 + 40);
+
+  fsSnapshotDelete("S17");          // left over from an earlier run?
+  fsDelete("SNAPF");
+  fsDelete("SNAPG");
+
+  i32 fdf = fsCreate("SNAPF");      // 8 blocks: reaches the indirect table
+  fsWrite(fdf, 8 * 512, data);
+  i32 fdg = fsCreate("SNAPG");
+  memset(buf, 17, 700);
+  fsWrite(fdg, 700, buf);
+  fsClose(fdg);
+
+  i32 ret = fsSnapshot("S17");
+  checkCursor(17, 0, ret);
+  ret = fsSnapshot("S17");
+  checkCursor(17, EFEXISTS, ret);
+
+  memset(buf, 99, 512);             // change the live tree
+  fsSeek(fdf, 0, SEEK_SET);
+  fsWrite(fdf, 100, buf);
+  fsSeek(fdf, 6 * 512 + 10, SEEK_SET);
+  fsWrite(fdf, 20, buf);
+  fsClose(fdf);
+  ret = fsDelete("SNAPG");
+  checkCursor(17, 0, ret);
+
+  ret = fsSnapshotMount("S17");         // the tree as it was
+  checkCursor(17, 0, ret);
+
+  fdf = fsOpen("SNAPF");
+  checkCursor(17, 8 * 512, fsSize(fdf));
+  for (i32 b = 0; b < 8; ++b) {
+    ret = fsRead(fdf, 512, buf);
+    checkCursor(17, 512, ret);
+    check(17, buf, 0, 512, b + 40);
+  }
+  fsSeek(fdf, 0, SEEK_SET);
+  checkCursor(17, EROFS, fsWrite(fdf, 10, buf));
+  fsClose(fdf);
+
+  fdg = fsOpen("SNAPG");
+  ret = fsRead(fdg, 700, buf);
+  checkCursor(17, 700, ret);
+  check(17, buf, 0, 700, 17);
+  fsClose(fdg);
+
+  checkCursor(17, EROFS, fsCreate("SNAPH"));
+  checkCursor(17, EROFS, fsDelete("SNAPF"));
+
+  fsMount(NULL, 0);                 // back to the live tree
+
+  fdf = fsOpen("SNAPF");
+  ret = fsRead(fdf, 512, buf);
+  checkCursor(17, 512, ret);
+  check(17, buf, 0, 100, 99);
+  check(17, buf, 100, 412, 40);
+  fsSeek(fdf, 6 * 512, SEEK_SET);
+  ret = fsRead(fdf, 512, buf);
+  checkCursor(17, 512, ret);
+  check(17, buf, 0, 10, 46);
+  check(17, buf, 10, 20, 99);
+  check(17, buf, 30, 482, 46);
+  fsClose(fdf);
+  checkCursor(17, EFNF, fsOpen("SNAPG"));
+
+  ret = fsSnapshotDelete("S17");
+  checkCursor(17, 0, ret);
+  ret = fsDelete("SNAPF");
+  checkCursor(17, 0, ret);
+}
+
+
+
+// ============================================================================
+// TEST 18 : fsCopy CPA (6 blocks and 300 bytes) to CPB: a whole clone.  Patch
+//           CPB: CPA keeps its own FBN 3.  Copy a range of CPA to CPC, with
+//           partial blocks at both ends.  A missing source is EFNF
+// ============================================================================
+void test18() {
+  i8 buf[BUFSIZE];                  // buffer for reads and writes
+  i8 data[7 * 512];                 // CPA: 6 blocks and a bit
+
+  for (i32 i = 0; i < 7 * 512; ++i) data[i] = (i8)(i / 512 + 60);
+
+  fsDelete("CPA");                  // left over from an earlier run?
+  fsDelete("CPB");
+  fsDelete("CPC");
+
+  i32 fda = fsCreate("CPA");
+  fsWrite(fda, 6 * 512 + 300, data);
+  fsClose(fda);
+
+  checkCursor(18, 6 * 512 + 300, fsCopy("CPA", "CPB", 0, 99999));
+  checkCursor(18, EFNF, fsCopy("NOCP", "CPB", 0, 10));
+
+  i32 fdb = fsOpen("CPB");          // whole clone
+  i32 ret = 0;
+  checkCursor(18, 6 * 512 + 300, fsSize(fdb));
+  for (i32 b = 0; b < 7; ++b) {
+    i32 n = (b < 6) ? 512 : 300;
+    ret = fsRead(fdb, n, buf);
+    checkCursor(18, n, ret);
+    check(18, buf, 0, n, b + 60);
+  }
+
+  memset(buf, 5, 512);              // CPB gets its own copy of FBN 3
+  fsSeek(fdb, 3 * 512 + 50, SEEK_SET);
+  fsWrite(fdb, 10, buf);
+  fsClose(fdb);
+
+  fda = fsOpen("CPA");
+  fsSeek(fda, 3 * 512, SEEK_SET);
+  ret = fsRead(fda, 512, buf);
+  checkCursor(18, 512, ret);
+  check(18, buf, 0, 512, 63);
+  fsClose(fda);
+
+  checkCursor(18, 1000, fsCopy("CPA", "CPC", 100, 1000));
+  i32 fdc = fsOpen("CPC");          // partial blocks at both ends
+  checkCursor(18, 1100, fsSize(fdc));
+  ret = fsRead(fdc, 1100, buf);
+  checkCursor(18, 1100, ret);
+  check(18, buf, 0, 100, 0);
+  check(18, buf, 100, 412, 60);
+  check(18, buf, 512, 512, 61);
+  check(18, buf, 1024, 76, 62);
+  fsClose(fdc);
+
+  ret = fsDelete("CPA");
+  checkCursor(18, 0, ret);
+  ret = fsDelete("CPB");
+  checkCursor(18, 0, ret);
+  ret = fsDelete("CPC");
+  checkCursor(18, 0, ret);
+}
+
+
+
+// ============================================================================
+// TEST 19 : fsReadView lends VIEWF's cached pages: 1200 bytes from byte 100
+//           come as 3 spans, and the cursor stays put.  A write meanwhile
+//           leaves the lent pages alone.  A view past EOF is clipped to it;
+//           one at EOF is empty
+// ============================================================================
+void test19() {
+  i8   buf[BUFSIZE];                // buffer for writes
+  View view;
+
+  fsDelete("VIEWF");                // left over from an earlier run?
+
+  i32 fd = fsCreate("VIEWF");       // blocks of 80, 81, 82, then 83 * 100
+  for (i32 b = 0; b < 4; ++b) {
+    memset(buf, 80 + b, 512);
+    fsWrite(fd, (b < 3) ? 512 : 100, buf);
+  }
+  fsSeek(fd, 0, SEEK_SET);
+
+  checkCursor(19, 1200, fsReadView(fd, 100, 1200, &view));
+  checkCursor(19, 3, view.nspans);
+  checkCursor(19, 412, view.spans[0].len);
+  check(19, (i8*)view.spans[0].data, 0, 412, 80);
+  check(19, (i8*)view.spans[1].data, 0, 512, 81);
+  check(19, (i8*)view.spans[2].data, 0, 276, 82);
+  checkCursor(19, 0, fsTell(fd));
+
+  memset(buf, 9, 512);              // the lent pages do not change
+  fsSeek(fd, 512, SEEK_SET);
+  fsWrite(fd, 512, buf);
+  check(19, (i8*)view.spans[1].data, 0, 512, 81);
+  fsReleaseView(&view);
+
+  checkCursor(19, 636, fsReadView(fd, 1000, 9999, &view));   // to EOF
+  checkCursor(19, 3, view.nspans);
+  check(19, (i8*)view.spans[0].data, 0, 24, 9);
+  check(19, (i8*)view.spans[1].data, 0, 512, 82);
+  check(19, (i8*)view.spans[2].data, 0, 100, 83);
+  fsReleaseView(&view);
+  checkCursor(19, 0, fsReadView(fd, 1636, 10, &view));
+
+  fsClose(fd);
+  i32 ret = fsDelete("VIEWF");
+  checkCursor(19, 0, ret);
+}
+
+
+
+// ============================================================================
+// TEST 20 : LOG, opened OPEN_APPEND: writes go to its tail buffer, at EOF
+//           whatever the cursor, and fsSync puts them on disk.  Then 4
+//           threads append 25-byte records, each followed by an fsSync: every
+//           record lands whole
+// ============================================================================
+i32 g_test20fd;                     // LOG, open for appends
+
+void* test20Writer(void* arg) {
+  i32 fd = g_test20fd;              // each writer appends records of its own
+  i8  rec[25];
+  memset(rec, 'a' + *(i32*)arg, 25);
+  for (i32 r = 0; r < 10; ++r) {
+    fsWrite(fd, 25, rec);
+    fsSync(fd);
+  }
+  return NULL;
+}
+
+void test20() {
+  i8 buf[BUFSIZE];                  // buffer for reads and writes
+
+  fsDelete("LOG");                  // left over from an earlier run?
+  fsClose(fsCreate("LOG"));
+
+  i32 fd = fsOpenMode("LOG", OPEN_APPEND);
+  memset(buf, 'x', 700);
+  fsWrite(fd, 700, buf);            // buffered: not on disk yet
+  fsSeek(fd, 0, SEEK_SET);
+  fsWrite(fd, 300, buf);            // appends, whatever the cursor
+  checkCursor(20, 1000, fsTell(fd));
+  checkCursor(20, 0, fsSync(fd));
+  checkCursor(20, 1000, fsSize(fd));
+
+  pthread_t writers[4];             // group-committed syncs
+  i32       ids[4];
+  g_test20fd = fd;
+  for (i32 w = 0; w < 4; ++w) {
+    ids[w] = w;
+    pthread_create(&writers[w], NULL, test20Writer, &ids[w]);
+  }
+  for (i32 w = 0; w < 4; ++w) pthread_join(writers[w], NULL);
+  fsClose(fd);                      // last close writes out the tail
+
+  fd = fsOpen("LOG");
+  checkCursor(20, 2000, fsSize(fd));
+  i32 ret = fsRead(fd, 1000, buf);
+  checkCursor(20, 1000, ret);
+  check(20, buf, 0, 1000, 'x');
+  ret = fsRead(fd, 1000, buf);
+  checkCursor(20, 1000, ret);
+  i32 counts[4] = {0};              // every record, whole
+  for (i32 i = 0; i < 1000; ++i) {
+    if (buf[i] >= 'a' && buf[i] <= 'd') ++counts[buf[i] - 'a'];
+    if (i % 25 > 0 && buf[i] != buf[i - 1]) checkCursor(20, i - i % 25, i);
+  }
+  for (i32 w = 0; w < 4; ++w) checkCursor(20, 250, counts[w]);
+  fsClose(fd);
+
+  ret = fsDelete("LOG");
+  checkCursor(20, 0, ret);
+}
+
+
+
+// ============================================================================
+// TEST 21 : A slab of 8 objects: the 9th alloc fails, and no two overlap.  4
+//           threads race allocs and frees through their magazines; after they
+//           exit none is in use, and all 8 can be had again
+// ============================================================================
+SLABDEFINE(g_test21slab, 16, 8);    // a small pool, to run dry
+
+void* test21Worker(void* arg) {
+  for (i32 r = 0; r < 1000; ++r) { // alloc and free, racing the others
+    i8* a = slabAlloc(&g_test21slab);
+    i8* b = slabAlloc(&g_test21slab);
+    if (a != NULL) { memset(a, *(i32*)arg, 16); slabFree(&g_test21slab, a); }
+    if (b != NULL) slabFree(&g_test21slab, b);
+  }
+  return NULL;                      // exit gives back its magazine
+}
+
+void test21() {
+  i8* objs[9];
+
+  i32 n = 0;                        // bounded: the 9th alloc fails
+  while (n < 9 && (objs[n] = slabAlloc(&g_test21slab)) != NULL) ++n;
+  checkCursor(21, 8, n);
+  checkCursor(21, 8, slabInUse(&g_test21slab));
+  for (i32 i = 0; i < 8; ++i) {     // each object apart from the others
+    for (i32 j = 0; j < i; ++j) assert(objs[i] != objs[j]);
+  }
+  for (i32 i = 0; i < 8; ++i) slabFree(&g_test21slab, objs[i]);
+  checkCursor(21, 0, slabInUse(&g_test21slab));
+
+  pthread_t workers[4];
+  i32       ids[4];
+  for (i32 w = 0; w < 4; ++w) {
+    ids[w] = w;
+    pthread_create(&workers[w], NULL, test21Worker, &ids[w]);
+  }
+  for (i32 w = 0; w < 4; ++w) pthread_join(workers[w], NULL);
+  checkCursor(21, 0, slabInUse(&g_test21slab));
+
+  n = 0;                            // nothing lost to the workers
+  while (n < 9 && (objs[n] = slabAlloc(&g_test21slab)) != NULL) ++n;
+  checkCursor(21, 8, n);
+  for (i32 i = 0; i < 8; ++i) slabFree(&g_test21slab, objs[i]);
+}
+
+
+
+// ============================================================================
+// TEST 22 : 4 tenant threads each format and fill an image of their own, then
+//           remount it and find their data, and only theirs.  BFSDISK never
+//           sees their files, and P5 is unchanged
+// ============================================================================
+void* test22Tenant(void* arg) {
+  i32 t = *(i32*)arg;               // each tenant formats an image of its own
+  char disk[16];
+  i8   buf[BYTESPERBLOCK];
+  sprintf(disk, "BFSDISK-T%d", t);
+
+  BfsVolume* vol = fsMount(disk, MOUNT_FORMAT);
+  checkCursor(22, 1, vol != NULL);
+  if (vol == NULL) return NULL;     // not on BFSDISK
+  i32 fd = fsCreate("TENANT");
+  memset(buf, 'A' + t, BYTESPERBLOCK);
+  for (i32 b = 0; b < 20; ++b) fsWrite(fd, BYTESPERBLOCK, buf);
+  fsClose(fd);
+  fsUnmount();                      // back on BFSDISK
+
+  vol = fsMount(disk, 0);           // its data, and only its
+  checkCursor(22, 1, vol != NULL);
+  if (vol == NULL) return NULL;
+  fd = fsOpen("TENANT");
+  checkCursor(22, 20 * BYTESPERBLOCK, fsSize(fd));
+  fsSeek(fd, 19 * BYTESPERBLOCK, SEEK_SET);
+  i32 ret = fsRead(fd, BYTESPERBLOCK, buf);
+  checkCursor(22, BYTESPERBLOCK, ret);
+  check(22, buf, 0, BYTESPERBLOCK, 'A' + t);
+  fsClose(fd);
+  checkCursor(22, EFNF, fsOpen("P5"));
+  fsUnmount();
+
+  remove(disk);
+  return NULL;
+}
+
+void test22() {
+  pthread_t tenants[4];
+  i32       ids[4];
+  i32       fd   = fsOpen("P5");
+  i32       size = fsSize(fd);
+  fsClose(fd);
+
+  for (i32 t = 0; t < 4; ++t) {
+    ids[t] = t;
+    pthread_create(&tenants[t], NULL, test22Tenant, &ids[t]);
+  }
+  for (i32 t = 0; t < 4; ++t) pthread_join(tenants[t], NULL);
+
+  checkCursor(22, EFNF, fsOpen("TENANT"));  // BFSDISK never saw them
+  fd = fsOpen("P5");
+  checkCursor(22, size, fsSize(fd));
+  fsClose(fd);
+}
+
+
+
+// ============================================================================
+// TEST 23 : Stripe a volume over 3 images, 2 blocks per stripe unit, and
+//           write STRIPED in runs of 4 blocks: every member holds its share
+//           of the 100 blocks.  Remount, and read it back in big, split reads
+// ============================================================================
+void test23() {
+  str  disks[3] = { "BFSDISK-S0", "BFSDISK-S1", "BFSDISK-S2" };
+  i8   buf[4 * BYTESPERBLOCK];
+
+  BfsVolume* vol = fsMountStriped(3, disks, 2, MOUNT_FORMAT);
+  checkCursor(23, 1, vol != NULL);
+  if (vol == NULL) return;          // not on BFSDISK
+  i32 fd = fsCreate("STRIPED");
+  for (i32 r = 0; r < 10; ++r) {    // runs of 4 blocks span 2 or 3 members
+    memset(buf, r, 4 * BYTESPERBLOCK);
+    fsWrite(fd, 4 * BYTESPERBLOCK, buf);
+  }
+  fsClose(fd);
+  fsUnmount();
+
+  i32 total = 0;                    // spread over every member
+  for (i32 m = 0; m < 3; ++m) {
+    FILE* fp = fopen(disks[m], "rb");
+    assert(fp != NULL);
+    fseek(fp, 0, SEEK_END);
+    checkCursor(23, 1, ftell(fp) >= 32 * BYTESPERBLOCK);
+    total += ftell(fp);
+    fclose(fp);
+  }
+  checkCursor(23, 100 * BYTESPERBLOCK, total);
+
+  vol = fsMountStriped(3, disks, 2, 0);
+  checkCursor(23, 1, vol != NULL);
+  if (vol == NULL) return;
+  fd = fsOpen("STRIPED");           // big reads, split and in parallel
+  for (i32 r = 0; r < 10; ++r) {
+    i32 ret = fsRead(fd, 4 * BYTESPERBLOCK, buf);
+    checkCursor(23, 4 * BYTESPERBLOCK, ret);
+    check(23, buf, 0, 4 * BYTESPERBLOCK, r);
+  }
+  fsClose(fd);
+  fsUnmount();
+
+  for (i32 m = 0; m < 3; ++m) remove(disks[m]);
+}
+
+
+
+// ============================================================================
+// TEST 24 : Writeback: 24 one-block writes to WB are copied into dirty slots,
+//           and fsSync writes them all out, in fewer writes than there were
+//           fsWrites.  The last block reads back
+// ============================================================================
+void test24() {
+  i8  buf[BYTESPERBLOCK];
+  i64 ios0, blocks0, ios, blocks;
+
+  wbStats(&ios0, &blocks0);
+  i32 fd = fsCreate("WB");
+  for (i32 b = 0; b < 24; ++b) {    // small writes: each just a copy
+    memset(buf, b, BYTESPERBLOCK);
+    fsWrite(fd, BYTESPERBLOCK, buf);
+  }
+  fsSync(fd);                       // all on the disk now
+  wbStats(&ios, &blocks);
+  ios    -= ios0;
+  blocks -= blocks0;
+  checkCursor(24, 1, blocks >= 24);
+  checkCursor(24, 1, ios < 24);     // fewer writes than fsWrites, though
+                                    //   each also dirtied metadata
+
+  fsSeek(fd, 23 * BYTESPERBLOCK, SEEK_SET);
+  i32 ret = fsRead(fd, BYTESPERBLOCK, buf);
+  checkCursor(24, BYTESPERBLOCK, ret);
+  check(24, buf, 0, BYTESPERBLOCK, 23);
+  fsClose(fd);
+  ret = fsDelete("WB");
+  checkCursor(24, 0, ret);
+}
+
+
+
+// ============================================================================
+// TEST 25 : Scan P5 5 times, reading one of 4 hot files between reads: the 2Q
+//           cache misses less than LRU, as the scan does not push out the hot
+//           set
+// ============================================================================
+i64 test25Misses(i32 policy, i32* hot) {
+  i8 buf[4 * BYTESPERBLOCK];
+  i32 fd = fsOpen("P5");
+
+  cachePolicy(policy);
+  for (i32 r = 0; r < 5; ++r) {     // scan P5, a hot file between reads
+    fsSeek(fd, 0, SEEK_SET);
+    for (i32 b = 0; b < 48; b += 4) {
+      fsRead(fd, 4 * BYTESPERBLOCK, buf);
+      fsSeek(hot[b / 4 % 4], 0, SEEK_SET);
+      fsRead(hot[b / 4 % 4], BYTESPERBLOCK, buf);
+    }
+  }
+  fsClose(fd);
+
+  CacheStats st;
+  cacheStats(&st);
+  return st.misses;
+}
+
+void test25() {
+  i8  buf[BYTESPERBLOCK];
+  i32 hot[4];
+  for (i32 h = 0; h < 4; ++h) {
+    char name[FNAMESIZE];
+    sprintf(name, "HOT%d", h);
+    fsDelete(name);                 // left over from an earlier run?
+    hot[h] = fsCreate(name);
+    memset(buf, h, BYTESPERBLOCK);
+    fsWrite(hot[h], BYTESPERBLOCK, buf);
+  }
+
+  i64 lru = test25Misses(CACHELRU, hot);
+  i64 twoq = test25Misses(CACHE2Q, hot);
+  checkCursor(25, 1, twoq < lru);  // the scan does not push out the hot set
+
+  for (i32 h = 0; h < 4; ++h) {
+    char name[FNAMESIZE];
+    sprintf(name, "HOT%d", h);
+    fsClose(hot[h]);
+    i32 ret = fsDelete(name);
+    checkCursor(25, 0, ret);
+  }
+}
+
+
+
+// ============================================================================
+// TEST 26 : Two threads each write a 4-block file, at once: each file lands
+//           in an allocation group of its own, in a single extent
+// ============================================================================
+void* test26Writer(void* arg) {
+  i8 buf[BYTESPERBLOCK];
+  i32 fd = *(i32*)arg;              // each writer fills a file of its own,
+  for (i32 b = 0; b < 4; ++b) {     //   a block at a time
+    memset(buf, b, BYTESPERBLOCK);
+    fsWrite(fd, BYTESPERBLOCK, buf);
+  }
+  return NULL;
+}
+
+void test26() {
+  str names[2] = { "GRPA", "GRPB" };
+  i32 fds[2];
+  pthread_t writers[2];
+
+  for (i32 w = 0; w < 2; ++w) fsDelete(names[w]);  // from an earlier run?
+  bfsReclaimDrain();                // every free block back on its Freelist
+
+  for (i32 w = 0; w < 2; ++w) {
+    fds[w] = fsCreate(names[w]);    // each lands in a group of its own
+  }
+  for (i32 w = 0; w < 2; ++w) {
+    pthread_create(&writers[w], NULL, test26Writer, &fds[w]);
+  }
+  for (i32 w = 0; w < 2; ++w) pthread_join(writers[w], NULL);
+
+  for (i32 w = 0; w < 2; ++w) {     // written at once, yet not interleaved
+    checkCursor(26, 512, fsFragScore(names[w]));
+    fsClose(fds[w]);
+    i32 ret = fsDelete(names[w]);
+    checkCursor(26, 0, ret);
+  }
+}
+
+
+
+// ============================================================================
+// TEST 27 : 100 async writes to ASYNC, with callbacks, and an async sync,
+//           while a second thread runs an event loop of its own on ASYNC2:
+//           each fsPoll runs only its own thread's callbacks.  An async read
+//           then finds the records in the order written
+// ============================================================================
+typedef struct {                    // Test27Loop: one event loop's state
+  pthread_t self;                   // the thread running it
+  i32       fd;
+  i32       ndone;                  // # callbacks run
+} Test27Loop;
+
+void test27Done(i32 ret, void* arg) {
+  Test27Loop* loop = (Test27Loop*)arg;
+  assert(ret == 0);                 // fsWrite's result
+  assert(pthread_equal(loop->self, pthread_self()));   // on its own thread
+  ++loop->ndone;
+}
+
+void* test27Thread(void* arg) {     // a second event loop, on ASYNC2
+  Test27Loop* loop = (Test27Loop*)arg;
+  i8 rec[100];
+  memset(rec, 7, 100);
+  loop->self = pthread_self();
+  i32 queued = 0;
+  for (i32 r = 0; r < 50; ++r) {
+    if (fsWriteAsync(loop->fd, 100, rec, test27Done, loop) != NULL) ++queued;
+  }
+  checkCursor(27, 50, queued);
+  while (loop->ndone < queued) fsPoll(1);
+  return NULL;
+}
+
+void test27() {
+  i8  recs[100][100];               // must stay put until complete
+  i8  buf[100 * 100];
+  Test27Loop loop  = { pthread_self(), 0, 0 };
+  Test27Loop loop2 = { pthread_self(), 0, 0 };
+
+  fsDelete("ASYNC");                // left over from an earlier run?
+  fsDelete("ASYNC2");
+  i32 fd = fsCreate("ASYNC");
+  loop2.fd = fsCreate("ASYNC2");
+
+  pthread_t t;
+  pthread_create(&t, NULL, test27Thread, &loop2);
+  i32 queued = 0;
+  for (i32 r = 0; r < 100; ++r) {   // 100 writes in flight, one thread
+    memset(recs[r], r, 100);
+    if (fsWriteAsync(fd, 100, recs[r], test27Done, &loop) != NULL) ++queued;
+  }
+  checkCursor(27, 100, queued);
+  FsFuture* sync = fsSyncAsync(fd, NULL, NULL);
+  while (loop.ndone < queued) fsPoll(1);  // the event loop
+  checkCursor(27, 0, fsAwait(sync));
+  pthread_join(t, NULL);
+  checkCursor(27, 0, fsPoll(0));    // nothing left over, nor the thread's
+  checkCursor(27, 50, loop2.ndone);
+  checkCursor(27, 5000, fsSize(loop2.fd));
+  fsClose(loop2.fd);
+  i32 ret = fsDelete("ASYNC2");
+  checkCursor(27, 0, ret);
+
+  fsSeek(fd, 0, SEEK_SET);
+  FsFuture* rd = fsReadAsync(fd, sizeof(buf), buf, NULL, NULL);
+  checkCursor(27, 10000, fsAwait(rd));
+  for (i32 r = 0; r < 100; ++r) {   // in the order written
+    check(27, buf, r * 100, 100, r);
+  }
+
+  fsClose(fd);
+  ret = fsDelete("ASYNC");
+  checkCursor(27, 0, ret);
+}
+
+
+
+// ============================================================================
+// TEST 28 : fsExport directory EXP, holding A (1500 bytes), to host files,
+//           then to a tar archive (a header, 3 blocks of data, 2 of end).  A
+//           missing path is EFNF, a file ENOTADIR
+// ============================================================================
+void test28() {
+  i8 buf[1500];
+  i8 got[1500];
+
+  fsDelete("EXP/A");                // left over from an earlier run?
+  fsDelete("EXP");
+  i32 ret = fsMkdir("EXP");
+  checkCursor(28, 0, ret);
+  i32 fd = fsCreate("EXP/A");
+  for (i32 i = 0; i < 1500; ++i) buf[i] = i % 251;
+  fsWrite(fd, 1500, buf);
+  fsClose(fd);
+
+  checkCursor(28, 0, fsExport("EXP", "EXPORT-DIR", 0));   // host files
+  FILE* fp = fopen("EXPORT-DIR/A", "rb");
+  assert(fp != NULL);
+  checkCursor(28, 1500, (i32)fread(got, 1, sizeof(got) + 1, fp));
+  fclose(fp);
+  checkCursor(28, 0, memcmp(buf, got, 1500));
+
+  checkCursor(28, 0, fsExport("EXP", "EXPORT.tar", EXPORT_TAR));
+  fp = fopen("EXPORT.tar", "rb");   // header, 3 blocks of data, 2 of end
+  assert(fp != NULL);
+  fseek(fp, 0, SEEK_END);
+  checkCursor(28, 6 * 512, (i32)ftell(fp));
+  fclose(fp);
+
+  checkCursor(28, EFNF, fsExport("NOSUCH", "EXPORT-DIR", 0));
+  checkCursor(28, ENOTADIR, fsExport("EXP/A", "EXPORT-DIR", 0));
+
+  remove("EXPORT-DIR/A");
+  remove("EXPORT-DIR");             // empty now
+  remove("EXPORT.tar");
+  ret = fsDelete("EXP/A");
+  checkCursor(28, 0, ret);
+  ret = fsDelete("EXP");
+  checkCursor(28, 0, ret);
+}
+
+
+
+// ============================================================================
+// TEST 29 : Trace 7 calls on TRC to TRACE-TEST; starting a trace twice is
+//           ETRACEON, and fsTraceStop returns the # of calls recorded.  Each
+//           record in the file holds its call and arguments.  The trace
+//           loads, and replays on BFSDISK-REPLAY with the same results.  A
+//           missing file is EFNF, and one that is not a trace, EBADTRACE
+// ============================================================================
+void test29() {
+  i8 buf[100];
+  memset(buf, 7, sizeof(buf));
+
+  fsDelete("TRC");                  // left over from an earlier run?
+  checkCursor(29, 0, fsTraceStart("TRACE-TEST"));
+  checkCursor(29, ETRACEON, fsTraceStart("TRACE-TEST"));
+  i32 fd = fsCreate("TRC");         // 5 calls, 3 bytes of path
+  fsWrite(fd, 100, buf);
+  fsSeek(fd, 0, SEEK_SET);
+  fsRead(fd, 100, buf);
+  fsClose(fd);
+  i32 fd2 = fsOpen("TRC");          // 2 calls, 3 bytes of path
+  fsClose(fd2);
+  checkCursor(29, 7, fsTraceStop());
+  checkCursor(29, 0, fsTraceStop());  // off already
+
+  TraceRec want[7] = {             // op, thread, pathlen, fd, arg, whence,
+    { TRACECREATE, 0, 3, fd,  0,   0,        fd,  0, 0 },   // ret, then the
+    { TRACEWRITE,  0, 0, fd,  100, 0,        0,   0, 0 },   // times, which
+    { TRACESEEK,   0, 0, fd,  0,   SEEK_SET, 0,   0, 0 },   // vary
+    { TRACEREAD,   0, 0, fd,  100, 0,        100, 0, 0 },
+    { TRACECLOSE,  0, 0, fd,  0,   0,        0,   0, 0 },
+    { TRACEOPEN,   0, 3, fd2, 100, 0,        fd2, 0, 0 },   // arg: its size
+    { TRACECLOSE,  0, 0, fd2, 0,   0,        0,   0, 0 },
+  };
+
+  FILE* fp = fopen("TRACE-TEST", "rb");   // magic, version, then records
+  assert(fp != NULL);
+  char magic[8];
+  i32  version = 0;
+  size_t got = fread(magic, 1, 8, fp);
+  checkCursor(29, 8, got);
+  got = fread(&version, sizeof(i32), 1, fp);
+  checkCursor(29, 1, got);
+  checkCursor(29, 0, memcmp(magic, TRACEMAGIC, 8));
+  checkCursor(29, TRACEVERSION, version);
+  for (i32 r = 0; r < 7; ++r) {
+    TraceRec rec;
+    char     path[TRACEPATHSIZE] = {0};
+    got = fread(&rec, sizeof(rec), 1, fp);
+    checkCursor(29, 1, got);
+    if (got != 1 || rec.pathlen >= TRACEPATHSIZE) break;
+    got = fread(path, 1, rec.pathlen, fp);
+    checkCursor(29, rec.pathlen, got);
+    checkCursor(29, want[r].op,      rec.op);
+    checkCursor(29, want[r].thread,  rec.thread);
+    checkCursor(29, want[r].pathlen, rec.pathlen);
+    checkCursor(29, want[r].fd,      rec.fd);
+    checkCursor(29, want[r].arg,     rec.arg);
+    checkCursor(29, want[r].whence,  rec.whence);
+    checkCursor(29, want[r].ret,     rec.ret);
+    checkCursor(29, 0, strcmp(path, rec.pathlen ? "TRC" : ""));
+  }
+  checkCursor(29, 0, fgetc(fp) != EOF);   // nothing after them
+  fclose(fp);
+  i32 ret = fsDelete("TRC");
+  checkCursor(29, 0, ret);
+
+  TraceReplay rp;                   // replay it, on a fresh volume
+  checkCursor(29, 0, traceLoad(&rp, "TRACE-TEST"));
+  checkCursor(29, 7, rp.n);
+  checkCursor(29, 1, rp.threads);
+  checkCursor(29, 100, rp.maxnumb);
+  BfsVolume* vol = fsMount("BFSDISK-REPLAY", MOUNT_FORMAT);
+  checkCursor(29, 1, vol != NULL);
+  if (vol == NULL) {                // not on BFSDISK
+    traceUnload(&rp);
+    return;
+  }
+  checkCursor(29, 7, traceReplay(&rp, 0));
+  for (i32 r = 0; r < 7; ++r) {
+    if (want[r].op == TRACECREATE || want[r].op == TRACEOPEN) {
+      checkCursor(29, 1, rp.rets[r] >= 0);          // an fd, not the same
+    } else {
+      checkCursor(29, want[r].ret, rp.rets[r]);
+    }
+  }
+  fd = fsOpen("TRC");
+  checkCursor(29, 100, fsSize(fd));
+  fsClose(fd);
+  fsUnmount();
+  remove("BFSDISK-REPLAY");
+  traceUnload(&rp);
+
+  checkCursor(29, EFNF, traceLoad(&rp, "TRACE-NONE"));
+  traceUnload(&rp);
+  fp = fopen("TRACE-TEST", "wb");   // not a trace
+  fputs("NOTATRACE", fp);
+  fclose(fp);
+  checkCursor(29, EBADTRACE, traceLoad(&rp, "TRACE-TEST"));
+  traceUnload(&rp);
+  remove("TRACE-TEST");
+}
+
+
+
+// ============================================================================
+// TEST 30 : Log-structured volume BFSDISK-LOG: A (20 blocks) and B (3) fill
+//           group 0 from the log, then A is truncated to 2 blocks.  A rewrite
+//           of B goes to the log, which breaks to group 1; fsClean empties
+//           group 0, moving its 4 live blocks.  The data reads back, and the
+//           volume is still log-structured after a remount
+// ============================================================================
+void test30() {
+  i8 buf[20 * BYTESPERBLOCK];
+  i8 got[20 * BYTESPERBLOCK];
+  i8 bexp[3 * BYTESPERBLOCK];       // what B should hold
+  for (i32 i = 0; i < 20 * BYTESPERBLOCK; ++i) buf[i] = i % 253;
+
+  BfsVolume* vol = fsMount("BFSDISK-LOG", MOUNT_FORMAT | MOUNT_LOG);
+  checkCursor(30, 1, vol != NULL);
+  if (vol == NULL) return;          // not on BFSDISK
+  i32 fa = fsCreate("A");           // 20 blocks, then B's 3, fill group 0
+  fsWrite(fa, 20 * BYTESPERBLOCK, buf);
+  i32 fb = fsCreate("B");
+  fsWrite(fb, 3 * BYTESPERBLOCK, buf + 10 * BYTESPERBLOCK);
+  memcpy(bexp, buf + 10 * BYTESPERBLOCK, 3 * BYTESPERBLOCK);
+  fsTruncate(fa, 2 * BYTESPERBLOCK);  // group 0 is mostly holes now
+
+  LogStats ls;
+  logStats(&ls);
+  checkCursor(30, 23, (i32)ls.appends);
+  checkCursor(30, 1, (i32)ls.breaks);
+
+  fsSync(fb);                       // dirty blocks are rewritten in place
+  fsSeek(fb, 100, SEEK_SET);        // rewrite in place?  no: to the log
+  fsWrite(fb, 77, buf);
+  memcpy(bexp + 100, buf, 77);
+  logStats(&ls);                    // the cleaner may have run already
+  checkCursor(30, 24, (i32)(ls.appends - ls.moved));
+  checkCursor(30, 2, (i32)ls.breaks); // the log moved on to group 1
+
+  fsClean();                        // empties group 0, if the cleaner
+  logStats(&ls);                    //   thread has not already
+  checkCursor(30, 4, (i32)ls.moved);
+
+  fsSeek(fa, 0, SEEK_SET);
+  checkCursor(30, 2 * BYTESPERBLOCK, fsRead(fa, sizeof(got), got));
+  checkCursor(30, 0, memcmp(buf, got, 2 * BYTESPERBLOCK));
+  fsSeek(fb, 0, SEEK_SET);
+  checkCursor(30, 3 * BYTESPERBLOCK, fsRead(fb, sizeof(got), got));
+  checkCursor(30, 0, memcmp(bexp, got, 3 * BYTESPERBLOCK));
+  fsClose(fa);
+  fsClose(fb);
+  fsUnmount();
+
+  vol = fsMount("BFSDISK-LOG", 0);  // still log-structured
+  checkCursor(30, 1, vol != NULL);
+  if (vol == NULL) return;
+  fb = fsOpen("B");
+  fsWrite(fb, 10, buf);
+  logStats(&ls);
+  checkCursor(30, 1, (i32)(ls.appends - ls.moved));
+  fsClose(fb);
+  fsUnmount();
+  remove("BFSDISK-LOG");
+}
+
+
+
+// ============================================================================
+// TEST 31 : fsImport host directory IMPORT-DIR, holding A (1500 bytes) and
+//           D/B (40 bytes), into a fresh BFSDISK-IMPORT, which reads back
+//           the same, built aside and renamed into place.  Nothing is
+//           written if a file does not fit, EDISKFULL, or a name is too
+//           long, EBIGFNAME.  A missing directory is EHOSTIO
+// ============================================================================
+void test31() {
+  i8 buf[92 * BYTESPERBLOCK];
+  i8 got[1500];
+  for (i32 i = 0; i < 1500; ++i) buf[i] = i % 249;
+
+  mkdir("IMPORT-DIR", 0755);        // the host tree
+  mkdir("IMPORT-DIR/D", 0755);
+  FILE* fp = fopen("IMPORT-DIR/A", "wb");
+  assert(fp != NULL);
+  fwrite(buf, 1, 1500, fp);
+  fclose(fp);
+  fp = fopen("IMPORT-DIR/D/B", "wb");
+  assert(fp != NULL);
+  fwrite(buf + 100, 1, 40, fp);
+  fclose(fp);
+
+  remove("BFSDISK-IMPORT");
+  checkCursor(31, 0, fsImport("IMPORT-DIR", "BFSDISK-IMPORT"));
+  checkCursor(31, 1, fopen("BFSDISK-IMPORT.tmp", "rb") == NULL);  // renamed
+  BfsVolume* vol = fsMount("BFSDISK-IMPORT", 0);
+  checkCursor(31, 1, vol != NULL);
+  if (vol == NULL) return;          // not on BFSDISK
+  i32 fd = fsOpen("A");
+  checkCursor(31, 1500, fsSize(fd));
+  checkCursor(31, 1500, fsRead(fd, 1500, got));
+  checkCursor(31, 0, memcmp(buf, got, 1500));
+  fsClose(fd);
+  fd = fsOpen("D/B");
+  checkCursor(31, 40, fsRead(fd, 40, got));
+  checkCursor(31, 0, memcmp(buf + 100, got, 40));
+  fsClose(fd);
+  fsUnmount();
+  remove("BFSDISK-IMPORT");
+
+  fp = fopen("IMPORT-DIR/BIG", "wb");   // 92 blocks: more than there are
+  assert(fp != NULL);
+  fwrite(buf, 1, sizeof(buf), fp);
+  fclose(fp);
+  checkCursor(31, EDISKFULL, fsImport("IMPORT-DIR", "BFSDISK-IMPORT"));
+  checkCursor(31, 1, fopen("BFSDISK-IMPORT", "rb") == NULL);  // not made
+  remove("IMPORT-DIR/BIG");
+
+  char name[sizeof("IMPORT-DIR/") + FNAMESIZE];
+  memset(name, 'N', sizeof(name) - 1);
+  memcpy(name, "IMPORT-DIR/", 11);
+  name[sizeof(name) - 1] = 0;       // a name of FNAMESIZE chars
+  fp = fopen(name, "wb");
+  assert(fp != NULL);
+  fclose(fp);
+  checkCursor(31, EBIGFNAME, fsImport("IMPORT-DIR", "BFSDISK-IMPORT"));
+  checkCursor(31, 1, fopen("BFSDISK-IMPORT", "rb") == NULL);
+  remove(name);
+
+  checkCursor(31, EHOSTIO, fsImport("IMPORT-NONE", "BFSDISK-IMPORT"));
+
+  remove("IMPORT-DIR/D/B");
+  remove("IMPORT-DIR/D");
+  remove("IMPORT-DIR/A");
+  remove("IMPORT-DIR");
+}
+
+
+
+// ============================================================================
+// TEST 32 : Write file FRAGC a block at a time, last block first, so its
+//           blocks lie on disk in reverse order.  Defragmented, it becomes one
+//           extent (score 512 per MB) and still holds the same data
+// ============================================================================
+void test32() {
+  i8 buf[3 * BUFSIZE];              // buffer for reads and writes
+
+  fsDelete("FRAGC");                // left over from an earlier run?
+
+  i32 fd = fsCreate("FRAGC");
+
+  for (int b = 3; b >= 0; --b) {
+    memset(buf, 30 + b, BYTESPERBLOCK);
+    fsSeek(fd, b * BYTESPERBLOCK, SEEK_SET);
+    fsWrite(fd, BYTESPERBLOCK, buf);
+  }
+  fsClose(fd);
+
+  checkCursor(32, 1, fsFragScore("FRAGC") > 512);
+
+  i32 ret = fsDefrag("FRAGC");
+  checkCursor(32, 0, ret);
+  checkCursor(32, 512, fsFragScore("FRAGC"));
+
+  fd  = fsOpen("FRAGC");
+  ret = fsRead(fd, 4 * BYTESPERBLOCK, buf);
+  checkCursor(32, 4 * BYTESPERBLOCK, ret);
+
+  for (int b = 0; b < 4; ++b) {
+    check(32, buf, b * 512, 512, 30 + b);
+  }
+
+  fsClose(fd);
+  fsDelete("FRAGC");
+}
+
+
+
+void p5test() {
+
+  i32 fd = fsOpen("P5");    // open "P5" for testing
+
+  test1(fd);
+  test2(fd);
+  test3(fd);
+  test4(fd);
+  test5(fd);
+  test6(fd);
+
+  fsClose(fd);
+
+  test7();
+  test8();
+  test9();
+  test10();
+  test11();
+  test12();
+  test13();
+  test14();
+  test15();
+  test16();
+  test17();
+  test18();
+  test19();
+  test20();
+  test21();
+  test22();
+  test23();
+  test24();
+  test25();
+  test26();
+  test27();
+  test28();
+  test29();
+  test30();
+  test31();
+  test32();
+
+}
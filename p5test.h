@@ -1,24 +1,68 @@
-#ifndef P5TEST_H
-#define P5TEST_H
-
-#include <assert.h>       // assert
-#include <stdio.h>        // fopen, printf, 
-#include <string.h>       // memset
-
-#include "alias.h"        // i32, etc
-#include "fs.h"           // fsOpen, etc
-
-#define BLOCKS        50
-#define BYTESPERBLOCK 512
-#define BUFSIZE       2000
-
-void check(i32 testnum, i8* buf, i32 start, i32 size, i32 val);
-void checkCursor(i32 testnum, i32 expected, i32 actual);
-void createP5();
-void test1(i32 fd);
-void test2(i32 fd);
-void test3(i32 fd);
-void test4(i32 fd);
-void p5test();
-
+#ifndef P5TEST_H
+#define P5TEST_H
+
+#include <assert.h>       // assert
+#include <pthread.h>      // pthread_create
+#include <stdio.h>        // fopen, printf, 
+#include <string.h>       // memset
+#include <sys/stat.h>     // mkdir
+
+#include "alias.h"        // i32, etc
+#include "bio.h"          // bioCrcCheck, bioReadRaw
+#include "cache.h"        // cachePolicy, cacheStats
+#include "comp.h"         // COMPMAXSIZE
+#include "crc.h"          // crc32c, crcSoft
+#include "fs.h"           // fsOpen, etc
+#include "log.h"          // logStats
+#include "slab.h"         // slabAlloc, etc
+#include "trace.h"        // traceLoad, traceReplay
+#include "wb.h"           // wbStats
+
+#define BLOCKS        50
+#define BYTESPERBLOCK 512
+#define BUFSIZE       2000
+
+void check(i32 testnum, i8* buf, i32 start, i32 size, i32 val);
+void checkCursor(i32 testnum, i32 expected, i32 actual);
+void createP5();
+void test1(i32 fd);
+void test2(i32 fd);
+void test3(i32 fd);
+void test4(i32 fd);
+void test5(i32 fd);
+void test6(i32 fd);
+void test7();
+void test8();
+void test9();
+void test10();
+void test11();
+void test12();
+void test13();
+void test14();
+void test15();
+void test16();
+void test17();
+void test18();
+void test19();
+void test20();
+void* test20Writer(void* arg);
+void test21();
+void* test21Worker(void* arg);
+void test22();
+void* test22Tenant(void* arg);
+void test23();
+void test24();
+void test25();
+i64 test25Misses(i32 policy, i32* hot);
+void test26();
+void* test26Writer(void* arg);
+void test27();
+void test27Done(i32 ret, void* arg);
+void test28();
+void test29();
+void test30();
+void test31();
+void test32();
+void p5test();
+
 #endif
\ No newline at end of file
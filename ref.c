@@ -0,0 +1,166 @@
+// ============================================================================
+// ref.c - Per-block bookkeeping, in block DBNREFS.  For every DBN it holds
+// the # of references beyond the first (0 for a block with one owner, or
+// none; n when n + 1 FBNs map it), and the generation it was last allocated
+// in (see snap.c).  bfsFreeList calls refDrop, so freeing a shared block
+// just drops a reference; writers check refGet to see whether a block must
+// be copied before it is changed.  The table is kept in memory and written
+// through on each change
+// ============================================================================
+
+#include "ref.h"
+#include "vol.h"
+
+_Static_assert(sizeof(RefTable) == BYTESPERBLOCK, "RefTable must fill a block");
+
+
+
+
+// ============================================================================
+// Read the table from DBNREFS, if not already in memory.  Caller holds the
+// BFS lock
+// ============================================================================
+void refLoad() {
+  if (g_vol->refsLoaded) return;
+  bioRead(DBNREFS, &g_vol->refs);
+  g_vol->refsLoaded = 1;
+}
+
+
+
+// ============================================================================
+// Return the generation block 'dbn' was allocated in
+// ============================================================================
+i32 refBirth(i32 dbn) {
+
+  if (dbn < MINDBN || dbn >= BLOCKSPERDISK) FATAL(EBADDBN);
+
+  bfsLock();
+  refLoad();
+  i32 gen = g_vol->refs.birth[dbn];
+  bfsUnlock();
+  return gen;
+}
+
+
+
+// ============================================================================
+// Record that the 'count' blocks from 'dbn' were allocated in generation
+// 'gen'.  Return 0
+// ============================================================================
+i32 refBorn(i32 dbn, i32 count, i32 gen) {
+
+  if (dbn < MINDBN || dbn + count > BLOCKSPERDISK) FATAL(EBADDBN);
+
+  bfsLock();
+  refLoad();
+  for (i32 i = 0; i < count; ++i) g_vol->refs.birth[dbn + i] = (i16)gen;
+  bioWrite(DBNREFS, &g_vol->refs);
+  bfsUnlock();
+  return 0;
+}
+
+
+
+// ============================================================================
+// Forget every extra reference to 'dbn', which nothing maps any more.  Return
+// 0
+// ============================================================================
+i32 refClear(i32 dbn) {
+
+  if (dbn < MINDBN || dbn >= BLOCKSPERDISK) FATAL(EBADDBN);
+
+  bfsLock();
+  refLoad();
+  if (g_vol->refs.refs[dbn] != 0) {
+    g_vol->refs.refs[dbn] = 0;
+    bioWrite(DBNREFS, &g_vol->refs);
+  }
+  bfsUnlock();
+  return 0;
+}
+
+
+
+// ============================================================================
+// Drop one reference to 'dbn'.  Return 1 if it was shared, so others still
+// hold it; 0 if this was its only owner, and the caller should free it
+// ============================================================================
+i32 refDrop(i32 dbn) {
+
+  if (dbn < MINDBN || dbn >= BLOCKSPERDISK) FATAL(EBADDBN);
+
+  bfsLock();
+  refLoad();
+
+  i32 shared = (g_vol->refs.refs[dbn] > 0);
+  if (shared) {
+    --g_vol->refs.refs[dbn];
+    bioWrite(DBNREFS, &g_vol->refs);
+  }
+
+  bfsUnlock();
+  return shared;
+}
+
+
+
+// ============================================================================
+// Write an empty table, for a newly formatted disk: no block is shared, and
+// all were born in generation 0
+// ============================================================================
+i32 refFormat() {
+  bfsLock();
+  memset(&g_vol->refs, 0, sizeof(g_vol->refs));
+  g_vol->refsLoaded = 1;
+  bioWrite(DBNREFS, &g_vol->refs);
+  bfsUnlock();
+  return 0;
+}
+
+
+
+// ============================================================================
+// Return the # of references to 'dbn' beyond the first
+// ============================================================================
+i32 refGet(i32 dbn) {
+
+  if (dbn < MINDBN || dbn >= BLOCKSPERDISK) FATAL(EBADDBN);
+
+  bfsLock();
+  refLoad();
+  i32 refs = g_vol->refs.refs[dbn];
+  bfsUnlock();
+  return refs;
+}
+
+
+
+// ============================================================================
+// Add a reference to 'dbn', which some FBN already maps.  Return the # of
+// references now beyond the first
+// ============================================================================
+i32 refInc(i32 dbn) {
+
+  if (dbn < MINDBN || dbn >= BLOCKSPERDISK) FATAL(EBADDBN);
+
+  bfsLock();
+  refLoad();
+  i32 refs = ++g_vol->refs.refs[dbn];
+  bioWrite(DBNREFS, &g_vol->refs);
+  bfsUnlock();
+  return refs;
+}
+
+
+
+// ============================================================================
+// Forget the in-memory table, so it is re-read from the disk.  Called at
+// mount
+// ============================================================================
+i32 refReset() {
+  bfsLock();
+  g_vol->refsLoaded = 0;
+  bfsUnlock();
+  return 0;
+}
@@ -0,0 +1,26 @@
+#ifndef REF_H
+#define REF_H
+
+// ===================================================================
+// ref.h - Per-block bookkeeping: reference counts, for blocks shared
+// between FBNs, and birth generations, for snapshots
+// ===================================================================
+
+#include "alias.h"
+#include "bfs.h"
+
+typedef struct {          // RefTable: the contents of block DBNREFS
+  i16 refs [I32SPERBLOCK];    // references beyond the first, per DBN
+  i16 birth[I32SPERBLOCK];    // generation each DBN was allocated in
+} RefTable;
+
+i32 refBirth (i32 dbn);
+i32 refBorn  (i32 dbn, i32 count, i32 gen);
+i32 refClear (i32 dbn);
+i32 refDrop  (i32 dbn);
+i32 refFormat();
+i32 refGet   (i32 dbn);
+i32 refInc   (i32 dbn);
+i32 refReset ();
+
+#endif
@@ -1,7 +1,22 @@
 #!/bin/bash
 
-rm -f a.out
+rm -f a.out bfsdefrag bfsbench mkbfs bfsextract bfsreplay
 
-gcc -Wall -Wextra -Wno-sign-compare *.c
+gcc -pthread -Wall -Wextra -Wno-sign-compare *.c
+
+gcc -pthread -Wall -Wextra -Wno-sign-compare -I. -o bfsdefrag \
+    tools/bfsdefrag.c aio.c arc.c bfs.c bio.c cache.c comp.c crc.c dedup.c dir.c errors.c fs.c log.c lz.c map.c ref.c slab.c snap.c tail.c trace.c vol.c wb.c
+
+gcc -pthread -Wall -Wextra -Wno-sign-compare -I. -o bfsbench \
+    tools/bfsbench.c aio.c arc.c bfs.c bio.c cache.c comp.c crc.c dedup.c dir.c errors.c fs.c log.c lz.c map.c ref.c slab.c snap.c tail.c trace.c vol.c wb.c
+
+gcc -pthread -Wall -Wextra -Wno-sign-compare -I. -o mkbfs \
+    tools/mkbfs.c aio.c arc.c bfs.c bio.c cache.c comp.c crc.c dedup.c dir.c errors.c fs.c log.c lz.c map.c ref.c slab.c snap.c tail.c trace.c vol.c wb.c
+
+gcc -pthread -Wall -Wextra -Wno-sign-compare -I. -o bfsextract \
+    tools/bfsextract.c aio.c arc.c bfs.c bio.c cache.c comp.c crc.c dedup.c dir.c errors.c fs.c log.c lz.c map.c ref.c slab.c snap.c tail.c trace.c vol.c wb.c
+
+gcc -pthread -Wall -Wextra -Wno-sign-compare -I. -o bfsreplay \
+    tools/bfsreplay.c aio.c arc.c bfs.c bio.c cache.c comp.c crc.c dedup.c dir.c errors.c fs.c log.c lz.c map.c ref.c slab.c snap.c tail.c trace.c vol.c wb.c
 
 ./a.out
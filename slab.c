@@ -0,0 +1,171 @@
+// ============================================================================
+// slab.c - Slab allocators.  A Slab is a fixed pool of same-size objects in
+// static storage, so memory use is bounded and nothing is malloc'd.  Free
+// objects sit on a lock-free stack (a Treiber stack, its head tagged against
+// ABA).  Each thread also keeps a magazine of up to SLABMAG free objects per
+// slab: most allocs and frees touch only the magazine, with no atomics at
+// all, and go to the shared stack half a magazine at a time.  A thread's
+// magazines are emptied back to their slabs when it exits
+// ============================================================================
+
+#include "bfs.h"
+#include "slab.h"
+
+typedef struct {          // SlabMag: one thread's free objects of one slab
+  i32 n;
+  i32 idx[SLABMAG];
+} SlabMag;
+
+__thread SlabMag g_slabmags[SLABMAX];           // this thread's magazines
+__thread i32     g_slabthread = 0;              // 1 => exit hook is set
+
+Slab*           g_slabs[SLABMAX];               // by id, for the exit hook
+i32             g_slabcount = 0;
+pthread_key_t   g_slabkey;
+pthread_mutex_t g_slablock = PTHREAD_MUTEX_INITIALIZER;    // slabSetup only
+
+
+
+// ============================================================================
+// Push object 'idx' of slab 's' on its free stack
+// ============================================================================
+void slabPush(Slab* s, i32 idx) {
+  u64 old = __atomic_load_n(&s->head, __ATOMIC_RELAXED);
+  for (;;) {
+    __atomic_store_n(&s->next[idx], (i32)(u32)old, __ATOMIC_RELAXED);
+    u64 top = (((old >> 32) + 1) << 32) | (u32)(idx + 1);
+    if (__atomic_compare_exchange_n(&s->head, &old, top, 1,
+                                    __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+      return;
+    }
+  }
+}
+
+
+
+// ============================================================================
+// Pop an object off the free stack of slab 's'.  Return its index, or -1 if
+// the stack is empty
+// ============================================================================
+i32 slabPop(Slab* s) {
+  u64 old = __atomic_load_n(&s->head, __ATOMIC_ACQUIRE);
+  for (;;) {
+    i32 top = (i32)(u32)old;
+    if (top == 0) return -1;
+    i32 next = __atomic_load_n(&s->next[top - 1], __ATOMIC_RELAXED);
+    u64 rest = (((old >> 32) + 1) << 32) | (u32)next;
+    if (__atomic_compare_exchange_n(&s->head, &old, rest, 1,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+      return top - 1;
+    }
+  }
+}
+
+
+
+// ============================================================================
+// Thread exit hook: give every object in the exiting thread's magazines,
+// 'mags', back to its slab
+// ============================================================================
+void slabThreadExit(void* mags) {
+  SlabMag* m = (SlabMag*)mags;
+  for (i32 id = 0; id < g_slabcount; ++id) {
+    while (m[id].n > 0) slabPush(g_slabs[id], m[id].idx[--m[id].n]);
+  }
+}
+
+
+
+// ============================================================================
+// Set up slab 's' on first use: put every object on its free stack, and give
+// it a magazine id.  FATAL if there are more than SLABMAX slabs
+// ============================================================================
+void slabSetup(Slab* s) {
+  pthread_mutex_lock(&g_slablock);
+  if (!s->ready) {
+    if (g_slabcount == 0) pthread_key_create(&g_slabkey, slabThreadExit);
+    if (g_slabcount == SLABMAX) {
+      pthread_mutex_unlock(&g_slablock);
+      FATAL(ENOBUFS);
+    }
+    for (i32 i = s->nobjs - 1; i >= 0; --i) slabPush(s, i);
+    s->id = g_slabcount;
+    g_slabs[g_slabcount++] = s;
+    __atomic_store_n(&s->ready, 1, __ATOMIC_RELEASE);
+  }
+  pthread_mutex_unlock(&g_slablock);
+}
+
+
+
+// ============================================================================
+// Return this thread's magazine for slab 's', setting up either if need be
+// ============================================================================
+SlabMag* slabMag(Slab* s) {
+  if (!__atomic_load_n(&s->ready, __ATOMIC_ACQUIRE)) slabSetup(s);
+  if (!g_slabthread) {                          // empty magazines at exit
+    pthread_setspecific(g_slabkey, g_slabmags);
+    g_slabthread = 1;
+  }
+  return &g_slabmags[s->id];
+}
+
+
+
+// ============================================================================
+// Take an object from slab 's'.  Its contents are whatever it last held.
+// Return it, or NULL if every object is in use
+// ============================================================================
+void* slabAlloc(Slab* s) {
+  SlabMag* m = slabMag(s);
+
+  if (m->n == 0) {                              // refill half a magazine
+    for (i32 k = 0; k < SLABMAG / 2; ++k) {
+      i32 idx = slabPop(s);
+      if (idx < 0) break;
+      m->idx[m->n++] = idx;
+    }
+    if (m->n == 0) {
+      __atomic_fetch_add(&s->fails, 1, __ATOMIC_RELAXED);
+      return NULL;
+    }
+  }
+
+  i64 inuse = __atomic_add_fetch(&s->allocs, 1, __ATOMIC_RELAXED)
+            - __atomic_load_n(&s->frees, __ATOMIC_RELAXED);
+  i64 peak  = __atomic_load_n(&s->peak, __ATOMIC_RELAXED);
+  while (inuse > peak && !__atomic_compare_exchange_n(&s->peak, &peak, inuse,
+                           1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+
+  return s->mem + (i64)m->idx[--m->n] * s->size;
+}
+
+
+
+// ============================================================================
+// Give object 'obj' back to slab 's'.  FATAL if it is not one of its objects
+// ============================================================================
+void slabFree(Slab* s, void* obj) {
+  if (obj == NULL) FATAL(EBADOBJ);
+  i64 off = (i8*)obj - s->mem;
+  if (off < 0 || off >= (i64)s->nobjs * s->size || off % s->size != 0) {
+    FATAL(EBADOBJ);
+  }
+
+  SlabMag* m = slabMag(s);
+  if (m->n == SLABMAG) {                        // spill half a magazine
+    while (m->n > SLABMAG / 2) slabPush(s, m->idx[--m->n]);
+  }
+  m->idx[m->n++] = (i32)(off / s->size);
+  __atomic_fetch_add(&s->frees, 1, __ATOMIC_RELAXED);
+}
+
+
+
+// ============================================================================
+// Return the # of objects of slab 's' in use now
+// ============================================================================
+i64 slabInUse(Slab* s) {
+  return __atomic_load_n(&s->allocs, __ATOMIC_RELAXED)
+       - __atomic_load_n(&s->frees,  __ATOMIC_RELAXED);
+}
@@ -0,0 +1,42 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+// ===================================================================
+// slab.h - Slab allocators: bounded pools of same-size in-core
+// objects, with lock-free allocation and per-thread free lists
+// ===================================================================
+
+#include "alias.h"
+
+#define SLABMAX       8       // # slabs; each has a magazine per thread
+#define SLABMAG       4       // objects a thread keeps on hand, per slab
+
+typedef struct {          // Slab: a pool of 'nobjs' objects of 'size' bytes
+  str  name;
+  i32  size;
+  i32  nobjs;
+  i8*  mem;               // the objects, back to back
+  i32* next;              // free stack links: index + 1.  0 => end
+  u64  head;              // free stack top: index + 1, and an ABA tag << 32
+  i32  id;                // index of its magazine, in each thread
+  i32  ready;             // 1 => set up, by slabSetup
+  i64  allocs;            // stats: # objects handed out,
+  i64  frees;             //   # given back,
+  i64  fails;             //   # allocs refused, pool empty,
+  i64  peak;              //   most in use at once
+} Slab;
+
+// Define slab 'var', with static storage for all its objects: it never
+// calls malloc, and never holds more than 'nobjs' objects
+
+#define SLABDEFINE(var, objsize, count)                                       \
+  i8   var##Mem[(count) * (objsize)] __attribute__((aligned(16)));           \
+  i32  var##Next[count];                                                      \
+  Slab var = { .name = #var, .size = (objsize), .nobjs = (count),            \
+               .mem = var##Mem, .next = var##Next }
+
+void* slabAlloc(Slab* s);
+void  slabFree (Slab* s, void* obj);
+i64   slabInUse(Slab* s);
+
+#endif
@@ -0,0 +1,383 @@
+// ============================================================================
+// snap.c - Snapshots.  The Super counts generations.  A snapshot records the
+// current generation, copies the INODEBLOCKS Inodes blocks, and starts a new
+// generation: O(1) work, whatever the size of the tree.  Every block in use
+// was born in the snapshot's generation or before, so from then on such a
+// block is frozen: bfsCow gives a writer a fresh block instead of changing
+// it, and bfsFreeList leaves it alone.  The snapshot's Inodes thus keep
+// seeing every map table, directory and data block as they were.  ref.c
+// records each block's birth generation, as the allocator hands it out.
+//
+// Deleting a snapshot marks every block reachable from the live tree and
+// from the snapshots left, and frees every other block in use
+// ============================================================================
+
+#include "comp.h"
+#include "dir.h"
+#include "map.h"
+#include "ref.h"
+#include "snap.h"
+#include "vol.h"
+
+_Static_assert(NUMSNAPS * sizeof(SnapEntry) <= BYTESPERBLOCK, "snapshots must fit a block");
+
+
+
+// ============================================================================
+// Read the snapshot table, if not already in memory.  Caller holds the BFS
+// lock
+// ============================================================================
+void snapLoad() {
+  if (g_vol->snapsLoaded) return;
+
+  i8 buf[BYTESPERBLOCK];
+  bioRead(DBNSNAPS, buf);
+  memcpy(g_vol->snaps, buf, sizeof(g_vol->snaps));
+
+  g_vol->snapgen = -1;
+  for (i32 s = 0; s < NUMSNAPS; ++s) {
+    if (g_vol->snaps[s].name[0] != 0 && g_vol->snaps[s].gen > g_vol->snapgen) {
+      g_vol->snapgen = g_vol->snaps[s].gen;
+    }
+  }
+  g_vol->snapsLoaded = 1;
+}
+
+
+
+// ============================================================================
+// Write the snapshot table back to DBNSNAPS.  Caller holds the BFS lock
+// ============================================================================
+void snapFlush() {
+  i8 buf[BYTESPERBLOCK] = {0};
+  memcpy(buf, g_vol->snaps, sizeof(g_vol->snaps));
+  bioWrite(DBNSNAPS, buf);
+}
+
+
+
+// ============================================================================
+// Return the slot of snapshot 'name', or EFNF
+// ============================================================================
+i32 snapFind(str name) {
+  for (i32 s = 0; s < NUMSNAPS; ++s) {
+    if (g_vol->snaps[s].name[0] != 0 && strcmp(g_vol->snaps[s].name, name) == 0) {
+      return s;
+    }
+  }
+  return EFNF;
+}
+
+
+
+// ============================================================================
+// Allocator hook: the 'count' blocks from 'dbn' were just allocated, in
+// generation 'gen'.  Their birth only matters once a snapshot exists, so
+// the table is left alone until then
+// ============================================================================
+i32 snapBorn(i32 dbn, i32 count, i32 gen) {
+  bfsLock();
+  snapLoad();
+  if (g_vol->snapgen >= 0) refBorn(dbn, count, gen);
+  bfsUnlock();
+  return 0;
+}
+
+
+
+// ============================================================================
+// Take snapshot 'name' of the live tree.  Return 0, or EFEXISTS if the name
+// is taken, ESNAPFULL if NUMSNAPS snapshots exist, and EBIGFNAME if 'name'
+// is FNAMESIZE chars or more
+// ============================================================================
+i32 snapCreate(str name) {
+
+  if (name == NULL) FATAL(ENULLPTR);
+  if (strlen(name) > FNAMESIZE - 1 || name[0] == 0) return EBIGFNAME;
+
+  bfsReclaimDrain();                    // no half-freed files in the copy
+
+  bfsLock();
+  snapLoad();
+
+  if (snapFind(name) != EFNF) { bfsUnlock(); return EFEXISTS; }
+
+  i32 slot = 0;
+  while (slot < NUMSNAPS && g_vol->snaps[slot].name[0] != 0) ++slot;
+  if (slot == NUMSNAPS) { bfsUnlock(); return ESNAPFULL; }
+
+  SnapEntry* se = &g_vol->snaps[slot];
+  i8 buf[BYTESPERBLOCK];
+
+  for (i32 b = 0; b < INODEBLOCKS; ++b) {
+    se->inodes[b] = bfsFindFreeBlock();
+    bioRead(DBNINODES + b, buf);
+    bioWrite(se->inodes[b], buf);
+  }
+
+  bioRead(DBNSUPER, buf);               // freeze this generation
+  Super* super = (Super*)buf;
+  se->gen = super->gen;
+  ++super->gen;
+  bioWrite(DBNSUPER, buf);
+
+  memset(se->name, 0, FNAMESIZE);
+  strcpy(se->name, name);
+  snapFlush();
+
+  if (se->gen > g_vol->snapgen) g_vol->snapgen = se->gen;
+
+  bfsUnlock();
+  return 0;
+}
+
+
+
+// ============================================================================
+// Mark in 'mark' the table at 'dbn' (level 'depth', 1 = leaf) and every
+// block below it
+// ============================================================================
+void snapMarkTable(i32 dbn, i32 depth, i8* mark) {
+  i32 tab[I32SPERBLOCK];
+  mark[dbn] = 1;
+  bioRead(dbn, tab);
+  for (i32 i = 0; i < I32SPERBLOCK; ++i) {
+    if (tab[i] == 0) continue;
+    if (depth == 1) {
+      mark[abs(tab[i])] = 1;              // may be unwritten (negated)
+    } else {
+      snapMarkTable(tab[i], depth - 1, mark);
+    }
+  }
+}
+
+
+
+// ============================================================================
+// Mark in 'mark' every block of the files in the INODEBLOCKS Inodes blocks
+// at 'dbns': data, map tables, clusters and cluster tables.  A deleted file
+// still being reclaimed holds its blocks until bfsReclaim frees them
+// ============================================================================
+void snapMarkInodes(i32* dbns, i8* mark) {
+  Inode inodes[INODESPERBLOCK];
+
+  for (i32 b = 0; b < INODEBLOCKS; ++b) {
+    bioRead(dbns[b], inodes);
+
+    for (i32 i = 0; i < INODESPERBLOCK; ++i) {
+      Inode* in = &inodes[i];
+      if (!(in->flags & INODEUSED) || (in->flags & INODEINLINE)) continue;
+
+      if (in->flags & INODECOMP) {
+        i32 tab[I32SPERBLOCK] = {0};
+        if (in->ctable != 0) {
+          mark[in->ctable] = 1;
+          bioRead(in->ctable, tab);
+        }
+        for (i32 c = 0; c < MAXCLUSTER; ++c) {
+          i32 e = (c < NUMCDIRECT) ? in->clusters[c] : tab[c - NUMCDIRECT];
+          for (i32 k = 0; k < CENTRYLEN(e); ++k) mark[CENTRYDBN(e) + k] = 1;
+        }
+        continue;
+      }
+
+      for (i32 d = 0; d < NUMDIRECT; ++d) {
+        if (in->direct[d] != 0) mark[abs(in->direct[d])] = 1;
+      }
+      if (in->indirect  != 0) snapMarkTable(in->indirect,  1, mark);
+      if (in->dindirect != 0) snapMarkTable(in->dindirect, 2, mark);
+      if (in->tindirect != 0) snapMarkTable(in->tindirect, 3, mark);
+    }
+  }
+}
+
+
+
+// ============================================================================
+// Delete snapshot 'name', and free the blocks only it still held.  Return 0,
+// or EFNF if there is no such snapshot
+// ============================================================================
+i32 snapDelete(str name) {
+
+  if (name == NULL) FATAL(ENULLPTR);
+
+  bfsReclaimDrain();
+
+  bfsLock();
+  snapLoad();
+
+  i32 slot = snapFind(name);
+  if (slot == EFNF) { bfsUnlock(); return EFNF; }
+
+  memset(&g_vol->snaps[slot], 0, sizeof(SnapEntry));
+  snapFlush();
+  g_vol->snapsLoaded = 0;                    // recompute g_vol->snapgen
+  snapLoad();
+
+  snapSweep();
+
+  bfsUnlock();
+  return 0;
+}
+
+
+
+// ============================================================================
+// Free every block in use that neither the live tree nor any snapshot can
+// reach: what a deleted snapshot alone held, or what a crash left allocated
+// but unmapped.  Nothing may be allocating meanwhile.  Return the # of
+// blocks freed
+// ============================================================================
+i32 snapSweep() {
+  bfsLock();
+  logRelease();                         // the log's run is in no tree
+
+  // Mark what is still reachable, and what is free
+
+  i8 mark[BLOCKSPERDISK] = {0};
+  for (i32 dbn = 0; dbn < MINDBN; ++dbn) mark[dbn] = 1;
+
+  i32 live[INODEBLOCKS];
+  for (i32 b = 0; b < INODEBLOCKS; ++b) live[b] = DBNINODES + b;
+  snapMarkInodes(live, mark);
+
+  for (i32 s = 0; s < NUMSNAPS; ++s) {
+    if (g_vol->snaps[s].name[0] == 0) continue;
+    for (i32 b = 0; b < INODEBLOCKS; ++b) mark[g_vol->snaps[s].inodes[b]] = 1;
+    snapMarkInodes(g_vol->snaps[s].inodes, mark);
+  }
+
+  i8 sbuf[BYTESPERBLOCK];
+  bioRead(DBNSUPER, sbuf);
+  Super* super = (Super*)sbuf;
+  for (i32 g = 0; g < NUMGROUPS; ++g) {
+    i32 dbn   = super->groups[g].firstFree;
+    i32 count = super->groups[g].freeRun;
+    i32 next  = super->groups[g].nextFree;
+    while (dbn != 0) {
+      if (count == 0) {                 // header on disk
+        i8 buf[BYTESPERBLOCK];
+        bioRead(dbn, buf);
+        FreeRun* run = (FreeRun*)buf;
+        bfsCheckRun(dbn, run);
+        count = (run->count == 0) ? 1 : run->count;
+        next  = run->next;
+      }
+      for (i32 i = 0; i < count; ++i) mark[dbn + i] = 1;
+      dbn   = next;
+      count = 0;
+    }
+  }
+
+  // Sweep: in use, yet reachable from nowhere
+
+  i32 dbns[BLOCKSPERDISK];
+  i32 n = 0;
+  for (i32 d = MINDBN; d < BLOCKSPERDISK; ++d) {
+    if (mark[d]) continue;
+    refClear(d);
+    dbns[n++] = d;
+  }
+  bfsFreeRuns(dbns, n);
+
+  bfsUnlock();
+  return n;
+}
+
+
+
+// ============================================================================
+// Write an empty snapshot table, for a newly formatted disk
+// ============================================================================
+i32 snapFormat() {
+  bfsLock();
+  memset(g_vol->snaps, 0, sizeof(g_vol->snaps));
+  g_vol->snapsLoaded = 1;
+  g_vol->snapgen     = -1;
+  g_vol->snapmount   = SNAPNONE;
+  snapFlush();
+  bfsUnlock();
+  return 0;
+}
+
+
+
+// ============================================================================
+// Return 1 if block 'dbn' may be held by a snapshot, so must not be changed
+// or freed; else 0.  Metadata blocks count as born in generation 0
+// ============================================================================
+i32 snapFrozen(i32 dbn) {
+  bfsLock();
+  snapLoad();
+  i32 birth  = (dbn < MINDBN) ? 0 : refBirth(dbn);
+  i32 frozen = (g_vol->snapgen >= 0 && birth <= g_vol->snapgen);
+  bfsUnlock();
+  return frozen;
+}
+
+
+
+// ============================================================================
+// Return the DBN of Inodes block 'b' of the tree mounted: the live one, or a
+// snapshot's copy
+// ============================================================================
+i32 snapInodes(i32 b) {
+  if (g_vol->snapmount == SNAPNONE) return DBNINODES + b;
+  return g_vol->snaps[g_vol->snapmount].inodes[b];
+}
+
+
+
+// ============================================================================
+// Mount snapshot 'name', read-only, in place of the live tree, until the
+// next fsMount.  Return 0, or EFNF if there is no such snapshot
+// ============================================================================
+i32 snapMount(str name) {
+
+  if (name == NULL) FATAL(ENULLPTR);
+
+  bfsLock();
+  snapLoad();
+
+  i32 slot = snapFind(name);
+  if (slot == EFNF) { bfsUnlock(); return EFNF; }
+
+  g_vol->snapmount = slot;
+  for (i32 inum = 0; inum < NUMINODES; ++inum) {
+    mapInval(inum);
+    compInval(inum);
+  }
+  dirCacheClear();
+
+  bfsUnlock();
+  return 0;
+}
+
+
+
+// ============================================================================
+// Return 1 if a snapshot is mounted, so nothing may be changed; else 0
+// ============================================================================
+i32 snapReadOnly() {
+  return g_vol->snapmount != SNAPNONE;
+}
+
+
+
+// ============================================================================
+// Forget the in-memory table, and go back to the live tree.  Called at mount
+// ============================================================================
+i32 snapReset() {
+  bfsLock();
+  if (g_vol->snapmount != SNAPNONE) {        // caches hold the snapshot's view
+    for (i32 inum = 0; inum < NUMINODES; ++inum) {
+      mapInval(inum);
+      compInval(inum);
+    }
+    dirCacheClear();
+  }
+  g_vol->snapsLoaded = 0;
+  g_vol->snapmount   = SNAPNONE;
+  bfsUnlock();
+  return 0;
+}
@@ -0,0 +1,32 @@
+#ifndef SNAP_H
+#define SNAP_H
+
+// ===================================================================
+// snap.h - Snapshots: frozen, read-only copies of the whole tree,
+// sharing every block with the live one until it changes
+// ===================================================================
+
+#include "alias.h"
+#include "bfs.h"
+
+#define NUMSNAPS      4       // # snapshots a disk can hold
+#define SNAPNONE      -1      // BfsVolume.snapmount: the live tree is mounted
+
+typedef struct {          // SnapEntry: one snapshot, in block DBNSNAPS
+  char name[FNAMESIZE];   // "" => slot free
+  i32  gen;               // generation frozen: blocks born in it or before
+  i32  inodes[INODEBLOCKS];   // DBNs of its copy of the Inodes blocks
+} SnapEntry;
+
+i32 snapBorn    (i32 dbn, i32 count, i32 gen);
+i32 snapCreate  (str name);
+i32 snapDelete  (str name);
+i32 snapFormat  ();
+i32 snapFrozen  (i32 dbn);
+i32 snapInodes  (i32 b);
+i32 snapMount   (str name);
+i32 snapReadOnly();
+i32 snapReset   ();
+i32 snapSweep   ();
+
+#endif
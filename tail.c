@@ -0,0 +1,276 @@
+// ============================================================================
+// tail.c - Append mode.  A file opened with OPEN_APPEND gets a tail buffer:
+// each fsWrite just copies its bytes to the end of the buffer, and the
+// buffer goes to the disk when it fills (TAILSIZE bytes, written block by
+// block, with the size updated once), when the file is read or changed some
+// other way, and on fsSync or the last fsClose.
+//
+// fsSync makes the file durable: the data is written and flushed to the
+// disk (bioSync), then the new size, then flushed again, so a crash never
+// leaves a size that covers unwritten data.  Syncs are group committed: one
+// caller at a time flushes, taking everything appended so far; callers that
+// arrive meanwhile wait for it, and find their bytes already durable, or
+// have one of them flush for all.  N writers syncing at once thus cost about
+// two flushes, not N.
+//
+// Buffers come from the slab g_tailbufs, only while a file is in append mode.
+// A flush takes the full buffer, leaving a fresh one for the appends that
+// arrive meanwhile: no copy
+// ============================================================================
+
+#include "comp.h"
+#include "slab.h"
+#include "tail.h"
+#include "vol.h"
+
+SLABDEFINE(g_tailbufs, TAILSIZE, TAILBUFS);     // shared by every volume
+
+
+
+// ============================================================================
+// Set up the lock and condition of every Tail.  Run once, before first use
+// ============================================================================
+void tailInit() {
+  for (i32 inum = 0; inum < NUMINODES; ++inum) {
+    pthread_mutex_init(&g_vol->tails[inum].lock, NULL);
+    pthread_cond_init (&g_vol->tails[inum].done, NULL);
+  }
+}
+
+
+
+// ============================================================================
+// Return the Tail of file 'inum'
+// ============================================================================
+Tail* tailOf(i32 inum) {
+  if (inum < 0 || inum > MAXINUM) FATAL(EBADINUM);
+  pthread_once(&g_vol->tailOnce, tailInit);
+  return &g_vol->tails[inum];
+}
+
+
+
+// ============================================================================
+// Write the 'len' bytes at 'data' to file 'inum', from byte 'offset'.  Only
+// data: the size is left to the caller (but an inline or compressed file
+// keeps its size in the same Inode write as its data)
+// ============================================================================
+void tailWrite(i32 inum, i32 offset, i32 len, i8* data) {
+  if (len == 0) return;
+  if (bfsWriteInline(inum, offset, len, data)) return;
+  if (compWrite(inum, offset, len, data)) return;
+
+  i8  blk[BYTESPERBLOCK];
+  i32 end = offset + len;
+
+  for (i32 pos = offset; pos < end; ) {
+    i32 fbn = pos / BYTESPERBLOCK;
+    i32 lo  = pos % BYTESPERBLOCK;
+    i32 hi  = (end - fbn * BYTESPERBLOCK < BYTESPERBLOCK)
+            ? end - fbn * BYTESPERBLOCK : BYTESPERBLOCK;
+
+    if (hi - lo < BYTESPERBLOCK) bfsRead(inum, fbn, blk);   // keep the rest
+    memcpy(blk + lo, data + (pos - offset), hi - lo);
+    bfsWriteBlock(inum, fbn, blk, hi - lo == BYTESPERBLOCK);
+
+    pos = fbn * BYTESPERBLOCK + hi;
+  }
+}
+
+
+
+// ============================================================================
+// Write out everything in the tail buffer 't' of file 'inum', then its size.
+// If 'sync', flush the disk after the data and again after the size, and
+// mark the file durable that far.  Caller holds t->lock, with no flush
+// running.  Given a fresh buffer for t, it is dropped during the I/O, so
+// appends can go on meanwhile
+// ============================================================================
+void tailDrain(Tail* t, i32 inum, i32 sync) {
+  i8* data  = t->buf;
+  i8* fresh = slabAlloc(&g_tailbufs);
+  i32 base  = t->base;
+  i32 len   = t->len;
+
+  t->base    += len;
+  t->len      = 0;
+  t->flushing = 1;
+  if (fresh != NULL) {                            // else appends must wait
+    t->buf = fresh;
+    pthread_mutex_unlock(&t->lock);
+  }
+
+  tailWrite(inum, base, len, data);
+  if (sync) bioSync();                            // data first,
+  if (bfsGetSize(inum) < base + len) bfsSetSize(inum, base + len);
+  if (sync) bioSync();                            //   then the size
+
+  if (fresh != NULL) {
+    slabFree(&g_tailbufs, data);
+    pthread_mutex_lock(&t->lock);
+  }
+  t->flushing = 0;
+  if (sync && t->synced < base + len) t->synced = base + len;
+  pthread_cond_broadcast(&t->done);
+}
+
+
+
+// ============================================================================
+// Append 'numb' bytes from 'buf' to file 'inum', if it is open in append
+// mode: they go to its tail buffer.  Store the new end of file in '*pend'.
+// Return 1 if so.  If the file is not in append mode, return 0, leaving the
+// write to the caller.  Return EBIGNUMB, buffering nothing, if a compressed
+// file would grow past COMPMAXSIZE
+// ============================================================================
+i32 tailAppend(i32 inum, i32 numb, void* buf, i32* pend) {
+
+  if (numb < 0)     FATAL(ENEGNUMB);
+  if (pend == NULL) FATAL(ENULLPTR);
+
+  Tail* t = tailOf(inum);
+  pthread_mutex_lock(&t->lock);
+
+  if (!t->active) { pthread_mutex_unlock(&t->lock); return 0; }
+
+  i32 base = (t->len == 0 && !t->flushing) ? bfsGetSize(inum) : t->base;
+  if (!compFits(inum, base + t->len + numb)) {
+    pthread_mutex_unlock(&t->lock);
+    return EBIGNUMB;
+  }
+
+  i8* src = (i8*)buf;
+  while (numb > 0) {
+    if (t->len == 0 && !t->flushing) {    // all written: size is current
+      t->base = bfsGetSize(inum);
+      if (t->synced > t->base) t->synced = t->base;     // was truncated
+    }
+
+    i32 n = TAILSIZE - t->len;
+    if (n == 0) {                         // full: write it out, in order
+      if (t->flushing) {
+        pthread_cond_wait(&t->done, &t->lock);
+      } else {
+        tailDrain(t, inum, 0);
+      }
+      continue;
+    }
+
+    if (n > numb) n = numb;               // a flush may be writing the
+    memcpy(t->buf + t->len, src, n);      //   bytes before: no matter
+    t->len += n;
+    src    += n;
+    numb   -= n;
+  }
+
+  *pend = t->base + t->len;
+  pthread_mutex_unlock(&t->lock);
+  return 1;
+}
+
+
+
+// ============================================================================
+// Write out the tail buffer of file 'inum', if it has one, so reads and other
+// changes see every byte appended.  No disk flush.  Return 0
+// ============================================================================
+i32 tailFlush(i32 inum) {
+  Tail* t = tailOf(inum);
+  pthread_mutex_lock(&t->lock);
+  while (t->flushing) pthread_cond_wait(&t->done, &t->lock);
+  if (t->len > 0) tailDrain(t, inum, 0);
+  pthread_mutex_unlock(&t->lock);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Write out the tail buffer of every file.  Return 0
+// ============================================================================
+i32 tailFlushAll() {
+  for (i32 inum = 0; inum < NUMINODES; ++inum) tailFlush(inum);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Drop every tail buffer, unwritten, for a newly formatted disk.  Return 0
+// ============================================================================
+i32 tailReset() {
+  for (i32 inum = 0; inum < NUMINODES; ++inum) tailStop(inum, 1);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Put file 'inum' in append mode, with an empty tail buffer.  Return 0, or
+// ENOBUFS if every tail buffer is in use
+// ============================================================================
+i32 tailStart(i32 inum) {
+  Tail* t = tailOf(inum);
+  pthread_mutex_lock(&t->lock);
+  if (!t->active) {
+    t->buf = slabAlloc(&g_tailbufs);
+    if (t->buf == NULL) {
+      pthread_mutex_unlock(&t->lock);
+      return ENOBUFS;
+    }
+    t->active = 1;
+    t->base   = bfsGetSize(inum);
+    t->len    = 0;
+    t->synced = 0;
+  }
+  pthread_mutex_unlock(&t->lock);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Take file 'inum' out of append mode, writing out its tail buffer first; or,
+// if 'discard' (the file is being deleted), dropping it.  Return 0
+// ============================================================================
+i32 tailStop(i32 inum, i32 discard) {
+  Tail* t = tailOf(inum);
+  pthread_mutex_lock(&t->lock);
+  while (t->flushing) pthread_cond_wait(&t->done, &t->lock);
+  if (t->len > 0 && !discard) tailDrain(t, inum, 0);
+  if (t->buf != NULL) slabFree(&g_tailbufs, t->buf);
+  t->buf    = NULL;
+  t->active = 0;
+  t->len    = 0;
+  pthread_mutex_unlock(&t->lock);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Make everything written to file 'inum' durable: data, then size.  Syncs
+// of one file are merged: see the top of this file.  Return 0
+// ============================================================================
+i32 tailSync(i32 inum) {
+  Tail* t = tailOf(inum);
+  pthread_mutex_lock(&t->lock);
+
+  if (!t->active) {                       // written through: just flush
+    pthread_mutex_unlock(&t->lock);
+    bioSync();
+    return 0;
+  }
+
+  i32 target = t->base + t->len;          // our bytes end here
+  while (t->synced < target) {
+    if (t->flushing) {                    // someone else is flushing: wait,
+      pthread_cond_wait(&t->done, &t->lock);  // it may have taken ours
+      continue;
+    }
+    tailDrain(t, inum, 1);                // we flush, for everyone so far
+  }
+
+  pthread_mutex_unlock(&t->lock);
+  return 0;
+}
@@ -0,0 +1,35 @@
+#ifndef TAIL_H
+#define TAIL_H
+
+// ===================================================================
+// tail.h - Append mode: a per-file tail buffer of bytes appended but
+// not yet written, and group-committed syncs
+// ===================================================================
+
+#include "alias.h"
+#include "bfs.h"
+
+#define TAILBLOCKS    8       // blocks' worth of appends a tail buffer holds
+#define TAILSIZE      (TAILBLOCKS * BYTESPERBLOCK)
+#define TAILBUFS      (2 * NUMINODES)   // tail buffers, in use or in flight
+
+typedef struct {          // Tail: the tail buffer of one file
+  i32 active;             // 1 => file is open in append mode
+  i32 base;               // file offset of buf[0]: bytes before are written
+  i32 len;                // # bytes in buf
+  i32 synced;             // file is durable up to here
+  i32 flushing;           // 1 => a flush is writing, with 'lock' dropped
+  pthread_mutex_t lock;
+  pthread_cond_t  done;   // signalled when a flush ends
+  i8* buf;                // TAILSIZE bytes, from g_tailbufs.  NULL => none
+} Tail;
+
+i32 tailAppend  (i32 inum, i32 numb, void* buf, i32* pend);
+i32 tailFlush   (i32 inum);
+i32 tailFlushAll();
+i32 tailReset   ();
+i32 tailStart   (i32 inum);
+i32 tailStop    (i32 inum, i32 discard);
+i32 tailSync    (i32 inum);
+
+#endif
@@ -0,0 +1,107 @@
+// ============================================================================
+// bfsbench.c - block cache benchmark: hit rates of the cache's replacement
+// policies under a mixed workload, on a scratch disk, BFSDISK-BENCH, in the
+// current directory
+//
+//   bfsbench                run the workload under LRU, then 2Q
+//   bfsbench rounds         ... for 'rounds' rounds (default 20)
+//
+// Each round scans file BIG, in bulk reads, with a read of one of a few
+// small, hot files after each.  Every read also needs the Inodes.  A good
+// policy keeps the hot files and the metadata through the scans.  Build,
+// from the top of the repo:
+//
+//   gcc -pthread -I. -o bfsbench tools/bfsbench.c
+//       aio.c arc.c bfs.c bio.c cache.c comp.c crc.c dedup.c dir.c errors.c
+//       fs.c log.c lz.c map.c ref.c slab.c snap.c tail.c trace.c vol.c wb.c
+// ============================================================================
+
+#include "bfs.h"
+#include "cache.h"
+#include "fs.h"
+
+#define BENCHDISK     "BFSDISK-BENCH"
+#define BENCHBIG      48      // blocks in the file scanned
+#define BENCHHOT      6       // # hot files, one block each
+#define BENCHRUN      4       // blocks per bulk read of the scan
+
+
+
+// ============================================================================
+// Create the files: BIG, scanned, and HOT0 ... , read at random
+// ============================================================================
+void benchSetup() {
+  i8 buf[BENCHBIG * BYTESPERBLOCK];
+  memset(buf, 'b', sizeof(buf));
+  i32 fd = fsCreate("BIG");
+  fsWrite(fd, sizeof(buf), buf);
+  fsClose(fd);
+
+  for (i32 h = 0; h < BENCHHOT; ++h) {
+    char name[FNAMESIZE];
+    sprintf(name, "HOT%d", h);
+    fd = fsCreate(name);
+    memset(buf, '0' + h, BYTESPERBLOCK);
+    fsWrite(fd, BYTESPERBLOCK, buf);
+    fsClose(fd);
+  }
+}
+
+
+
+// ============================================================================
+// Run 'rounds' rounds of the workload under cache 'policy', and print the
+// hit rates
+// ============================================================================
+void benchRun(str name, i32 policy, i32 rounds) {
+  i8  buf[BENCHRUN * BYTESPERBLOCK];
+  i32 hot[BENCHHOT];
+
+  i32 big = fsOpen("BIG");
+  for (i32 h = 0; h < BENCHHOT; ++h) {
+    char file[FNAMESIZE];
+    sprintf(file, "HOT%d", h);
+    hot[h] = fsOpen(file);
+  }
+
+  srand(1);
+  cachePolicy(policy);
+  for (i32 r = 0; r < rounds; ++r) {
+    fsSeek(big, 0, SEEK_SET);
+    for (i32 b = 0; b < BENCHBIG; b += BENCHRUN) {
+      fsRead(big, BENCHRUN * BYTESPERBLOCK, buf);           // the scan
+      i32 h = rand() % BENCHHOT;                            // a hot read
+      fsSeek(hot[h], 0, SEEK_SET);
+      fsRead(hot[h], BYTESPERBLOCK, buf);
+    }
+  }
+
+  CacheStats st;
+  cacheStats(&st);
+  i64 all  = st.hits + st.misses;
+  i64 meta = st.metahits + st.metamisses;
+  printf("%-4s %8lld hits %8lld misses  %5.1f%% hit  %5.1f%% metadata hit \n",
+         name, (long long)st.hits, (long long)st.misses,
+         all  ? 100.0 * st.hits / all : 0.0,
+         meta ? 100.0 * st.metahits / meta : 0.0);
+
+  fsClose(big);
+  for (i32 h = 0; h < BENCHHOT; ++h) fsClose(hot[h]);
+}
+
+
+
+int main(int argc, char** argv) {
+  i32 rounds = (argc > 1) ? atoi(argv[1]) : 20;
+
+  bfsInitOFT();
+  if (fsMount(BENCHDISK, MOUNT_FORMAT) == NULL) return 1;
+  benchSetup();
+
+  benchRun("LRU", CACHELRU, rounds);
+  benchRun("2Q",  CACHE2Q,  rounds);
+
+  fsUnmount();
+  remove(BENCHDISK);
+  return 0;
+}
@@ -0,0 +1,93 @@
+// ============================================================================
+// bfsdefrag.c - defragment files on the BFS disk in the current directory
+//
+//   bfsdefrag               defragment every file, in every directory
+//   bfsdefrag p1 p2 ...     defragment just the named files (eg "a/b/c")
+//
+// For each file, print its extents, mapped blocks and score (extents per MB)
+// before and after.  Build, from the top of the repo:
+//
+//   gcc -pthread -I. -o bfsdefrag tools/bfsdefrag.c
+//       bfs.c bio.c dir.c errors.c fs.c map.c
+// ============================================================================
+
+#include "bfs.h"
+#include "fs.h"
+
+// ============================================================================
+// Defragment file 'fname' and report.  Return 0, or the fsDefrag error
+// ============================================================================
+i32 defragOne(str fname) {
+  i32 inum = bfsFindInum(fname);
+  if (inum == EFNF) {
+    printf("%-16s not found \n", fname);
+    return EFNF;
+  }
+
+  i32 extents, blocks;
+  i32 score = bfsFragScore(inum, &extents, &blocks);
+  printf("%-16s %4d extents %5d blocks %8d /MB", fname, extents, blocks, score);
+
+  i32 ret = fsDefrag(fname);
+
+  score = bfsFragScore(inum, &extents, &blocks);
+  switch (ret) {
+    case 0:
+      printf("  ->  %4d extents %8d /MB \n", extents, score);  break;
+    case ENORUN:
+      printf("  ->  skipped: no free run of %d blocks \n", blocks);  break;
+    case ECHANGED:
+      printf("  ->  skipped: file changed during copy \n");  break;
+    case EFOPEN:
+      printf("  ->  skipped: file is open \n");  break;
+    default:
+      printf("  ->  error %d \n", ret);  break;
+  }
+  return ret;
+}
+
+
+
+// ============================================================================
+// Defragment every file in directory 'dir', and in the directories below it.
+// Return 0, or 1 if any file failed
+// ============================================================================
+i32 defragTree(str dir) {
+  i32  ret    = 0;
+  i32  cursor = 0;
+  char name[FNAMESIZE];
+
+  while (fsReaddir(dir, &cursor, name) == 1) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s%s%s", dir, dir[0] ? "/" : "", name);
+
+    Inode inode;
+    bfsReadInode(bfsFindInum(path), &inode);
+    if (inode.flags & INODEDIR) {
+      if (defragTree(path) != 0) ret = 1;
+    } else if (defragOne(path) != 0) {
+      ret = 1;
+    }
+  }
+  return ret;
+}
+
+
+
+int main(int argc, char** argv) {
+  bfsInitOFT();
+  fsMount(BFSDISK, 0);
+
+  i32 ret = 0;
+
+  if (argc > 1) {
+    for (int a = 1; a < argc; ++a) {
+      if (defragOne(argv[a]) != 0) ret = 1;
+    }
+  } else {
+    if (defragTree("") != 0) ret = 1;
+  }
+
+  fsUnmount();
+  return ret;
+}
@@ -0,0 +1,53 @@
+// ============================================================================
+// bfsextract.c - copy files out of a BFS disk image: BFSDISK, in the current
+// directory, unless '-i image' names another
+//
+//   bfsextract dir          copy the whole tree into host directory 'dir'
+//   bfsextract dir path     ... just the tree below BFS directory 'path'
+//   bfsextract -            write the whole tree, as a tar archive, to stdout
+//   bfsextract - path       ... just the tree below 'path'
+//   bfsextract -i image ... any of the above, from disk image 'image'
+//
+// Every block is read once, in DBN order over all the files; see fsExport.
+// So a backup is just "bfsextract - > backup.tar", or a pipe.  Build, from
+// the top of the repo:
+//
+//   gcc -pthread -I. -o bfsextract tools/bfsextract.c
+//       aio.c arc.c bfs.c bio.c cache.c comp.c crc.c dedup.c dir.c errors.c
+//       fs.c log.c lz.c map.c ref.c slab.c snap.c tail.c trace.c vol.c wb.c
+// ============================================================================
+
+#include "bfs.h"
+#include "fs.h"
+
+int main(int argc, char** argv) {
+  str image = BFSDISK;
+  if (argc > 1 && strcmp(argv[1], "-i") == 0) {
+    image = (argc > 2) ? argv[2] : NULL;
+    argc -= 2;
+    argv += 2;
+  }
+  if (argc < 2 || image == NULL) {
+    fprintf(stderr, "usage: bfsextract [-i image] dir|- [path] \n");
+    return 1;
+  }
+  str dest = argv[1];
+  str path = (argc > 2) ? argv[2] : "";
+  i32 mode = (strcmp(dest, "-") == 0) ? EXPORT_TAR : 0;
+
+  FILE* fp = fopen(image, "rb");            // fsMount would FATAL
+  if (fp == NULL) {
+    fprintf(stderr, "bfsextract: cannot open %s \n", image);
+    return 1;
+  }
+  fclose(fp);
+
+  bfsInitOFT();
+  if (fsMount(image, 0) == NULL) return 1;
+
+  i32 ret = fsExport(path, dest, mode);
+  if (ret != 0) fprintf(stderr, "bfsextract: error %d \n", ret);
+
+  fsUnmount();
+  return (ret == 0) ? 0 : 1;
+}
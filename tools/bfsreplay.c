@@ -0,0 +1,112 @@
+// ============================================================================
+// bfsreplay.c - replay a workload trace, from fsTraceStart, against a fresh
+// BFS disk, BFSDISK-REPLAY, in the current directory, and report latencies
+//
+//   bfsreplay trace          closed loop: each thread makes its next call as
+//                            soon as the last returns
+//   bfsreplay trace open     open loop: each call is made at the time it was
+//                            made in the trace, ready or not; its latency
+//                            counts from then, so queueing shows
+//
+// Every thread of the trace is replayed by a thread of its own, its calls in
+// their recorded order.  Files the trace opened but did not create are
+// created first, at the size they had.  For each kind of call, print the
+// count and the mean, median, 99th percentile and worst latency in us, for
+// the replay and as traced.  Build, from the top of the repo:
+//
+//   gcc -pthread -I. -o bfsreplay tools/bfsreplay.c
+//       aio.c arc.c bfs.c bio.c cache.c comp.c crc.c dedup.c dir.c errors.c
+//       fs.c log.c lz.c map.c ref.c slab.c snap.c tail.c trace.c vol.c wb.c
+// ============================================================================
+
+#include "bfs.h"
+#include "fs.h"
+#include "trace.h"
+
+#define REPLAYDISK    "BFSDISK-REPLAY"
+
+static TraceReplay g_rp;
+
+
+
+// ============================================================================
+// Order latencies, for qsort
+// ============================================================================
+int replayCmp(const void* a, const void* b) {
+  i64 x = *(i64*)a, y = *(i64*)b;
+  return (x > y) - (x < y);
+}
+
+
+
+// ============================================================================
+// Print the latencies of the calls to 'op', called 'name'
+// ============================================================================
+void replayReport(TraceReplay* rp, i32 op, str name) {
+  i64* got = malloc((rp->n + 1) * sizeof(i64));
+  i64* was = malloc((rp->n + 1) * sizeof(i64));
+  if (got == NULL || was == NULL) FATAL(ENOBUFS);
+
+  i32 n = 0;
+  i64 gotsum = 0, wassum = 0;
+  for (i32 r = 0; r < rp->n; ++r) {
+    if (rp->recs[r].op != op) continue;
+    got[n] = rp->lat[r];
+    was[n] = rp->recs[r].dur;
+    gotsum += got[n];
+    wassum += was[n];
+    ++n;
+  }
+
+  if (n > 0) {
+    qsort(got, n, sizeof(i64), replayCmp);
+    qsort(was, n, sizeof(i64), replayCmp);
+    printf("%-6s %7d  %9.1f %7lld %7lld %8lld   %9.1f %7lld %7lld %8lld \n",
+           name, n,
+           (double)gotsum / n, (long long)got[n / 2],
+           (long long)got[n * 99 / 100], (long long)got[n - 1],
+           (double)wassum / n, (long long)was[n / 2],
+           (long long)was[n * 99 / 100], (long long)was[n - 1]);
+  }
+  free(got);
+  free(was);
+}
+
+
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    printf("usage: bfsreplay trace [open] \n");
+    return 1;
+  }
+
+  TraceReplay* rp = &g_rp;
+  i32 ret = traceLoad(rp, argv[1]);
+  if (ret != 0) {
+    printf("bfsreplay: %s %s \n", argv[1],
+           (ret == EFNF) ? "cannot be opened" : "is not a BFS trace");
+    return 1;
+  }
+
+  bfsInitOFT();
+  if (fsMount(REPLAYDISK, MOUNT_FORMAT) == NULL) return 1;
+  traceReplay(rp, argc > 2 && strcmp(argv[2], "open") == 0);
+  i64 wall = traceNow() - rp->t0;
+
+  printf("%d calls, %d threads, %s loop, %lld us; %d calls skipped \n",
+         rp->n, rp->threads, rp->open ? "open" : "closed", (long long)wall,
+         rp->skipped);
+  printf("%-6s %7s  %9s %7s %7s %8s   %9s %7s %7s %8s \n", "call", "count",
+         "mean us", "p50", "p99", "max", "traced", "p50", "p99", "max");
+  replayReport(rp, TRACEOPEN,   "open");
+  replayReport(rp, TRACECREATE, "create");
+  replayReport(rp, TRACEREAD,   "read");
+  replayReport(rp, TRACEWRITE,  "write");
+  replayReport(rp, TRACESEEK,   "seek");
+  replayReport(rp, TRACECLOSE,  "close");
+
+  fsUnmount();
+  remove(REPLAYDISK);
+  traceUnload(rp);
+  return 0;
+}
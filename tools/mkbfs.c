@@ -0,0 +1,45 @@
+// ============================================================================
+// mkbfs.c - build a BFS disk image from a directory tree on the host
+//
+//   mkbfs dir               format BFSDISK, in the current directory, and
+//                           copy into it every file and directory below 'dir'
+//   mkbfs dir image         ... into disk image 'image'
+//
+// The copy is fsImport's (see arc.c): the whole tree is planned first, and
+// if its files, directories or blocks do not fit, nothing is written.  Then
+// the directories and files are created, each file given its blocks as one
+// contiguous run, so the metadata is all in place before any data moves.
+// Last, several threads copy the files' contents, each file in one read and
+// one fsWrite, which writeback turns into large sequential writes.  Build,
+// from the top of the repo:
+//
+//   gcc -pthread -I. -o mkbfs tools/mkbfs.c
+//       aio.c arc.c bfs.c bio.c cache.c comp.c crc.c dedup.c dir.c errors.c
+//       fs.c log.c lz.c map.c ref.c slab.c snap.c tail.c trace.c vol.c wb.c
+// ============================================================================
+
+#include "bfs.h"
+#include "fs.h"
+
+
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    printf("usage: mkbfs dir [image] \n");
+    return 1;
+  }
+  str image = (argc > 2) ? argv[2] : BFSDISK;
+
+  bfsInitOFT();
+  i32 ret = fsImport(argv[1], image);
+  switch (ret) {
+    case 0:         printf("mkbfs: wrote %s \n", image);              break;
+    case EHOSTIO:   printf("mkbfs: cannot read all of %s \n", argv[1]); break;
+    case EBIGFNAME: printf("mkbfs: a name or path is too long \n");    break;
+    case ENOINODE:  printf("mkbfs: more than %d files and directories \n",
+                           NUMINODES - 1);                            break;
+    case EDISKFULL: printf("mkbfs: too big for the image \n");         break;
+    default:        printf("mkbfs: cannot mount %s \n", image);        break;
+  }
+  return (ret == 0) ? 0 : 1;
+}
@@ -0,0 +1,423 @@
+// ============================================================================
+// trace.c - Workload traces.  Between fsTraceStart and fsTraceStop, every
+// fsOpen, fsCreate, fsRead, fsWrite, fsSeek and fsClose, from any thread, is
+// recorded: its arguments, result, start time and duration, as a fixed-size
+// TraceRec (plus the path, for open and create).  Each traced fs call checks
+// TRACING() first, and if it is on, comes here, which times the call itself
+// and appends its record.  Records gather in a TRACEBUF buffer, written to
+// the trace file when it fills.  A trace file is TRACEMAGIC, TRACEVERSION,
+// then the records.  traceLoad reads one back, and traceReplay replays it,
+// for bfsreplay
+// ============================================================================
+
+#include <time.h>
+
+#include "fs.h"
+#include "trace.h"
+#include "vol.h"
+
+Trace g_trace = {
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+__thread i32 g_traceIn     = 0;
+__thread i32 g_traceThread = 0;       // this thread's number in the trace,
+__thread i32 g_traceGen    = 0;       //   valid if this is g_trace.gen
+
+
+
+// ============================================================================
+// Record fsClose('fd')
+// ============================================================================
+i32 traceClose(i32 fd) {
+  i64 t0 = traceNow();
+  g_traceIn = 1;
+  i32 ret = fsClose(fd);
+  g_traceIn = 0;
+  traceEnd(TRACECLOSE, fd, 0, 0, ret, t0, NULL);
+  return ret;
+}
+
+
+
+// ============================================================================
+// Record fsCreate('path')
+// ============================================================================
+i32 traceCreate(str path) {
+  i64 t0 = traceNow();
+  g_traceIn = 1;
+  i32 ret = fsCreate(path);
+  g_traceIn = 0;
+  traceEnd(TRACECREATE, ret, 0, 0, ret, t0, path);
+  return ret;
+}
+
+
+
+// ============================================================================
+// Append the record of a call to 'op', which began at 't0' us and has just
+// returned 'ret'.  'path' is NULL but for open and create.  A call that ends
+// after fsTraceStop is not recorded
+// ============================================================================
+void traceEnd(i32 op, i32 fd, i32 arg, i32 whence, i32 ret, i64 t0,
+              str path) {
+  i64 t1 = traceNow();
+
+  TraceRec rec;
+  memset(&rec, 0, sizeof(rec));
+  rec.op      = op;
+  rec.pathlen = (path == NULL) ? 0 : strnlen(path, TRACEPATHSIZE - 1);
+  rec.fd      = fd;
+  rec.arg     = arg;
+  rec.whence  = whence;
+  rec.ret     = ret;
+  rec.dur     = (u32)(t1 - t0);
+
+  pthread_mutex_lock(&g_trace.lock);
+  if (!g_trace.on) { pthread_mutex_unlock(&g_trace.lock); return; }
+
+  if (g_traceGen != g_trace.gen) {         // first call in this trace
+    g_traceGen    = g_trace.gen;
+    g_traceThread = g_trace.threads++;
+  }
+  rec.thread = (u8)g_traceThread;
+  rec.start  = (t0 > g_trace.t0) ? (u32)(t0 - g_trace.t0) : 0;
+
+  if (g_trace.used + sizeof(rec) + rec.pathlen > TRACEBUF) {
+    if (traceFlush() != 0) g_trace.failed = 1;
+  }
+  memcpy(g_trace.buf + g_trace.used, &rec, sizeof(rec));
+  g_trace.used += sizeof(rec);
+  if (path != NULL) memcpy(g_trace.buf + g_trace.used, path, rec.pathlen);
+  g_trace.used += rec.pathlen;
+  ++g_trace.recs;
+
+  pthread_mutex_unlock(&g_trace.lock);
+}
+
+
+
+// ============================================================================
+// Write the buffered records to the trace file.  Call with g_trace.lock
+// held.  Return 0, or EHOSTIO
+// ============================================================================
+i32 traceFlush() {
+  i32 n = g_trace.used;
+  g_trace.used = 0;
+  if (n == 0) return 0;
+  return (fwrite(g_trace.buf, 1, n, g_trace.fp) == (size_t)n) ? 0 : EHOSTIO;
+}
+
+
+
+// ============================================================================
+// Load trace file 'path' into 'rp', for traceReplay.  Return 0, EFNF if it
+// cannot be opened, or EBADTRACE if it is not a trace.  A record cut short,
+// at the end, is dropped.  Give it back with traceUnload
+// ============================================================================
+i32 traceLoad(TraceReplay* rp, str path) {
+  memset(rp, 0, sizeof(TraceReplay));
+  pthread_mutex_init(&rp->lock, NULL);
+
+  FILE* fp = fopen(path, "rb");
+  if (fp == NULL) return EFNF;
+
+  char magic[8];
+  i32  version = 0;
+  if (fread(magic, 1, 8, fp) != 8 || memcmp(magic, TRACEMAGIC, 8) != 0
+      || fread(&version, sizeof(i32), 1, fp) != 1
+      || version != TRACEVERSION) {
+    fclose(fp);
+    return EBADTRACE;
+  }
+
+  i32 max = 0;
+  TraceRec rec;
+  while (fread(&rec, sizeof(rec), 1, fp) == 1) {
+    if (rp->n == max) {
+      max = (max == 0) ? 1024 : 2 * max;
+      rp->recs  = realloc(rp->recs,  max * sizeof(TraceRec));
+      rp->paths = realloc(rp->paths, max * TRACEPATHSIZE);
+      if (rp->recs == NULL || rp->paths == NULL) FATAL(ENOBUFS);
+    }
+    rp->paths[rp->n][0] = 0;
+    if (rec.pathlen >= TRACEPATHSIZE
+        || fread(rp->paths[rp->n], 1, rec.pathlen, fp) != rec.pathlen) break;
+    rp->paths[rp->n][rec.pathlen] = 0;
+    if ((rec.op == TRACEREAD || rec.op == TRACEWRITE) && rec.arg > rp->maxnumb)
+      rp->maxnumb = rec.arg;
+    if (rec.thread + 1 > rp->threads) rp->threads = rec.thread + 1;
+    rp->recs[rp->n++] = rec;
+  }
+  fclose(fp);
+
+  rp->lat  = calloc(rp->n + 1, sizeof(i64));
+  rp->rets = calloc(rp->n + 1, sizeof(i32));
+  if (rp->lat == NULL || rp->rets == NULL) FATAL(ENOBUFS);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Return a monotonic clock reading, in us
+// ============================================================================
+i64 traceNow() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (i64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+
+// ============================================================================
+// Record fsOpen('path'), with the size of the file opened, so a replay can
+// create it first
+// ============================================================================
+i32 traceOpen(str path) {
+  i64 t0 = traceNow();
+  g_traceIn = 1;
+  i32 ret = fsOpen(path);
+  i32 size = (ret >= 0) ? fsSize(ret) : 0;
+  g_traceIn = 0;
+  traceEnd(TRACEOPEN, ret, size, 0, ret, t0, path);
+  return ret;
+}
+
+
+
+// ============================================================================
+// Create, on the calling thread's volume, every file trace 'rp' opens
+// without creating it first, as big as it was when opened, with its parent
+// directories.  Return 0
+// ============================================================================
+i32 tracePrepare(TraceReplay* rp) {
+  i8 zero[BYTESPERBLOCK] = {0};
+
+  for (i32 r = 0; r < rp->n; ++r) {
+    TraceRec* rec = &rp->recs[r];
+    if (rec->op != TRACEOPEN || rec->ret < 0) continue;
+
+    str path = rp->paths[r];
+    i32 fd = fsOpen(path);
+    if (fd >= 0) { fsClose(fd); continue; }   // made already
+
+    for (char* s = strchr(path, '/'); s != NULL; s = strchr(s + 1, '/')) {
+      *s = 0;
+      fsMkdir(path);                          // EFEXISTS is fine
+      *s = '/';
+    }
+
+    fd = fsCreate(path);
+    for (i32 left = rec->arg; left > 0; left -= BYTESPERBLOCK) {
+      fsWrite(fd, (left < BYTESPERBLOCK) ? left : BYTESPERBLOCK, zero);
+    }
+    fsClose(fd);
+  }
+  return 0;
+}
+
+
+
+// ============================================================================
+// Record fsRead('fd', 'numb', 'buf')
+// ============================================================================
+i32 traceRead(i32 fd, i32 numb, void* buf) {
+  i64 t0 = traceNow();
+  g_traceIn = 1;
+  i32 ret = fsRead(fd, numb, buf);
+  g_traceIn = 0;
+  traceEnd(TRACEREAD, fd, numb, 0, ret, t0, NULL);
+  return ret;
+}
+
+
+
+// ============================================================================
+// Replay trace 'rp', from traceLoad, on the calling thread's volume: prepare
+// it (see tracePrepare), then replay each thread of the trace on a thread of
+// its own, its calls in their recorded order.  With 'open' clear, the loop
+// is closed: each thread makes its next call as soon as the last returns.
+// With 'open' set, each call is made at the time it was made in the trace,
+// ready or not, and its latency counts from then, so queueing shows.  Each
+// call's latency goes in rp->lat, and its result in rp->rets.  Return the #
+// of calls made: those on fds that never opened are skipped
+// ============================================================================
+i32 traceReplay(TraceReplay* rp, i32 open) {
+  static pthread_t   threads[TRACETHREADS];
+  static TraceThread tts[TRACETHREADS];
+
+  rp->open    = open;
+  rp->vol     = g_vol;
+  rp->skipped = 0;
+  memset(rp->fds, 0, sizeof(rp->fds));
+  tracePrepare(rp);
+
+  rp->t0 = traceNow();
+  for (i32 t = 0; t < rp->threads; ++t) {
+    tts[t].rp     = rp;
+    tts[t].thread = t;
+    pthread_create(&threads[t], NULL, traceReplayMain, &tts[t]);
+  }
+  for (i32 t = 0; t < rp->threads; ++t) pthread_join(threads[t], NULL);
+  return rp->n - rp->skipped;
+}
+
+
+
+// ============================================================================
+// Body of the replay thread for trace thread 'arg', a TraceThread: make its
+// calls, in order
+// ============================================================================
+void* traceReplayMain(void* arg) {
+  TraceThread* tt = (TraceThread*)arg;
+  TraceReplay* rp = tt->rp;
+  fsUse(rp->vol);
+
+  i8* buf = calloc(rp->maxnumb + 1, 1);
+  if (buf == NULL) FATAL(ENOBUFS);
+
+  for (i32 r = 0; r < rp->n; ++r) {
+    TraceRec* rec = &rp->recs[r];
+    if (rec->thread != tt->thread) continue;
+
+    i64 due = rp->t0 + rec->start;
+    if (rp->open) {                             // wait for its time
+      i64 now = traceNow();
+      if (now < due) {
+        struct timespec ts = { (due - now) / 1000000,
+                               (due - now) % 1000000 * 1000 };
+        nanosleep(&ts, NULL);
+      }
+    }
+
+    i32 fd = 0;
+    if (rec->op != TRACEOPEN && rec->op != TRACECREATE) {
+      pthread_mutex_lock(&rp->lock);
+      fd = (rec->fd >= 0 && rec->fd < TRACEFDS) ? rp->fds[rec->fd] : 0;
+      if (fd == 0) ++rp->skipped;
+      pthread_mutex_unlock(&rp->lock);
+      if (fd == 0) continue;
+    }
+
+    i64 t0 = traceNow();
+    i32 ret = 0;
+    switch (rec->op) {
+      case TRACEOPEN:   ret = fsOpen(rp->paths[r]);                   break;
+      case TRACECREATE: ret = fsCreate(rp->paths[r]);
+                        if (ret == EFEXISTS) ret = fsOpen(rp->paths[r]);
+                        break;
+      case TRACEREAD:   ret = fsRead(fd, rec->arg, buf);              break;
+      case TRACEWRITE:  ret = fsWrite(fd, rec->arg, buf);             break;
+      case TRACESEEK:   ret = fsSeek(fd, rec->arg, rec->whence);      break;
+      case TRACECLOSE:  ret = fsClose(fd);                            break;
+    }
+    rp->lat[r]  = traceNow() - (rp->open ? due : t0);
+    rp->rets[r] = ret;
+
+    if ((rec->op == TRACEOPEN || rec->op == TRACECREATE)
+        && rec->ret >= 0 && rec->ret < TRACEFDS) {
+      pthread_mutex_lock(&rp->lock);
+      rp->fds[rec->ret] = (ret >= 0) ? ret : 0;
+      pthread_mutex_unlock(&rp->lock);
+    }
+  }
+
+  free(buf);
+  return NULL;
+}
+
+
+
+// ============================================================================
+// Record fsSeek('fd', 'offset', 'whence')
+// ============================================================================
+i32 traceSeek(i32 fd, i32 offset, i32 whence) {
+  i64 t0 = traceNow();
+  g_traceIn = 1;
+  i32 ret = fsSeek(fd, offset, whence);
+  g_traceIn = 0;
+  traceEnd(TRACESEEK, fd, offset, whence, ret, t0, NULL);
+  return ret;
+}
+
+
+
+// ============================================================================
+// Start recording to trace file 'path', created afresh.  Return 0; ETRACEON
+// if a trace is already being recorded; EHOSTIO if 'path' cannot be written
+// ============================================================================
+i32 traceStart(str path) {
+  if (path == NULL) FATAL(ENULLPTR);
+
+  pthread_mutex_lock(&g_trace.lock);
+  if (g_trace.on) { pthread_mutex_unlock(&g_trace.lock); return ETRACEON; }
+
+  FILE* fp = fopen(path, "wb");
+  i32 version = TRACEVERSION;
+  if (fp == NULL || fwrite(TRACEMAGIC, 1, 8, fp) != 8
+                 || fwrite(&version, sizeof(i32), 1, fp) != 1) {
+    if (fp != NULL) fclose(fp);
+    pthread_mutex_unlock(&g_trace.lock);
+    return EHOSTIO;
+  }
+
+  g_trace.fp      = fp;
+  g_trace.t0      = traceNow();
+  g_trace.gen    += 1;
+  g_trace.threads = 0;
+  g_trace.failed  = 0;
+  g_trace.recs    = 0;
+  g_trace.used    = 0;
+  g_trace.on      = 1;
+  pthread_mutex_unlock(&g_trace.lock);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Stop recording, and close the trace file.  Return the # of records in it,
+// 0 if no trace was being recorded, or EHOSTIO if it could not be written
+// ============================================================================
+i32 traceStop() {
+  pthread_mutex_lock(&g_trace.lock);
+  if (!g_trace.on) { pthread_mutex_unlock(&g_trace.lock); return 0; }
+
+  g_trace.on = 0;
+  i32 ret = traceFlush();
+  if (fclose(g_trace.fp) != 0 || g_trace.failed) ret = EHOSTIO;
+  g_trace.fp = NULL;
+  i32 recs = (i32)g_trace.recs;
+  pthread_mutex_unlock(&g_trace.lock);
+  return (ret == 0) ? recs : ret;
+}
+
+
+
+// ============================================================================
+// Give back trace 'rp', from traceLoad.  Return 0
+// ============================================================================
+i32 traceUnload(TraceReplay* rp) {
+  free(rp->recs);
+  free(rp->paths);
+  free(rp->lat);
+  free(rp->rets);
+  pthread_mutex_destroy(&rp->lock);
+  memset(rp, 0, sizeof(TraceReplay));
+  return 0;
+}
+
+
+
+// ============================================================================
+// Record fsWrite('fd', 'numb', 'buf')
+// ============================================================================
+i32 traceWrite(i32 fd, i32 numb, void* buf) {
+  i64 t0 = traceNow();
+  g_traceIn = 1;
+  i32 ret = fsWrite(fd, numb, buf);
+  g_traceIn = 0;
+  traceEnd(TRACEWRITE, fd, numb, 0, ret, t0, NULL);
+  return ret;
+}
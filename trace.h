@@ -0,0 +1,98 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// ===================================================================
+// trace.h - Workload traces: fs calls recorded, with their timing,
+// to a binary file, and replayed, for bfsreplay
+// ===================================================================
+
+#include "alias.h"
+#include "bfs.h"
+
+#define TRACEMAGIC    "BFSTRACE"  // first 8 bytes of a trace file
+#define TRACEVERSION  1
+#define TRACEBUF      65536   // bytes of records buffered before a write
+#define TRACEPATHSIZE 256     // longest path recorded, plus its NUL
+#define TRACETHREADS  256     // most threads in a trace: TraceRec.thread is u8
+#define TRACEFDS      256     // fds of a trace, mapped to its replay's
+
+#define TRACEOPEN     1       // TraceRec.op
+#define TRACECREATE   2
+#define TRACEREAD     3
+#define TRACEWRITE    4
+#define TRACESEEK     5
+#define TRACECLOSE    6
+#define TRACEOPS      7
+
+#define TRACING()     (g_trace.on && !g_traceIn)
+
+typedef struct {          // TraceRec: one fs call, as recorded
+  u8  op;                 // TRACEOPEN ... TRACECLOSE
+  u8  thread;             // caller: threads are numbered from 0, in order
+  u16 pathlen;            // # bytes of path after the record: open, create
+  i32 fd;                 // fd, or for open and create, the fd returned
+  i32 arg;                // numb: read, write.  offset: seek.  size: open
+  i32 whence;             // seek
+  i32 ret;                // what the call returned
+  u32 start;              // us from fsTraceStart to the call
+  u32 dur;                // us the call took
+} TraceRec;
+
+_Static_assert(sizeof(TraceRec) == 28, "TraceRecs are packed in the file");
+
+typedef struct {          // Trace: the trace being recorded
+  i32   on;               // 1 => fs calls are recorded
+  FILE* fp;
+  i64   t0;               // us at fsTraceStart
+  i32   gen;              // bumped by each fsTraceStart
+  i32   threads;          // # threads numbered so far
+  i32   failed;           // 1 => a write to 'fp' failed
+  i64   recs;             // # records so far
+  i32   used;             // # bytes in 'buf'
+  i8    buf[TRACEBUF];
+  pthread_mutex_t lock;   // guards all the above
+} Trace;
+
+typedef struct {          // TraceReplay: a trace loaded, and its replay
+  TraceRec*  recs;
+  char     (*paths)[TRACEPATHSIZE];  // path of each open and create
+  i64*       lat;         // us each call took, in the replay
+  i32*       rets;        // what each call returned, in the replay
+  i32        n;           // # records
+  i32        threads;     // # threads that made them
+  i32        open;        // 1 => open loop
+  i32        maxnumb;     // biggest read or write, for the buffers
+  i64        t0;          // us when the replay started
+  i32        fds[TRACEFDS];   // trace fd => replay fd.  0 => none
+  i32        skipped;     // # calls on fds that never opened
+  BfsVolume* vol;         // volume replayed on
+  pthread_mutex_t lock;   // guards 'fds' and 'skipped'
+} TraceReplay;
+
+typedef struct {          // TraceThread: one thread of a trace, replayed
+  TraceReplay* rp;
+  i32          thread;
+} TraceThread;
+
+extern Trace        g_trace;
+extern __thread i32 g_traceIn;        // 1 => inside a traced call
+
+i32   traceClose     (i32 fd);
+i32   traceCreate    (str path);
+void  traceEnd       (i32 op, i32 fd, i32 arg, i32 whence, i32 ret, i64 t0,
+                      str path);
+i32   traceFlush     ();
+i32   traceLoad      (TraceReplay* rp, str path);
+i64   traceNow       ();
+i32   traceOpen      (str path);
+i32   tracePrepare   (TraceReplay* rp);
+i32   traceRead      (i32 fd, i32 numb, void* buf);
+i32   traceReplay    (TraceReplay* rp, i32 open);
+void* traceReplayMain(void* arg);
+i32   traceSeek      (i32 fd, i32 offset, i32 whence);
+i32   traceStart     (str path);
+i32   traceStop      ();
+i32   traceUnload    (TraceReplay* rp);
+i32   traceWrite     (i32 fd, i32 numb, void* buf);
+
+#endif
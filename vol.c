@@ -0,0 +1,75 @@
+// ============================================================================
+// vol.c - Volumes.  Everything BFS holds in memory for a disk image (open
+// files, caches, checksums, refcounts, snapshots, tail buffers, dirty
+// blocks, locks) lives
+// in its BfsVolume, so volumes share nothing and never contend.  Each thread
+// works on one volume at a time, g_vol, which every module reaches its state
+// through.  The boot volume, for BFSDISK, is static; others come from a slab
+// of NUMVOLUMES
+// ============================================================================
+
+#include "slab.h"
+#include "vol.h"
+
+BfsVolume           g_bootvol = VOLINIT(BFSDISK);
+__thread BfsVolume* g_vol     = &g_bootvol;
+
+SLABDEFINE(g_volumes, sizeof(BfsVolume), NUMVOLUMES);
+
+
+
+// ============================================================================
+// Take a volume for disk image 'path', set up as VOLINIT would.  Nothing is
+// read from the disk yet.  Return it, or NULL if NUMVOLUMES are in use, or
+// 'path' is too long
+// ============================================================================
+BfsVolume* volAlloc(str path) {
+  if (strlen(path) >= VOLPATHSIZE) return NULL;
+  BfsVolume* vol = slabAlloc(&g_volumes);
+  if (vol == NULL) return NULL;
+
+  pthread_once_t once = PTHREAD_ONCE_INIT;
+
+  memset(vol, 0, sizeof(BfsVolume));
+  strcpy(vol->path, path);
+  strcpy(vol->members[0], path);
+  vol->nmembers    = 1;
+  vol->stripe      = 1;
+  vol->bfslockOnce = once;
+  vol->cacheOnce   = once;
+  vol->tailOnce    = once;
+  vol->snapgen     = -1;
+  vol->snapmount   = SNAPNONE;
+  pthread_mutex_init(&vol->reclaim.lock, NULL);
+  pthread_cond_init (&vol->reclaim.wake, NULL);
+  pthread_cond_init (&vol->reclaim.idle, NULL);
+  pthread_mutex_init(&vol->crclock, NULL);
+  pthread_mutex_init(&vol->cachelock, NULL);
+  pthread_mutex_init(&vol->wb.lock, NULL);
+  pthread_mutex_init(&vol->wb.io, NULL);
+  pthread_cond_init (&vol->wb.kick, NULL);
+  pthread_mutex_init(&vol->log.lock, NULL);
+  pthread_cond_init (&vol->log.kick, NULL);
+  pthread_cond_init (&vol->log.idle, NULL);
+  return vol;
+}
+
+
+
+// ============================================================================
+// Give back volume 'vol', from volAlloc, once no thread is using it
+// ============================================================================
+void volFree(BfsVolume* vol) {
+  slabFree(&g_volumes, vol);
+}
+
+
+
+// ============================================================================
+// Make 'vol' the calling thread's volume.  Return the one before
+// ============================================================================
+BfsVolume* volUse(BfsVolume* vol) {
+  BfsVolume* old = g_vol;
+  g_vol = vol;
+  return old;
+}
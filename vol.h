@@ -0,0 +1,111 @@
+#ifndef VOL_H
+#define VOL_H
+
+// ===================================================================
+// vol.h - Volumes: everything in memory about one mounted disk
+// image, so one process can serve many at once
+// ===================================================================
+
+#include "alias.h"
+#include "bfs.h"
+#include "cache.h"
+#include "comp.h"
+#include "dedup.h"
+#include "dir.h"
+#include "log.h"
+#include "fs.h"
+#include "map.h"
+#include "ref.h"
+#include "snap.h"
+#include "tail.h"
+#include "wb.h"
+
+#define NUMVOLUMES    256     // # volumes mounted at once, past the boot one
+#define VOLPATHSIZE   256     // longest disk image path, with its NUL
+#define VOLMEMBERS    8       // most disk images one volume is striped over
+
+struct BfsVolume {        // BfsVolume: one mounted disk image
+  char            path[VOLPATHSIZE];    // disk image, eg "BFSDISK"; or the
+                                        //   first member of a stripe set
+  char            members[VOLMEMBERS][VOLPATHSIZE]; // bio.c: stripe set,
+  i32             nmembers;             //   in order.  1 => just 'path'
+  i32             stripe;               //   # blocks per stripe unit
+
+  OFTE            oft[NUMOFTENTRIES];   // bfs.c: Open File Table
+  pthread_mutex_t bfslock;              //   guards Super, Inodes, directories
+  pthread_once_t  bfslockOnce;
+  Reclaim         reclaim;
+
+  u32             crctab[I32SPERBLOCK]; // bio.c: CRC32C of every DBN
+  i32             crcLoaded;            //   1 => crctab is read from DBNCRC
+  i32             crcDirty;             //   1 => it has changed since
+  pthread_mutex_t crclock;
+
+  CacheSlot       cache[CACHESLOTS];    // cache.c
+  u32             cachetick;            //   LRU clock
+  u32             cacheseq;             //   bumped on every write
+  i32             cacheghosts[CACHEGHOSTS]; // A1out: DBNs evicted from A1in
+  i32             cacheghostnext;
+  i32             cachepolicy;          //   CACHE2Q or CACHELRU
+  CacheStats      cachestats;
+  pthread_mutex_t cachelock;
+  pthread_once_t  cacheOnce;
+
+  CompCache       compcache[NUMINODES]; // comp.c
+
+  i32             dedupidx[DEDUPSLOTS];     // dedup.c: DBN per slot
+  u32             deduphash[BLOCKSPERDISK]; //   fingerprint of each DBN
+  i8              dedupin[BLOCKSPERDISK];   //   1 => DBN is in the index
+
+  DirCache        dircache[DIRCACHESIZE];   // dir.c
+
+  MapCache        mapcache[NUMINODES];  // map.c
+
+  RefTable        refs;                 // ref.c: copy of DBNREFS
+  i32             refsLoaded;           //   1 => refs matches DBNREFS
+
+  SnapEntry       snaps[NUMSNAPS];      // snap.c: copy of DBNSNAPS
+  i32             snapsLoaded;          //   1 => snaps matches DBNSNAPS
+  i32             snapgen;              //   newest snapshot's gen.  -1 => none
+  i32             snapmount;            //   snapshot mounted read-only
+
+  Tail            tails[NUMINODES];     // tail.c
+  pthread_once_t  tailOnce;
+
+  Writeback       wb;                   // wb.c
+
+  Log             log;                  // log.c
+};
+
+// The state of a volume before its first mount: locks ready, nothing loaded
+
+#define VOLINIT(disk)                                                         \
+  { .path        = disk,                                                      \
+    .members     = { disk },                                                  \
+    .nmembers    = 1,                                                         \
+    .stripe      = 1,                                                         \
+    .bfslockOnce = PTHREAD_ONCE_INIT,                                         \
+    .reclaim     = { .lock = PTHREAD_MUTEX_INITIALIZER,                       \
+                     .wake = PTHREAD_COND_INITIALIZER,                        \
+                     .idle = PTHREAD_COND_INITIALIZER },                      \
+    .crclock     = PTHREAD_MUTEX_INITIALIZER,                                 \
+    .cachelock   = PTHREAD_MUTEX_INITIALIZER,                                 \
+    .cacheOnce   = PTHREAD_ONCE_INIT,                                         \
+    .snapgen     = -1,                                                        \
+    .snapmount   = SNAPNONE,                                                  \
+    .tailOnce    = PTHREAD_ONCE_INIT,                                         \
+    .wb          = { .lock = PTHREAD_MUTEX_INITIALIZER,                       \
+                     .io   = PTHREAD_MUTEX_INITIALIZER,                       \
+                     .kick = PTHREAD_COND_INITIALIZER },                      \
+    .log         = { .lock = PTHREAD_MUTEX_INITIALIZER,                       \
+                     .kick = PTHREAD_COND_INITIALIZER,                        \
+                     .idle = PTHREAD_COND_INITIALIZER } }
+
+extern BfsVolume           g_bootvol;   // BFSDISK: every thread starts on it
+extern __thread BfsVolume* g_vol;       // volume this thread is working on
+
+BfsVolume* volAlloc(str path);
+void       volFree (BfsVolume* vol);
+BfsVolume* volUse  (BfsVolume* vol);
+
+#endif
@@ -0,0 +1,257 @@
+// ============================================================================
+// wb.c - Writeback.  bioWrite* do not go to the disk: each block is copied
+// into a dirty slot of its volume, where a rewrite overwrites it in place.
+// A background thread writes the dirty blocks out once WBSTART of them
+// gather, or the oldest is WBAGE ms old.  It sweeps them in DBN order (the
+// elevator), merging runs of adjacent DBNs into one write each.  A writer
+// that finds all WBSLOTS slots dirty is throttled: it writes back, itself,
+// before going on.  Reads see dirty blocks first.  Each pass puts the
+// checksum table in with the blocks (bioCrcSync), so the table and the data
+// reach the disk together, not only at a sync.  bioSync writes back everything before its fsync, so a sync is
+// still a durability barrier
+// ============================================================================
+
+#include <time.h>
+
+#include "bio.h"
+#include "vol.h"
+#include "wb.h"
+
+
+
+// ============================================================================
+// Write back every dirty block of the calling thread's volume, in DBN order,
+// one write per run of adjacent DBNs.  The checksum table joins them first,
+// holding the CRC of every block dirty as the pass starts.  A block rewritten meanwhile
+// stays dirty, to go next time.  Return 0.  Abort on an I/O error
+// ============================================================================
+i32 wbFlush() {
+  Writeback* wb = &g_vol->wb;
+  bioCrcSync();                                 // before we hold 'io'
+  pthread_mutex_lock(&wb->io);
+  pthread_mutex_lock(&wb->lock);
+
+  for (i32 dbn = 0; dbn < BLOCKSPERDISK; ) {
+    if (wb->idx[dbn] == 0) { ++dbn; continue; }
+
+    i8  run[WBSLOTS * BYTESPERBLOCK];           // gather the run
+    u32 gens[WBSLOTS];
+    i32 n = 0;
+    while (dbn + n < BLOCKSPERDISK && wb->idx[dbn + n] != 0 && n < WBSLOTS) {
+      WbSlot* ws = &wb->slots[wb->idx[dbn + n] - 1];
+      memcpy(run + n * BYTESPERBLOCK, ws->data, BYTESPERBLOCK);
+      gens[n++] = ws->gen;
+    }
+    pthread_mutex_unlock(&wb->lock);
+
+    i32 ret = bioStripeIO(dbn, n, run, 1);
+    if (ret != 0) { pthread_mutex_unlock(&wb->io); FATAL(ret); }
+
+    pthread_mutex_lock(&wb->lock);
+    ++wb->ios;
+    wb->blocks += n;
+    for (i32 k = 0; k < n; ++k) {               // clean, unless rewritten
+      i32 s = wb->idx[dbn + k] - 1;
+      if (s < 0 || wb->slots[s].gen != gens[k]) continue;
+      wb->idx[dbn + k] = 0;
+      --wb->ndirty;
+    }
+    dbn += n;
+  }
+
+  pthread_mutex_unlock(&wb->lock);
+  pthread_mutex_unlock(&wb->io);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Body of the writeback thread of volume 'arg': sleep until WBSTART blocks
+// are dirty, or one is WBAGE ms old, then write back.  Exit at wbStop, once
+// nothing is dirty
+// ============================================================================
+void* wbMain(void* arg) {
+  g_vol = (BfsVolume*)arg;
+  Writeback* wb = &g_vol->wb;
+
+  pthread_mutex_lock(&wb->lock);
+  for (;;) {
+    i64 oldest = 0;
+    for (i32 s = 0; s < WBSLOTS && wb->ndirty > 0; ++s) {
+      if (wb->slots[s].dbn < 0 || wb->idx[wb->slots[s].dbn] != s + 1) continue;
+      if (oldest == 0 || wb->slots[s].born < oldest) oldest = wb->slots[s].born;
+    }
+
+    i32 due = wb->ndirty >= WBSTART || (oldest && wbNow() - oldest >= WBAGE);
+    if (!due && wb->stop && wb->ndirty == 0) break;
+
+    if (due || wb->stop) {
+      pthread_mutex_unlock(&wb->lock);
+      wbFlush();
+      pthread_mutex_lock(&wb->lock);
+      continue;
+    }
+
+    struct timespec ts;                         // nap: at most WBAGE ms
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_nsec += (i64)WBAGE * 1000000;
+    ts.tv_sec  += ts.tv_nsec / 1000000000;
+    ts.tv_nsec %= 1000000000;
+    pthread_cond_timedwait(&wb->kick, &wb->lock, &ts);
+  }
+  pthread_mutex_unlock(&wb->lock);
+  return NULL;
+}
+
+
+
+// ============================================================================
+// Return 1 if block 'dbn' is dirty: written, but not yet written back.  Else
+// 0
+// ============================================================================
+i32 wbDirty(i32 dbn) {
+  pthread_mutex_lock(&g_vol->wb.lock);
+  i32 dirty = g_vol->wb.idx[dbn] != 0;
+  pthread_mutex_unlock(&g_vol->wb.lock);
+  return dirty;
+}
+
+
+
+// ============================================================================
+// Return the time now, in ms, from an arbitrary start
+// ============================================================================
+i64 wbNow() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (i64)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+
+// ============================================================================
+// Read 'count' blocks, from DBN 'dbn' on, into 'buf': from the disk, with
+// any that are dirty taken from their slots.  Return 0, or the I/O error
+// ============================================================================
+i32 wbRead(i32 dbn, i32 count, void* buf) {
+  Writeback* wb = &g_vol->wb;
+  pthread_mutex_lock(&wb->lock);
+
+  i32 dirty = 0;
+  for (i32 k = 0; k < count && !dirty; ++k) dirty = wb->idx[dbn + k] != 0;
+  if (!dirty) {                                 // clean: the disk is current
+    pthread_mutex_unlock(&wb->lock);
+    return bioStripeIO(dbn, count, buf, 0);
+  }
+
+  i32 ret = bioStripeIO(dbn, count, buf, 0);    // no block may go clean
+  for (i32 k = 0; k < count && ret == 0; ++k) { //   till we are done
+    i32 s = wb->idx[dbn + k] - 1;
+    if (s < 0) continue;
+    memcpy((i8*)buf + k * BYTESPERBLOCK, wb->slots[s].data, BYTESPERBLOCK);
+  }
+  pthread_mutex_unlock(&wb->lock);
+  return ret;
+}
+
+
+
+// ============================================================================
+// Forget every dirty block, unwritten, as the disk is being replaced.  Called
+// at format
+// ============================================================================
+i32 wbReset() {
+  Writeback* wb = &g_vol->wb;
+  pthread_mutex_lock(&wb->io);
+  pthread_mutex_lock(&wb->lock);
+  memset(wb->idx, 0, sizeof(wb->idx));
+  for (i32 s = 0; s < WBSLOTS; ++s) wb->slots[s].dbn = -1;
+  wb->ndirty = 0;
+  pthread_mutex_unlock(&wb->lock);
+  pthread_mutex_unlock(&wb->io);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Store the # of writes the calling thread's volume has issued in '*pios',
+// and the # of blocks they wrote in '*pblocks'.  Return 0
+// ============================================================================
+i32 wbStats(i64* pios, i64* pblocks) {
+  pthread_mutex_lock(&g_vol->wb.lock);
+  *pios    = g_vol->wb.ios;
+  *pblocks = g_vol->wb.blocks;
+  pthread_mutex_unlock(&g_vol->wb.lock);
+  return 0;
+}
+
+
+
+// ============================================================================
+// Write back everything, then end the writeback thread, if one is running.
+// Called when a volume is unmounted for good
+// ============================================================================
+i32 wbStop() {
+  Writeback* wb = &g_vol->wb;
+  pthread_mutex_lock(&wb->lock);
+  i32 started = wb->started;
+  wb->stop = 1;
+  pthread_cond_signal(&wb->kick);
+  pthread_mutex_unlock(&wb->lock);
+
+  if (started) pthread_join(wb->thread, NULL);
+  wbFlush();                                    // in case there was none
+  wb->started = 0;
+  wb->stop    = 0;
+  return 0;
+}
+
+
+
+// ============================================================================
+// Copy 'count' blocks from 'buf' into dirty slots, for DBN 'dbn' on.  A block
+// already dirty is overwritten in place.  If every slot is taken, write back
+// first (the throttle).  Wake the writeback thread, starting it if need be,
+// once WBSTART blocks are dirty.  Return 0
+// ============================================================================
+i32 wbWrite(i32 dbn, i32 count, void* buf) {
+  Writeback* wb = &g_vol->wb;
+  pthread_mutex_lock(&wb->lock);
+
+  if (!wb->started) {
+    wb->started = !pthread_create(&wb->thread, NULL, wbMain, g_vol);
+  }
+
+  for (i32 k = 0; k < count; ++k) {
+    i8* src = (i8*)buf + k * BYTESPERBLOCK;
+    i32 s   = wb->idx[dbn + k] - 1;
+
+    while (s < 0 && wb->ndirty == WBSLOTS) {    // throttled: make room
+      pthread_mutex_unlock(&wb->lock);
+      wbFlush();
+      pthread_mutex_lock(&wb->lock);
+      s = wb->idx[dbn + k] - 1;
+    }
+
+    if (s < 0) {                                // take a free slot
+      for (s = 0; s < WBSLOTS; ++s) {
+        i32 d = wb->slots[s].dbn;
+        if (d < 0 || wb->idx[d] != s + 1) break;
+      }
+      wb->slots[s].dbn  = dbn + k;
+      wb->slots[s].born = wbNow();
+      wb->idx[dbn + k]  = s + 1;
+      ++wb->ndirty;
+    }
+    memcpy(wb->slots[s].data, src, BYTESPERBLOCK);
+    ++wb->slots[s].gen;
+  }
+
+  if (wb->ndirty >= WBSTART) pthread_cond_signal(&wb->kick);
+  pthread_mutex_unlock(&wb->lock);
+
+  if (!wb->started) wbFlush();                  // no thread: write through
+  return 0;
+}
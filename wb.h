@@ -0,0 +1,47 @@
+#ifndef WB_H
+#define WB_H
+
+// ===================================================================
+// wb.h - Writeback: dirty blocks held in memory, and written out
+// later, sorted and merged, by a background thread
+// ===================================================================
+
+#include "alias.h"
+#include "bfs.h"
+
+#define WBSLOTS       32      // dirty limit: writers past it flush, themselves
+#define WBSTART       16      // # dirty blocks that wakes the writeback thread
+#define WBAGE         50      // ms a block may stay dirty before it is written
+
+typedef struct {          // WbSlot: one dirty block
+  i32 dbn;                // free unless Writeback.idx[dbn] points back here
+  u32 gen;                // bumped on each rewrite
+  i64 born;               // ms it went dirty, for WBAGE
+  i8  data[BYTESPERBLOCK];
+} WbSlot;
+
+typedef struct {          // Writeback: a volume's dirty blocks
+  WbSlot slots[WBSLOTS];
+  i32    idx[BLOCKSPERDISK];  // slot + 1 holding each DBN.  0 => clean
+  i32    ndirty;
+  i64    ios;             // stats: # writes issued,
+  i64    blocks;          //   # blocks they wrote
+  i32    started;         // 1 => writeback thread is running
+  i32    stop;            // 1 => writeback thread must exit, at unmount
+  pthread_mutex_t lock;   // guards all the above
+  pthread_mutex_t io;     // held by whoever is writing back, one at a time
+  pthread_cond_t  kick;   // signalled when writeback may be due
+  pthread_t       thread;
+} Writeback;
+
+i32   wbDirty (i32 dbn);
+i32   wbFlush ();
+void* wbMain  (void* arg);
+i64   wbNow   ();
+i32   wbRead  (i32 dbn, i32 count, void* buf);
+i32   wbReset ();
+i32   wbStats (i64* pios, i64* pblocks);
+i32   wbStop  ();
+i32   wbWrite (i32 dbn, i32 count, void* buf);
+
+#endif